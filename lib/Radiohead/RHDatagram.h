@@ -10,7 +10,11 @@
 
 // This is the maximum possible message size for radios supported by RadioHead.
 // Not all radios support this length, and many are much smaller
+// Can be pre-defined to the longest message the application sends or receives, with the
+// RHRouter header, to size RHMessagePool's buffers (and save SRAM)
+#ifndef RH_MAX_MESSAGE_LEN
 #define RH_MAX_MESSAGE_LEN 255
+#endif
 
 /////////////////////////////////////////////////////////////////////
 /// \class RHDatagram RHDatagram.h <RHDatagram.h>
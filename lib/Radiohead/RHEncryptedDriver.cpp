@@ -12,15 +12,24 @@ RHEncryptedDriver::RHEncryptedDriver(RHGenericDriver& driver, BlockCipher& block
     : _driver(driver),
       _blockcipher(blockcipher)
 {
-    _buffer = (uint8_t *)calloc(_driver.maxMessageLength(), sizeof(uint8_t));
 }
 
 bool RHEncryptedDriver::recv(uint8_t* buf, uint8_t* len)
 {
-    int h = 0; // Index of output _buffer
+    int h = 0; // Index of output buf
 
-    bool status = _driver.recv(_buffer, len);
-    if (status && buf && len)
+    if (!buf || !len)
+	return _driver.recv(buf, len); // Discarded: nothing to decrypt
+    // The ciphertext is only needed until it is decrypted into buf
+    uint8_t* buffer = RHMessagePool::take();
+    if (!buffer)
+	return false;
+#if RH_POOL_BUFFER_LEN < 255
+    if (*len > RH_POOL_BUFFER_LEN)
+	*len = RH_POOL_BUFFER_LEN;
+#endif
+    bool status = _driver.recv(buffer, len);
+    if (status)
     {
 	int blockSize = _blockcipher.blockSize(); // Size of blocks used by encryption
 	int nbBlocks = *len / blockSize; 	  // Number of blocks in that message
@@ -30,7 +39,7 @@ bool RHEncryptedDriver::recv(uint8_t* buf, uint8_t* len)
 	    for (int k = 0; k < nbBlocks; k++)
 	    {
 		// Decrypt each block
-		_blockcipher.decryptBlock(&buf[h], &_buffer[k*blockSize]); // Decrypt that block into buf	
+		_blockcipher.decryptBlock(&buf[h], &buffer[k*blockSize]); // Decrypt that block into buf	
 		h += blockSize;
 #ifdef STRICT_CONTENT_LEN	
 		if (k == 0)
@@ -46,6 +55,7 @@ bool RHEncryptedDriver::recv(uint8_t* buf, uint8_t* len)
 	}
     }
 
+    RHMessagePool::give(buffer);
     return status;
 }
 
@@ -60,6 +70,11 @@ bool RHEncryptedDriver::send(const uint8_t* data, uint8_t len)
     if (len == 0) // PassThru
 	return _driver.send(data, len);
 
+    // The ciphertext is only needed until the driver has it
+    uint8_t* buffer = RHMessagePool::take();
+    if (!buffer)
+	return false;
+
     if (_cipheringBlocks.blockSize != blockSize)
     {
 	// Cipher has changed it's block size
@@ -97,15 +112,15 @@ bool RHEncryptedDriver::send(const uint8_t* data, uint8_t len)
 	    else
 		_cipheringBlocks.inputBlock[h++] = 0; // Completing with trailing 0
 	}
-	_blockcipher.encryptBlock(&_buffer[k * blockSize], _cipheringBlocks.inputBlock); // Cipher that message into _buffer
+	_blockcipher.encryptBlock(&buffer[k * blockSize], _cipheringBlocks.inputBlock); // Cipher that message into buffer
     }
 //    Serial.println(max_message_length);
 //    Serial.println(nbBlocks);
 //    Serial.println(nbBpM);
 //    Serial.println(k);
 //    Serial.println(blockSize);
-//    printBuffer("single send", _buffer, k * blockSize);
-    if (!_driver.send(_buffer, k*blockSize))  // We now send that message with it's new length
+//    printBuffer("single send", buffer, k * blockSize);
+    if (!_driver.send(buffer, k*blockSize))  // We now send that message with it's new length
 	status = false;
 #else	
     uint8_t nbMsg = (nbBlocks * blockSize) / max_message_length + 1; // How many message do we need
@@ -129,19 +144,22 @@ bool RHEncryptedDriver::send(const uint8_t* data, uint8_t len)
 		else
 		    _cipheringBlocks.inputBlock[h++] = 0;
 	    }
-	    _blockcipher.encryptBlock(&_buffer[k * blockSize], _cipheringBlocks.inputBlock); // Cipher that message into buffer
+	    _blockcipher.encryptBlock(&buffer[k * blockSize], _cipheringBlocks.inputBlock); // Cipher that message into buffer
 	}
-//	printBuffer("multiple send", _buffer, k * blockSize);
-	if (!_driver.send(_buffer, k * blockSize))  // We now send that message with it's new length
+//	printBuffer("multiple send", buffer, k * blockSize);
+	if (!_driver.send(buffer, k * blockSize))  // We now send that message with it's new length
 	    status = false;
     }
 #endif
+    RHMessagePool::give(buffer);
     return status;
 }
 
 uint8_t RHEncryptedDriver::maxMessageLength()
 {
     int driver_len = _driver.maxMessageLength();
+    if (driver_len > RH_POOL_BUFFER_LEN)
+	driver_len = RH_POOL_BUFFER_LEN; // The ciphertext is put in an RHMessagePool buffer
     
 #ifndef ALLOW_MULTIPLE_MSG
     driver_len = ((int)(driver_len/_blockcipher.blockSize()) ) * _blockcipher.blockSize();
@@ -13,6 +13,7 @@
 #define RHEncryptedDriver_h
 
 #include <RHGenericDriver.h>
+#include <RHMessagePool.h>
 #if defined(RH_ENABLE_ENCRYPTION_MODULE) || defined(DOXYGEN)
 #include <BlockCipher.h>
 
@@ -110,11 +111,18 @@ public:
     /// \return The return value from teh drivers waitCAD() method
     virtual bool            waitCAD() { return _driver.waitCAD();};
 
+    /// Calls the pollCAD method in the driver
+    /// \return The return value from the drivers pollCAD() method
+    virtual int32_t         pollCAD(unsigned long started, uint8_t& backoffExponent) { return _driver.pollCAD(started, backoffExponent);};
+
     /// Sets the Channel Activity Detection timeout in milliseconds to be used by waitCAD().
     /// The default is 0, which means do not wait for CAD detection.
     /// CAD detection depends on support for isChannelActive() by your particular radio.
     void setCADTimeout(unsigned long cad_timeout) {_driver.setCADTimeout(cad_timeout);};
 
+    /// Calls setCADSkip() in the driver, whose waitCAD() is the one send() uses
+    virtual void setCADSkip(bool skip) { _driver.setCADSkip(skip);};
+
     /// Determine if the currently selected radio channel is active.
     /// This is expected to be subclassed by specific radios to implement their Channel Activity Detection
     /// if supported. If the radio does not support CAD, returns true immediately. If a RadioHead radio 
@@ -231,9 +239,6 @@ private:
     } CipherBlocks;
     
     CipherBlocks            _cipheringBlocks;
-    
-    /// Buffer to store encrypted/decrypted message
-    uint8_t*                _buffer;
 };
 
 /// @example nrf24_encrypted_client.pde
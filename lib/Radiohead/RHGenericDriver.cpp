@@ -16,7 +16,12 @@ RHGenericDriver::RHGenericDriver()
     _rxBad(0),
     _rxGood(0),
     _txGood(0),
-    _cad_timeout(0)
+    _cad_timeout(0),
+    _cad_backoff(0),
+    _cadBusy(0),
+    _cadDeferMillis(0),
+    _cadTimeouts(0),
+    _cadSkip(false)
 {
 }
 
@@ -77,32 +82,46 @@ bool RHGenericDriver::waitPacketSent(uint16_t timeout)
 // Wait until no channel activity detected or timeout
 bool RHGenericDriver::waitCAD()
 {
-    //Keep track of the millis when this request was first made. Used to correct the TX time if we had to first perform a route discovery. 
-	//This is used to compensate the time recieved by the time it took the message to get to me. 
-	uint32_t Strt_millis = millis();
+    unsigned long t = millis();
+    uint8_t backoffExponent = 0;
+    int32_t wait;
+    while ((wait = pollCAD(t, backoffExponent)) > 0)
+	delay(wait);
+    return wait == 0;
+}
 
-    if (!_cad_timeout)
-	return true;
+// One check of the channel for waitCAD(), without waiting
+int32_t RHGenericDriver::pollCAD(unsigned long started, uint8_t& backoffExponent)
+{
+    if (!_cad_timeout || _cadSkip)
+	return 0;
 
-    // Wait for any channel activity to finish or timeout
     // Sophisticated DCF function...
     // DCF : BackoffTime = random() x aSlotTime
     // 100 - 1000 ms
     // 10 sec timeout
-    unsigned long t = millis();
-    while (isChannelActive())
+    if (!isChannelActive())
     {
-         if (millis() - t > _cad_timeout) 
-	     return false;
+	_cadDeferMillis += millis() - started;
+	return 0;
+    }
+    _cadBusy++;
+    if (millis() - started > _cad_timeout)
+    {
+	_cadTimeouts++;
+	_cadDeferMillis += millis() - started;
+	return -1;
+    }
+    if (backoffExponent < RH_CAD_MAX_BACKOFF_EXPONENT)
+	backoffExponent++;
 #if (RH_PLATFORM == RH_PLATFORM_STM32) // stdlib on STMF103 gets confused if random is redefined
-	 delay(_random(1, 10) * 100);
+    return _random(1, 10) * 100;
 #else
-        //  delay(random(1, 10) * 100); // Should these values be configurable? Macros?
-        delay(random(0, _cad_timeout*2)); // Delay a random amount between 0 and CAD timeout * 2.
+    //  delay(random(1, 10) * 100); // Should these values be configurable? Macros?
+    if (_cad_backoff)
+	return random(1, (1UL << backoffExponent) + 1) * _cad_backoff; // 1 to 2^n slots - doubles with each busy detection
+    return random(1, _cad_timeout*2); // A random amount up to CAD timeout * 2
 #endif
-    }
-
-    return true;
 }
 
 // subclasses are expected to override if CAD is available for that radio
@@ -222,6 +241,31 @@ void RHGenericDriver::setCADTimeout(unsigned long cad_timeout)
     _cad_timeout = cad_timeout;
 }
 
+void RHGenericDriver::setCADBackoff(unsigned long cad_backoff)
+{
+    _cad_backoff = cad_backoff;
+}
+
+void RHGenericDriver::setCADSkip(bool skip)
+{
+    _cadSkip = skip;
+}
+
+uint16_t RHGenericDriver::cadBusy()
+{
+    return _cadBusy;
+}
+
+uint32_t RHGenericDriver::cadDeferMillis()
+{
+    return _cadDeferMillis;
+}
+
+uint16_t RHGenericDriver::cadTimeouts()
+{
+    return _cadTimeouts;
+}
+
 #if (RH_PLATFORM == RH_PLATFORM_ATTINY)
 // Tinycore does not have __cxa_pure_virtual, so without this we
 // get linking complaints from the default code generated for pure virtual functions
@@ -17,6 +17,11 @@
 // Default timeout for waitCAD() in ms
 #define RH_CAD_DEFAULT_TIMEOUT            10000
 
+// Largest backoff used by waitCAD() is 2^RH_CAD_MAX_BACKOFF_EXPONENT backoff slots
+#ifndef RH_CAD_MAX_BACKOFF_EXPONENT
+#define RH_CAD_MAX_BACKOFF_EXPONENT       4
+#endif
+
 /////////////////////////////////////////////////////////////////////
 /// \class RHGenericDriver RHGenericDriver.h <RHGenericDriver.h>
 /// \brief Abstract base class for a RadioHead driver.
@@ -135,7 +140,9 @@ public:
     /// Channel Activity Detection (CAD).
     /// Blocks until channel activity is finished or CAD timeout occurs.
     /// Uses the radio's CAD function (if supported) to detect channel activity.
-    /// Implements random delays of 100 to 1000ms while activity is detected and until timeout.
+    /// Implements random delays while activity is detected and until timeout: 0 to twice the CAD timeout,
+    /// or with setCADBackoff(), 1 to 2^n backoff slots where n counts the busy detections (up to RH_CAD_MAX_BACKOFF_EXPONENT).
+    /// Busy detections and the time spent waiting are counted - see cadBusy() and cadDeferMillis().
     /// Caution: the random() function is not seeded. If you want non-deterministic behaviour, consider
     /// using something like randomSeed(analogRead(A0)); in your sketch.
     /// Permits the implementation of listen-before-talk mechanism (Collision Avoidance).
@@ -146,11 +153,31 @@ public:
     /// shows the channel is clear within the timeout period (or the timeout period is 0), else returns false.
     virtual bool            waitCAD();
 
+    /// One step of waitCAD() that does not block: checks the channel once and, if it is busy, says how long to
+    /// back off before checking again. Lets a caller that must keep running (see RHReliableDatagram::sendPoll())
+    /// listen before talk without waiting in delay(). Busy detections, deferral and timeouts are counted as by waitCAD().
+    /// \param[in] started millis() when the transmission was first ready to go - the CAD timeout runs from it
+    /// \param[in,out] backoffExponent The busy detections so far (up to RH_CAD_MAX_BACKOFF_EXPONENT), 0 at the first check
+    /// \return 0 if the channel is clear (or there is no CAD timeout, or setCADSkip() is set), the time in ms to back
+    /// off if it is busy, or -1 if it has stayed busy past the CAD timeout
+    virtual int32_t         pollCAD(unsigned long started, uint8_t& backoffExponent);
+
     /// Sets the Channel Activity Detection timeout in milliseconds to be used by waitCAD().
     /// The default is 0, which means do not wait for CAD detection.
     /// CAD detection depends on support for isChannelActive() by your particular radio.
     void setCADTimeout(unsigned long cad_timeout);
 
+    /// Sets the backoff slot in milliseconds used by waitCAD() when the channel is busy. Each busy detection
+    /// doubles the number of slots the random delay is drawn from (binary exponential backoff). A slot of about
+    /// the time on air of a typical message works well. The default is 0, which keeps delays of 0 to twice the CAD timeout.
+    void setCADBackoff(unsigned long cad_backoff);
+
+    /// Sets whether waitCAD() lets the next transmissions go without looking at the channel. Used for
+    /// acknowledgements and replies: they answer a message that has just been received, and the sender's wait for
+    /// them is shorter than a backoff slot, so deferring them would only make the sender retry.
+    /// \param[in] skip true to send without channel activity detection until called again with false
+    virtual void setCADSkip(bool skip);
+
     /// Determine if the currently selected radio channel is active.
     /// This is expected to be subclassed by specific radios to implement their Channel Activity Detection
     /// if supported. If the radio does not support CAD, returns true immediately. If a RadioHead radio 
@@ -258,6 +285,18 @@ public:
     /// \return The number of packets successfully transmitted
     virtual uint16_t       txGood();
 
+    /// Returns the count of the number of times waitCAD() found the channel busy
+    /// \return The number of busy channel detections
+    uint16_t       cadBusy();
+
+    /// Returns the total time waitCAD() has deferred transmissions for a busy channel
+    /// \return The deferral time in milliseconds
+    uint32_t       cadDeferMillis();
+
+    /// Returns the count of the number of transmissions abandoned because the channel stayed busy past the CAD timeout
+    /// \return The number of CAD timeouts
+    uint16_t       cadTimeouts();
+
 protected:
 
     /// The current transport operating mode
@@ -311,6 +350,21 @@ protected:
     /// Channel activity timeout in ms
     unsigned int        _cad_timeout;
 
+    /// Channel activity backoff slot in ms - 0 for delays of up to twice the timeout
+    unsigned int        _cad_backoff;
+
+    /// Count of the number of busy channel detections
+    uint16_t            _cadBusy;
+
+    /// Total time transmissions were deferred by a busy channel in ms
+    uint32_t            _cadDeferMillis;
+
+    /// Count of the number of transmissions abandoned for a busy channel
+    uint16_t            _cadTimeouts;
+
+    /// Transmissions go without channel activity detection - see setCADSkip()
+    bool                _cadSkip;
+
 private:
 
 };
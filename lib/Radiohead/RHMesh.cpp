@@ -13,13 +13,20 @@
 
 #include <RHMesh.h>
 
-uint8_t RHMesh::_tmpMessage[RH_ROUTER_MAX_MESSAGE_LEN];
-
 ////////////////////////////////////////////////////////////////////
 // Constructors
 RHMesh::RHMesh(RHGenericDriver& driver, uint8_t thisAddress) 
     : RHRouter(driver, thisAddress)
 {
+#if RH_MESH_SEEN_REQUESTS
+    memset(_seenRequests, 0, sizeof(_seenRequests));
+    _seenNext = 0;
+    _pendingLen = 0;
+#endif
+    _rebroadcastDelay = RH_MESH_REBROADCAST_DELAY;
+    _rebroadcastThreshold = RH_MESH_REBROADCAST_THRESHOLD;
+    _meshState = MeshSendIdle;
+    _meshResult = RH_ROUTER_ERROR_NONE;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -29,6 +36,13 @@ RHMesh::RHMesh(RHGenericDriver& driver, uint8_t thisAddress)
 // Discovers a route to the destination (if necessary), sends and 
 // waits for delivery to the next hop (but not for delivery to the final destination)
 uint8_t RHMesh::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address, uint8_t flags)
+{
+    return sendtoWaitReply(buf, len, address, flags, NULL, NULL, NULL, 0);
+}
+
+////////////////////////////////////////////////////////////////////
+// With reply == NULL this is sendtoWait()
+uint8_t RHMesh::sendtoWaitReply(uint8_t* buf, uint8_t len, uint8_t address, uint8_t flags, uint8_t* reply, uint8_t* replyLen, uint8_t* replyFlags, uint16_t replyTimeout)
 {
 	//Keep track of the millis when this request was first made. Used to correct the TX time if we had to first perform a route discovery. 
 	//This is used to compensate the time recieved by the time it took the message to get to me. 
@@ -39,6 +53,7 @@ uint8_t RHMesh::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address, uint8_t f
 
     if (address != RH_BROADCAST_ADDRESS)
     {
+	expireRoutes(); // A stale route is found again
 	RoutingTableEntry* route = getRouteTo(address);
 	if (!route && !doArp(address))
 	    return RH_ROUTER_ERROR_NO_ROUTE;
@@ -55,10 +70,192 @@ uint8_t RHMesh::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address, uint8_t f
 	}
 
     // Now have a route. Contruct an application layer message and send it via that route
-    MeshApplicationMessage* a = (MeshApplicationMessage*)&_tmpMessage;
+    MeshApplicationMessage* a = (MeshApplicationMessage*)messageData();
     a->header.msgType = RH_MESH_MESSAGE_TYPE_APPLICATION;
     memcpy(a->data, buf, len);
-    return RHRouter::sendtoWait(_tmpMessage, sizeof(RHMesh::MeshMessageHeader) + len, address, flags);
+    if (!reply)
+	return RHRouter::sendtoWait(messageData(), sizeof(RHMesh::MeshMessageHeader) + len, address, flags);
+
+    // RHRouter sends the message from where it was built, and the reply comes back there
+    uint8_t tmpMessageLen = RH_ROUTER_MAX_MESSAGE_LEN;
+    uint8_t ret = RHRouter::sendtoWaitReply(messageData(), sizeof(RHMesh::MeshMessageHeader) + len, address, flags, messageData(), &tmpMessageLen, replyFlags, replyTimeout);
+    if (ret == RH_ROUTER_ERROR_UNABLE_TO_DELIVER)
+	deleteRouteTo(address); // As route() does when the next hop does not acknowledge
+    if (   ret == RH_ROUTER_ERROR_NONE
+	&& tmpMessageLen >= 1
+	&& a->header.msgType == RH_MESH_MESSAGE_TYPE_APPLICATION)
+    {
+	uint8_t msgLen = tmpMessageLen - sizeof(MeshMessageHeader);
+	if (*replyLen > msgLen)
+	    *replyLen = msgLen;
+	memcpy(reply, a->data, *replyLen);
+    }
+    else
+	*replyLen = 0;
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHMesh::sendtoStart(uint8_t* buf, uint8_t len, uint8_t address, uint8_t flags)
+{
+    return sendtoStartReply(buf, len, address, flags, NULL, NULL, NULL, 0);
+}
+
+////////////////////////////////////////////////////////////////////
+// As sendtoWaitReply(), with the waits in sendPoll()
+uint8_t RHMesh::sendtoStartReply(uint8_t* buf, uint8_t len, uint8_t address, uint8_t flags, uint8_t* reply, uint8_t* replyLen, uint8_t* replyFlags, uint16_t replyTimeout)
+{
+    if (_meshState != MeshSendIdle)
+	return RH_ROUTER_ERROR_BUSY;
+    if (len > RH_MESH_MAX_MESSAGE_LEN)
+	return RH_ROUTER_ERROR_INVALID_LENGTH;
+
+    _meshStarted = millis();
+    _meshBuf = buf;
+    _meshLen = len;
+    _meshAddress = address;
+    _meshFlags = flags;
+    _meshReply = reply;
+    _meshReplyLen = replyLen;
+    _meshReplyFlags = replyFlags;
+    _meshReplyTimeout = replyTimeout;
+    expireRoutes(); // A stale route is found again
+    if (address == RH_BROADCAST_ADDRESS || getRouteTo(address))
+	return startApplicationMessage();
+
+    // Need to discover a route, as doArp() does
+    MeshRouteDiscoveryMessage* p = (MeshRouteDiscoveryMessage*)messageData();
+    p->header.msgType = RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST;
+    p->destlen = 1; 
+    p->dest = address; // Who we are looking for
+    uint8_t ret = RHRouter::sendtoStart((uint8_t*)p, sizeof(RHMesh::MeshMessageHeader) + 2, RH_BROADCAST_ADDRESS);
+    if (ret != RH_ROUTER_SEND_PENDING)
+	return ret;
+    _meshState = MeshSendArpRequest;
+    return _meshResult = ret;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHMesh::startApplicationMessage()
+{
+    // The route discovery delay, as in sendtoWaitReply()
+    uint16_t meshRouteDiscoveryDelay = (millis() - _meshStarted)/10;
+    if (_meshBuf[_meshLen-1] + meshRouteDiscoveryDelay >= 255)
+	_meshBuf[_meshLen-1] = 255;
+    else
+	_meshBuf[_meshLen-1] = _meshBuf[_meshLen-1] + meshRouteDiscoveryDelay;
+
+    MeshApplicationMessage* a = (MeshApplicationMessage*)messageData();
+    a->header.msgType = RH_MESH_MESSAGE_TYPE_APPLICATION;
+    memcpy(a->data, _meshBuf, _meshLen);
+    uint8_t ret;
+    if (_meshReply)
+    {
+	// RHRouter sends the message from where it was built, and the reply comes back there
+	_meshTmpLen = RH_ROUTER_MAX_MESSAGE_LEN;
+	ret = RHRouter::sendtoStartReply(messageData(), sizeof(RHMesh::MeshMessageHeader) + _meshLen, _meshAddress, _meshFlags, messageData(), &_meshTmpLen, _meshReplyFlags, _meshReplyTimeout);
+    }
+    else
+	ret = RHRouter::sendtoStart(messageData(), sizeof(RHMesh::MeshMessageHeader) + _meshLen, _meshAddress, _meshFlags);
+    _meshState = (ret == RH_ROUTER_SEND_PENDING) ? MeshSending : MeshSendIdle;
+    return _meshResult = ret;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHMesh::sendPoll()
+{
+    uint8_t ret;
+    switch (_meshState)
+    {
+    case MeshSendArpRequest:
+	ret = RHRouter::sendPoll();
+	if (ret == RH_ROUTER_SEND_PENDING)
+	    return ret;
+	if (ret != RH_ROUTER_ERROR_NONE)
+	{
+	    _meshState = MeshSendIdle;
+	    return _meshResult = RH_ROUTER_ERROR_NO_ROUTE;
+	}
+	_meshState = MeshSendArpWait;
+	_arpStarted = millis();
+	_arpTimeout = RH_MESH_ARP_TIMEOUT;
+	_arpResolved = false;
+	return _meshResult;
+
+    case MeshSendArpWait:
+#if RH_MESH_SEEN_REQUESTS
+	sendPendingRequest(false); // Requests from others are still passed on while we wait
+#endif
+	if (available())
+	{
+	    // As doArp(): listen on for RH_MESH_ARP_WINDOW after the first response
+	    MeshRouteDiscoveryMessage* p = (MeshRouteDiscoveryMessage*)messageData();
+	    uint8_t messageLen = RH_ROUTER_MAX_MESSAGE_LEN;
+	    if (   RHRouter::recvfromAck(messageData(), &messageLen)
+		&& messageLen > 1
+		&& p->header.msgType == RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_RESPONSE
+		&& !_arpResolved)
+	    {
+		_arpResolved = true;
+		if (millis() - _arpStarted + RH_MESH_ARP_WINDOW < _arpTimeout)
+		    _arpTimeout = millis() - _arpStarted + RH_MESH_ARP_WINDOW;
+	    }
+	}
+	if (millis() - _arpStarted < _arpTimeout)
+	    return _meshResult;
+	if (!_arpResolved)
+	{
+	    _meshState = MeshSendIdle;
+	    return _meshResult = RH_ROUTER_ERROR_NO_ROUTE;
+	}
+	return startApplicationMessage();
+
+    case MeshSending:
+	ret = RHRouter::sendPoll();
+	if (ret == RH_ROUTER_SEND_PENDING)
+	    return ret;
+	if (ret == RH_ROUTER_ERROR_UNABLE_TO_DELIVER)
+	    deleteRouteTo(_meshAddress); // As route() does when the next hop does not acknowledge
+	if (_meshReply)
+	{
+	    MeshApplicationMessage* a = (MeshApplicationMessage*)messageData();
+	    if (   ret == RH_ROUTER_ERROR_NONE
+		&& _meshTmpLen >= 1
+		&& a->header.msgType == RH_MESH_MESSAGE_TYPE_APPLICATION)
+	    {
+		uint8_t msgLen = _meshTmpLen - sizeof(MeshMessageHeader);
+		if (*_meshReplyLen > msgLen)
+		    *_meshReplyLen = msgLen;
+		memcpy(_meshReply, a->data, *_meshReplyLen);
+	    }
+	    else
+		*_meshReplyLen = 0;
+	}
+	_meshState = MeshSendIdle;
+	return _meshResult = ret;
+
+    default:
+	return _meshResult;
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHMesh::sendReply(uint8_t* buf, uint8_t len, uint8_t flags)
+{
+    if (len > RH_MESH_MAX_MESSAGE_LEN)
+	return false;
+
+    MeshApplicationMessage* a = (MeshApplicationMessage*)messageData();
+    a->header.msgType = RH_MESH_MESSAGE_TYPE_APPLICATION;
+    memcpy(a->data, buf, len);
+    return RHRouter::sendReply(messageData(), sizeof(RHMesh::MeshMessageHeader) + len, flags);
+}
+
+////////////////////////////////////////////////////////////////////
+void RHMesh::setRebroadcast(uint16_t maxDelay, uint8_t threshold)
+{
+    _rebroadcastDelay = maxDelay;
+    _rebroadcastThreshold = threshold;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -66,7 +263,7 @@ bool RHMesh::doArp(uint8_t address)
 {
     // Need to discover a route
     // Broadcast a route discovery message with nothing in it
-    MeshRouteDiscoveryMessage* p = (MeshRouteDiscoveryMessage*)&_tmpMessage;
+    MeshRouteDiscoveryMessage* p = (MeshRouteDiscoveryMessage*)messageData();
     p->header.msgType = RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST;
     p->destlen = 1; 
     p->dest = address; // Who we are looking for
@@ -76,29 +273,38 @@ bool RHMesh::doArp(uint8_t address)
     
     // Wait for a reply, which will be unicast back to us
     // It will contain the complete route to the destination
-    uint8_t messageLen = sizeof(_tmpMessage);
+    // The request reaches the destination by every path, so keep listening for 
+    // RH_MESH_ARP_WINDOW after the first reply. peekAtMessage() keeps the cheapest route
     // FIXME: timeout should be configurable
     unsigned long starttime = millis();
+    unsigned long timeout = RH_MESH_ARP_TIMEOUT;
+    bool resolved = false;
     int32_t timeLeft;
-    while ((timeLeft = RH_MESH_ARP_TIMEOUT - (millis() - starttime)) > 0)
+    while ((timeLeft = timeout - (millis() - starttime)) > 0)
     {
+#if RH_MESH_SEEN_REQUESTS
+	sendPendingRequest(false); // Requests from others are still passed on while we wait
+	if (waitAvailableTimeout(pendingWait(timeLeft)))
+#else
 	if (waitAvailableTimeout(timeLeft))
+#endif
 	{
-	    if (RHRouter::recvfromAck(_tmpMessage, &messageLen))
+	    uint8_t messageLen = RH_ROUTER_MAX_MESSAGE_LEN;
+	    if (RHRouter::recvfromAck(messageData(), &messageLen))
 	    {
 		if (   messageLen > 1
-		       && p->header.msgType == RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_RESPONSE)
+		       && p->header.msgType == RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_RESPONSE
+		       && !resolved)
 		{
-		    // Got a reply, now add the next hop to the dest to the routing table
-		    // The first hop taken is the first octet
-		    addRouteTo(address, headerFrom());
-		    return true;
+		    resolved = true;
+		    if (millis() - starttime + RH_MESH_ARP_WINDOW < timeout)
+			timeout = millis() - starttime + RH_MESH_ARP_WINDOW;
 		}
 	    }
 	}
 	YIELD;
     }
-    return false;
+    return resolved;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -112,17 +318,24 @@ void RHMesh::peekAtMessage(RoutedMessage* message, uint8_t messageLen)
 	// This is a unicast RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_RESPONSE messages 
 	// being routed back to the originator here. Want to scrape some routing data out of the response
 	// We can find the routes to all the nodes between here and the responding node
+	// Each is offered with its hop count and the quality of the link the response came over,
+	// so a later response by a better path replaces it and a worse one does not
 	MeshRouteDiscoveryMessage* d = (MeshRouteDiscoveryMessage*)message->data;
-	addRouteTo(d->dest, headerFrom());
+	uint8_t quality = linkQuality();
+	offerRoute(d->dest, headerFrom(), message->header.hops + 1, quality);
 	uint8_t numRoutes = messageLen - sizeof(RoutedMessageHeader) - sizeof(MeshMessageHeader) - 2;
 	uint8_t i;
 	// Find us in the list of nodes that were traversed to get to the responding node
 	for (i = 0; i < numRoutes; i++)
 	    if (d->route[i] == _thisAddress)
 		break;
+	uint8_t us = i;
 	i++;
 	while (i < numRoutes)
-	    addRouteTo(d->route[i++], headerFrom());
+	{
+	    offerRoute(d->route[i], headerFrom(), i - us, quality);
+	    i++;
+	}
     }
     else if (   messageLen > 1 
 	     && m->msgType == RH_MESH_MESSAGE_TYPE_ROUTE_FAILURE)
@@ -146,7 +359,7 @@ uint8_t RHMesh::route(RoutedMessage* message, uint8_t messageLen)
 	if (message->header.source != _thisAddress)
 	{
 	    // This is being proxied, so tell the originator about it
-	    MeshRouteFailureMessage* p = (MeshRouteFailureMessage*)&_tmpMessage;
+	    MeshRouteFailureMessage* p = (MeshRouteFailureMessage*)messageData();
 	    p->header.msgType = RH_MESH_MESSAGE_TYPE_ROUTE_FAILURE;
 	    p->dest = message->header.dest; // Who you were trying to deliver to
 	    // Make sure there is a route back towards whoever sent the original message
@@ -168,15 +381,18 @@ bool RHMesh::isPhysicalAddress(uint8_t* address, uint8_t addresslen)
 ////////////////////////////////////////////////////////////////////
 bool RHMesh::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags, uint8_t* hops)
 {     
-    uint8_t tmpMessageLen = sizeof(_tmpMessage);
+    uint8_t tmpMessageLen = RH_ROUTER_MAX_MESSAGE_LEN;
     uint8_t _source;
     uint8_t _dest;
     uint8_t _id;
     uint8_t _flags;
     uint8_t _hops;
-    if (RHRouter::recvfromAck(_tmpMessage, &tmpMessageLen, &_source, &_dest, &_id, &_flags, &_hops))
+#if RH_MESH_SEEN_REQUESTS
+    sendPendingRequest(false);
+#endif
+    if (RHRouter::recvfromAck(messageData(), &tmpMessageLen, &_source, &_dest, &_id, &_flags, &_hops))
     {
-	MeshMessageHeader* p = (MeshMessageHeader*)&_tmpMessage;
+	MeshMessageHeader* p = (MeshMessageHeader*)messageData();
 
 	if (   tmpMessageLen >= 1 
 	    && p->msgType == RH_MESH_MESSAGE_TYPE_APPLICATION)
@@ -214,21 +430,43 @@ bool RHMesh::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* d
 		    return false; // Already been through us. Discard
 	    
 	        
-            addRouteTo(_source, headerFrom()); // The originator needs to be added regardless of node type
+	    // Copies of the request come by every path, so routes back are offered rather than 
+	    // replaced: the cheapest is kept
+	    uint8_t quality = linkQuality();
+	    uint32_t changes = routesChanged();
+            offerRoute(_source, headerFrom(), numRoutes + 1, quality); // The originator needs to be added regardless of node type
+	    bool betterRoute = routesChanged() != changes;
 
 	    // Hasnt been past us yet, record routes back to the earlier nodes
             // No need to waste memory if we are not participating in routing
             if (_isa_router)
             {
 	        for (i = 0; i < numRoutes; i++)
-		    addRouteTo(d->route[i], headerFrom());
+		    offerRoute(d->route[i], headerFrom(), numRoutes - i, quality);
             }
 
+#if RH_MESH_SEEN_REQUESTS
+	    // Pass each request on once. A copy by another path is only answered if it is for us 
+	    // and came by a better route back, which the response will then take
+	    SeenRequest* seen = seenRequest(_source, _id);
+	    if (seen)
+	    {
+		if (seen->copies < 255)
+		    seen->copies++;
+		if (!betterRoute || !isPhysicalAddress(&d->dest, d->destlen))
+		    return false;
+	    }
+	    else
+		seen = rememberRequest(_source, _id);
+#else
+	    (void)betterRoute;
+#endif
+
 	    if (isPhysicalAddress(&d->dest, d->destlen))
 	    {
 		// This route discovery is for us. Unicast the whole route back to the originator
 		// as a RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_RESPONSE
-		// We are certain to have a route there, because we just got it
+		// We are certain to have a route there, because we just got it (or a better one)
 		d->header.msgType = RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_RESPONSE;
 		RHRouter::sendtoWait((uint8_t*)d, tmpMessageLen, _source);
 	    }
@@ -237,9 +475,13 @@ bool RHMesh::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* d
 		// Its for someone else, rebroadcast it, after adding ourselves to the list
 		d->route[numRoutes] = _thisAddress;
 		tmpMessageLen++;
+#if RH_MESH_SEEN_REQUESTS
+		rebroadcastRequest(messageData(), tmpMessageLen, seen);
+#else
 		// Have to impersonate the source
 		// REVISIT: if this fails what can we do?
-		RHRouter::sendtoFromSourceWait(_tmpMessage, tmpMessageLen, RH_BROADCAST_ADDRESS, _source);
+		RHRouter::sendtoFromSourceWait(messageData(), tmpMessageLen, RH_BROADCAST_ADDRESS, _source);
+#endif
 	    }
 	}
     }
@@ -253,7 +495,11 @@ bool RHMesh::recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t timeout, ui
     int32_t timeLeft;
     while ((timeLeft = timeout - (millis() - starttime)) > 0)
     {
+#if RH_MESH_SEEN_REQUESTS
+	if (waitAvailableTimeout(pendingWait(timeLeft)) || _pendingLen)
+#else
 	if (waitAvailableTimeout(timeLeft))
+#endif
 	{
 	    if (recvfromAck(buf, len, from, to, id, flags, hops))
 		return true;
@@ -263,5 +509,119 @@ bool RHMesh::recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t timeout, ui
     return false;
 }
 
+////////////////////////////////////////////////////////////////////
+unsigned long RHMesh::rebroadcastDueIn(unsigned long timeLeft)
+{
+#if RH_MESH_SEEN_REQUESTS
+    return pendingWait(timeLeft);
+#else
+    return timeLeft; // Requests are rebroadcast at once
+#endif
+}
+
+////////////////////////////////////////////////////////////////////
+void RHMesh::flushRebroadcast()
+{
+#if RH_MESH_SEEN_REQUESTS
+    sendPendingRequest(true);
+#endif
+}
+
+#if RH_MESH_SEEN_REQUESTS
+////////////////////////////////////////////////////////////////////
+RHMesh::SeenRequest* RHMesh::seenRequest(uint8_t source, uint8_t id)
+{
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < RH_MESH_SEEN_REQUESTS; i++)
+    {
+	SeenRequest* seen = &_seenRequests[i];
+	if (   seen->heard
+	    && seen->source == source
+	    && seen->id == id
+	    && now - seen->heard < RH_MESH_SEEN_TIMEOUT)
+	    return seen;
+    }
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////
+RHMesh::SeenRequest* RHMesh::rememberRequest(uint8_t source, uint8_t id)
+{
+    // If the oldest is still held back it goes now, so the copies counted for it stay with it
+    if (_pendingLen && _pendingSource == _seenRequests[_seenNext].source && _pendingId == _seenRequests[_seenNext].id)
+	sendPendingRequest(true);
+    SeenRequest* seen = &_seenRequests[_seenNext];
+    _seenNext = (_seenNext + 1) % RH_MESH_SEEN_REQUESTS;
+    seen->source = source;
+    seen->id = id;
+    seen->copies = 0;
+    seen->heard = millis() | 1; // 0 marks an empty slot
+    return seen;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHMesh::rebroadcastRequest(uint8_t* message, uint8_t len, SeenRequest* seen)
+{
+    if (!_rebroadcastDelay || len > sizeof(_pendingRequest))
+    {
+	// Have to impersonate the source. The id is kept so others know it is the same request
+	// REVISIT: if this fails what can we do?
+	RHRouter::forwardFromSourceWait(message, len, RH_BROADCAST_ADDRESS, seen->source, 0, seen->id);
+	sendPendingRequest(true); // Not before: sending it would overwrite message, in the router's buffer
+	return;
+    }
+    uint8_t heldLen = _pendingLen;
+    uint8_t heldSource = _pendingSource;
+    uint8_t heldId = _pendingId;
+    // Neighbours that heard the same copy would otherwise all rebroadcast at once, and collide.
+    // Only one request is held back at a time, and one still waiting goes first: it changes places with 
+    // this one, so it is sent from the router's buffer (see messageData())
+    uint8_t swapLen = (len > heldLen) ? len : heldLen;
+    for (uint8_t i = 0; i < swapLen; i++)
+    {
+	uint8_t octet = _pendingRequest[i];
+	_pendingRequest[i] = message[i];
+	message[i] = octet;
+    }
+    _pendingLen = len;
+    _pendingSource = seen->source;
+    _pendingId = seen->id;
+    _pendingDue = millis() + random(0, _rebroadcastDelay + 1);
+    if (heldLen && requestStillNeeded(heldSource, heldId))
+	RHRouter::forwardFromSourceWait(message, heldLen, RH_BROADCAST_ADDRESS, heldSource, 0, heldId);
+}
+
+////////////////////////////////////////////////////////////////////
+void RHMesh::sendPendingRequest(bool now)
+{
+    if (!_pendingLen || (!now && (int32_t)(millis() - _pendingDue) < 0))
+	return;
+    uint8_t len = _pendingLen;
+    _pendingLen = 0;
+    if (requestStillNeeded(_pendingSource, _pendingId))
+	RHRouter::forwardFromSourceWait(_pendingRequest, len, RH_BROADCAST_ADDRESS, _pendingSource, 0, _pendingId);
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHMesh::requestStillNeeded(uint8_t source, uint8_t id)
+{
+    // A request no longer remembered is too old: the originator has given up on it.
+    // If enough neighbours have passed it on already, ours would reach nobody new
+    SeenRequest* seen = seenRequest(source, id);
+    return seen && !(_rebroadcastThreshold && seen->copies >= _rebroadcastThreshold);
+}
+
+////////////////////////////////////////////////////////////////////
+unsigned long RHMesh::pendingWait(unsigned long timeLeft)
+{
+    if (!_pendingLen)
+	return timeLeft;
+    int32_t due = _pendingDue - millis();
+    if (due <= 0)
+	return 0;
+    return (unsigned long)due < timeLeft ? due : timeLeft;
+}
+#endif
+
 
 
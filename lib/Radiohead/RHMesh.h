@@ -18,6 +18,29 @@
 // Timeout for address resolution in milliecs
 #define RH_MESH_ARP_TIMEOUT 2000
 
+// How long address resolution keeps listening after the first reply for replies by other paths, in millisecs
+#ifndef RH_MESH_ARP_WINDOW
+#define RH_MESH_ARP_WINDOW 400
+#endif
+
+// Route discovery requests remembered (by source and id) so each is passed on once. 
+// 0 passes on every copy at once, as before v15.15
+#ifndef RH_MESH_SEEN_REQUESTS
+#define RH_MESH_SEEN_REQUESTS 8
+#endif
+
+// How long a route discovery request is remembered, in millisecs
+#define RH_MESH_SEEN_TIMEOUT (2 * RH_MESH_ARP_TIMEOUT)
+
+// Default longest random wait before a request is rebroadcast, in millisecs (see setRebroadcast())
+#define RH_MESH_REBROADCAST_DELAY 250
+
+// Default number of copies of a request heard from other nodes that stops its rebroadcast (see setRebroadcast())
+#define RH_MESH_REBROADCAST_THRESHOLD 3
+
+// Longest request held back for a delayed rebroadcast - longer ones are rebroadcast at once
+#define RH_MESH_PENDING_REQUEST_LEN (3 + RH_DEFAULT_MAX_HOPS)
+
 /////////////////////////////////////////////////////////////////////
 /// \class RHMesh RHMesh.h <RHMesh.h>
 /// \brief RHRouter subclass for sending addressed, optionally acknowledged datagrams
@@ -48,7 +71,13 @@
 ///
 /// If a node receives a RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST that already has itself 
 /// listed in the visited nodes, it knows it has already seen and rebroadcast this request, 
-/// and threfore ignores it. This prevents broadcast storms.
+/// and threfore ignores it. Nodes also remember the source and id of the last RH_MESH_SEEN_REQUESTS
+/// requests, so a request arriving by several paths is passed on only once. The rebroadcast waits a 
+/// random time of up to RH_MESH_REBROADCAST_DELAY and is dropped if RH_MESH_REBROADCAST_THRESHOLD 
+/// copies of the request are heard from other nodes meanwhile - in a dense mesh the neighbours 
+/// have already been reached. This prevents broadcast storms (see setRebroadcast()).
+/// The request keeps its id as it is passed on, so nodes running an earlier version (which give it 
+/// a new id) only weaken the suppression.
 /// When a node receives a RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST it can use the list of 
 /// nodes aready visited to deduce routes back towards the originating (requesting node). 
 /// This also means that when the destination node of the request is reached, it (and all 
@@ -65,9 +94,11 @@
 /// RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_RESPONSE together ensure the original requester and all 
 /// the intermediate nodes know how to route to the source and destination nodes and every node along the path.
 ///
-/// Note that there is a race condition here that can effect routing on multipath routes. For example, 
-/// if the route to the destination can traverse several paths, last reply from the destination 
-/// will be the one used.
+/// If the route to the destination can traverse several paths, the destination replies to the request 
+/// by each of them. The requester listens for RH_MESH_ARP_WINDOW after the first reply, and every node 
+/// keeps the route with the lowest RHRouter::routeCost() - the quality of the link to the next hop 
+/// (its RSSI until acknowledgements have measured it) and the hop count - of those it hears of 
+/// (see RHRouter::offerRoute()).
 ///
 /// \par Route Failure
 ///
@@ -174,6 +205,81 @@ public:
     ///           (usually because it dod not acknowledge due to being off the air or out of range
     uint8_t sendtoWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags = 0);
 
+    /// Request/response transaction. As sendtoWait(), but when dest is the next hop its application
+    /// reply (sent with sendReply()) comes back as the acknowledgement, so the exchange takes one message
+    /// each way instead of two acknowledged messages (see RHRouter::sendtoWaitReply()).
+    /// \param [in] buf The application message data
+    /// \param [in] len Number of octets in the application message data. 0 is permitted
+    /// \param [in] dest The destination node address. Must not be RH_BROADCAST_ADDRESS
+    /// \param [in] flags Optional flags delivered end-to-end to the dest address
+    /// \param [in] reply Location to copy the application reply. May be the same as buf.
+    /// \param [in,out] replyLen Pointer to the number of octets available in reply. Set to the number of octets copied, 
+    ///                 0 if no reply came back with the acknowledgement (dest is not the next hop or does not reply to requests).
+    /// \param [out] replyFlags If not NULL, set to the end-to-end flags of the reply
+    /// \param [in] replyTimeout Extra time in milliseconds to wait for the reply on each try
+    /// \return The result code, as for sendtoWait()
+    uint8_t sendtoWaitReply(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags, uint8_t* reply, uint8_t* replyLen, uint8_t* replyFlags, uint16_t replyTimeout);
+
+    /// Starts sending a message as sendtoWait() does, but returns without waiting: for the route discovery 
+    /// if no route is known, then for the transmission and the acknowledgement from the next hop. Call 
+    /// sendPoll() until it is no longer RH_ROUTER_SEND_PENDING. buf must not change until then (the delay 
+    /// octet at its end is updated, as by sendtoWait()), and until then only sendPoll() may be used to send or receive.
+    /// \param [in] buf The application message data
+    /// \param [in] len Number of octets in the application message data. 0 is permitted
+    /// \param [in] dest The destination node address
+    /// \param [in] flags Optional flags delivered end-to-end to the dest address
+    /// \return RH_ROUTER_SEND_PENDING if the send was started, otherwise a result code as for sendtoWait(), or 
+    ///         RH_ROUTER_ERROR_BUSY if a send is still pending
+    uint8_t sendtoStart(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags = 0);
+
+    /// Starts a request/response transaction as sendtoWaitReply() does, but returns without waiting (see sendtoStart()).
+    /// reply, replyLen and replyFlags are set when sendPoll() returns RH_ROUTER_ERROR_NONE.
+    /// \param [in] buf The application message data
+    /// \param [in] len Number of octets in the application message data. 0 is permitted
+    /// \param [in] dest The destination node address. Must not be RH_BROADCAST_ADDRESS
+    /// \param [in] flags Optional flags delivered end-to-end to the dest address
+    /// \param [in] reply Location to copy the application reply. May be the same as buf.
+    /// \param [in,out] replyLen Pointer to the number of octets available in reply. Set to the number of octets copied, 
+    ///                 0 if no reply came back with the acknowledgement.
+    /// \param [out] replyFlags If not NULL, set to the end-to-end flags of the reply
+    /// \param [in] replyTimeout Extra time in milliseconds to wait for the reply on each try
+    /// \return The result code, as for sendtoStart()
+    uint8_t sendtoStartReply(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags, uint8_t* reply, uint8_t* replyLen, uint8_t* replyFlags, uint16_t replyTimeout);
+
+    /// Moves the send started by sendtoStart() on without blocking: the route discovery (collecting the 
+    /// responses, and passing on requests from other nodes, as doArp() does), then the message itself 
+    /// (see RHRouter::sendPoll()). A route the next hop did not acknowledge is deleted, as route() does.
+    /// \return RH_ROUTER_SEND_PENDING until the send completes, then its result code as for sendtoWait() 
+    ///         until the next send is started
+    uint8_t sendPoll();
+
+    /// Replies to the last request returned by recvfromAck(). The reply is the acknowledgement of 
+    /// the request, so send it promptly (see RHReliableDatagram::sendReply()).
+    /// \param [in] buf The application reply data
+    /// \param [in] len Number of octets in the application reply data
+    /// \param [in] flags Optional flags delivered end-to-end with the reply
+    /// \return false if there is no request waiting for a reply
+    bool sendReply(uint8_t* buf, uint8_t len, uint8_t flags = 0);
+
+    /// Sets how route discovery requests from other nodes are passed on. A request is rebroadcast after a 
+    /// random wait of up to maxDelay, unless threshold copies of it have been heard from other nodes by then. 
+    /// Defaults to RH_MESH_REBROADCAST_DELAY and RH_MESH_REBROADCAST_THRESHOLD.
+    /// The request held back is sent from recvfromAck(), so keep calling it (or recvfromAckTimeout()).
+    /// A node that sleeps between calls should wake by rebroadcastDueIn() and call flushRebroadcast() 
+    /// before it puts the radio to sleep.
+    /// \param [in] maxDelay Longest wait in milliseconds. 0 rebroadcasts at once
+    /// \param [in] threshold Copies heard that stop the rebroadcast. 0 always rebroadcasts
+    void setRebroadcast(uint16_t maxDelay, uint8_t threshold);
+
+    /// Time until the request held back (see setRebroadcast()) is due to be rebroadcast
+    /// \param [in] timeLeft The longest time of interest, in milliseconds
+    /// \return timeLeft, or less if the request held back is due sooner - 0 if it is due now
+    unsigned long rebroadcastDueIn(unsigned long timeLeft);
+
+    /// Rebroadcasts the request held back now, without waiting for it to be due - unless enough copies 
+    /// of it have been heard or it is too old (see setRebroadcast()). Does nothing if none is held back
+    void flushRebroadcast();
+
     /// Starts the receiver if it is not running already, processes and possibly routes any received messages
     /// addressed to other nodes
     /// and delivers any messages addressed to this node.
@@ -231,7 +337,7 @@ protected:
     virtual uint8_t route(RoutedMessage* message, uint8_t messageLen);
 
     /// Try to resolve a route for the given address. Blocks while discovering the route
-    /// which may take up to 4000 msec.
+    /// which may take up to 4000 msec. Listens on for RH_MESH_ARP_WINDOW after the first reply.
     /// Virtual so subclasses can override.
     /// \param [in] address The physical address to resolve
     /// \return true if the address was resolved and added to the local routing table
@@ -250,8 +356,82 @@ protected:
     virtual bool isPhysicalAddress(uint8_t* address, uint8_t addresslen);
 
 private:
-    /// Temporary message buffer
-    static uint8_t _tmpMessage[RH_ROUTER_MAX_MESSAGE_LEN];
+#if RH_MESH_SEEN_REQUESTS
+    /// A route discovery request this node has heard
+    typedef struct
+    {
+	uint8_t      source;    ///< Originator of the request
+	uint8_t      id;        ///< End-to-end id of the request
+	uint8_t      copies;    ///< Copies heard since the first, up to 255
+	uint32_t     heard;     ///< millis() when the first copy was heard
+    } SeenRequest;
+
+    /// Returns the request with this source and id heard in the last RH_MESH_SEEN_TIMEOUT, or NULL
+    SeenRequest* seenRequest(uint8_t source, uint8_t id);
+
+    /// Remembers a request heard for the first time, in place of the oldest
+    SeenRequest* rememberRequest(uint8_t source, uint8_t id);
+
+    /// Rebroadcasts a request now, or holds it back for a random time (see setRebroadcast())
+    void rebroadcastRequest(uint8_t* message, uint8_t len, SeenRequest* seen);
+
+    /// Sends the request held back, unless enough copies of it were heard, once it is due (or at once if now)
+    void sendPendingRequest(bool now);
+
+    /// Whether a request held back is still worth rebroadcasting
+    bool requestStillNeeded(uint8_t source, uint8_t id);
+
+    /// timeLeft, or less if the request held back is due sooner
+    unsigned long pendingWait(unsigned long timeLeft);
+
+    /// Requests heard, the oldest at _seenNext
+    SeenRequest          _seenRequests[RH_MESH_SEEN_REQUESTS];
+    uint8_t              _seenNext;
+
+    /// The request held back for a delayed rebroadcast, and when it is due. _pendingLen is 0 if none
+    uint8_t              _pendingRequest[RH_MESH_PENDING_REQUEST_LEN];
+    uint8_t              _pendingLen;
+    uint8_t              _pendingSource;
+    uint8_t              _pendingId;
+    uint32_t             _pendingDue;
+#endif
+
+    /// Longest random wait before a request is rebroadcast, in milliseconds
+    uint16_t             _rebroadcastDelay;
+
+    /// Copies of a request heard that stop its rebroadcast. 0 always rebroadcasts
+    uint8_t              _rebroadcastThreshold;
+
+    /// Where the send started by sendtoStart() is up to
+    typedef enum
+    {
+	MeshSendIdle = 0,       ///< Not sending. sendPoll() returns the result of the last send
+	MeshSendArpRequest,     ///< Broadcasting a route discovery request
+	MeshSendArpWait,        ///< Collecting route discovery responses
+	MeshSending             ///< Sending the application message to the next hop
+    } MeshSendState;
+
+    /// Sends the application message of the send started by sendtoStart(), once there is a route
+    uint8_t startApplicationMessage();
+
+    /// The send started by sendtoStart()
+    MeshSendState        _meshState;
+    uint8_t              _meshResult;       ///< Result code of the last send
+    uint8_t*             _meshBuf;
+    uint8_t              _meshLen;
+    uint8_t              _meshAddress;
+    uint8_t              _meshFlags;
+    uint8_t*             _meshReply;        ///< NULL if it is not a request
+    uint8_t*             _meshReplyLen;
+    uint8_t*             _meshReplyFlags;
+    uint16_t             _meshReplyTimeout;
+    uint32_t             _meshStarted;      ///< millis() when it was started, for the route discovery delay
+    uint8_t              _meshTmpLen;       ///< Length of the reply in messageData()
+
+    /// The route discovery of the send started by sendtoStart()
+    uint32_t             _arpStarted;
+    uint32_t             _arpTimeout;
+    bool                 _arpResolved;
 
 };
 
@@ -0,0 +1,49 @@
+// RHMessagePool.cpp
+//
+// Fixed message buffers shared by the layers of a RadioHead stack
+
+#include <RHMessagePool.h>
+
+uint8_t RHMessagePool::_buffers[RH_POOL_BUFFERS][RH_POOL_BUFFER_LEN];
+bool    RHMessagePool::_taken[RH_POOL_BUFFERS];
+uint8_t RHMessagePool::_mostTaken = 0;
+
+////////////////////////////////////////////////////////////////////
+uint8_t* RHMessagePool::take()
+{
+    for (uint8_t i = 0; i < RH_POOL_BUFFERS; i++)
+    {
+	if (!_taken[i])
+	{
+	    _taken[i] = true;
+	    uint8_t now = taken();
+	    if (now > _mostTaken)
+		_mostTaken = now;
+	    return _buffers[i];
+	}
+    }
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHMessagePool::give(uint8_t* buffer)
+{
+    for (uint8_t i = 0; i < RH_POOL_BUFFERS; i++)
+	if (buffer == _buffers[i])
+	    _taken[i] = false;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHMessagePool::taken()
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < RH_POOL_BUFFERS; i++)
+	count += _taken[i];
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHMessagePool::mostTaken()
+{
+    return _mostTaken;
+}
@@ -0,0 +1,57 @@
+// RHMessagePool.h
+//
+// Fixed message buffers shared by the layers of a RadioHead stack
+
+#ifndef RHMessagePool_h
+#define RHMessagePool_h
+
+#include <RHDatagram.h>
+
+/// Octets in each buffer: the longest message with its RHRouter header, which is also the longest
+/// RHEncryptedDriver sends or receives encrypted (see RHEncryptedDriver::maxMessageLength())
+#ifndef RH_POOL_BUFFER_LEN
+#define RH_POOL_BUFFER_LEN RH_MAX_MESSAGE_LEN
+#endif
+
+/// Number of buffers: RHRouter's (which RHMesh builds its messages in) and RHEncryptedDriver's
+#ifndef RH_POOL_BUFFERS
+#define RH_POOL_BUFFERS 2
+#endif
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHMessagePool RHMessagePool.h <RHMessagePool.h>
+/// \brief Message buffers allocated at compile time, each owned by one layer of the stack at a time
+///
+/// A layer takes a buffer, hands it down the stack with the message in it and gives it back once the
+/// message is done with:
+/// - RHRouter takes one when the first router is constructed and keeps it. RHMesh builds its messages
+///   after the space for the RHRouter header, RHRouter fills in the header where it is and RHReliableDatagram
+///   sends it from there, and puts the reply (or the next message received) in the same buffer.
+/// - RHEncryptedDriver takes one for the ciphertext of each message it sends or receives.
+///
+/// So no buffer is allocated on the heap or the stack, and none is longer than RH_POOL_BUFFER_LEN, which
+/// can be set (with RH_MAX_MESSAGE_LEN) from the longest message the application sends or receives.
+class RHMessagePool
+{
+public:
+    /// Takes a free buffer. The caller owns it until it gives it back with give()
+    /// \return A buffer of RH_POOL_BUFFER_LEN octets, or NULL if all are taken
+    static uint8_t* take();
+
+    /// Gives back a buffer taken with take()
+    /// \param[in] buffer The buffer. NULL is ignored
+    static void give(uint8_t* buffer);
+
+    /// \return The number of buffers taken now
+    static uint8_t taken();
+
+    /// \return The most buffers that have been taken at once. RH_POOL_BUFFERS need be no more
+    static uint8_t mostTaken();
+
+private:
+    static uint8_t _buffers[RH_POOL_BUFFERS][RH_POOL_BUFFER_LEN];
+    static bool    _taken[RH_POOL_BUFFERS];
+    static uint8_t _mostTaken;
+};
+
+#endif
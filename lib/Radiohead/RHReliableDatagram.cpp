@@ -21,8 +21,16 @@ RHReliableDatagram::RHReliableDatagram(RHGenericDriver& driver, uint8_t thisAddr
     _retransmissions = 0;
     _lastSequenceNumber = 0;
     _timeout = RH_DEFAULT_TIMEOUT;
+    _minTimeout = RH_DEFAULT_MIN_TIMEOUT;
+    _roundTripCount = 0;
     _retries = RH_DEFAULT_RETRIES;
-    memset(_seenIds, 0, sizeof(_seenIds));
+    _window = RH_RELIABLE_WINDOW;
+    _sendState = RH_RELIABLE_SEND_IDLE;
+    _sendOnAir = false;
+    _sendListening = false;
+    _seenIdsCount = 0;
+    _requestPending = false;
+    _replyLen = 0;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -32,6 +40,27 @@ void RHReliableDatagram::setTimeout(uint16_t timeout)
     _timeout = timeout;
 }
 
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::setMinTimeout(uint16_t timeout)
+{
+    _minTimeout = timeout;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::clearRoundTripTimes()
+{
+    _roundTripCount = 0;
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHReliableDatagram::retransmitTimeout(uint8_t address)
+{
+    for (uint8_t i = 0; i < _roundTripCount; i++)
+	if (_roundTrips[i].address == address)
+	    return timeoutFor(&_roundTrips[i]);
+    return timeoutFor(NULL);
+}
+
 ////////////////////////////////////////////////////////////////////
 void RHReliableDatagram::setRetries(uint8_t retries)
 {
@@ -46,30 +75,32 @@ uint8_t RHReliableDatagram::retries()
 
 ////////////////////////////////////////////////////////////////////
 bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
+{
+    return sendtoWaitReply(buf, len, address, NULL, NULL, 0);
+}
+
+////////////////////////////////////////////////////////////////////
+// With reply == NULL this is sendtoWait()
+bool RHReliableDatagram::sendtoWaitReply(uint8_t* buf, uint8_t len, uint8_t address, uint8_t* reply, uint8_t* replyLen, uint16_t replyTimeout)
 {
     // Assemble the message
     uint8_t thisSequenceNumber = ++_lastSequenceNumber;
     uint8_t retries = 0;
+    RoundTrip* rtt = (address == RH_BROADCAST_ADDRESS) ? NULL : roundTripTo(address);
     while (retries++ <= _retries)
     {
 	setHeaderId(thisSequenceNumber);
+	setSendFlags(reply != NULL, retries > 1);
 
-        // Set and clear header flags depending on if this is an
-        // initial send or a retry.
-        uint8_t headerFlagsToSet = RH_FLAGS_NONE;
-        // Always clear the ACK flag
-        uint8_t headerFlagsToClear = RH_FLAGS_ACK;
-        if (retries == 1) {
-            // On an initial send, clear the RETRY flag in case
-            // it was previously set
-            headerFlagsToClear |= RH_FLAGS_RETRY;
-        } else {
-            // Not an initial send, set the RETRY flag
-            headerFlagsToSet = RH_FLAGS_RETRY;
-        }
-        setHeaderFlags(headerFlagsToSet, headerFlagsToClear);
-
-	sendto(buf, len, address);
+	// Listen before talk here rather than in the driver's send(), so the time a busy channel held the
+	// message back goes in its delay octet before it is on air
+	unsigned long listening = millis();
+	bool clear = _driver.waitCAD();
+	addTransmitDelay(buf, len, millis() - listening);
+	_driver.setCADSkip(true);
+	if (clear)
+	    sendto(buf, len, address);
+	_driver.setCADSkip(false);
 	waitPacketSent();
 
 	// Never wait for ACKS to broadcasts:
@@ -80,18 +111,71 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 	    _retransmissions++;
 	unsigned long thisSendTime = millis(); // Timeout does not include original transmit time
 
-	// Compute a new timeout, random between _timeout and _timeout*2
-	// This is to prevent collisions on every retransmit
-	// if 2 nodes try to transmit at the same time
-#if (RH_PLATFORM == RH_PLATFORM_RASPI) // use standard library random(), bugs in random(min, max)
-	uint16_t timeout = _timeout + (_timeout * (random() & 0xFF) / 256);
-#else
-	uint16_t timeout = _timeout + (_timeout * random(0, 256) / 256);
-#endif
-
+	uint16_t timeout = randomTimeout(rtt);
 	//Round the total timeout to the nearest hundredth of a ms. Decreasing resolution allows us to include the total timeout within the message packet but still maintain total accuracy of it upto 2,550 ms (255 *10).  
 	timeout = (timeout/10)*10;
 
+	addRetransmissionDelay(buf, len, timeout);
+
+	// A request also waits for the receiver to prepare its reply. That is not a transmit delay so it is not
+	// added to the retransmission delay above.
+	if (reply)
+	    timeout += replyTimeout;
+
+	//Update the activity Millis value due to attempting re-tries and the max duration being set to 2X timeout. 
+	//This doesn't account for the time it takes to send so effectivly could prevent re-tries unless we re-set it here. 
+	activityMillis = millis();
+
+	bool acknowledged = waitAck(address, thisSequenceNumber, thisSendTime, timeout, reply, replyLen, reply != NULL);
+	if (acknowledged)
+	{
+	    // Only a first transmission is timed: an ACK of a retry could be for any of the tries (Karn's rule)
+	    // The time a request's receiver is allowed for its reply is not part of the round trip
+	    if (rtt && retries == 1)
+	    {
+		uint32_t roundTrip = millis() - thisSendTime;
+		if (reply)
+		    roundTrip = (roundTrip > replyTimeout) ? roundTrip - replyTimeout : 0;
+		measuredRoundTrip(rtt, roundTrip);
+	    }
+	    return true;
+	}
+	// Timeout exhausted, maybe retry. Until a round trip is measured again each timeout is twice the last
+	if (rtt && rtt->backoff < 3)
+	    rtt->backoff++;
+	YIELD;
+    }
+    // Retries exhausted
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::setSendFlags(bool request, bool retry)
+{
+    // Set and clear header flags depending on if this is an
+    // initial send or a retry.
+    uint8_t headerFlagsToSet = RH_FLAGS_NONE;
+    // Always clear the ACK and WINDOW flags
+    uint8_t headerFlagsToClear = RH_FLAGS_ACK | RH_FLAGS_WINDOW;
+    // Mark requests - the reply will come back as the ACK
+    if (request)
+	headerFlagsToSet |= RH_FLAGS_REQUEST;
+    else
+	headerFlagsToClear |= RH_FLAGS_REQUEST;
+    if (!retry) {
+	// On an initial send, clear the RETRY flag in case
+	// it was previously set
+	headerFlagsToClear |= RH_FLAGS_RETRY;
+    } else {
+	// Not an initial send, set the RETRY flag
+	headerFlagsToSet |= RH_FLAGS_RETRY;
+    }
+    setHeaderFlags(headerFlagsToSet, headerFlagsToClear);
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::addRetransmissionDelay(uint8_t* buf, uint8_t len, uint16_t timeout)
+{
 	// If we assume the message is initiated from RFM95 Mesh then buf[5] is the message type. If buf[5] = 0, this is an application message. Let's "hijack" the last two bytes of that message to add the number of re-transmissions 
 	// and the delay with each transmission. This can be used to determine the total transmit time end to end of a message by accounting for re-transmissions in route. 
 	// This is used to synronize time properly between LoRa nodes despite variable transmit time. 
@@ -99,52 +183,236 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 	// indicate the we exceeded 2.55 seconds of re-transmission and to not use this data to set the time. 
 	if (buf[5] == 0){
 		buf[len-2]++; // Increment the number of re-transmissions
-		if (buf[len-1] + timeout/10 >= 255){
+		addTransmitDelay(buf, len, timeout);
+	}
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::addTransmitDelay(uint8_t* buf, uint8_t len, uint32_t delay)
+{
+	if (buf[5] == 0){
+		if (buf[len-1] + delay/10 >= 255){
 			buf[len-1] = 255; // Max value of a byte is 255. If greater than this value, then simply set it to 255. 
 		}
 		else{
-			buf[len-1] = buf[len-1] + timeout/10; // Accumulate the total timeout between all re-transmissions so we know end to end total timeout delay. Accuracy is hundreths of a second with a max timeout of 255. If greater than 255 (2.5 seconds) then just set it to 255 indicating max delay. 
+			buf[len-1] = buf[len-1] + delay/10; // Accumulate the total timeout between all re-transmissions so we know end to end total timeout delay. Accuracy is hundreths of a second with a max timeout of 255. If greater than 255 (2.5 seconds) then just set it to 255 indicating max delay. 
 		}
 	}
+}
 
-	//Update the activity Millis value due to attempting re-tries and the max duration being set to 2X timeout. 
-	//This doesn't account for the time it takes to send so effectivly could prevent re-tries unless we re-set it here. 
-	activityMillis = millis();
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::sendtoStart(uint8_t* buf, uint8_t len, uint8_t address)
+{
+    return sendtoStartReply(buf, len, address, NULL, NULL, 0);
+}
+
+////////////////////////////////////////////////////////////////////
+// With reply == NULL this is sendtoStart()
+bool RHReliableDatagram::sendtoStartReply(uint8_t* buf, uint8_t len, uint8_t address, uint8_t* reply, uint8_t* replyLen, uint16_t replyTimeout)
+{
+    if (_sendState == RH_RELIABLE_SEND_PENDING)
+	return false;
+    _sendState = RH_RELIABLE_SEND_PENDING;
+    _sendBuf = buf;
+    _sendLen = len;
+    _sendAddress = address;
+    _sendId = ++_lastSequenceNumber;
+    _sendTries = 0;
+    _sendReply = reply;
+    _sendReplyLen = replyLen;
+    _sendReplyTimeout = replyTimeout;
+    _sendListening = false;
+    sendTry();
+    return true;
+}
 
-	int32_t timeLeft;
-        while ((timeLeft = timeout - (millis() - thisSendTime)) > 0)
+////////////////////////////////////////////////////////////////////
+// As one pass of the loop in sendtoWaitReply(), up to the wait for the ACK. The channel is checked first
+// without waiting: while it is busy sendPoll() calls this again once the backoff has passed
+void RHReliableDatagram::sendTry()
+{
+    if (!_sendListening)
+    {
+	_sendListening = true;
+	_sendCadStart = millis();
+	_sendCadExponent = 0;
+    }
+    int32_t backoff = _driver.pollCAD(_sendCadStart, _sendCadExponent);
+    if (backoff > 0)
+    {
+	_sendCadAt = millis() + backoff;
+	return;
+    }
+    _sendListening = false;
+    addTransmitDelay(_sendBuf, _sendLen, millis() - _sendCadStart); // The time the channel held it back, as sendtoWaitReply()
+    if (_sendTries++)
+	_retransmissions++;
+    if (backoff < 0)
+    {
+	// The channel stayed busy past the CAD timeout - this try is not sent, the next one listens again
+	if (_sendTries > _retries)
+	    _sendState = RH_RELIABLE_SEND_FAILED;
+	else
+	    sendTry();
+	return;
+    }
+
+    setHeaderId(_sendId);
+    setSendFlags(_sendReply != NULL, _sendTries > 1);
+    // The channel was found clear just now - the driver's send() does not check it again
+    _driver.setCADSkip(true);
+    sendto(_sendBuf, _sendLen, _sendAddress);
+    _driver.setCADSkip(false);
+    _sendOnAir = true;
+    if (_sendAddress == RH_BROADCAST_ADDRESS)
+	return;
+
+    _sendTimeout = (randomTimeout(roundTripTo(_sendAddress)) / 10) * 10;
+    addRetransmissionDelay(_sendBuf, _sendLen, _sendTimeout);
+    if (_sendReply)
+	_sendTimeout += _sendReplyTimeout;
+    activityMillis = millis();
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHReliableDatagram::sendPoll()
+{
+    if (_sendState != RH_RELIABLE_SEND_PENDING)
+	return _sendState;
+    if (_sendListening)
+    {
+	// Backing off from a busy channel, then checking it again
+	if ((long)(millis() - _sendCadAt) >= 0)
+	    sendTry();
+	return _sendState;
+    }
+    if (_sendOnAir)
+    {
+	// The timeout does not include the transmit time
+	if (_driver.mode() == RHGenericDriver::RHModeTx)
+	    return _sendState;
+	_sendOnAir = false;
+	_sendTime = millis();
+	// Never wait for ACKS to broadcasts
+	if (_sendAddress == RH_BROADCAST_ADDRESS)
+	    return _sendState = RH_RELIABLE_SEND_ACKNOWLEDGED;
+    }
+
+    RoundTrip* rtt = roundTripTo(_sendAddress);
+    if (available() && ackReceived(_sendAddress, _sendId, _sendReply, _sendReplyLen, _sendReply != NULL))
+    {
+	// Only a first transmission is timed (Karn's rule), without the time allowed for a reply
+	if (rtt && _sendTries == 1)
+	{
+	    uint32_t roundTrip = millis() - _sendTime;
+	    if (_sendReply)
+		roundTrip = (roundTrip > _sendReplyTimeout) ? roundTrip - _sendReplyTimeout : 0;
+	    measuredRoundTrip(rtt, roundTrip);
+	}
+	return _sendState = RH_RELIABLE_SEND_ACKNOWLEDGED;
+    }
+    if (millis() - _sendTime < _sendTimeout)
+	return _sendState;
+
+    // Timeout exhausted, maybe retry. Until a round trip is measured again each timeout is twice the last
+    if (rtt && rtt->backoff < 3)
+	rtt->backoff++;
+    if (_sendTries > _retries)
+	return _sendState = RH_RELIABLE_SEND_FAILED;
+    sendTry();
+    return _sendState;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::setWindow(uint8_t window)
+{
+    _window = (window < 1) ? 1 : (window > RH_RELIABLE_DEDUP_WINDOW) ? RH_RELIABLE_DEDUP_WINDOW : window;
+}
+
+////////////////////////////////////////////////////////////////////
+uint32_t RHReliableDatagram::sendtoWaitWindow(uint8_t** bufs, const uint8_t* lens, uint8_t count, uint8_t address)
+{
+    if (address == RH_BROADCAST_ADDRESS)
+	return 0;
+    // The receiver says which of the 32 messages before the one it acknowledges arrived
+    if (count > RH_RELIABLE_DEDUP_WINDOW)
+	count = RH_RELIABLE_DEDUP_WINDOW;
+    // Message i is sent with ID firstId + i
+    uint8_t firstId = _lastSequenceNumber + 1;
+    _lastSequenceNumber += count;
+    uint8_t tries[RH_RELIABLE_DEDUP_WINDOW];
+    memset(tries, 0, sizeof(tries));
+    uint32_t acked = 0;
+    uint8_t window = _window;
+    int16_t poll = -1; // The last message of a burst whose ACK was lost
+    RoundTrip* rtt = roundTripTo(address);
+    while (true)
+    {
+	// The next burst: after a lost ACK, the last message again on its own (its ACK says which of the
+	// burst arrived). Otherwise the first messages not yet acknowledged that have tries left
+	uint8_t burst[RH_RELIABLE_DEDUP_WINDOW];
+	uint8_t n = 0;
+	if (poll >= 0 && tries[poll] <= _retries)
+	    burst[n++] = poll;
+	else
+	    for (uint8_t i = 0; i < count && n < window; i++)
+		if (!(acked & (1UL << i)) && tries[i] <= _retries)
+		    burst[n++] = i;
+	if (!n)
+	    break;
+
+	for (uint8_t k = 0; k < n; k++)
 	{
-	    if (waitAvailableTimeout(timeLeft))
+	    uint8_t i = burst[k];
+	    setHeaderId(firstId + i);
+	    // All but the last are not acknowledged on their own
+	    uint8_t headerFlagsToSet = (k + 1 < n) ? RH_FLAGS_WINDOW : RH_FLAGS_NONE;
+	    uint8_t headerFlagsToClear = RH_FLAGS_ACK | RH_FLAGS_REQUEST | ((k + 1 < n) ? RH_FLAGS_NONE : RH_FLAGS_WINDOW);
+	    if (tries[i]++)
 	    {
-		uint8_t from, to, id, flags;
-		if (recvfrom(0, 0, &from, &to, &id, &flags)) // Discards the message
-		{
-		    // Now have a message: is it our ACK?
-		    if (   from == address 
-			   && to == _thisAddress 
-			   && (flags & RH_FLAGS_ACK) 
-			   && (id == thisSequenceNumber))
-		    {
-			// Its the ACK we are waiting for
-			return true;
-		    }
-		    else if (   !(flags & RH_FLAGS_ACK)
-				&& (id == _seenIds[from]))
-		    {
-			// This is a request we have already received. ACK it again
-			acknowledge(id, from);
-		    }
-		    // Else discard it
-		}
+		headerFlagsToSet |= RH_FLAGS_RETRY;
+		_retransmissions++;
 	    }
-	    // Not the one we are waiting for, maybe keep waiting until timeout exhausted
-	    YIELD;
+	    else
+		headerFlagsToClear |= RH_FLAGS_RETRY;
+	    setHeaderFlags(headerFlagsToSet, headerFlagsToClear);
+	    sendto(bufs[i], lens[i], address);
+	    waitPacketSent();
+	}
+	unsigned long thisSendTime = millis();
+	activityMillis = thisSendTime;
+
+	uint8_t last = burst[n - 1];
+	uint8_t ack[5];
+	uint8_t ackLen = sizeof(ack);
+	if (waitAck(address, firstId + last, thisSendTime, randomTimeout(rtt), ack, &ackLen, false))
+	{
+	    // Only a first transmission is timed (Karn's rule)
+	    if (rtt && tries[last] == 1)
+		measuredRoundTrip(rtt, millis() - thisSendTime);
+	    acked |= 1UL << last;
+	    poll = -1;
+	    if (ackLen < sizeof(ack))
+		window = 1; // The receiver does not say which arrived - it acknowledges each message
+	    else
+	    {
+		// Every message sent before this one that arrived - not only this burst's: after a lost ACK the burst is
+		// only known to have arrived from the ACK of the poll, which carries the same list
+		uint32_t received = ack[1] | ((uint32_t)ack[2] << 8) | ((uint32_t)ack[3] << 16) | ((uint32_t)ack[4] << 24);
+		for (uint8_t i = 0; i < last; i++)
+		    if (tries[i] && (received & (1UL << (last - i - 1))))
+			acked |= 1UL << i;
+	    }
+	}
+	else
+	{
+	    poll = last;
+	    if (rtt && rtt->backoff < 3)
+		rtt->backoff++;
 	}
-	// Timeout exhausted, maybe retry
 	YIELD;
     }
-    // Retries exhausted
-    return false;
+    return acked;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -161,10 +429,20 @@ bool RHReliableDatagram::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from,
 	if (!(_flags & RH_FLAGS_ACK))
 	{
 	    // Its a normal message not an ACK
-	    if (_to ==_thisAddress)
+	    if (_to ==_thisAddress && (_flags & RH_FLAGS_REQUEST))
+	    {
+		// Its a request - the reply is the ACK. A new request is answered by the caller with sendReply(),
+		// a retried one that we have already answered is answered again here
+		bool seen = !(RH_ENABLE_EXPLICIT_RETRY_DEDUP && !(_flags & RH_FLAGS_RETRY)) && seenId(_from, _id);
+		if (seen && _replyLen && _replyTo == _from && _replyId == _id)
+		    acknowledgeWithReply(_id, _from, _replyBuf, _replyLen); // Our reply was lost, send it again
+		else if (seen)
+		    acknowledge(_id, _from);
+	    }
+	    else if (_to ==_thisAddress && !(_flags & RH_FLAGS_WINDOW))
 	    {
 	        // Its for this node and
-		// Its not a broadcast, so ACK it
+		// Its not a broadcast, or one of a burst that is acknowledged as a whole, so ACK it
 		// Acknowledge message with ACK set in flags and ID set to received ID
 		acknowledge(_id, _from);
 	    }
@@ -174,13 +452,17 @@ bool RHReliableDatagram::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from,
             // shuts down between transmissions. Devices that do this will report the
             // the same ID each time since their internal sequence number will reset
             // to zero each time the device starts up.
-	    if ((RH_ENABLE_EXPLICIT_RETRY_DEDUP && !(_flags & RH_FLAGS_RETRY)) || _id != _seenIds[_from])
+	    if ((RH_ENABLE_EXPLICIT_RETRY_DEDUP && !(_flags & RH_FLAGS_RETRY)) || !seenId(_from, _id))
 	    {
 		if (from)  *from =  _from;
 		if (to)    *to =    _to;
 		if (id)    *id =    _id;
 		if (flags) *flags = _flags;
-		_seenIds[_from] = _id;
+		recordId(_from, _id, _flags & RH_FLAGS_RETRY);
+		// Only the message just returned can be replied to
+		_requestPending = (_to == _thisAddress) && (_flags & RH_FLAGS_REQUEST);
+		_requestFrom = _from;
+		_requestId = _id;
 		return true;
 	    }
 	    // Else just re-ack it and wait for a new one
@@ -206,6 +488,223 @@ bool RHReliableDatagram::recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t
     return false;
 }
 
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::seenId(uint8_t from, uint8_t id)
+{
+    for (uint8_t i = 0; i < _seenIdsCount; i++)
+    {
+	if (_seenIds[i].address != from)
+	    continue;
+	// How far back from the latest, modulo 256. Ahead of it (back > 128) is new
+	uint8_t back = _seenIds[i].latest - id;
+	return back < RH_RELIABLE_DEDUP_WINDOW && (_seenIds[i].window & (1UL << back));
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+uint32_t RHReliableDatagram::receivedBefore(uint8_t from, uint8_t id)
+{
+    for (uint8_t i = 0; i < _seenIdsCount; i++)
+    {
+	if (_seenIds[i].address != from)
+	    continue;
+	// Bit n of the window is latest - n, so id - n is bit n + back: ahead of the latest, n - ahead
+	uint8_t back = _seenIds[i].latest - id;
+	uint8_t ahead = id - _seenIds[i].latest;
+	if (back < RH_RELIABLE_DEDUP_WINDOW - 1)
+	    return _seenIds[i].window >> (back + 1);
+	if (ahead >= 1 && ahead <= RH_RELIABLE_DEDUP_WINDOW)
+	    return _seenIds[i].window << (ahead - 1);
+	return 0;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::recordId(uint8_t from, uint8_t id, bool retry)
+{
+    bool restarted = RH_ENABLE_EXPLICIT_RETRY_DEDUP && !retry && seenId(from, id);
+    uint8_t i;
+    for (i = 0; i < _seenIdsCount; i++)
+	if (_seenIds[i].address == from)
+	    break;
+    SeenIds seen;
+    if (i < _seenIdsCount)
+	seen = _seenIds[i];
+    else
+    {
+	// Not heard from lately: a free slot, or else the least recently heard
+	if (_seenIdsCount < RH_RELIABLE_DEDUP_SOURCES)
+	    _seenIdsCount++;
+	i = _seenIdsCount - 1;
+	seen.address = from;
+	seen.latest = id;
+	seen.window = 0;
+    }
+    uint8_t back = seen.latest - id;
+    bool behindWindow = back >= RH_RELIABLE_DEDUP_WINDOW && back <= 128;
+    if (restarted || (behindWindow && !retry))
+    {
+	// Already received, or far behind the latest: the sender has restarted its sequence numbers
+	seen.latest = id;
+	seen.window = 1;
+    }
+    else if (behindWindow)
+	; // A retry from before the window: delivered, but the window stays where it is
+    else if (back == 0 || back > 128)
+    {
+	// The latest from this sender: slide the window on
+	uint8_t ahead = id - seen.latest;
+	seen.window = (ahead < RH_RELIABLE_DEDUP_WINDOW) ? seen.window << ahead : 0;
+	seen.latest = id;
+	seen.window |= 1;
+    }
+    else
+	seen.window |= 1UL << back; // Arrived out of order
+    memmove(&_seenIds[1], &_seenIds[0], i * sizeof(SeenIds));
+    _seenIds[0] = seen;
+}
+
+////////////////////////////////////////////////////////////////////
+RHReliableDatagram::RoundTrip* RHReliableDatagram::roundTripTo(uint8_t address)
+{
+    if (!RH_RELIABLE_RTT_PEERS)
+	return NULL;
+    uint8_t i;
+    for (i = 0; i < _roundTripCount; i++)
+	if (_roundTrips[i].address == address)
+	    break;
+    RoundTrip found;
+    if (i < _roundTripCount)
+	found = _roundTrips[i];
+    else
+    {
+	// Not known: a free slot, or else the least recently used
+	if (_roundTripCount < RH_RELIABLE_RTT_PEERS)
+	    _roundTripCount++;
+	i = _roundTripCount - 1;
+	found.address = address;
+	found.backoff = 0;
+	found.srtt8 = 0;
+	found.rttvar4 = 0;
+    }
+    memmove(&_roundTrips[1], &_roundTrips[0], i * sizeof(RoundTrip));
+    _roundTrips[0] = found;
+    return &_roundTrips[0];
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHReliableDatagram::timeoutFor(const RoundTrip* rtt)
+{
+    // The smoothed round trip plus four mean deviations, or the configured timeout until one is measured
+    uint32_t base = (rtt && rtt->srtt8) ? (rtt->srtt8 >> 3) + rtt->rttvar4 : _timeout;
+    if (base < _minTimeout)
+	base = _minTimeout;
+    uint32_t timeout = rtt ? base << rtt->backoff : base;
+    if (timeout > RH_MAX_TIMEOUT)
+	timeout = (base > RH_MAX_TIMEOUT) ? base : RH_MAX_TIMEOUT;
+    return timeout;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHReliableDatagram::measuredRoundTrip(RoundTrip* rtt, uint32_t roundTrip)
+{
+    // Held to 8s so the smoothed time fits in 16 bits as eighths
+    int32_t sample = (roundTrip < 1) ? 1 : (roundTrip > 8000) ? 8000 : roundTrip;
+    if (!rtt->srtt8)
+    {
+	// First measurement: the deviation starts at half the round trip
+	rtt->srtt8 = sample << 3;
+	rtt->rttvar4 = sample << 1;
+    }
+    else
+    {
+	// srtt += (sample - srtt) / 8, rttvar += (|sample - srtt| - rttvar) / 4
+	int32_t delta = sample - (rtt->srtt8 >> 3);
+	rtt->srtt8 += delta;
+	if (delta < 0)
+	    delta = -delta;
+	rtt->rttvar4 += delta - (rtt->rttvar4 >> 2);
+    }
+    rtt->backoff = 0;
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHReliableDatagram::randomTimeout(const RoundTrip* rtt)
+{
+    // Random between the timeout to this address and twice it
+    // This is to prevent collisions on every retransmit
+    // if 2 nodes try to transmit at the same time
+    uint16_t rto = timeoutFor(rtt);
+#if (RH_PLATFORM == RH_PLATFORM_RASPI) // use standard library random(), bugs in random(min, max)
+    return rto + (rto * (random() & 0xFF) / 256);
+#else
+    return rto + (rto * random(0, 256) / 256);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::waitAck(uint8_t address, uint8_t ackId, unsigned long sendTime, uint16_t timeout, uint8_t* buf, uint8_t* len, bool reply)
+{
+    int32_t timeLeft;
+    while ((timeLeft = timeout - (millis() - sendTime)) > 0)
+    {
+	if (waitAvailableTimeout(timeLeft) && ackReceived(address, ackId, buf, len, reply))
+	    return true;
+	// Not the one we are waiting for, maybe keep waiting until timeout exhausted
+	YIELD;
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::ackReceived(uint8_t address, uint8_t ackId, uint8_t* buf, uint8_t* len, bool reply)
+{
+    uint8_t from, to, id, flags;
+    // The headers are known before the message is collected, so only our ACK is copied out
+    if (   buf
+	&& headerFrom() == address
+	&& headerTo() == _thisAddress
+	&& (headerFlags() & RH_FLAGS_ACK)
+	&& headerId() == ackId)
+    {
+	if (reply && !(headerFlags() & RH_FLAGS_REQUEST))
+	{
+	    // Plain ACK - the receiver does not reply to requests
+	    *len = 0;
+	    return recvfrom(0, 0);
+	}
+	return recvfrom(buf, len);
+    }
+    if (recvfrom(0, 0, &from, &to, &id, &flags)) // Discards the message
+    {
+	// Now have a message: is it our ACK?
+	if (   from == address 
+	       && to == _thisAddress 
+	       && (flags & RH_FLAGS_ACK) 
+	       && (id == ackId))
+	{
+	    // Its the ACK we are waiting for - its payload was not kept
+	    if (buf)
+		*len = 0;
+	    return true;
+	}
+	else if (   !(flags & (RH_FLAGS_ACK | RH_FLAGS_WINDOW))
+		    && seenId(from, id))
+	{
+	    // This is a message we have already received. ACK it again
+	    if ((flags & RH_FLAGS_REQUEST) && _replyLen && _replyTo == from && _replyId == id)
+		acknowledgeWithReply(id, from, _replyBuf, _replyLen);
+	    else
+		acknowledge(id, from);
+	}
+	// Else discard it
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
 uint32_t RHReliableDatagram::retransmissions()
 {
     return _retransmissions;
@@ -216,17 +715,55 @@ void RHReliableDatagram::resetRetransmissions()
     _retransmissions = 0;
 }
  
+bool RHReliableDatagram::sendReply(uint8_t* buf, uint8_t len)
+{
+    if (!_requestPending)
+	return false;
+    _requestPending = false;
+
+    // Keep it in case the request is retried
+    _replyTo = _requestFrom;
+    _replyId = _requestId;
+    _replyLen = (len <= sizeof(_replyBuf)) ? len : 0;
+    memcpy(_replyBuf, buf, _replyLen);
+
+    acknowledgeWithReply(_requestId, _requestFrom, buf, len);
+    return true;
+}
+
+uint8_t RHReliableDatagram::replyAddress()
+{
+    return _requestPending ? _requestFrom : RH_BROADCAST_ADDRESS;
+}
+
+void RHReliableDatagram::acknowledgeWithReply(uint8_t id, uint8_t to, uint8_t* buf, uint8_t len)
+{
+    setHeaderId(id);
+    setHeaderFlags(RH_FLAGS_ACK | RH_FLAGS_REQUEST, RH_FLAGS_RETRY);
+    // The reply answers the request just received - it goes without listen before talk, as acknowledge()
+    _driver.setCADSkip(true);
+    sendto(buf, len, to);
+    _driver.setCADSkip(false);
+    waitPacketSent();
+}
+
 void RHReliableDatagram::acknowledge(uint8_t id, uint8_t from)
 {
     setHeaderId(id);
-    setHeaderFlags(RH_FLAGS_ACK);
+    setHeaderFlags(RH_FLAGS_ACK, RH_FLAGS_REQUEST);
     // We would prefer to send a zero length ACK,
     // but if an RH_RF22 receives a 0 length message with a CRC error, it will never receive
     // a 0 length message again, until its reset, which makes everything hang :-(
     // So we send an ACK of 1 octet
     // REVISIT: should we send the RSSI for the information of the sender?
-    uint8_t ack = '!';
-    sendto(&ack, sizeof(ack), from); 
+    // Then which of the messages before this one have arrived, for a sender of bursts (see sendtoWaitWindow())
+    uint32_t received = receivedBefore(from, id);
+    uint8_t ack[5] = { '!', (uint8_t)received, (uint8_t)(received >> 8), (uint8_t)(received >> 16), (uint8_t)(received >> 24) };
+    // Without listen before talk: a backoff slot is longer than the sender waits for this ACK, so a deferred ACK
+    // would only be followed by a needless retry on a channel that is already busy
+    _driver.setCADSkip(true);
+    sendto(ack, sizeof(ack), from); 
+    _driver.setCADSkip(false);
     waitPacketSent();
 }
 
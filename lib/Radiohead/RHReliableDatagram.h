@@ -15,6 +15,12 @@
 /// The retry bit in the header FLAGS. This indicates that the payload is a retry for a
 /// previously sent message.
 #define RH_FLAGS_RETRY 0x40
+/// The request bit in the header FLAGS. On a message, the sender will take the receiver's reply as the
+/// acknowledgement (see sendtoWaitReply()). On an ACK, the payload is that reply.
+#define RH_FLAGS_REQUEST 0x20
+/// The window bit in the header FLAGS. The message is one of a burst sent by sendtoWaitWindow() and is not
+/// acknowledged on its own: the last message of the burst is sent without it, and its ACK says which of the others arrived.
+#define RH_FLAGS_WINDOW 0x10
 
 /// This macro enables enhanced message deduplication behavior. This currently defaults
 /// to 0 (off), but this may change to default to 1 (on) in future releases. Consumers who
@@ -29,12 +35,52 @@
 /// do not support the RETRY header. If you do, deduping of messages will be broken.
 #define RH_ENABLE_EXPLICIT_RETRY_DEDUP 1
 
+/// Number of senders whose recent sequence numbers are kept for duplicate detection. The least recently 
+/// heard is replaced: a retry from a sender no longer kept is taken as new
+#ifndef RH_RELIABLE_DEDUP_SOURCES
+#define RH_RELIABLE_DEDUP_SOURCES 32
+#endif
+
+/// Sequence numbers before a sender's latest that are kept as seen or not (the bits of SeenIds::window)
+#define RH_RELIABLE_DEDUP_WINDOW 32
+
+/// The default number of messages sendtoWaitWindow() sends before waiting for an acknowledgement
+#ifndef RH_RELIABLE_WINDOW
+#define RH_RELIABLE_WINDOW 8
+#endif
+
 /// the default retry timeout in milliseconds
 #define RH_DEFAULT_TIMEOUT 200
 
 /// The default number of retries
 #define RH_DEFAULT_RETRIES 3
 
+/// The default shortest retransmit timeout in milliseconds, however fast acknowledgements come back (see setMinTimeout())
+#define RH_DEFAULT_MIN_TIMEOUT 20
+
+/// The longest retransmit timeout in milliseconds, however slow acknowledgements are or often they are lost
+#ifndef RH_MAX_TIMEOUT
+#define RH_MAX_TIMEOUT 8000
+#endif
+
+/// Number of next hops whose round trip times are kept. The least recently used is replaced. 
+/// 0 always waits the timeout set by setTimeout(), as before v15.16
+#ifndef RH_RELIABLE_RTT_PEERS
+#define RH_RELIABLE_RTT_PEERS 8
+#endif
+
+/// The longest reply kept for answering a retried request. A retried request whose reply was longer
+/// (or has been replaced by a reply to someone else) is acknowledged without the reply.
+#ifndef RH_RELIABLE_MAX_REPLY_LEN
+#define RH_RELIABLE_MAX_REPLY_LEN 64
+#endif
+
+/// Status of the send started by sendtoStart(), returned by sendPoll()
+#define RH_RELIABLE_SEND_IDLE         0 ///< No send started
+#define RH_RELIABLE_SEND_PENDING      1 ///< Backing off from a busy channel, on air or waiting for the ACK
+#define RH_RELIABLE_SEND_ACKNOWLEDGED 2 ///< Acknowledged (or a broadcast, sent)
+#define RH_RELIABLE_SEND_FAILED       3 ///< Not acknowledged after all the retries
+
 /////////////////////////////////////////////////////////////////////
 /// \class RHReliableDatagram RHReliableDatagram.h <RHReliableDatagram.h>
 /// \brief RHDatagram subclass for sending addressed, acknowledged, retransmitted datagrams.
@@ -51,6 +97,13 @@
 /// You can use RHReliableDatagram to send broadcast messages, with a TO address of RH_BROADCAST_ADDRESS,
 /// however broadcasts are not acknowledged or retransmitted and are therefore NOT actually reliable.
 ///
+/// The retransmit timeout adapts to each address sent to, as TCP's does: the round trip time (from the end 
+/// of the transmission to the acknowledgement) is smoothed, and the timeout is the smoothed round trip 
+/// plus four times its mean deviation - so fast links stop waiting soon after a loss and slow or variable 
+/// ones do not retransmit before the acknowledgement could come. Only acknowledgements of a first 
+/// transmission are measured (Karn's rule: an acknowledgement of a retried message could be for either). 
+/// Each timeout doubles the timeout to that address until a round trip is measured again. The timeout 
+/// set by setTimeout() is used until a round trip has been measured, and it is never below setMinTimeout().
 /// The retransmit timeout is randomly varied between timeout and timeout*2 to prevent collisions on all
 /// retries when 2 nodes happen to start sending at the same time .
 ///
@@ -62,6 +115,20 @@
 /// - ID set to the ID of the original message
 /// - FLAGS with the RH_FLAGS_ACK bit set
 /// - 1 octet of payload containing ASCII '!' (since some drivers cannot handle 0 length payloads)
+/// - 4 octets saying which of the 32 messages before it from the same sender have been received: 
+///   bit n-1 (least significant octet first) for the ID n before. Earlier versions sent only the '!'
+///
+/// sendtoWaitWindow() sends a number of messages with up to setWindow() of them in flight: a burst of 
+/// messages is sent back to back, all but the last marked RH_FLAGS_WINDOW so the receiver does not 
+/// acknowledge them (it could not be heard while the sender is transmitting). The ACK of the last says 
+/// which of the burst arrived, and the next burst sends only those that did not, with messages not yet 
+/// sent. Bulk transfers take one round trip per burst instead of one per message.
+///
+/// sendtoStart() sends a message as sendtoWait() does without waiting for it: it returns once the first 
+/// transmission has started, and sendPoll() - called as often as the application can - retransmits on 
+/// timeout and says when the message has been acknowledged or has failed. The application keeps running 
+/// while the message is on air and while its ACK is awaited, and while a try backs off from a busy channel
+/// (with RHGenericDriver::setCADTimeout() each try listens before it talks, as the driver's send() does).
 ///
 /// \par Media Access Strategy
 ///
@@ -107,9 +174,25 @@ public:
     /// Caution: if you are using slow packet rates and long packets 
     /// you may need to change the timeout for reliable operations.
     /// The actual timeout is randomly varied between timeout and timeout*2.
+    /// Only used for an address until a round trip to it has been measured.
     /// \param[in] timeout The new timeout period in milliseconds
     void setTimeout(uint16_t timeout);
 
+    /// Sets the shortest retransmit timeout, however fast the measured round trips are. Should be 
+    /// the time on air of a message and its acknowledgement, plus the time the receiver takes to 
+    /// acknowledge. Defaults to RH_DEFAULT_MIN_TIMEOUT
+    /// \param[in] timeout The shortest timeout in milliseconds
+    void setMinTimeout(uint16_t timeout);
+
+    /// Forgets the round trip times measured, for example when the modem settings change. 
+    /// setTimeout() is used again until new ones have been measured
+    void clearRoundTripTimes();
+
+    /// The retransmit timeout for a first transmission to an address, before its random variation
+    /// \param[in] address The address sent to
+    /// \return The timeout in milliseconds
+    uint16_t retransmitTimeout(uint8_t address);
+
     /// Sets the maximum number of retries. Defaults to 3 at construction time. 
     /// If set to 0, each message will only ever be sent once.
     /// sendtoWait will give up and return false if there is no ack received after all transmissions time out
@@ -134,6 +217,81 @@ public:
     /// \return true if the message was transmitted and an acknowledgement was received.
     bool sendtoWait(uint8_t* buf, uint8_t len, uint8_t address);
 
+    /// Request/response transaction: sends the message (with retries) marked as a request and waits for
+    /// the receiver's reply, which is sent as the acknowledgement. One exchange on air instead of two
+    /// acknowledged messages. Each try waits replyTimeout milliseconds longer than sendtoWait() to
+    /// give the receiver time to prepare the reply.
+    /// A receiver that does not know about requests sends a plain ACK. That still counts as delivery:
+    /// sendtoWaitReply() returns true with *replyLen set to 0 and the reply (if any) will arrive as an
+    /// ordinary message.
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send
+    /// \param[in] address The address to send the message to. Must not be RH_BROADCAST_ADDRESS
+    /// \param[in] reply Location to copy the reply. May be the same as buf.
+    /// \param[in,out] replyLen Pointer to the number of octets available in reply. Set to the number of octets copied, 0 if the ACK carried no reply.
+    /// \param[in] replyTimeout Extra time in milliseconds to wait for the reply on each try
+    /// \return true if the message was transmitted and acknowledged (with or without a reply)
+    bool sendtoWaitReply(uint8_t* buf, uint8_t len, uint8_t address, uint8_t* reply, uint8_t* replyLen, uint16_t replyTimeout);
+
+    /// Sets the number of messages sendtoWaitWindow() sends before waiting for an acknowledgement. 
+    /// Defaults to RH_RELIABLE_WINDOW. 1 is stop and wait, as sendtoWait()
+    /// \param[in] window The largest burst, 1 to RH_RELIABLE_DEDUP_WINDOW messages
+    void setWindow(uint8_t window);
+
+    /// Sends a number of messages to one address with up to setWindow() of them in flight, and waits 
+    /// until each has been acknowledged or has been sent 1 + retries() times. Each burst waits for a single 
+    /// ACK: the receiver's ACK of its last message says which of the others arrived, and only those that 
+    /// did not are sent again (with RH_FLAGS_RETRY). If that ACK is lost, the last message is sent again on 
+    /// its own to find out - its ACK says which of the whole burst arrived. A receiver that does not say which messages arrived (an earlier version - it
+    /// acknowledges every message) is sent the rest one at a time.
+    /// Unlike sendtoWait(), the retransmission octets at the end of application messages are left alone.
+    /// \param[in] bufs Pointers to the messages, in the order they are to be received
+    /// \param[in] lens Number of octets in each message
+    /// \param[in] count Number of messages. Up to RH_RELIABLE_DEDUP_WINDOW - the receiver only says which of that many arrived
+    /// \param[in] address The address to send the messages to. Must not be RH_BROADCAST_ADDRESS
+    /// \return Bit i set if message i was acknowledged - all count bits if the transfer completed. 0 for a broadcast
+    uint32_t sendtoWaitWindow(uint8_t** bufs, const uint8_t* lens, uint8_t count, uint8_t address);
+
+    /// Starts sending a message as sendtoWait() does, but returns as soon as it is on air (or backing off 
+    /// from a busy channel). Call sendPoll() until it is no longer RH_RELIABLE_SEND_PENDING. The message is 
+    /// not copied: buf must not change until then, and until then only sendPoll() may be used to send or receive.
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send
+    /// \param[in] address The address to send the message to
+    /// \return false if a send is still pending
+    bool sendtoStart(uint8_t* buf, uint8_t len, uint8_t address);
+
+    /// Starts a request/response transaction as sendtoWaitReply() does, but returns as soon as the request 
+    /// is on air (see sendtoStart()). reply and replyLen are set when sendPoll() returns RH_RELIABLE_SEND_ACKNOWLEDGED.
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send
+    /// \param[in] address The address to send the message to. Must not be RH_BROADCAST_ADDRESS
+    /// \param[in] reply Location to copy the reply. May be the same as buf.
+    /// \param[in,out] replyLen Pointer to the number of octets available in reply. Set to the number of octets copied, 0 if the ACK carried no reply.
+    /// \param[in] replyTimeout Extra time in milliseconds to wait for the reply on each try
+    /// \return false if a send is still pending
+    bool sendtoStartReply(uint8_t* buf, uint8_t len, uint8_t address, uint8_t* reply, uint8_t* replyLen, uint16_t replyTimeout);
+
+    /// Moves the send started by sendtoStart() on without blocking: checks a busy channel again when its
+    /// backoff has passed, notes the end of the transmission, collects its ACK, and retransmits when the
+    /// retransmit timeout passes. A try the channel stays too busy for counts as a try. Other messages received 
+    /// meanwhile are handled as sendtoWait() handles them.
+    /// \return RH_RELIABLE_SEND_PENDING until the send completes, then RH_RELIABLE_SEND_ACKNOWLEDGED or 
+    /// RH_RELIABLE_SEND_FAILED until the next send is started. RH_RELIABLE_SEND_IDLE if none was started
+    uint8_t sendPoll();
+
+    /// Sends the reply to the last request returned by recvfromAck(). Requests are not acknowledged
+    /// by recvfromAck(): this reply is the acknowledgement, so send it before the requester times out.
+    /// The reply is kept (up to RH_RELIABLE_MAX_REPLY_LEN octets) and sent again if the request is retried.
+    /// \param[in] buf Pointer to the reply
+    /// \param[in] len Number of octets to send
+    /// \return false if there is no request waiting for a reply
+    bool sendReply(uint8_t* buf, uint8_t len);
+
+    /// The address of the node waiting for a reply from sendReply()
+    /// \return The address, or RH_BROADCAST_ADDRESS if no request is waiting for a reply
+    uint8_t replyAddress();
+
     /// If there is a valid message available for this node, send an acknowledgement to the SRC
     /// address (blocking until this is complete), then copy the message to buf and return true
     /// else return false. 
@@ -186,11 +344,87 @@ protected:
     /// Blocks until the ACK has been sent
     void acknowledge(uint8_t id, uint8_t from);
 
+    /// Send a reply as the ACK for the request id to the given address
+    /// Blocks until the reply has been sent
+    void acknowledgeWithReply(uint8_t id, uint8_t to, uint8_t* buf, uint8_t len);
+
     /// Checks whether the message currently in the Rx buffer is a new message, not previously received
     /// based on the from address and the sequence.  If it is new, it is acknowledged and returns true
     /// \return true if there is a message received and it is a new message
     bool haveNewMessage();
 
+    /// Returns whether the message id from an address has been received already - it is within 
+    /// RH_RELIABLE_DEDUP_WINDOW of the latest id from there and was marked as seen
+    /// \param[in] from The sender
+    /// \param[in] id The sequence number of the message
+    bool seenId(uint8_t from, uint8_t id);
+
+    /// Which of the RH_RELIABLE_DEDUP_WINDOW messages before id from an address have been received, 
+    /// as sent in its ACK: bit n-1 set if id-n has
+    uint32_t receivedBefore(uint8_t from, uint8_t id);
+
+    /// Marks the message id from an address as received, moving its window on if it is the latest. 
+    /// A first try with an id already received means the sender has restarted its sequence numbers
+    /// \param[in] from The sender
+    /// \param[in] id The sequence number of the message
+    /// \param[in] retry True if the message is marked RH_FLAGS_RETRY
+    void recordId(uint8_t from, uint8_t id, bool retry);
+
+    /// The sequence numbers recently received from a sender - a sliding window, as IPsec keeps
+    typedef struct
+    {
+	uint32_t     window;    ///< Bit n set if latest - n has been received
+	uint8_t      address;   ///< The sender
+	uint8_t      latest;    ///< Latest sequence number received (modulo 256)
+    } SeenIds;
+
+    /// The round trip times measured to a next hop, kept as TCP does
+    typedef struct
+    {
+	uint8_t      address;   ///< The next hop
+	uint8_t      backoff;   ///< Timeouts since the last round trip was measured, up to 3 - each doubles the timeout
+	uint16_t     srtt8;     ///< Smoothed round trip time in eighths of a millisecond. 0 if none measured
+	uint16_t     rttvar4;   ///< Mean deviation of the round trip time in quarters of a millisecond
+    } RoundTrip;
+
+    /// Returns the round trip times to an address, adding it in place of the least recently used. 
+    /// The one returned is moved to the front. NULL if RH_RELIABLE_RTT_PEERS is 0
+    RoundTrip* roundTripTo(uint8_t address);
+
+    /// The timeout for a transmission to an address, with its backoff
+    uint16_t timeoutFor(const RoundTrip* rtt);
+
+    /// Adds a round trip time measured to an address (RFC 6298) and clears its backoff
+    void measuredRoundTrip(RoundTrip* rtt, uint32_t roundTrip);
+
+    /// Waits until timeout milliseconds after sendTime for the ACK of message ackId from address. Messages 
+    /// already received that are sent again meanwhile are acknowledged again, others are discarded.
+    /// \param[in] buf Location to copy the ACK's payload, or NULL to discard it
+    /// \param[in,out] len Pointer to the number of octets available in buf. Set to the number copied
+    /// \param[in] reply True if the message was a request: only a reply is copied, and *len is 0 after a plain ACK
+    /// \return true if the ACK was received
+    bool waitAck(uint8_t address, uint8_t ackId, unsigned long sendTime, uint16_t timeout, uint8_t* buf, uint8_t* len, bool reply);
+
+    /// Collects the message available, as waitAck() does with each message it receives
+    /// \return true if it was the ACK of message ackId from address
+    bool ackReceived(uint8_t address, uint8_t ackId, uint8_t* buf, uint8_t* len, bool reply);
+
+    /// Sets the header flags of a message to send
+    /// \param[in] request true if the reply comes back as the ACK
+    /// \param[in] retry true if this is not the first transmission
+    void setSendFlags(bool request, bool retry);
+
+    /// Adds a retransmission and its timeout to the octets at the end of an RHMesh application message
+    /// (buf[5] is 0), so the receiver knows how long the message was delayed on its way
+    void addRetransmissionDelay(uint8_t* buf, uint8_t len, uint16_t timeout);
+
+    /// Adds a delay in ms that is not a retransmission - the time listen before talk held the message back -
+    /// to the delay octet of an RHMesh application message, as addRetransmissionDelay() adds a timeout
+    void addTransmitDelay(uint8_t* buf, uint8_t len, uint32_t delay);
+
+    /// The retransmit timeout for a transmission, random between the timeout to its address and twice that
+    uint16_t randomTimeout(const RoundTrip* rtt);
+
 private:
     /// Count of retransmissions we have had to send
     uint32_t _retransmissions;
@@ -203,15 +437,59 @@ private:
     /// Defaults to 200
     uint16_t _timeout;
 
+    /// Shortest retransmit timeout (milliseconds)
+    uint16_t _minTimeout;
+
+    /// Round trip times of the next hops sent to, the most recently used first
+    RoundTrip _roundTrips[RH_RELIABLE_RTT_PEERS ? RH_RELIABLE_RTT_PEERS : 1];
+    uint8_t   _roundTripCount;
+
     // Retries (0 means one try only)
     /// Defaults to 3
     uint8_t _retries;
 
-    /// Array of the last seen sequence number indexed by node address that sent it
-    /// It is used for duplicate detection. Duplicated messages are re-acknowledged when received 
-    /// (this is generally due to lost ACKs, causing the sender to retransmit, even though we have already
-    /// received that message)
-    uint8_t _seenIds[256];
+    /// The largest burst sendtoWaitWindow() sends
+    uint8_t _window;
+
+    /// Transmits the send started by sendtoStart() again (or for the first time) once the channel is clear.
+    /// While it is busy the try waits in sendPoll() until _sendCadAt
+    void sendTry();
+
+    /// The send started by sendtoStart()
+    uint8_t       _sendState;       ///< RH_RELIABLE_SEND_*
+    bool          _sendOnAir;       ///< Its transmission has not ended yet
+    uint8_t*      _sendBuf;
+    uint8_t       _sendLen;
+    uint8_t       _sendAddress;
+    uint8_t       _sendId;
+    uint8_t       _sendTries;       ///< Transmissions so far
+    uint8_t*      _sendReply;       ///< NULL if it is not a request
+    uint8_t*      _sendReplyLen;
+    uint16_t      _sendReplyTimeout;
+    uint16_t      _sendTimeout;     ///< Of the last transmission, from its end
+    unsigned long _sendTime;        ///< millis() at the end of the last transmission
+    bool          _sendListening;   ///< The next try is waiting for a clear channel (see RHGenericDriver::pollCAD())
+    unsigned long _sendCadStart;    ///< millis() when the next try was first ready to go
+    unsigned long _sendCadAt;       ///< millis() when the channel is checked again
+    uint8_t       _sendCadExponent; ///< Busy detections of the channel for the next try
+
+    /// The sequence numbers recently received from each sender, the most recently heard first
+    /// They are used for duplicate detection, even when messages arrive out of order through relays. 
+    /// Duplicated messages are re-acknowledged when received (this is generally due to lost ACKs, 
+    /// causing the sender to retransmit, even though we have already received that message)
+    SeenIds _seenIds[RH_RELIABLE_DEDUP_SOURCES];
+    uint8_t _seenIdsCount;
+
+    /// The request waiting for a reply from sendReply()
+    bool _requestPending;
+    uint8_t _requestFrom;
+    uint8_t _requestId;
+
+    /// The last reply sent, kept to answer a retry of its request
+    uint8_t _replyTo;
+    uint8_t _replyId;
+    uint8_t _replyLen;
+    uint8_t _replyBuf[RH_RELIABLE_MAX_REPLY_LEN];
 };
 
 /// @example rf22_reliable_datagram_client.pde
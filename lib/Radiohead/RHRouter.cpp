@@ -13,7 +13,9 @@
 
 #include <RHRouter.h>
 
-RHRouter::RoutedMessage RHRouter::_tmpMessage;
+static_assert(sizeof(RHRouter::RoutedMessage) <= RH_POOL_BUFFER_LEN, "RH_POOL_BUFFER_LEN is shorter than RH_MAX_MESSAGE_LEN");
+
+RHRouter::RoutedMessage* RHRouter::_tmpMessage = NULL;
 
 ////////////////////////////////////////////////////////////////////
 // Constructors
@@ -22,13 +24,19 @@ RHRouter::RHRouter(RHGenericDriver& driver, uint8_t thisAddress)
 {
     _max_hops = RH_DEFAULT_MAX_HOPS;
     _isa_router = true;
+    _routesChanges = 0;
+    _routedResult = RH_ROUTER_ERROR_NONE;
     clearRoutingTable();
+    if (!_tmpMessage)
+	_tmpMessage = (RoutedMessage*)RHMessagePool::take(); // Shared by every router, for as long as the program runs
 }
 
 ////////////////////////////////////////////////////////////////////
 // Public methods
 bool RHRouter::init()
 {
+    if (!_tmpMessage)
+	return false; // RH_POOL_BUFFERS is too few
     bool ret = RHReliableDatagram::init();
     if (ret)
 	_max_hops = RH_DEFAULT_MAX_HOPS;
@@ -49,63 +57,257 @@ void RHRouter::setIsaRouter(bool isa_router)
 ////////////////////////////////////////////////////////////////////
 void RHRouter::addRouteTo(uint8_t dest, uint8_t next_hop, uint8_t state)
 {
-    uint8_t i;
-
     // First look for an existing entry we can update
-    for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
+    uint8_t slot = _routeIndex[indexPosition(dest)];
+    RoutingTableEntry* route;
+    bool added = !slot;
+    if (slot)
     {
-	if (_routes[i].dest == dest)
-	{
-	    _routes[i].dest = dest;
-	    _routes[i].next_hop = next_hop;
-	    _routes[i].state = state;
-	    return;
-	}
+	route = &_routes[slot - 1];
+	unlinkRoute(slot - 1); // To move it to the most recently used end
     }
-
-    // Look for an invalid entry we can use
-    for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
+    else
     {
-	if (_routes[i].state == Invalid)
-	{
-	    _routes[i].dest = dest;
-	    _routes[i].next_hop = next_hop;
-	    _routes[i].state = state;
-	    return;
-	}
+	// Need to make room for a new one
+	if (_routesCount >= RH_ROUTING_TABLE_SIZE)
+	    retireOldestRoute();
+	slot = _routesCount + 1;
+	_routeIndex[indexPosition(dest)] = slot; // Found after retireOldestRoute(), which can move routes in the index
+	route = &_routes[slot - 1];
+	route->uses = 0;
     }
-
-    // Need to make room for a new one
-    retireOldestRoute();
-    // Should be an invalid slot now
-    for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
+    if (added || route->next_hop != next_hop)
     {
-	if (_routes[i].state == Invalid)
-	{
-	    _routes[i].dest = dest;
-	    _routes[i].next_hop = next_hop;
-	    _routes[i].state = state;
-	}
+	// A different path. Its next hop scores as in the other routes through it
+	RoutingTableEntry* link = routeVia(next_hop);
+	route->hops = 1;
+	route->quality = link ? link->quality : RH_ROUTE_QUALITY_INITIAL; // Nothing is known about the link yet
+	route->measured = link && link->measured;
+	_routesChanges++;
     }
+    if (added)
+	_routesCount++;
+    route->dest = dest;
+    route->next_hop = next_hop;
+    route->state = state;
+    route->lastUsed = millis();
+    linkRoute(slot - 1);
 }
 
 ////////////////////////////////////////////////////////////////////
 RHRouter::RoutingTableEntry* RHRouter::getRouteTo(uint8_t dest)
+{
+    uint8_t slot = _routeIndex[indexPosition(dest)];
+    if (slot && _routes[slot - 1].state != Invalid)
+	return &_routes[slot - 1];
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////
+RHRouter::RoutingTableEntry* RHRouter::useRouteTo(uint8_t dest)
+{
+    expireRoutes();
+    RoutingTableEntry* route = getRouteTo(dest);
+    if (route)
+	useRoute(route);
+    return route;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::useRoute(RoutingTableEntry* route)
+{
+    uint8_t index = route - _routes;
+    unlinkRoute(index);
+    if (route->uses < 255)
+	route->uses++;
+    route->lastUsed = millis();
+    linkRoute(index);
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::expireRoutes()
+{
+    if (!RH_ROUTE_EXPIRY_MS)
+	return;
+    // The least recently used of each list goes first, so the first one still fresh ends the search
+    uint32_t now = millis(); // As lastUsed, so the age is right when millis() wraps
+    for (uint8_t list = 0; list < 2; list++)
+	while (   _oldestRoute[list] != RH_ROUTE_NONE
+	       && now - _routes[_oldestRoute[list]].lastUsed > RH_ROUTE_EXPIRY_MS)
+	    deleteRoute(_oldestRoute[list]);
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::linkRoute(uint8_t index)
+{
+    RoutingTableEntry* route = &_routes[index];
+    route->older = _newestRoute[route->uses ? 1 : 0];
+    route->newer = RH_ROUTE_NONE;
+    relinkRoute(index);
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::unlinkRoute(uint8_t index)
+{
+    RoutingTableEntry* route = &_routes[index];
+    uint8_t list = route->uses ? 1 : 0;
+    if (route->older == RH_ROUTE_NONE)
+	_oldestRoute[list] = route->newer;
+    else
+	_routes[route->older].newer = route->newer;
+    if (route->newer == RH_ROUTE_NONE)
+	_newestRoute[list] = route->older;
+    else
+	_routes[route->newer].older = route->older;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::relinkRoute(uint8_t index)
+{
+    RoutingTableEntry* route = &_routes[index];
+    uint8_t list = route->uses ? 1 : 0;
+    if (route->older == RH_ROUTE_NONE)
+	_oldestRoute[list] = index;
+    else
+	_routes[route->older].newer = index;
+    if (route->newer == RH_ROUTE_NONE)
+	_newestRoute[list] = index;
+    else
+	_routes[route->newer].older = index;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::updateRouteQuality(uint8_t dest, bool acknowledged)
+{
+    uint8_t slot = _routeIndex[indexPosition(dest)];
+    if (!slot)
+	return;
+    // The acknowledgement measures the link to the next hop, which all routes through it share.
+    // Moving average over about the last 4 messages
+    RoutingTableEntry* route = &_routes[slot - 1];
+    uint8_t quality = route->quality;
+    if (acknowledged)
+	quality += (255 - quality + 3) / 4;
+    else
+	quality -= (quality + 3) / 4;
+    setLinkQuality(route->next_hop, quality, true);
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHRouter::nextHopQuality(uint8_t next_hop)
+{
+    RoutingTableEntry* link = routeVia(next_hop);
+    return link ? link->quality : 0;
+}
+
+////////////////////////////////////////////////////////////////////
+RHRouter::RoutingTableEntry* RHRouter::routeVia(uint8_t next_hop)
 {
     uint8_t i;
-    for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
-	if (_routes[i].dest == dest && _routes[i].state != Invalid)
+    for (i = 0; i < _routesCount; i++)
+	if (_routes[i].next_hop == next_hop)
 	    return &_routes[i];
     return NULL;
 }
 
+////////////////////////////////////////////////////////////////////
+void RHRouter::setLinkQuality(uint8_t next_hop, uint8_t quality, bool measured)
+{
+    uint8_t i;
+    for (i = 0; i < _routesCount; i++)
+	if (_routes[i].next_hop == next_hop)
+	{
+	    _routes[i].quality = quality;
+	    _routes[i].measured = measured;
+	}
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHRouter::offerRoute(uint8_t dest, uint8_t next_hop, uint8_t hops, uint8_t quality)
+{
+    // A link that has carried messages is scored by their acknowledgements
+    RoutingTableEntry* link = routeVia(next_hop);
+    bool measured = link && link->measured;
+    if (measured)
+	quality = link->quality;
+
+    uint8_t slot = _routeIndex[indexPosition(dest)];
+    RoutingTableEntry* route = slot ? &_routes[slot - 1] : NULL;
+    if (   route
+	&& route->next_hop != next_hop
+	&& route->state == Valid
+	&& routeCost(quality, hops) + RH_ROUTE_SWITCH_MARGIN >= routeCost(route->quality, route->hops))
+	return false; // The route held is as good
+
+    addRouteTo(dest, next_hop);
+    _routes[_routeIndex[indexPosition(dest)] - 1].hops = hops;
+    setLinkQuality(next_hop, quality, measured); // The latest estimate, until the link is measured
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHRouter::routeCost(uint8_t quality, uint8_t hops)
+{
+    if (quality < 1)
+	quality = 1;
+    if (hops < 1)
+	hops = 1;
+    return 16 * 255 / quality + (hops - 1) * RH_ROUTE_HOP_COST;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHRouter::linkQuality()
+{
+    int16_t rssi = _driver.lastRssi();
+    if (rssi <= RH_ROUTE_RSSI_FLOOR)
+	return 16;
+    if (rssi >= RH_ROUTE_RSSI_GOOD)
+	return 240;
+    return 16 + (int32_t)(rssi - RH_ROUTE_RSSI_FLOOR) * (240 - 16) / (RH_ROUTE_RSSI_GOOD - RH_ROUTE_RSSI_FLOOR);
+}
+
 ////////////////////////////////////////////////////////////////////
 void RHRouter::deleteRoute(uint8_t index)
 {
-    // Delete a route by copying following routes on top of it
-    memcpy(&_routes[index], &_routes[index+1], 
-	   sizeof(RoutingTableEntry) * (RH_ROUTING_TABLE_SIZE - index - 1));
-    _routes[RH_ROUTING_TABLE_SIZE - 1].state = Invalid;
+    if (index >= _routesCount)
+	return;
+    // Delete a route by moving the last route on top of it
+    unlinkRoute(index);
+    unindexRoute(indexPosition(_routes[index].dest));
+    _routesChanges++;
+    _routesCount--;
+    if (index != _routesCount)
+    {
+	_routes[index] = _routes[_routesCount];
+	_routeIndex[indexPosition(_routes[index].dest)] = index + 1;
+	relinkRoute(index);
+    }
+    _routes[_routesCount].state = Invalid;
+}
+
+////////////////////////////////////////////////////////////////////
+uint16_t RHRouter::indexPosition(uint8_t dest)
+{
+    uint16_t position = dest % RH_ROUTE_INDEX_SIZE;
+    while (_routeIndex[position] && _routes[_routeIndex[position] - 1].dest != dest)
+	position = (position + 1) % RH_ROUTE_INDEX_SIZE;
+    return position;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::unindexRoute(uint16_t position)
+{
+    // A route stays where it is if the empty entry is not between the position it is looked up from and its own
+    uint16_t i = position;
+    while (_routeIndex[i = (i + 1) % RH_ROUTE_INDEX_SIZE])
+    {
+	uint16_t from = _routes[_routeIndex[i] - 1].dest % RH_ROUTE_INDEX_SIZE;
+	if (i > position ? (from > position && from <= i) : (from > position || from <= i))
+	    continue;
+	_routeIndex[position] = _routeIndex[i];
+	position = i;
+    }
+    _routeIndex[position] = 0;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -113,7 +315,7 @@ void RHRouter::printRoutingTable()
 {
 #ifdef RH_HAVE_SERIAL
     uint8_t i;
-    for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
+    for (i = 0; i < _routesCount; i++)
     {
 	Serial.print(i, DEC);
 	Serial.print(" Dest: ");
@@ -121,7 +323,15 @@ void RHRouter::printRoutingTable()
 	Serial.print(" Next Hop: ");
 	Serial.print(_routes[i].next_hop, DEC);
 	Serial.print(" State: ");
-	Serial.println(_routes[i].state, DEC);
+	Serial.print(_routes[i].state, DEC);
+	Serial.print(" Quality: ");
+	Serial.print(_routes[i].quality, DEC);
+	Serial.print(" Uses: ");
+	Serial.print(_routes[i].uses, DEC);
+	Serial.print(" Hops: ");
+	Serial.print(_routes[i].hops, DEC);
+	Serial.print(" Unused for: ");
+	Serial.println(millis() - _routes[i].lastUsed, DEC);
     }
 #endif
 }
@@ -129,23 +339,40 @@ void RHRouter::printRoutingTable()
 ////////////////////////////////////////////////////////////////////
 bool RHRouter::deleteRouteTo(uint8_t dest)
 {
-    uint8_t i;
-    for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
-    {
-	if (_routes[i].dest == dest)
-	{
-	    deleteRoute(i);
-	    return true;
-	}
-    }
-    return false;
+    uint8_t slot = _routeIndex[indexPosition(dest)];
+    if (!slot)
+	return false;
+    deleteRoute(slot - 1);
+    return true;
 }
 
 ////////////////////////////////////////////////////////////////////
 void RHRouter::retireOldestRoute()
 {
-    // We just obliterate the first in the table and clear the last
-    deleteRoute(0);
+    uint8_t count = _routesCount;
+    expireRoutes();
+    if (_routesCount < count)
+	return;
+
+    // Routes never used go first. Otherwise age, in seconds or so, is scaled by 2 - quality/255 
+    // so a route whose next hop stopped acknowledging goes before a good one
+    uint8_t victim = _oldestRoute[0];
+    if (victim == RH_ROUTE_NONE)
+    {
+	uint32_t now = millis();
+	uint32_t worst = 0;
+	uint8_t i = victim = _oldestRoute[1];
+	for (uint8_t n = 0; n < RH_ROUTE_EVICT_CANDIDATES && i != RH_ROUTE_NONE; n++, i = _routes[i].newer)
+	{
+	    uint32_t score = ((now - _routes[i].lastUsed) >> 10) * (510 - _routes[i].quality);
+	    if (score > worst)
+	    {
+		worst = score;
+		victim = i;
+	    }
+	}
+    }
+    deleteRoute(victim);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -154,6 +381,42 @@ void RHRouter::clearRoutingTable()
     uint8_t i;
     for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
 	_routes[i].state = Invalid;
+    memset(_routeIndex, 0, sizeof(_routeIndex));
+    _oldestRoute[0] = _oldestRoute[1] = RH_ROUTE_NONE;
+    _newestRoute[0] = _newestRoute[1] = RH_ROUTE_NONE;
+    _routesCount = 0;
+    _routesChanges++;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHRouter::routeCount()
+{
+    return _routesCount;
+}
+
+////////////////////////////////////////////////////////////////////
+const RHRouter::RoutingTableEntry* RHRouter::routeAt(uint8_t index)
+{
+    return index < _routesCount ? &_routes[index] : NULL;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::restoreRoute(uint8_t dest, uint8_t next_hop, uint8_t hops, uint8_t quality, bool used)
+{
+    addRouteTo(dest, next_hop);
+    uint8_t index = _routeIndex[indexPosition(dest)] - 1;
+    RoutingTableEntry* route = &_routes[index];
+    route->hops = hops;
+    unlinkRoute(index); // Into the list of routes used, if it had been
+    route->uses = used ? 1 : 0;
+    linkRoute(index);
+    setLinkQuality(next_hop, quality, used || route->measured);
+}
+
+////////////////////////////////////////////////////////////////////
+uint32_t RHRouter::routesChanged()
+{
+    return _routesChanges;
 }
 
 
@@ -165,19 +428,157 @@ uint8_t RHRouter::sendtoWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t fl
 ////////////////////////////////////////////////////////////////////
 // Waits for delivery to the next hop (but not for delivery to the final destination)
 uint8_t RHRouter::sendtoFromSourceWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t source, uint8_t flags)
+{
+    return forwardFromSourceWait(buf, len, dest, source, flags, _lastE2ESequenceNumber++);
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHRouter::forwardFromSourceWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t source, uint8_t flags, uint8_t id)
 {
     if (((uint16_t)len + sizeof(RoutedMessageHeader)) > _driver.maxMessageLength())
 	return RH_ROUTER_ERROR_INVALID_LENGTH;
 
     // Construct a RH RouterMessage message
-    _tmpMessage.header.source = source;
-    _tmpMessage.header.dest = dest;
-    _tmpMessage.header.hops = 0;
-    _tmpMessage.header.id = _lastE2ESequenceNumber++;
-    _tmpMessage.header.flags = flags;
-    memcpy(_tmpMessage.data, buf, len);
+    _tmpMessage->header.source = source;
+    _tmpMessage->header.dest = dest;
+    _tmpMessage->header.hops = 0;
+    _tmpMessage->header.id = id;
+    _tmpMessage->header.flags = flags;
+    memmove(_tmpMessage->data, buf, len); // buf may already be there (see messageData())
+
+    return route(_tmpMessage, sizeof(RoutedMessageHeader)+len);
+}
 
-    return route(&_tmpMessage, sizeof(RoutedMessageHeader)+len);
+////////////////////////////////////////////////////////////////////
+// Only a next hop can reply in the acknowledgement - further away the reply is an ordinary routed message
+uint8_t RHRouter::sendtoWaitReply(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags, uint8_t* reply, uint8_t* replyLen, uint8_t* replyFlags, uint16_t replyTimeout)
+{
+    expireRoutes();
+    RoutingTableEntry* route = getRouteTo(dest);
+    if (dest == RH_BROADCAST_ADDRESS || !route || route->next_hop != dest)
+    {
+	*replyLen = 0;
+	return sendtoWait(buf, len, dest, flags);
+    }
+
+    if (((uint16_t)len + sizeof(RoutedMessageHeader)) > _driver.maxMessageLength())
+	return RH_ROUTER_ERROR_INVALID_LENGTH;
+    useRoute(route);
+
+    // Construct a RH RouterMessage message
+    _tmpMessage->header.source = _thisAddress;
+    _tmpMessage->header.dest = dest;
+    _tmpMessage->header.hops = 0;
+    _tmpMessage->header.id = _lastE2ESequenceNumber++;
+    _tmpMessage->header.flags = flags;
+    memmove(_tmpMessage->data, buf, len); // buf may already be there (see messageData())
+
+    // The reply comes back with its RHRouter header
+    bool acknowledged = RHReliableDatagram::sendtoWaitReply((uint8_t*)_tmpMessage, sizeof(RoutedMessageHeader)+len, dest, reply, replyLen, replyTimeout);
+    updateRouteQuality(dest, acknowledged);
+    if (!acknowledged)
+	return RH_ROUTER_ERROR_UNABLE_TO_DELIVER;
+
+    takeReply(reply, replyLen, replyFlags);
+    return RH_ROUTER_ERROR_NONE;
+}
+
+////////////////////////////////////////////////////////////////////
+void RHRouter::takeReply(uint8_t* reply, uint8_t* replyLen, uint8_t* replyFlags)
+{
+    RoutedMessageHeader* header = (RoutedMessageHeader*)reply;
+    if (*replyLen < sizeof(RoutedMessageHeader) || header->dest != _thisAddress)
+	*replyLen = 0; // Delivered, but nothing we can use came back with the acknowledgement
+    else
+    {
+	if (replyFlags) *replyFlags = header->flags;
+	*replyLen -= sizeof(RoutedMessageHeader);
+	memmove(reply, reply + sizeof(RoutedMessageHeader), *replyLen);
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHRouter::sendtoStart(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags)
+{
+    return sendtoStartReply(buf, len, dest, flags, NULL, NULL, NULL, 0);
+}
+
+////////////////////////////////////////////////////////////////////
+// With reply == NULL this is sendtoStart(). As sendtoWaitReply(), only a next hop can reply in the acknowledgement
+uint8_t RHRouter::sendtoStartReply(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags, uint8_t* reply, uint8_t* replyLen, uint8_t* replyFlags, uint16_t replyTimeout)
+{
+    if (_routedResult == RH_ROUTER_SEND_PENDING)
+	return RH_ROUTER_ERROR_BUSY;
+    if (((uint16_t)len + sizeof(RoutedMessageHeader)) > _driver.maxMessageLength())
+	return RH_ROUTER_ERROR_INVALID_LENGTH;
+
+    uint8_t next_hop = RH_BROADCAST_ADDRESS;
+    if (dest != RH_BROADCAST_ADDRESS)
+    {
+	RoutingTableEntry* route = useRouteTo(dest);
+	if (!route)
+	    return RH_ROUTER_ERROR_NO_ROUTE;
+	next_hop = route->next_hop;
+    }
+    if (reply && (dest == RH_BROADCAST_ADDRESS || next_hop != dest))
+    {
+	*replyLen = 0;
+	reply = NULL;
+    }
+
+    // Construct a RH RouterMessage message
+    _tmpMessage->header.source = _thisAddress;
+    _tmpMessage->header.dest = dest;
+    _tmpMessage->header.hops = 0;
+    _tmpMessage->header.id = _lastE2ESequenceNumber++;
+    _tmpMessage->header.flags = flags;
+    memmove(_tmpMessage->data, buf, len); // buf may already be there (see messageData())
+
+    bool started = reply
+	? RHReliableDatagram::sendtoStartReply((uint8_t*)_tmpMessage, sizeof(RoutedMessageHeader)+len, next_hop, reply, replyLen, replyTimeout)
+	: RHReliableDatagram::sendtoStart((uint8_t*)_tmpMessage, sizeof(RoutedMessageHeader)+len, next_hop);
+    if (!started)
+	return RH_ROUTER_ERROR_BUSY;
+    _routedDest = dest;
+    _routedReply = reply;
+    _routedReplyLen = replyLen;
+    _routedReplyFlags = replyFlags;
+    return _routedResult = RH_ROUTER_SEND_PENDING;
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHRouter::sendPoll()
+{
+    if (_routedResult != RH_ROUTER_SEND_PENDING)
+	return _routedResult;
+    uint8_t state = RHReliableDatagram::sendPoll();
+    if (state == RH_RELIABLE_SEND_PENDING)
+	return _routedResult;
+
+    bool acknowledged = (state == RH_RELIABLE_SEND_ACKNOWLEDGED);
+    if (_routedDest != RH_BROADCAST_ADDRESS)
+	updateRouteQuality(_routedDest, acknowledged);
+    if (!acknowledged)
+	return _routedResult = RH_ROUTER_ERROR_UNABLE_TO_DELIVER;
+    if (_routedReply)
+	takeReply(_routedReply, _routedReplyLen, _routedReplyFlags);
+    return _routedResult = RH_ROUTER_ERROR_NONE;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHRouter::sendReply(uint8_t* buf, uint8_t len, uint8_t flags)
+{
+    if (((uint16_t)len + sizeof(RoutedMessageHeader)) > _driver.maxMessageLength())
+	return false;
+
+    _tmpMessage->header.source = _thisAddress;
+    _tmpMessage->header.dest = replyAddress();
+    _tmpMessage->header.hops = 0;
+    _tmpMessage->header.id = _lastE2ESequenceNumber++;
+    _tmpMessage->header.flags = flags;
+    memmove(_tmpMessage->data, buf, len); // buf may already be there (see messageData())
+
+    return RHReliableDatagram::sendReply((uint8_t*)_tmpMessage, sizeof(RoutedMessageHeader)+len);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -187,13 +588,16 @@ uint8_t RHRouter::route(RoutedMessage* message, uint8_t messageLen)
     uint8_t next_hop = RH_BROADCAST_ADDRESS;
     if (message->header.dest != RH_BROADCAST_ADDRESS)
     {
-	RoutingTableEntry* route = getRouteTo(message->header.dest);
+	RoutingTableEntry* route = useRouteTo(message->header.dest);
 	if (!route)
 	    return RH_ROUTER_ERROR_NO_ROUTE;
 	next_hop = route->next_hop;
     }
 
-    if (!RHReliableDatagram::sendtoWait((uint8_t*)message, messageLen, next_hop))
+    bool acknowledged = RHReliableDatagram::sendtoWait((uint8_t*)message, messageLen, next_hop);
+    if (message->header.dest != RH_BROADCAST_ADDRESS)
+	updateRouteQuality(message->header.dest, acknowledged);
+    if (!acknowledged)
 	return RH_ROUTER_ERROR_UNABLE_TO_DELIVER;
 
     return RH_ROUTER_ERROR_NONE;
@@ -211,12 +615,12 @@ void RHRouter::peekAtMessage(RoutedMessage* message, uint8_t messageLen)
 ////////////////////////////////////////////////////////////////////
 bool RHRouter::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags, uint8_t* hops)
 {  
-    uint8_t tmpMessageLen = sizeof(_tmpMessage);
+    uint8_t tmpMessageLen = sizeof(RoutedMessage);
     uint8_t _from;
     uint8_t _to;
     uint8_t _id;
     uint8_t _flags;
-    if (RHReliableDatagram::recvfromAck((uint8_t*)&_tmpMessage, &tmpMessageLen, &_from, &_to, &_id, &_flags))
+    if (RHReliableDatagram::recvfromAck((uint8_t*)_tmpMessage, &tmpMessageLen, &_from, &_to, &_id, &_flags))
     {
 	// Here we simulate networks with limited visibility between nodes
 	// so we can test routing
@@ -275,24 +679,24 @@ bool RHRouter::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t*
 	}
 #endif
 
-	peekAtMessage(&_tmpMessage, tmpMessageLen);
+	peekAtMessage(_tmpMessage, tmpMessageLen);
 	// See if its for us or has to be routed
-	if (_tmpMessage.header.dest == _thisAddress || _tmpMessage.header.dest == RH_BROADCAST_ADDRESS)
+	if (_tmpMessage->header.dest == _thisAddress || _tmpMessage->header.dest == RH_BROADCAST_ADDRESS)
 	{
 	    // Deliver it here
-	    if (source) *source  = _tmpMessage.header.source;
-	    if (dest)   *dest    = _tmpMessage.header.dest;
-	    if (id)     *id      = _tmpMessage.header.id;
-	    if (flags)  *flags   = _tmpMessage.header.flags;
-	    if (hops)   *hops    = _tmpMessage.header.hops;
+	    if (source) *source  = _tmpMessage->header.source;
+	    if (dest)   *dest    = _tmpMessage->header.dest;
+	    if (id)     *id      = _tmpMessage->header.id;
+	    if (flags)  *flags   = _tmpMessage->header.flags;
+	    if (hops)   *hops    = _tmpMessage->header.hops;
 	    uint8_t msgLen = tmpMessageLen - sizeof(RoutedMessageHeader);
 	    if (*len > msgLen)
 		*len = msgLen;
-	    memcpy(buf, _tmpMessage.data, *len);
+	    memmove(buf, _tmpMessage->data, *len);
 	    return true; // Its for you!
 	}
-	else if (   _tmpMessage.header.dest != RH_BROADCAST_ADDRESS
-		 && _tmpMessage.header.hops++ < _max_hops)
+	else if (   _tmpMessage->header.dest != RH_BROADCAST_ADDRESS
+		 && _tmpMessage->header.hops++ < _max_hops)
 	{
 	    // Maybe it has to be routed to the next hop
 	    // REVISIT: if it fails due to no route or unable to deliver to the next hop, 
@@ -300,7 +704,7 @@ bool RHRouter::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t*
 	    
 	    // If we are forwarding packets, do so. Otherwise, drop.
 	    if (_isa_router)
-	        route(&_tmpMessage, tmpMessageLen);
+	        route(_tmpMessage, tmpMessageLen);
 	}
 	// Discard it and maybe wait for another
     }
@@ -8,12 +8,53 @@
 #define RHRouter_h
 
 #include <RHReliableDatagram.h>
+#include <RHMessagePool.h>
 
 // Default max number of hops we will route
 #define RH_DEFAULT_MAX_HOPS 30
 
-// The default size of the routing table we keep
+// The default size of the routing table we keep (at most 255)
+#ifndef RH_ROUTING_TABLE_SIZE
 #define RH_ROUTING_TABLE_SIZE 50
+#endif
+
+// A route not used for this long (ms) is stale and is deleted by expireRoutes(). 0 keeps routes until evicted
+#ifndef RH_ROUTE_EXPIRY_MS
+#define RH_ROUTE_EXPIRY_MS 86400000UL
+#endif
+
+// Least recently used routes retireOldestRoute() weighs by quality when every route has been used
+#ifndef RH_ROUTE_EVICT_CANDIDATES
+#define RH_ROUTE_EVICT_CANDIDATES 4
+#endif
+
+// Slots in the index of the routing table by destination - more than RH_ROUTING_TABLE_SIZE, and the more 
+// there are to spare, the fewer a lookup passes over
+#ifndef RH_ROUTE_INDEX_SIZE
+#define RH_ROUTE_INDEX_SIZE (2 * RH_ROUTING_TABLE_SIZE)
+#endif
+#if RH_ROUTE_INDEX_SIZE <= RH_ROUTING_TABLE_SIZE
+#error "RH_ROUTE_INDEX_SIZE must be more than RH_ROUTING_TABLE_SIZE"
+#endif
+
+// No route - the end of a list of routes (RH_ROUTING_TABLE_SIZE is at most 255)
+#define RH_ROUTE_NONE 0xff
+
+// Quality given to a new route (0 to 255) before any message has been sent over it
+#define RH_ROUTE_QUALITY_INITIAL 128
+
+// RSSI (dBm) of a message at the edge of reception and of one on a link that seldom loses a message - 
+// linkQuality() scores the links between them from 16 to 240
+#define RH_ROUTE_RSSI_FLOOR -120
+#define RH_ROUTE_RSSI_GOOD  -95
+
+// Expected transmissions, in sixteenths, counted for each hop of a route after the first - links this node cannot measure
+#ifndef RH_ROUTE_HOP_COST
+#define RH_ROUTE_HOP_COST 24
+#endif
+
+// A route heard of replaces a working one only if it is expected to take this many sixteenths of a transmission fewer
+#define RH_ROUTE_SWITCH_MARGIN 8
 
 // Error codes
 #define RH_ROUTER_ERROR_NONE              0
@@ -22,6 +63,8 @@
 #define RH_ROUTER_ERROR_TIMEOUT           3
 #define RH_ROUTER_ERROR_NO_REPLY          4
 #define RH_ROUTER_ERROR_UNABLE_TO_DELIVER 5
+#define RH_ROUTER_ERROR_BUSY              6
+#define RH_ROUTER_SEND_PENDING            7
 
 // This size of RH_ROUTER_MAX_MESSAGE_LEN is OK for Arduino Mega, but too big for
 // Duemilanove. Size of 50 works with the sample router programs on Duemilanove.
@@ -92,9 +135,24 @@
 /// You can also use addRouteTo() to change a route and 
 /// deleteRouteTo() to delete a route at run time. Youcan also clear the entire routing table
 ///
-/// The Routing Table has limited capacity for entries (defined by RH_ROUTING_TABLE_SIZE, which is 10)
-/// if more than RH_ROUTING_TABLE_SIZE are added, the oldest (first) one will be removed by calling 
-/// retireOldestRoute()
+/// The Routing Table has limited capacity for entries (defined by RH_ROUTING_TABLE_SIZE, which is 50)
+/// if more than RH_ROUTING_TABLE_SIZE are added, the route least worth keeping will be removed by calling 
+/// retireOldestRoute(). Each route records when it was last used and how often, and is scored by the 
+/// quality of its next hop - the share of recent messages it acknowledged - so a busy route is kept while routes 
+/// overheard in other nodes' route discoveries are evicted. The routes are kept in two lists, those 
+/// used and those only heard of, each from the least to the most recently used, so the choice does 
+/// not depend on how many routes are held. A route unused for RH_ROUTE_EXPIRY_MS is deleted by 
+/// expireRoutes(), which each send calls before it looks up its route.
+///
+/// The quality of a route is that of the link to its next hop (see nextHopQuality()), kept in each route 
+/// through it, so an acknowledgement (or its absence) rescores all the routes through that next hop at once. 
+/// A next hop no route goes through any longer is forgotten. routeCost() turns quality and hop count into the 
+/// expected number of transmissions, and offerRoute() only replaces a route with a cheaper one.
+///
+/// The routes are the first routeCount() entries of the table, in no particular order, found through 
+/// an index hashed by destination address, so getRouteTo(), addRouteTo() and deleteRouteTo() take about 
+/// the same time however many routes are held - a route deleted is replaced by the last one. The index costs 
+/// RH_ROUTE_INDEX_SIZE octets of RAM.
 ///
 /// \par Message Format
 ///
@@ -166,7 +224,14 @@ public:
     {
 	uint8_t      dest;      ///< Destination node address
 	uint8_t      next_hop;  ///< Send via this next hop address
-	uint8_t      state;     ///< State of this route, one of RouteState
+	uint8_t      state : 7; ///< State of this route, one of RouteState
+	uint8_t      measured : 1; ///< Set once the link to next_hop has carried a message, so quality is measured
+	uint8_t      quality;   ///< Quality of the link to next_hop, the same in every route through it (see nextHopQuality())
+	uint8_t      uses;      ///< Messages sent over the route, up to 255 - 0 for a route only overheard
+	uint8_t      hops;      ///< Hops to dest through next_hop, 1 when dest is the next hop
+	uint8_t      older;     ///< Index of the route in the same list used before this one, RH_ROUTE_NONE for the oldest
+	uint8_t      newer;     ///< Index of the route in the same list used after this one, RH_ROUTE_NONE for the newest
+	uint32_t     lastUsed;  ///< millis() when a message was last sent over the route, or it was added or updated
     } RoutingTableEntry;
 
     /// Constructor. 
@@ -195,24 +260,55 @@ public:
     void setMaxHops(uint8_t max_hops);
 
     /// Adds a route to the local routing table, or updates it if already present.
-    /// If there is not enough room the oldest (first) route will be deleted by calling retireOldestRoute().
+    /// If there is not enough room the route least worth keeping will be deleted by calling retireOldestRoute().
+    /// The route becomes the most recently used of its list.
     /// \param [in] dest The destination node address. RH_BROADCAST_ADDRESS is permitted.
     /// \param [in] next_hop The address of the next hop to send messages destined for dest
     /// \param [in] state The satte of the route. Defaults to Valid
     void addRouteTo(uint8_t dest, uint8_t next_hop, uint8_t state = Valid);
 
-    /// Finds and returns a RoutingTableEntry for the given destination node
+    /// Adds a route learned from a route discovery, unless the route held to dest is cheaper (see routeCost()).
+    /// A route through the same next hop is always updated. Unlike addRouteTo(), a working route is kept when 
+    /// the new one is no better.
+    /// \param [in] dest The destination node address
+    /// \param [in] next_hop The address of the next hop to send messages destined for dest
+    /// \param [in] hops Hops to dest through next_hop, 1 when dest is the next hop
+    /// \param [in] quality Estimated quality of the link to next_hop (see linkQuality()). A link that has 
+    ///              carried messages is scored by their acknowledgements instead
+    /// \return true if the route was added or updated
+    bool offerRoute(uint8_t dest, uint8_t next_hop, uint8_t hops, uint8_t quality);
+
+    /// Quality of the link to a next hop, which every route through it shares: the share of recent messages 
+    /// it acknowledged, 0 to 255. Until it has carried a message, the estimate the last route through it 
+    /// came with (see offerRoute()), RH_ROUTE_QUALITY_INITIAL for a route added with addRouteTo(). 
+    /// 0 if no route goes through it. Looks through the routes held
+    /// \param [in] next_hop The address of the next hop
+    uint8_t nextHopQuality(uint8_t next_hop);
+
+    /// Expected number of transmissions, in sixteenths, to deliver a message over a route: 
+    /// 255 / quality for the first hop, as the link's acknowledgements go, and RH_ROUTE_HOP_COST for each further hop
+    /// \param [in] quality Quality of the link to the next hop, 0 to 255
+    /// \param [in] hops Hops to the destination
+    static uint16_t routeCost(uint8_t quality, uint8_t hops);
+
+    /// Finds and returns a RoutingTableEntry for the given destination node.
+    /// Finding a route does not count as using it (see useRouteTo()).
     /// \param [in] dest The desired destination node address.
     /// \return pointer to a RoutingTableEntry for dest
     RoutingTableEntry* getRouteTo(uint8_t dest);
 
+    /// Deletes the routes unused for RH_ROUTE_EXPIRY_MS. Only the least recently used routes are 
+    /// looked at, so this is quick when none has expired
+    void expireRoutes();
+
     /// Deletes from the local routing table any route for the destination node.
     /// \param [in] dest The destination node address
     /// \return true if the route was present
     bool deleteRouteTo(uint8_t dest);
 
-    /// Deletes the oldest (first) route from the 
-    /// local routing table
+    /// Deletes the route least worth keeping from the local routing table: the expired ones if there 
+    /// are any, otherwise the least recently used of the routes never used, otherwise the worst of the 
+    /// RH_ROUTE_EVICT_CANDIDATES least recently used, a poor quality route counting as up to twice as old
     void retireOldestRoute();
 
     /// Clears all entries from the 
@@ -223,6 +319,27 @@ public:
     /// routing table using Serial
     void printRoutingTable();
 
+    /// Number of routes in the local routing table
+    uint8_t routeCount();
+
+    /// Returns the route at a 0 based index, in no particular order - to save the routing table
+    /// \param [in] index The index, less than routeCount()
+    const RoutingTableEntry* routeAt(uint8_t index);
+
+    /// Puts back a route saved before a reset (see routeAt()). Its age starts again, since millis() 
+    /// has restarted, and it counts as used if it had been. Routes restored later count as more recently used
+    /// \param [in] dest The destination node address
+    /// \param [in] next_hop The address of the next hop to send messages destined for dest
+    /// \param [in] hops Hops to dest through next_hop
+    /// \param [in] quality Quality of the link to next_hop when the route was saved (see nextHopQuality())
+    /// \param [in] used true if the route had been looked up
+    void restoreRoute(uint8_t dest, uint8_t next_hop, uint8_t hops, uint8_t quality, bool used);
+
+    /// Changes whenever a route is added, deleted or sent through a different next hop, so a saved 
+    /// copy of the routing table is only written again when it is out of date. Wide enough that
+    /// it does not come back round to the same value between two saves
+    uint32_t routesChanged();
+
     /// Sends a message to the destination node. Initialises the RHRouter message header 
     /// (the SOURCE address is set to the address of this node, HOPS to 0) and calls 
     /// route() which looks up in the routing table the next hop to deliver to and sends the 
@@ -257,6 +374,63 @@ public:
     ///           (usually because it dod not acknowledge due to being off the air or out of range
     uint8_t sendtoFromSourceWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t source, uint8_t flags = 0);
 
+    /// Request/response transaction (see RHReliableDatagram::sendtoWaitReply()). When dest is the next hop
+    /// the message is sent as a request and dest's reply (sent with sendReply()) comes back as the 
+    /// acknowledgement. When dest is further away the message is routed as with sendtoWait() and the 
+    /// reply will arrive as an ordinary message.
+    /// \param [in] buf The application message data
+    /// \param [in] len Number of octets in the application message data. 0 is permitted
+    /// \param [in] dest The destination node address
+    /// \param [in] flags Optional flags delivered end-to-end to the dest address
+    /// \param [in] reply Location to copy the reply (without the RHRouter header). May be the same as buf.
+    /// \param [in,out] replyLen Pointer to the number of octets available in reply. Set to the number of octets copied, 
+    ///                 0 if no reply came back with the acknowledgement.
+    /// \param [out] replyFlags If not NULL, set to the end-to-end flags of the reply
+    /// \param [in] replyTimeout Extra time in milliseconds to wait for the reply on each try
+    /// \return The result code, as for sendtoWait()
+    uint8_t sendtoWaitReply(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags, uint8_t* reply, uint8_t* replyLen, uint8_t* replyFlags, uint16_t replyTimeout);
+
+    /// Replies to the last request returned by recvfromAck() - see RHReliableDatagram::sendReply()
+    /// \param [in] buf The application reply data
+    /// \param [in] len Number of octets in the application reply data
+    /// \param [in] flags Optional flags delivered end-to-end with the reply
+    /// \return false if there is no request waiting for a reply
+    bool sendReply(uint8_t* buf, uint8_t len, uint8_t flags = 0);
+
+    /// Starts sending a message to the destination node as sendtoWait() does, but returns as soon as it is 
+    /// on air to the next hop (see RHReliableDatagram::sendtoStart()). Call sendPoll() until it is no longer 
+    /// RH_ROUTER_SEND_PENDING. The message is copied, but until then only sendPoll() may be used to send or receive.
+    /// Unlike sendtoWait(), the message does not go through route().
+    /// \param [in] buf The application message data
+    /// \param [in] len Number of octets in the application message data. 0 is permitted
+    /// \param [in] dest The destination node address
+    /// \param [in] flags Optional flags delivered end-to-end to the dest address
+    /// \return The result code:
+    ///         - RH_ROUTER_SEND_PENDING The message is on its way to the next hop
+    ///         - RH_ROUTER_ERROR_INVALID_LENGTH The message is too long
+    ///         - RH_ROUTER_ERROR_NO_ROUTE There was no route for dest in the local routing table
+    ///         - RH_ROUTER_ERROR_BUSY A send is still pending
+    uint8_t sendtoStart(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags = 0);
+
+    /// Starts a request/response transaction as sendtoWaitReply() does, but returns as soon as the request is 
+    /// on air (see sendtoStart()). reply, replyLen and replyFlags are set when sendPoll() returns RH_ROUTER_ERROR_NONE.
+    /// \param [in] buf The application message data
+    /// \param [in] len Number of octets in the application message data. 0 is permitted
+    /// \param [in] dest The destination node address
+    /// \param [in] flags Optional flags delivered end-to-end to the dest address
+    /// \param [in] reply Location to copy the reply (without the RHRouter header). May be the same as buf.
+    /// \param [in,out] replyLen Pointer to the number of octets available in reply. Set to the number of octets copied, 
+    ///                 0 if no reply came back with the acknowledgement.
+    /// \param [out] replyFlags If not NULL, set to the end-to-end flags of the reply
+    /// \param [in] replyTimeout Extra time in milliseconds to wait for the reply on each try
+    /// \return The result code, as for sendtoStart()
+    uint8_t sendtoStartReply(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t flags, uint8_t* reply, uint8_t* replyLen, uint8_t* replyFlags, uint16_t replyTimeout);
+
+    /// Moves the send started by sendtoStart() on without blocking (see RHReliableDatagram::sendPoll())
+    /// \return RH_ROUTER_SEND_PENDING until the next hop has acknowledged the message or the retries are 
+    /// exhausted, then RH_ROUTER_ERROR_NONE or RH_ROUTER_ERROR_UNABLE_TO_DELIVER until the next send is started
+    uint8_t sendPoll();
+
     /// Starts the receiver if it is not running already.
     /// If there is a valid message available for this node (or RH_BROADCAST_ADDRESS), 
     /// send an acknowledgement to the last hop
@@ -315,6 +489,43 @@ protected:
     /// \param [in] index The 0 based index of the routing table entry to delete
     void deleteRoute(uint8_t index);
 
+    /// As getRouteTo(), after deleting expired routes (see expireRoutes()), and counts a use of the route 
+    /// found: it becomes the most recently used. Called for each message sent
+    /// \param [in] dest The destination node address
+    /// \return pointer to a RoutingTableEntry for dest, or NULL if there is none
+    RoutingTableEntry* useRouteTo(uint8_t dest);
+
+    /// As sendtoFromSourceWait(), but the message keeps the end-to-end id it was sent with, so nodes 
+    /// can tell copies of a broadcast being passed on from new messages
+    /// \param [in] buf The application message data
+    /// \param [in] len Number of octets in the application message data. 0 is permitted
+    /// \param [in] dest The destination node address
+    /// \param [in] source The (fake) originating node address
+    /// \param [in] flags Optional flags delivered end-to-end to the dest address
+    /// \param [in] id The end-to-end id of the message being passed on
+    /// \return The result code, as for sendtoFromSourceWait()
+    uint8_t forwardFromSourceWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t source, uint8_t flags, uint8_t id);
+
+    /// Records whether the next hop of the route to dest acknowledged a message sent over it, in the 
+    /// quality of that next hop, which every route through it shares
+    /// \param [in] dest The destination node address
+    /// \param [in] acknowledged true if the next hop acknowledged the message
+    void updateRouteQuality(uint8_t dest, bool acknowledged);
+
+    /// Estimated quality (as nextHopQuality()) of the link from the node the last message came from, 
+    /// from the RSSI of that message: 16 at RH_ROUTE_RSSI_FLOOR or below to 240 at RH_ROUTE_RSSI_GOOD or above.
+    /// Virtual so subclasses can use a better measure of the link.
+    virtual uint8_t linkQuality();
+
+    /// Takes the RHRouter header off a reply that came back with an acknowledgement - *replyLen is set to 0 if 
+    /// the reply is not one for this node
+    void takeReply(uint8_t* reply, uint8_t* replyLen, uint8_t* replyFlags);
+
+    /// The data part of the message buffer (RH_ROUTER_MAX_MESSAGE_LEN octets, after the space for the RHRouter header).
+    /// A message built here and passed as buf to sendtoWait() and the rest is sent without being copied, and a message
+    /// received into it with recvfromAck() is left where it is. Anything here is lost when the next message is sent or received
+    uint8_t* messageData() { return _tmpMessage->data; }
+
     /// The last end-to-end sequence number to be used
     /// Defaults to 0
     uint8_t _lastE2ESequenceNumber;
@@ -328,11 +539,56 @@ protected:
 
 private:
 
-    /// Temporary mesage buffer
-    static RoutedMessage _tmpMessage;
+    /// Counts a use of a route and makes it the most recently used
+    void useRoute(RoutingTableEntry* route);
+
+    /// Adds a route at the most recently used end of its list - the routes used or those never used (see uses)
+    void linkRoute(uint8_t index);
+
+    /// Takes a route out of its list
+    void unlinkRoute(uint8_t index);
+
+    /// The first route found through a next hop, NULL if there is none
+    RoutingTableEntry* routeVia(uint8_t next_hop);
+
+    /// Sets the quality of the link to a next hop in every route through it
+    void setLinkQuality(uint8_t next_hop, uint8_t quality, bool measured);
+
+    /// Position in _routeIndex of the route to dest, or of the empty entry it would go in
+    uint16_t indexPosition(uint8_t dest);
+
+    /// Empties an entry of _routeIndex, moving back routes after it that would not be found past an empty entry
+    void unindexRoute(uint16_t position);
 
-    /// Local routing table
+    /// Points the routes next to a route in its list, or the ends of the list, at the route's index
+    void relinkRoute(uint8_t index);
+
+    /// Temporary mesage buffer, from RHMessagePool
+    static RoutedMessage* _tmpMessage;
+
+    /// The send started by sendtoStart(): its result (RH_ROUTER_SEND_PENDING until it completes), destination and reply
+    uint8_t              _routedResult;
+    uint8_t              _routedDest;
+    uint8_t*             _routedReply;
+    uint8_t*             _routedReplyLen;
+    uint8_t*             _routedReplyFlags;
+
+    /// Local routing table, the routes in use are the first _routesCount
     RoutingTableEntry    _routes[RH_ROUTING_TABLE_SIZE];
+
+    /// Number of routes in _routes
+    uint8_t              _routesCount;
+
+    /// Incremented whenever a route is added, deleted or changes its next hop
+    uint32_t             _routesChanges;
+
+    /// Position in _routes + 1 of the routes, 0 for an empty entry. A route is in the first entry, from its 
+    /// destination address modulo RH_ROUTE_INDEX_SIZE on, that is empty or its own
+    uint8_t              _routeIndex[RH_ROUTE_INDEX_SIZE];
+
+    /// Least and most recently used of the routes never used [0] and of those used [1], RH_ROUTE_NONE if there are none
+    uint8_t              _oldestRoute[2];
+    uint8_t              _newestRoute[2];
 };
 
 /// @example rf22_router_client.pde
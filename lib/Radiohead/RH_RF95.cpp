@@ -38,6 +38,7 @@ RH_RF95::RH_RF95(uint8_t slaveSelectPin, uint8_t interruptPin, RHGenericSPI& spi
     _myInterruptIndex = 0xff; // Not allocated yet
     _enableCRC = true;
     _useRFO = false;
+    _lastRxTime = 0;
 }
 
 bool RH_RF95::init()
@@ -193,8 +194,17 @@ void RH_RF95::handleInterrupt()
     {
 	// Packet received, no CRC error
 //	Serial.println("R");
+	_lastRxTime = millis();
 	// Have received a packet
 	uint8_t len = spiRead(RH_RF95_REG_13_RX_NB_BYTES);
+#if (RH_RF95_MAX_MESSAGE_LEN + RH_RF95_HEADER_LEN) < RH_RF95_FIFO_SIZE
+	if (len > sizeof(_buf))
+	{
+	    // Longer than RH_RF95_MAX_MESSAGE_LEN: not a message this build sends. validateRxBuf() drops it
+	    _rxBad++;
+	    len = 0;
+	}
+#endif
 
 	// Reset the fifo read ptr to the beginning of the packet
 	spiWrite(RH_RF95_REG_0D_FIFO_ADDR_PTR, spiRead(RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR));
@@ -488,16 +498,23 @@ void RH_RF95::setModemRegisters(const ModemConfig* config)
 // Returns true if its a valid choice
 bool RH_RF95::setModemConfig(ModemConfigChoice index)
 {
-    if (index > (signed int)(sizeof(MODEM_CONFIG_TABLE) / sizeof(ModemConfig)))
-        return false;
-
     ModemConfig cfg;
-    memcpy_P(&cfg, &MODEM_CONFIG_TABLE[index], sizeof(RH_RF95::ModemConfig));
+    if (!getModemConfig(index, &cfg))
+        return false;
     setModemRegisters(&cfg);
 
     return true;
 }
 
+bool RH_RF95::getModemConfig(ModemConfigChoice index, ModemConfig* config)
+{
+    if (index >= (signed int)(sizeof(MODEM_CONFIG_TABLE) / sizeof(ModemConfig)))
+        return false;
+
+    memcpy_P(config, &MODEM_CONFIG_TABLE[index], sizeof(RH_RF95::ModemConfig));
+    return true;
+}
+
 void RH_RF95::setPreambleLength(uint16_t bytes)
 {
     spiWrite(RH_RF95_REG_20_PREAMBLE_MSB, bytes >> 8);
@@ -575,6 +592,11 @@ int RH_RF95::lastSNR()
     return _lastSNR;
 }
 
+uint32_t RH_RF95::getLastRxTime()
+{
+    return _lastRxTime;
+}
+
  ///////////////////////////////////////////////////
  //
  // additions below by Brian Norman 9th Nov 2018
@@ -657,6 +657,13 @@ public:
     /// \return true if index is a valid choice.
     bool        setModemConfig(ModemConfigChoice index);
 
+    /// Gets the register values of one of the predefined modem configurations, without changing the radio.
+    /// Useful for calculating the time on air of a configuration before selecting it.
+    /// \param[in] index The configuration choice.
+    /// \param[out] config The register values for that choice.
+    /// \return true if index is a valid choice.
+    static bool getModemConfig(ModemConfigChoice index, ModemConfig* config);
+
     /// Tests whether a new message is available from the Driver. 
     /// On most drivers, this will also put the Driver into RHModeRx mode until
     /// a message is actually received by the transport, when it will be returned to RHModeIdle.
@@ -786,6 +793,11 @@ public:
     /// \return SNR of the last received message in dB
     int lastSNR();
 
+    /// Returns the time in millis when the most recent message was received (RxDone), so the time a
+    /// received message has been waiting to be read can be accounted for.
+    /// \return millis() at the RxDone interrupt of the last received message
+    uint32_t getLastRxTime();
+
     /// brian.n.norman@gmail.com 9th Nov 2018
     /// Sets the radio spreading factor.
     /// valid values are 6 through 12.
@@ -898,7 +910,7 @@ private:
     volatile uint8_t    _bufLen;
     
     /// The receiver/transmitter buffer
-    uint8_t             _buf[RH_RF95_MAX_PAYLOAD_LEN];
+    uint8_t             _buf[RH_RF95_MAX_MESSAGE_LEN + RH_RF95_HEADER_LEN];
 
     /// True when there is a valid message in the buffer
     volatile bool       _rxBufValid;
@@ -909,6 +921,9 @@ private:
     /// Last measured SNR, dB
     int8_t              _lastSNR;
 
+    /// millis() when the last message was received
+    volatile uint32_t   _lastRxTime;
+
     /// If true, sends CRCs in every packet and requires a valid CRC in every received packet
     bool                _enableCRC;
 
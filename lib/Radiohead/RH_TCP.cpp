@@ -118,7 +118,9 @@ void RH_TCP::checkForEvents()
     static uint16_t socketBufLen = 0;
 
     // Read at most the amount of space we have left in the buffer
-    ssize_t count = read(_socket, socketBuf + socketBufLen, sizeof(socketBuf) - socketBufLen);
+    ssize_t count = 0;
+    if (socketBufLen < sizeof(socketBuf))
+	count = read(_socket, socketBuf + socketBufLen, sizeof(socketBuf) - socketBufLen);
     if (count < 0)
     {
 	if (errno != EAGAIN)
@@ -127,54 +129,57 @@ void RH_TCP::checkForEvents()
 	    exit(1);
 	}
     }
-    else if (count == 0)
+    else if (count == 0 && socketBufLen < sizeof(socketBuf))
     {
 	// End of file
 	fprintf(stderr,"RH_TCP::checkForEvents unexpected end of file on read\n");
 	exit(1);
     }
     else
-    {
 	socketBufLen += count;
-	while (socketBufLen >= 5)
+
+    // Extract at most one packet: the rest wait in socketBuf until it has been read, as 
+    // its headers are used before the payload is collected
+    while (socketBufLen >= 5 && !_rxBufFull)
+    {
+	RHTcpTypeMessage* message = ((RHTcpTypeMessage*)socketBuf);
+	uint32_t len = ntohl(message->length);
+	uint32_t messageLen = len + sizeof(message->length);
+	if (len > sizeof(socketBuf) - sizeof(message->length))
 	{
-	    RHTcpTypeMessage* message = ((RHTcpTypeMessage*)socketBuf);
-	    uint32_t len = ntohl(message->length);
-	    uint32_t messageLen = len + sizeof(message->length);
-	    if (len > sizeof(socketBuf) - sizeof(message->length))
-	    {
-		// Bogus length
-		fprintf(stderr, "RH_TCP::checkForEvents read ridiculous length: %d. Corrupt message stream? Aborting\n", len);
-		exit(1);
-	    }
-	    if (socketBufLen >= len + sizeof(message->length))
+	    // Bogus length
+	    fprintf(stderr, "RH_TCP::checkForEvents read ridiculous length: %d. Corrupt message stream? Aborting\n", len);
+	    exit(1);
+	}
+	if (socketBufLen >= len + sizeof(message->length))
+	{
+	    // Got at least all of this message
+	    if (message->type == RH_TCP_MESSAGE_TYPE_PACKET && len >= 5)
 	    {
-		// Got at least all of this message
-		if (message->type == RH_TCP_MESSAGE_TYPE_PACKET && len >= 5)
+		// REVISIT: need to check if we are actually receiving?
+		// Its a new packet, extract the headers and payload
+		RHTcpPacket* packet = ((RHTcpPacket*)socketBuf);
+		_rxHeaderTo    = packet->to;
+		_rxHeaderFrom  = packet->from;
+		_rxHeaderId    = packet->id;
+		_rxHeaderFlags = packet->flags;
+		uint32_t payloadLen = len - 5;
+		if (payloadLen <= sizeof(_rxBuf))
 		{
-		    // REVISIT: need to check if we are actually receiving?
-		    // Its a new packet, extract the headers and payload
-		    RHTcpPacket* packet = ((RHTcpPacket*)socketBuf);
-		    _rxHeaderTo    = packet->to;
-		    _rxHeaderFrom  = packet->from;
-		    _rxHeaderId    = packet->id;
-		    _rxHeaderFlags = packet->flags;
-		    uint32_t payloadLen = len - 5;
-		    if (payloadLen <= sizeof(_rxBuf))
-		    {
-			// Enough room in our receiver buffer
-			memcpy(_rxBuf, packet->payload, payloadLen);
-			_rxBufLen = payloadLen;
-			_rxBufFull = true;
-		    }
+		    // Enough room in our receiver buffer
+		    memcpy(_rxBuf, packet->payload, payloadLen);
+		    _rxBufLen = payloadLen;
+		    _rxBufFull = true;
 		}
-		// check for other message types here
-		// Now remove the used message by copying the trailing bytes (maybe start of a new message?)
-		// to the top of the buffer
-		memcpy(socketBuf, socketBuf + messageLen, sizeof(socketBuf) - messageLen);
-		socketBufLen -= messageLen;
 	    }
+	    // check for other message types here
+	    // Now remove the used message by copying the trailing bytes (maybe start of a new message?)
+	    // to the top of the buffer
+	    memmove(socketBuf, socketBuf + messageLen, sizeof(socketBuf) - messageLen);
+	    socketBufLen -= messageLen;
 	}
+	else
+	    break; // Wait for the rest of the message
     }
 }
 
@@ -194,9 +199,12 @@ bool RH_TCP::available()
 {
     if (_socket < 0)
 	return false;
-    checkForEvents();
-    if (_rxBufFull)
+    // Skip packets for other nodes until one for us is waiting
+    while (!_rxBufValid)
     {
+	checkForEvents();
+	if (!_rxBufFull)
+	    break;
 	validateRxBuf();
 	_rxBufFull= false;
     }
@@ -215,26 +223,38 @@ bool RH_TCP::waitAvailableTimeout(uint16_t timeout, uint16_t polldelay)
     int            max_fd;
     fd_set         input;
     int            result;
+    unsigned long  starttime = millis();
 
-    FD_ZERO(&input);
-    FD_SET(_socket, &input);
-    max_fd = _socket + 1;
-
-    if (timeout)
-    {
-	struct timeval timer;
-	// Timeout is in milliseconds
-	timer.tv_sec  = timeout / 1000;
-	timer.tv_usec = (timeout % 1000) * 1000;
-	result = select(max_fd, &input, NULL, NULL, &timer);
-    }
-    else
+    // A packet may already be waiting in the socket buffer, and a readable socket may only
+    // bring packets for other nodes
+    while (!available())
     {
-	result = select(max_fd, &input, NULL, NULL, NULL);
+	FD_ZERO(&input);
+	FD_SET(_socket, &input);
+	max_fd = _socket + 1;
+
+	if (timeout)
+	{
+	    unsigned long elapsed = millis() - starttime;
+	    if (elapsed >= timeout)
+		return false;
+	    struct timeval timer;
+	    // Timeout is in milliseconds
+	    timer.tv_sec  = (timeout - elapsed) / 1000;
+	    timer.tv_usec = ((timeout - elapsed) % 1000) * 1000;
+	    result = select(max_fd, &input, NULL, NULL, &timer);
+	}
+	else
+	{
+	    result = select(max_fd, &input, NULL, NULL, NULL);
+	}
+	if (result < 0)
+	{
+	    fprintf(stderr, "RH_TCP::waitAvailableTimeout: select failed %s\n", strerror(errno));
+	    return false;
+	}
     }
-    if (result < 0)
-	fprintf(stderr, "RH_TCP::waitAvailableTimeout: select failed %s\n", strerror(errno));
-    return result > 0;
+    return true;
 }
 
 bool RH_TCP::recv(uint8_t* buf, uint8_t* len)
@@ -290,14 +310,14 @@ bool RH_TCP::sendPacket(const uint8_t* data, uint8_t len)
     if (_socket < 0)
 	return false;
     RHTcpPacket m;
-    m.length = htonl(len + 4);
+    m.length = htonl(len + 5); // type and the 4 headers - checkForEvents() takes 5 off
     m.type  = RH_TCP_MESSAGE_TYPE_PACKET;
     m.to    = _txHeaderTo;
     m.from  = _txHeaderFrom;
     m.id    = _txHeaderId;
     m.flags = _txHeaderFlags;
     memcpy(m.payload, data, len);
-    ssize_t sent = write(_socket, &m, len + 8);
+    ssize_t sent = write(_socket, &m, len + 9);
     return sent > 0;
 }
 
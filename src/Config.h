@@ -27,6 +27,61 @@
 #define TIME_HIGH_BEFORE_DETECTING 100UL        // Only initiate a detection if the sensor pin is high for TIME_HIGH_BEFORE_DETECTING ms
 #define TRANSMIT_LATENCY 60UL						        // How many seconds do we wait to send a message after the count has changed
 
+/**  Reporting Settings  **/
+#define AGGREGATE_MAX_BUCKETS 8                 // Number of count intervals (buckets) carried in one aggregated report
+#define AGGREGATE_DEFAULT_BUCKET_MINUTES 0      // Bucket length until the gateway sets one (alert code 14) - 0 sends a single snapshot per report
+#define AGGREGATE_MAX_BUCKET_MINUTES 60         // Largest bucket length the gateway can set
+#define REPORT_DEFAULT_DELTA 2                  // Change in the net count from the last report worth a report of its own - set by the gateway (alert code 16)
+#define REPORT_SWING_FACTOR 3                   // A change of this many deltas is reported at once (see ReportPolicy.h)
+
+/**  Report Queue Settings  **/
+#define QUEUE_MAX_REPORTS 12                    // Reports kept until they can be sent again - when full the oldest data report is dropped
+#define QUEUE_RAM_ADDRESS 0                     // Start of the queue in the AB1805's RAM (256 bytes, kept through resets and power cycles)
+
+/**  Route Store Settings  **/
+#define ROUTE_STORE_RAM_ADDRESS 148             // Saved mesh routes in the AB1805's RAM - after the report queue (148 bytes)
+#define ROUTE_STORE_MAX_ROUTES 20               // Routes saved - those used first, then the most recently used
+#define ROUTE_STORE_MAX_AGE_SECONDS 86400UL     // Saved routes older than this are discovered again - as RH_ROUTE_EXPIRY_MS
+#define ROUTE_STORE_REFRESH_SECONDS 3600UL      // Unchanged routes are saved again this often so they stay young enough to restore
+
+/**  Reporting Slot Settings  **/
+#define SLOT_CONTENTION_HUNDREDTHS 200U         // Start of each reporting frame kept for joins and nodes without a slot (see LoRA_Slots.h)
+#define SLOT_CONTENTION_EXCHANGE_HUNDREDTHS 50U // ... a random start in the contention slot leaves this long for the exchange to finish
+#define SLOT_CONTENTION_MAX_BACKOFF 5           // Contention is spread over up to 2^5 frames after repeated attempts with no reply
+#define SLOT_LATE_HUNDREDTHS 5U                 // A slot missed by more than this (the node was busy counting) waits for the next frame
+
+/**  Link Adaptation Settings  **/
+#define ADR_DATA_RATES 8                        // Number of steps in the data rate ladder (see LinkAdaptation.cpp)
+#define ADR_DEFAULT_DATA_RATE 0                 // Bw500Cr45Sf128 - the data rate the gateway always listens on - nodes fall back to it
+#define ADR_SNR_MARGIN_DB 5                     // SNR margin above the demodulation floor that a data rate must keep
+#define ADR_HYSTERESIS_DB 3                     // Extra margin needed before proposing a faster data rate
+#define ADR_MIN_SAMPLES 4                       // Acknowledgements averaged before a different data rate is proposed
+#define ADR_FALLBACK_FAILURES 6                 // Consecutive failed deliveries before falling back to the default data rate
+#define TX_POWER_MAX 23                         // dBm - PA_BOOST maximum - used at startup, after a data rate change and after repeated failures
+#define TX_POWER_MIN 5                          // dBm - lowest power the control loop will use
+#define TX_POWER_SNR_MARGIN_DB 10               // SNR margin above the demodulation floor the gateway should see on our messages
+#define TX_POWER_STEP_DOWN_DB 1                 // Power is lowered slowly - one step per acknowledgement with spare margin
+#define TX_POWER_STEP_UP_DB 3                   // ... and raised quickly - on a thin margin or a failed delivery
+
+/**  Listen Window Settings  **/
+#define LISTEN_SLEEP_WINDOW 1                   // 1 - sleep with the radio in receive until DIO0 or the end of the window, 0 - stay awake and poll (as before v15.3)
+#define LISTEN_TIMEOUT_MS 5000UL                // Longest we wait for the gateway to reply - and the window until the gateway tells us its reply delay
+#define LISTEN_MARGIN_MS 250UL                  // Added to the gateway's reply delay and the time on air of its reply - covers retries and a relay hop
+#define LISTEN_MCU_ACTIVE_UA 6500UL             // Current estimates used to compare listening energy - SAMD21 awake at 48MHz
+#define LISTEN_MCU_SLEEP_UA 50UL                // ... SAMD21 in standby with the RTC and EIC running
+#define LISTEN_RADIO_RX_UA 11500UL              // ... RFM95 in continuous receive
+
+/**  Listen Before Talk Settings  **/
+#define LBT_CAD_TIMEOUT_MS 1000UL               // Shortest a message waits for a clear channel (CAD) - longer at slow rates (see applyChannelAccess()) - 0 transmits without listening first
+#define LBT_MIN_BACKOFF_MS 10UL                 // Shortest backoff slot - the slot is the time on air of a data report at the data rate in use
+
+/**  Acknowledgement Timeout Settings  **/
+#define ACK_TIMEOUT_MARGIN_MS 20UL              // Added to an acknowledgement's time on air for the shortest retransmit timeout - the next hop decrypting, checking the channel and replying
+
+/**  Time Sync Settings  **/
+#define TIME_SYNC_GATEWAY_LATENCY_MS 3UL        // Gateway time stamp to start of transmission - encrypting and loading the FIFO
+#define TIME_SYNC_MAX_ERROR_MS 1000UL           // Clock error corrected when the delivery time is not known (retries past the delay byte's 2.55 seconds)
+
 /******************************************************************************************************/
 /**                                                                                                  **/
 /**                              TIME OF FLIGHT OCCUPANCY SENSOR MODULE                              **/
@@ -72,6 +127,8 @@
 #define TOF_DEFAULT_DETECTIONS_PER_SECOND 15                // Number of detections to make per second when in detection mode on the TOF sensor module (this rate is slower than that of measure mode).
 #define TOF_DEFAULT_DISTANCE_MODE 1                         // Default distance mode for the sensor (0 = short, 1 = medium, 2 = long)
 #define TOF_CALIBRATION_RETRY_DELAY 200                     // Length of time (in ms) to delay if, during calibration, we detect a person and need to try again.
+#define TOF_BASELINE_PROBE_SAMPLES 5                        // Number of samples taken at startup to check the stored baselines before we skip a full calibration.
+#define TOF_BASELINE_PROBE_TOLERANCE 100                    // Largest difference (in mm) between the probe and the stored floor distances for the stored baselines to be reused.
 
                     /**  Table of Optical Centers   ***
                       * 
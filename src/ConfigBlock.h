@@ -0,0 +1,176 @@
+/**
+ * @file ConfigBlock.h
+ * @author Chip McClelland (chip@seeinisghts.com)
+ * @brief Wire format of the configuration block - any set of node settings in one data acknowledgement
+ * @details A data ack longer than DataAckFrame::length carries a configuration block between its fixed fields and the two
+ * retransmission bytes. The block is an id byte followed by items of (tag, length, value) - values are big-endian and the
+ * tag of each setting is the alert code that sets it on its own. The node checks every item before it changes anything, so
+ * a block is applied whole or not at all, then stores the settings with a single write and confirms the block with a
+ * configuration report (LoRA_Frames.h) that echoes each item with the value now in effect. The id is stored with the
+ * settings so a block sent again (the confirmation was lost) is confirmed without being applied twice. Id 0 is reserved -
+ * a new node has applied no block and stores 0 - so the gateway numbers its blocks from 1 and a block with id 0 is never
+ * taken for a repeat.
+ *
+ * This file only depends on the C standard headers so it can also be compiled natively (see tools/).
+ *
+ * @version 0.1
+ * @date 2024-03-04
+ *
+ */
+
+#ifndef __CONFIGBLOCK_H
+#define __CONFIGBLOCK_H
+
+#include <stdint.h>
+#include "Config.h"
+#include "LoRA_Frames.h"
+
+// Settings the gateway can change in a configuration block - (name, tag, bytes, minimum, maximum)
+#define LORA_CONFIG_ITEMS(ITEM)                                                                     \
+    ITEM(zoneMode,                  7,  1,  0,      6)      /* TOF zone mode (see Config.h) */      \
+    ITEM(distanceMode,              8,  1,  0,      2)      /* 0 short, 1 medium, 2 long    */      \
+    ITEM(interferenceBuffer,        9,  2,  0,      4000)   /* Floor interference buffer mm */      \
+    ITEM(occupancyCalibrationLoops, 10, 2,  1,      1000)                                           \
+    ITEM(recalibrate,               11, 0,  0,      0)      /* No value - recalibrates TOF  */      \
+    ITEM(occupancyNet,              12, 2,  -32768, 32767)  /* Overwrites the net count     */      \
+    ITEM(tofDetectionsPerSecond,    13, 1,  1,      100)                                            \
+    ITEM(reportBucketMinutes,       14, 1,  0,      AGGREGATE_MAX_BUCKET_MINUTES)                   \
+    ITEM(reportDelta,               16, 1,  0,      255)
+
+/**
+ * @brief One row of the item table - used to check a block and to print the gateway side of the format
+ */
+struct ConfigItemInfo {
+    const char* name;
+    uint8_t tag;
+    uint8_t length;                                     // Value bytes - 0 for an action
+    int32_t minimum;                                    // Values with a negative minimum are signed
+    int32_t maximum;
+};
+
+#define LORA_CONFIG_TAG(name, tag, bytes, minimum, maximum)     CONFIG_##name = tag,
+#define LORA_CONFIG_TABLE(name, tag, bytes, minimum, maximum)   { #name, tag, bytes, minimum, maximum },
+#define LORA_CONFIG_COUNT(name, tag, bytes, minimum, maximum)   + 1
+#define LORA_CONFIG_BYTES(name, tag, bytes, minimum, maximum)   + 2 + bytes
+
+enum ConfigTag : uint8_t { LORA_CONFIG_ITEMS(LORA_CONFIG_TAG) };
+
+class ConfigBlock {
+public:
+    /**
+     * @brief What the node did with a block - sent back in the configuration report
+     */
+    enum Result : uint8_t {
+        APPLIED = 0,                                    // Every item was applied
+        REPEATED = 1,                                   // Already applied - the items were not applied again
+        UNKNOWN_TAG = 2,                                // failedTag is not a setting this node knows
+        BAD_LENGTH = 3,                                 // failedTag has the wrong number of value bytes
+        OUT_OF_RANGE = 4,                               // failedTag's value is outside the setting's range
+        DUPLICATE_TAG = 5,                              // failedTag is in the block twice
+        TRUNCATED = 6                                   // The block ends part way through an item
+    };
+
+    enum { noId = 0 };                                  // Stored by a node that has applied no block - never sent
+    enum { maxItems = 0 LORA_CONFIG_ITEMS(LORA_CONFIG_COUNT) };
+    enum { maxLength = 1 LORA_CONFIG_ITEMS(LORA_CONFIG_BYTES) };     // The id and every item once
+
+    struct Item {
+        uint8_t tag;
+        int32_t value;
+    };
+
+    static const ConfigItemInfo* items() {
+        static const ConfigItemInfo table[] = { LORA_CONFIG_ITEMS(LORA_CONFIG_TABLE) };
+        return table;
+    }
+
+    static const ConfigItemInfo* find(uint8_t tag) {
+        for (uint8_t i = 0; i < maxItems; i++) {
+            if (items()[i].tag == tag) return &items()[i];
+        }
+        return NULL;
+    }
+
+    /**
+     * @brief Reads the block from p to end and checks every item against the table
+     *
+     * @return APPLIED if every item is valid (item() then holds them, in the order sent) - otherwise the first problem
+     * found, with its tag in failedTag(). A block with no items is valid.
+     */
+    Result parse(const uint8_t* p, const uint8_t* end) {
+        _count = 0;
+        _failedTag = 0;
+        if (p >= end) return TRUNCATED;
+        _id = *p++;
+        while (p < end) {
+            if (end - p < 2) return TRUNCATED;
+            _failedTag = p[0];
+            uint8_t length = p[1];
+            p += 2;
+            const ConfigItemInfo* info = find(_failedTag);
+            if (!info) return UNKNOWN_TAG;
+            if (length != info->length) return BAD_LENGTH;
+            if (end - p < length) return TRUNCATED;
+            for (uint8_t i = 0; i < _count; i++) {
+                if (_item[i].tag == info->tag) return DUPLICATE_TAG;
+            }
+            int32_t value = readValue(p, length, info->minimum < 0);
+            if (value < info->minimum || value > info->maximum) return OUT_OF_RANGE;
+            _item[_count].tag = info->tag;
+            _item[_count].value = value;
+            _count++;
+            p += length;
+        }
+        _failedTag = 0;
+        return APPLIED;
+    }
+
+    /**
+     * @brief Writes one item - used to echo the settings in the configuration report
+     *
+     * @return The number of bytes written - 0 for a tag that is not in the table
+     */
+    static uint8_t writeItem(uint8_t* p, uint8_t tag, int32_t value) {
+        const ConfigItemInfo* info = find(tag);
+        if (!info) return 0;
+        p[0] = tag;
+        p[1] = info->length;
+        if (info->length == 1) p[2] = (uint8_t)value;
+        else if (info->length == 2) framePut<uint16_t>(p + 2, (uint16_t)value);
+        return 2 + info->length;
+    }
+
+    /**
+     * @brief True if this is the block last applied (appliedId) sent again - a new node has applied none (noId)
+     */
+    bool repeatOf(uint8_t appliedId) const { return _id != noId && _id == appliedId; }
+
+    uint8_t id() const { return _id; }
+    uint8_t count() const { return _count; }
+    const Item &item(uint8_t index) const { return _item[index]; }
+    uint8_t failedTag() const { return _failedTag; }
+
+protected:
+    static int32_t readValue(const uint8_t* p, uint8_t length, bool isSigned) {
+        if (length == 1) return isSigned ? (int32_t)(int8_t)p[0] : (int32_t)p[0];
+        if (length == 2) return isSigned ? (int32_t)frameGet<int16_t>(p) : (int32_t)frameGet<uint16_t>(p);
+        return 0;
+    }
+
+    uint8_t _id = 0;
+    uint8_t _count = 0;
+    uint8_t _failedTag = 0;
+    Item _item[maxItems];
+};
+
+// The longest frames are an aggregated report with every bucket (each count change is at most three bytes as a zigzag
+// varint), a configuration report echoing every setting and a data acknowledgement carrying every setting - each with
+// the two bytes RadioHead uses to track retransmissions. The radio stack's buffers are sized for the longest of them
+// (RH_MAX_MESSAGE_LEN and RH_RF95_MAX_MESSAGE_LEN in platformio.ini - checked in LoRA_Functions.cpp)
+constexpr uint8_t frameLongest(uint8_t a, uint8_t b) { return a > b ? a : b; }
+#define LORA_MAX_AGGREGATE_REPORT_LEN (AggregateReportFrame::length + AGGREGATE_MAX_BUCKETS * 6 + 2)
+#define LORA_MAX_CONFIG_REPORT_LEN (ConfigReportFrame::length + ConfigBlock::maxLength - 1 + 2)
+#define LORA_MAX_DATA_ACK_LEN (DataAckFrame::length + ConfigBlock::maxLength)
+#define LORA_MAX_FRAME_LEN frameLongest(LORA_MAX_AGGREGATE_REPORT_LEN, frameLongest(LORA_MAX_CONFIG_REPORT_LEN, LORA_MAX_DATA_ACK_LEN))
+
+#endif  /* __CONFIGBLOCK_H */
@@ -0,0 +1,119 @@
+#include "LinkAdaptation.h"
+#include "LoRA_Functions.h"
+
+// The data rate ladder - fastest first. Each step trades speed for link budget. Step 0 is ADR_DEFAULT_DATA_RATE.
+static const RH_RF95::ModemConfig dataRates[ADR_DATA_RATES] = {
+    //  1d,     1e,      26
+    { 0x92,   0x74,    0x04},       // 0 - Bw500Cr45Sf128 - default
+    { 0x82,   0x74,    0x04},       // 1 - Bw250Cr45Sf128
+    { 0x72,   0x74,    0x04},       // 2 - Bw125Cr45Sf128
+    { 0x72,   0x84,    0x04},       // 3 - Bw125Cr45Sf256
+    { 0x72,   0x94,    0x04},       // 4 - Bw125Cr45Sf512
+    { 0x72,   0xa4,    0x04},       // 5 - Bw125Cr45Sf1024
+    { 0x72,   0xb4,    0x0c},       // 6 - Bw125Cr45Sf2048 - low data rate optimisation
+    { 0x72,   0xc4,    0x0c}        // 7 - Bw125Cr45Sf4096 - low data rate optimisation
+};
+
+// Halving the bandwidth lowers the noise floor by 3dB so the same signal is received with a 3dB better SNR
+static int16_t bandwidthGainTenths(uint32_t fromHz, uint32_t toHz) {
+    int16_t gain = 0;
+    while (toHz < fromHz) { toHz *= 2; gain += 30; }
+    while (toHz > fromHz) { toHz /= 2; gain -= 30; }
+    return gain;
+}
+
+LinkAdaptation *LinkAdaptation::_instance;
+
+// [static]
+LinkAdaptation &LinkAdaptation::instance() {
+    if (!_instance) {
+        _instance = new LinkAdaptation();
+    }
+    return *_instance;
+}
+
+LinkAdaptation::LinkAdaptation() {
+}
+
+LinkAdaptation::~LinkAdaptation() {
+}
+
+void LinkAdaptation::setup() {
+    if (sysStatus.dataRate >= ADR_DATA_RATES) sysStatus.dataRate = ADR_DEFAULT_DATA_RATE;
+    Log.infoln("Link adaptation starting at data rate %d", sysStatus.dataRate);
+}
+
+// [static]
+const RH_RF95::ModemConfig &LinkAdaptation::modemConfig(uint8_t rate) {
+    return dataRates[(rate < ADR_DATA_RATES) ? rate : ADR_DEFAULT_DATA_RATE];
+}
+
+void LinkAdaptation::deliverySucceeded(int snr) {
+    consecutiveFailures = 0;
+    int16_t snrTenths = snr * 10;
+    if (snrSamples == 0) snrAverage = snrTenths;
+    else snrAverage += (snrTenths - snrAverage) / 4;                    // Smooth out the fading on any one acknowledgement
+    if (snrSamples < 255) snrSamples++;
+    adjustTxPower(snr);
+}
+
+void LinkAdaptation::deliveryFailed() {
+    if (consecutiveFailures < 255) consecutiveFailures++;
+    selectTxPower((consecutiveFailures >= 2) ? TX_POWER_MAX : _txPower + TX_POWER_STEP_UP_DB);	// Back to full power if it happens again
+    if (consecutiveFailures < ADR_FALLBACK_FAILURES || sysStatus.dataRate == ADR_DEFAULT_DATA_RATE) return;
+    Log.infoln("%d failed deliveries at data rate %d - falling back to the default data rate", consecutiveFailures, sysStatus.dataRate);
+    selectDataRate(ADR_DEFAULT_DATA_RATE);
+}
+
+uint8_t LinkAdaptation::proposedDataRate() const {
+    if (snrSamples < ADR_MIN_SAMPLES) return sysStatus.dataRate;
+
+    const RH_RF95::ModemConfig &active = modemConfig(sysStatus.dataRate);
+    uint32_t activeBandwidth = loraModemFromRegisters(active.reg_1d, active.reg_1e, active.reg_26, 8).bandwidthHz;
+
+    for (uint8_t rate = 0; rate < ADR_DATA_RATES; rate++) {            // Fastest first - the first one with enough margin wins
+        LoRaModem modem = loraModemFromRegisters(dataRates[rate].reg_1d, dataRates[rate].reg_1e, dataRates[rate].reg_26, 8);
+        int16_t expectedSnr = snrAverage + bandwidthGainTenths(activeBandwidth, modem.bandwidthHz);
+        int16_t requiredSnr = loraDemodulationFloorTenths(modem.spreadingFactor) + ADR_SNR_MARGIN_DB * 10;
+        if (rate < sysStatus.dataRate) requiredSnr += ADR_HYSTERESIS_DB * 10;
+        if (expectedSnr >= requiredSnr) return rate;
+    }
+    return ADR_DATA_RATES - 1;
+}
+
+bool LinkAdaptation::confirmDataRate(uint8_t rate) {
+    if (rate >= ADR_DATA_RATES) return false;
+    selectDataRate(rate);
+    return true;
+}
+
+void LinkAdaptation::selectDataRate(uint8_t rate) {
+    consecutiveFailures = 0;
+    if (rate == sysStatus.dataRate) return;
+    sysStatus.dataRate = rate;
+    snrSamples = 0;                                                     // SNR seen at the old data rate does not carry over
+    sysData.sysDataChanged = true;
+    LoRA.applyModemConfig(modemConfig(rate));
+    selectTxPower(TX_POWER_MAX);                                        // Start over at full power on the new data rate
+    Log.infoln("Data rate now %d", rate);
+}
+
+void LinkAdaptation::adjustTxPower(int snr) {
+    const RH_RF95::ModemConfig &active = modemConfig(sysStatus.dataRate);
+    uint8_t spreadingFactor = loraModemFromRegisters(active.reg_1d, active.reg_1e, active.reg_26, 8).spreadingFactor;
+
+    // The gateway's acknowledgement went out at full power - ours arrive weaker by the power we are holding back
+    int16_t marginTenths = snr * 10 - (TX_POWER_MAX - _txPower) * 10 - loraDemodulationFloorTenths(spreadingFactor);
+
+    if (marginTenths < TX_POWER_SNR_MARGIN_DB * 10) selectTxPower(_txPower + TX_POWER_STEP_UP_DB);
+    else if (marginTenths >= (TX_POWER_SNR_MARGIN_DB + TX_POWER_STEP_DOWN_DB) * 10) selectTxPower(_txPower - TX_POWER_STEP_DOWN_DB);
+}
+
+void LinkAdaptation::selectTxPower(int power) {
+    if (power > TX_POWER_MAX) power = TX_POWER_MAX;
+    if (power < TX_POWER_MIN) power = TX_POWER_MIN;
+    if (power == _txPower) return;
+    _txPower = power;
+    LoRA.applyTxPower(_txPower);
+    Log.infoln("Transmit power now %ddBm", _txPower);
+}
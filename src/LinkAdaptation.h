@@ -0,0 +1,135 @@
+/**
+ * @file LinkAdaptation.h
+ * @author Chip McClelland (chip@seeinisghts.com)
+ * @brief Adaptive data rate (ADR) and transmit power control for the node's link to the gateway
+ * @details The node averages the SNR of the acknowledgements it receives and works out the fastest step in the data rate
+ * ladder that keeps ADR_SNR_MARGIN_DB above the demodulation floor. That proposal is sent in the status block and the node
+ * only changes data rate once the gateway confirms it (alert code 15). If deliveries keep failing at a confirmed data rate
+ * the node falls back to the default data rate, which the gateway always listens on, so it cannot strand itself.
+ *
+ * Transmit power is controlled the same way. The gateway always transmits at full power, so the SNR of its acknowledgement
+ * less the power we are holding back is what the gateway should see on our messages. Power is lowered one step at a time while
+ * that keeps TX_POWER_SNR_MARGIN_DB and raised quickly when the margin is thin or a delivery fails.
+ * @version 0.1
+ * @date 2024-03-04
+ *
+ */
+
+#ifndef __LINKADAPTATION_H
+#define __LINKADAPTATION_H
+
+#include <arduino.h>
+#include <ArduinoLog.h>
+#include <RH_RF95.h>
+#include "Config.h"
+#include "MyData.h"
+#include "LoRA_Airtime.h"
+
+#define linkControl LinkAdaptation::instance()
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From global application setup you must call (before the radio is set up):
+ * LinkAdaptation::instance().setup();
+ */
+class LinkAdaptation {
+public:
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use LinkAdaptation::instance() to instantiate the singleton.
+     */
+    static LinkAdaptation &instance();
+
+    /**
+     * @brief Perform setup operations; call this from global application setup()
+     *
+     * You typically use linkControl.setup();
+     */
+    void setup();
+
+    /**
+     * @brief A message was delivered to the next hop - snr is the SNR of its acknowledgement in dB
+     */
+    void deliverySucceeded(int snr);
+
+    /**
+     * @brief A message could not be delivered - falls back to the default data rate after ADR_FALLBACK_FAILURES in a row
+     */
+    void deliveryFailed();
+
+    /**
+     * @brief The fastest data rate that keeps the SNR margin - the current data rate until enough acknowledgements are seen
+     */
+    uint8_t proposedDataRate() const;
+
+    /**
+     * @brief The gateway has confirmed a data rate - applies it to the radio and stores it
+     *
+     * @return false if the data rate is not a step in the ladder
+     */
+    bool confirmDataRate(uint8_t rate);
+
+    /**
+     * @brief The transmit power in dBm chosen by the power control loop
+     */
+    uint8_t txPower() const { return _txPower; }
+
+    /**
+     * @brief The radio registers for a step in the data rate ladder
+     */
+    static const RH_RF95::ModemConfig &modemConfig(uint8_t rate);
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use LinkAdaptation::instance() to instantiate the singleton.
+     */
+    LinkAdaptation();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~LinkAdaptation();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    LinkAdaptation(const LinkAdaptation&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    LinkAdaptation& operator=(const LinkAdaptation&) = delete;
+
+    /**
+     * @brief Changes the data rate used by the radio and stores it
+     */
+    void selectDataRate(uint8_t rate);
+
+    /**
+     * @brief Steps the transmit power toward the lowest level that keeps the SNR margin at the gateway
+     */
+    void adjustTxPower(int snr);
+
+    /**
+     * @brief Changes the transmit power - limited to TX_POWER_MIN to TX_POWER_MAX
+     */
+    void selectTxPower(int power);
+
+    int16_t snrAverage = 0;                             // Average acknowledgement SNR in tenths of a dB
+    uint8_t snrSamples = 0;                             // Acknowledgements in the average - reset when the data rate changes
+    uint8_t consecutiveFailures = 0;                    // Failed deliveries since the last success
+    uint8_t _txPower = TX_POWER_MAX;                    // Transmit power in dBm
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static LinkAdaptation *_instance;
+};
+
+#endif  /* __LINKADAPTATION_H */
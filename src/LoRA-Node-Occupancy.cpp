@@ -45,9 +45,33 @@
 // v13 - Node now reports at a frequency set by the gateway - Requires Gateway v22 or later
 // v13 - Node now reports TRNASMIT_LATENCY seconds after the last count change, instead of immediately with a rate limit
 // v14 - Fixed an issue where the node would not reset the occupancy count if it got stuck in state 3 
-
-
-#define CURRENT_FIRMWARE_RELEASE 14
+// v14.1 - TOF baselines are stored in EEPROM and checked with a short probe at startup - full calibration only runs when the probe disagrees
+// v14.2 - Message layouts moved to LoRA_Frames.h - fields are read and written in place in the radio buffer, received lengths are checked
+// v14.3 - Aggregated reports - the gateway can set a bucket length (alert code 14) and the node sends several buckets of counts per report
+// v15 - Data report status and configuration are bit packed - 25 byte report fits in two Speck blocks (was three) - Requires a gateway that decodes the packed report
+// v15.1 - Adaptive data rate - node proposes a data rate from its SNR margin, gateway confirms with alert code 15, falls back to the default if deliveries fail
+// v15.2 - Transmit power control - power is stepped down to keep an SNR margin at the gateway and back up after failed deliveries - reported in the status block
+// v15.3 - Listen window is sized by the gateway's reply delay (in the data ack) - node sleeps with the radio in receive until DIO0 or the end of the window - Requires a gateway that sends its reply delay
+// v15.4 - Reports and join requests are sent as requests - the gateway's reply is the acknowledgement, one exchange per report when the gateway is in range (older gateways still work)
+// v15.5 - Clock is set to the hundredth - gateway time is compensated for time on air, retries and hops, and the clock error is reported in the status block - Requires a gateway that sends hundredths
+// v15.6 - Reports go in a reporting slot assigned by the gateway (data ack) - joins and nodes without a slot contend at the start of each frame
+// v15.7 - Listen before talk - the radio checks the channel (CAD) before each transmission and backs off while it is busy - busy detections and deferral time are logged
+// v15.8 - Reports that cannot be delivered (and buckets that would be merged) are queued in the RTC's RAM with their sequence number and sent again once the gateway replies - Requires a gateway that accepts queued reports
+// v15.9 - Reporting policy - a change in the net count is only reported ahead of the heartbeat when it reaches a delta set by the gateway (alert code 16) - at once for large swings and crossing the occupancy limit
+// v15.10 - Configuration blocks - a data ack can carry any set of settings (tag, length, value) - checked, applied and stored with one write, then confirmed in one configuration report - alert codes 7 to 13 still work
+// v15.11 - Route lookups (every send and forward) and route updates (every route discovery) go through a table indexed by address - the same time however many routes are held
+// v15.12 - Routes record when they were last used, how often and how reliably their next hop acknowledges - a full table evicts overheard routes first, then the least recently used (poor routes sooner) - routes unused for a day expire
+// v15.13 - Route discovery listens on after the first response and keeps the route expected to take the fewest transmissions - from the RSSI of the link, its acknowledgements and the hop count - a route heard of only replaces a worse one
+// v15.14 - Mesh routes are saved in the RTC's RAM after the report queue and restored at startup if less than a day old - a reset or power cycle no longer sets off a route discovery
+// v15.15 - Route discovery requests are passed on once (nodes remember the source and id of recent requests) after a random wait of up to 250mS, and not at all once three neighbours have been heard passing them on - far fewer broadcasts per discovery in a dense mesh
+// v15.16 - The acknowledgement timeout adapts to each next hop - its smoothed round trip time plus four deviations, timed on first tries only and doubled after each timeout - between the acknowledgement's time on air and 8s (it was 120mS after a reset whatever the data rate, 1s or more after a rate change)
+// v15.17 - Duplicate detection keeps a window of the last 32 sequence numbers from each of 32 senders (the RAM of the last-id table it replaces) - retries that arrive after a newer message, out of order through relays, or across the 255 wrap are no longer delivered twice
+// v15.18 - Windowed transfers in RadioHead - sendtoWaitWindow() sends up to 8 messages back to back and waits for one acknowledgement, which says which of them arrived - only the missing ones are sent again (acknowledgements now carry the last 32 ids received, still one cipher block)
+// v15.19 - Reports are sent with a non-blocking send in RadioHead (sendtoStart() then sendPoll() in RHReliableDatagram, RHRouter and RHMesh) - the node keeps sampling the sensor while a report is on air, while its acknowledgement or a route discovery is awaited, between retries and while a busy channel holds it back (sendPoll() runs the listen before talk backoff)
+// v15.20 - The radio stack's message buffers come from RHMessagePool, sized at compile time for the longest frame (RH_MAX_MESSAGE_LEN and RH_RF95_MAX_MESSAGE_LEN in platformio.ini) - RHMesh builds its messages in RHRouter's buffer and RHEncryptedDriver no longer allocates one on the heap, saving 1129 bytes of SRAM (tools/radio_ram_report.cpp)
+
+
+#define CURRENT_FIRMWARE_RELEASE 15
 
 /*
 Wish List:
@@ -68,6 +92,10 @@ Wish List:
 #include "take_measurements.h"
 #include "MyData.h"
 #include "LoRA_Functions.h"
+#include "ReportAggregator.h"
+#include "ReportQueue.h"
+#include "ReportPolicy.h"
+#include "LinkAdaptation.h"
 #include "Config.h"
 
 const uint8_t firmwareRelease = 13;
@@ -85,12 +113,18 @@ void transmitDelayTimerISR();
 void listeningDurationTimerISR();
 void userSwitchISR();
 void sensorISR();
+void wakeUp_RFM95_DIO0();
 void publishStateTransition(void);
+void sampleOccupancy();
+void sampleWhileSending();
 
 // Program Variables
 volatile bool userSwitchDetected = false;		
 volatile bool sensorDetect = false;
 volatile bool pendingReport = false;
+bool sendQueued = false;								// The next transmission is a queued report
+ReportPolicy reportPolicy;								// Which count changes are reported ahead of the heartbeat
+volatile bool rfm95Interrupt = false;					// DIO0 - the radio has received (or sent) a message
 volatile uint8_t IRQ_Reason = 0; 						// 0 - Invalid, 1 - AB1805, 2 - RFM95 DIO0, 3 - RFM95 IRQ, 4 - User Switch, 5 - Sensor
 
 // Device Setup
@@ -116,12 +150,18 @@ void setup()
 	currentData.setup();
 	sysStatus.firmwareRelease = firmwareRelease;
 	measure.setup();
+	aggregator.setup();
+	reportQueue.setup();								// Reports queued before a reset or power cycle are still in the RTC's RAM
+	reportPolicy.reportSent(current.occupancyNet);		// Changes are measured from the count we start with
 	current.batteryState = 1;							// The prevents us from being in a deep sleep loop - need to measure on each reset
 
 	// Need to set up the User Button pressed action here
 	LowPower.attachInterruptWakeup(gpio.I2C_INT, sensorISR, RISING);
 	LowPower.attachInterruptWakeup(gpio.USER_SW, userSwitchISR, FALLING);
-	// LowPower.attachInterruptWakeup(gpio.RFM95_DIO0, wakeUp_RFM95_DIO0, RISING);	// DIO0 is an extra interrupt output from the radio. Could be used for LoRaWAN and/or CAD sleep in the future. 
+	LowPower.attachInterruptWakeup(gpio.RFM95_DIO0, wakeUp_RFM95_DIO0, RISING);	// DIO0 is an extra interrupt output from the radio - wakes us when the gateway's reply arrives
+
+	linkControl.setup();								// Before the radio - it selects the data rate
+	LoRA.whileSending(sampleWhileSending);				// Walkers are still counted while a report is on its way
 
 	// In this section we test for issues and set alert codes as needed
 	if (! LoRA.setup(false)) 	{						// Start the LoRA radio - Node
@@ -164,6 +204,7 @@ void loop()
 		case IDLE_STATE: {														// Unlike most sketches - nodes spend most time in sleep and only transit IDLE once or twice each period
 			if (state != oldState) {
 				publishStateTransition();              							// We will apply the back-offs before sending to ERROR state - so if we are here we will take action
+				LoRA.saveRoutes();												// Sending, relaying and listening may have changed the routes
 			}
 
 			if (current.batteryState == 0) state = LOW_BATTERY;					// Battery level is very low - going to sleep until we get some charge
@@ -172,18 +213,45 @@ void loop()
 
 			time_t currentTime = timeFunctions.getTime();						// Starting time
 
-			if (pendingReport == true) {	// If the current data has changed, set the next wake/report to TRANSMIT_LATENCY seconds from now
-				Log.infoln("Current data has changed - going to transmit in %d seconds", sysStatus.transmitLatencySeconds);
-				sysStatus.nextConnection = currentTime + sysStatus.transmitLatencySeconds;	// Set nextConnection to TRANSMIT_LATENCY from now
+			if (pendingReport == true && aggregator.enabled()) pendingReport = false;	// Counts are carried in the buckets - report when they are full
+
+			if (pendingReport == true) {	// If the current data has changed, the policy decides whether it is reported before the heartbeat
+				ReportPolicy::Urgency urgency = reportPolicy.countChanged(currentTime, current.occupancyNet, sysStatus.reportDelta, sysStatus.reportDelta * REPORT_SWING_FACTOR, PeopleCounter::instance().getLimit(), sysStatus.transmitLatencySeconds);
+				if (urgency == ReportPolicy::NOW) Log.infoln("Net count moved from %d to %d - transmitting now", reportPolicy.lastReported(), current.occupancyNet);
+				else if (urgency == ReportPolicy::AFTER_LATENCY) Log.infoln("Net count moved from %d to %d - going to transmit within %d seconds", reportPolicy.lastReported(), current.occupancyNet, sysStatus.transmitLatencySeconds);
+				else Log.infoln("Net count within %d of the last report - waiting for the heartbeat", sysStatus.reportDelta);
 				pendingReport = false;
 			}
 
-			if (sysStatus.lastConnection < sysStatus.nextConnection && sysStatus.nextConnection - currentTime <= 0){ // if a report is overdue
+			if ((sysStatus.lastConnection < sysStatus.nextConnection && sysStatus.nextConnection - currentTime <= 0) || reportPolicy.changeDue(currentTime)){ // if a report is overdue
+				if (!LoRA.reportSlotDue()) break;	// Keep counting until our reporting slot
 				Log.infoln("Report is overdue - transmitting");
 				state = LoRA_TRANSMISSION_STATE;	// transmit now
 				pendingReport = false;
 				break;
 			} 
+
+			if (aggregator.reportDue()) {
+				if (!LoRA.reportSlotDue()) break;
+				Log.infoln("Aggregation buckets are full - transmitting");
+				state = LoRA_TRANSMISSION_STATE;
+				break;
+			}
+
+			if (sysStatus.alertCodeNode == 0 && LoRA.configReportDue() && LoRA.linkUp()) {	// The gateway is waiting to hear its configuration block was applied
+				if (!LoRA.reportSlotDue()) break;
+				Log.infoln("Configuration block received - transmitting the confirmation");
+				state = LoRA_TRANSMISSION_STATE;
+				break;
+			}
+
+			if (sysStatus.alertCodeNode == 0 && reportQueue.depth() && LoRA.linkUp()) {	// The gateway is replying again - send what we could not
+				if (!LoRA.reportSlotDue()) break;
+				Log.infoln("%d queued reports - transmitting the next one", reportQueue.depth());
+				sendQueued = true;
+				state = LoRA_TRANSMISSION_STATE;
+				break;
+			}
 		} break;
 
 		case ACTIVE_PING: {														// Defined as a state so we could get max sampling rate
@@ -194,16 +262,7 @@ void loop()
 				Log.infoln("Active Ping with occupancyNet of %d. occupancyGross of %d and occupancyState of %d", current.occupancyNet, current.occupancyGross, current.occupancyState);
 			}
 
-			int16_t occupancyBeforeMeasure = current.occupancyNet;
-			
-			measure.loop();	
-
-			int16_t occupancyAfterMeasure = current.occupancyNet;
-
-			if(occupancyBeforeMeasure != occupancyAfterMeasure) {
-				pendingReport = true;
-				Log.infoln("Occupancy changed from %d to %d - setting pending report - state %d", occupancyBeforeMeasure, occupancyAfterMeasure, current.occupancyState);
-			}
+			sampleOccupancy();
 			
 			if (!digitalRead(gpio.I2C_INT) && current.occupancyState != 3) {				// If the pin is LOW, and the occupancyState is not 3 send back to IDLE
 				state = IDLE_STATE;																// ... and go back to IDLE_STATE
@@ -240,27 +299,52 @@ void loop()
 		} break;
 
 		case LoRA_LISTENING_STATE: {															// Timers will take us to transmit and back to idle
-			static unsigned long listeningStarted = 0;
+			static uint32_t listeningStarted = 0;												// RTC milliseconds - millis() stops while we sleep
+			static uint32_t listeningWindow = 0;
+			static uint32_t asleepMillis = 0;
 
 			if (state != oldState) {
-				listeningStarted = millis();
+				listeningStarted = timeFunctions.rtcMillis();
+				listeningWindow = LoRA.replyWindowMillis();										// The gateway tells us how long it takes to reply
+				asleepMillis = 0;
 				randomSeed(sysStatus.lastConnection * sysStatus.nodeNumber);					// Done so we can genrate rando numbers later
 				publishStateTransition();                   									// Publish state transition
+				LoRA.startListening();
 			}
 
+			rfm95Interrupt = false;
+			uint32_t elapsedMillis = timeFunctions.rtcMillis() - listeningStarted;				// Before the reply sets the clock
+
 			if (LoRA_Functions::instance().listenForLoRAMessageNode()) {						// Listen for LoRA signals - could be an acknowledgement or a message to relay to another node
 				if (sysStatus.alertCodeNode != 0) {
 					Log.infoln("Alert code %d - going to error state", sysStatus.alertCodeNode);
 					state = ERROR_STATE;														// Need to resolve alert before listening for others
 				}
-				Log.infoln("Received a message in %lmSec", millis() - listeningStarted);
+				Log.infoln("Received a message in %lmSec", elapsedMillis);
+				LoRA.logListenWindow(true, elapsedMillis, asleepMillis);
+				LoRA.flushRebroadcast();														// Nothing listens again until the next report
 				sysStatusData::instance().sysDataChanged = true;													// We have received a message - need to update the system data
 				state = IDLE_STATE;
 			}
-			else if (millis() - listeningStarted > 5000L) {
-				Log.infoln("Listened for 5 seconds - going back to idle");
+			else if (elapsedMillis >= listeningWindow) {
+				Log.infoln("Listened for %lmSec - going back to idle", elapsedMillis);
+				LoRA.logListenWindow(false, elapsedMillis, asleepMillis);
+				LoRA.replyMissed();																// A report a relay took is sent again
+				LoRA.flushRebroadcast();														// Nothing listens again until the next report
 				state = IDLE_STATE;																// Go back to IDLE state - no response
 			}
+#if LISTEN_SLEEP_WINDOW
+			else if (!rfm95Interrupt) {															// Nothing arrived while we were checking - the radio stays in receive
+				uint32_t windowLeft = listeningWindow - elapsedMillis;
+				uint32_t sleepMillis = LoRA.rebroadcastDueIn(windowLeft);						// ... and wake for a route discovery request we are relaying
+				uint32_t sleepStarted = timeFunctions.rtcMillis();
+				if (sleepMillis) LowPower.sleep(sleepMillis);									// DIO0, the request or the end of the window wakes us
+				uint32_t sleptMillis = timeFunctions.rtcMillis() - sleepStarted;
+				asleepMillis += sleptMillis;
+				LoRA.sleptWhileListening(sleptMillis, rfm95Interrupt);							// A frame left unread is older than millis() says
+				if (sleepMillis < windowLeft && !rfm95Interrupt) LoRA.flushRebroadcast();		// It is due - millis() stopped while we slept, so the manager cannot tell
+			}
+#endif
 
 		} break;
 
@@ -273,7 +357,13 @@ void loop()
 			measure.takeMeasurements();											// Taking measurements now should allow for accurate battery measurements
 			LoRA_Functions::instance().clearBuffer();
 			// Based on Alert code, determine what message to send
-			if (sysStatus.alertCodeNode == 0) result = LoRA_Functions::instance().composeDataReportNode();
+			if (sysStatus.alertCodeNode == 0 && sendQueued) result = LoRA_Functions::instance().composeQueuedReportNode();
+			else if (sysStatus.alertCodeNode == 0 && LoRA.configReportDue() && LoRA.linkUp()) result = LoRA_Functions::instance().composeConfigReportNode();
+			else if (sysStatus.alertCodeNode == 0 && aggregator.enabled()) result = LoRA_Functions::instance().composeAggregateReportNode();
+			else if (sysStatus.alertCodeNode == 0) {
+				reportPolicy.reportSent(current.occupancyNet);					// Undelivered reports are queued - so the gateway will get this count
+				result = LoRA_Functions::instance().composeDataReportNode();
+			}
 			else if (sysStatus.alertCodeNode == 1 || sysStatus.alertCodeNode == 2) result = LoRA_Functions::instance().composeJoinRequesttNode();
 			else {
 				Log.infoln("Alert code = %d",sysStatus.alertCodeNode);
@@ -281,7 +371,20 @@ void loop()
 				break;															// Resolve the alert code in ERROR_STATE
 			}		
 
-			if (result) {
+			if (sendQueued) {
+				sendQueued = false;												// A queued report is not retried here - it stays queued until the gateway replies again
+				if (!result) {
+					state = IDLE_STATE;
+					break;
+				}
+			}
+
+			if (result && LoRA.replyReceived()) {
+				retryCount = 0;													// The gateway's reply was the acknowledgement - nothing to listen for
+				sysStatusData::instance().sysDataChanged = true;
+				state = IDLE_STATE;												// Idle takes us to the error state if the reply set an alert code
+			}
+			else if (result) {
 				retryCount = 0;													// Successful transmission - go listen for response
 				state = LoRA_LISTENING_STATE;
 				sysStatusData::instance().sysDataChanged = true;
@@ -289,6 +392,7 @@ void loop()
 			else if (retryCount >= 3) {
 				Log.infoln("Too many retries - giving up for this period");
 				retryCount = 0;
+				LoRA.queueFailedReport();										// Sent again once the gateway replies
 				if ((timeFunctions.getTime() - sysStatus.lastConnection > 3600UL) && timeFunctions.getTime() > sysStatus.nextConnection) { 	// Device has not connected and it is past due for a connection
 					Log.infoln("Not connecting - power cycle after current cycle");
 					sysStatus.alertCodeNode = 3;							// This will trigger a power cycle reset	
@@ -311,10 +415,14 @@ void loop()
 				publishStateTransition();                   					// Publish state transition
 				variableDelay = random(20000);									// a random delay up to 20 seconds
 				startDelay = millis();
-				Log.infoln("Going to retry in %u seconds", variableDelay/1000UL);
+				if (sysStatus.slotFrameSeconds) Log.infoln("Going to retry in the next reporting slot");
+				else Log.infoln("Going to retry in %u seconds", variableDelay/1000UL);
 			}
 
-			if (millis() >= startDelay + variableDelay) state = LoRA_TRANSMISSION_STATE;
+			if (sysStatus.slotFrameSeconds) {
+				if (LoRA.reportSlotDue()) state = LoRA_TRANSMISSION_STATE;	// Our slot is kept free for us
+			}
+			else if (millis() >= startDelay + variableDelay) state = LoRA_TRANSMISSION_STATE;
 
 		} break;
 
@@ -326,10 +434,12 @@ void loop()
 			switch (sysStatus.alertCodeNode) {
 			case 1:															// Case 1 is an unconfigured node - needs to send join request
 				sysStatus.nodeNumber = 255;
+				if (!LoRA.reportSlotDue()) break;	// Joins go in the contention slot
 				Log.infoln("LoRA Radio initialized as an unconfigured node %i and a uniqueID of %u", sysStatus.nodeNumber, sysStatus.uniqueID);
 				state = LoRA_TRANSMISSION_STATE;							// Sends the alert and clears alert code
 			break;
 			case 2:																// Case 2 is for Time not synced
+				if (!LoRA.reportSlotDue()) break;
 				Log.infoln("Alert 2- Time is not valid going to join again");
 				state = LoRA_TRANSMISSION_STATE;								// Sends the alert and clears alert code
 			break;
@@ -337,6 +447,8 @@ void loop()
 				static unsigned long enteredState = millis();
 				if (millis() - enteredState > 30000L) {
 					Log.infoln("Alert 3 - Resetting device");
+					aggregator.queueBuckets();								// The buckets would be lost - the queue is kept in the RTC's RAM
+					LoRA.saveRoutes();										// ... as are the routes
 					sysStatus.alertCodeNode = 0;							// Need to clear so we don't get in a retry cycle
 					sysData.storeSysData();         // All this is required as we are done trainsiting loop
 					delay(2000);
@@ -409,6 +521,28 @@ void loop()
 				sysStatus.alertCodeNode = 0;
 				state = LoRA_TRANSMISSION_STATE;								// Sends the alert and clears alert code
 			break;
+			case 14: 															// In this state the gateway sets the aggregated report bucket length (minutes) using the alertContext - 0 turns aggregation off
+				if (sysStatus.alertContextNode <= AGGREGATE_MAX_BUCKET_MINUTES) {
+					sysStatus.reportBucketMinutes = sysStatus.alertContextNode;
+					aggregator.restart();
+					Log.infoln("Alert code 14 - Report bucket length now set to %d minutes", sysStatus.reportBucketMinutes);
+				}
+				else Log.infoln("Alert code 14 - Bucket length of %d minutes is too long - ignored", sysStatus.alertContextNode);
+				sysStatus.alertCodeNode = 0;
+				state = LoRA_TRANSMISSION_STATE;								// Sends the alert and clears alert code
+			break;
+			case 15: 															// In this state the gateway confirms the data rate proposed in the status block using the alertContext
+				if (linkControl.confirmDataRate(sysStatus.alertContextNode)) Log.infoln("Alert code 15 - Data rate now set to %d", sysStatus.dataRate);
+				else Log.infoln("Alert code 15 - Data rate %d is not valid - ignored", sysStatus.alertContextNode);
+				sysStatus.alertCodeNode = 0;
+				state = LoRA_TRANSMISSION_STATE;								// Sends the alert and clears alert code
+			break;
+			case 16: 															// In this state the gateway sets the change in the net count worth a report of its own using the alertContext
+				sysStatus.reportDelta = (sysStatus.alertContextNode > 255) ? 255 : sysStatus.alertContextNode;
+				Log.infoln("Alert code 16 - Net count changes of %d or more now reported before the heartbeat", (sysStatus.reportDelta) ? sysStatus.reportDelta : 1);
+				sysStatus.alertCodeNode = 0;
+				state = LoRA_TRANSMISSION_STATE;								// Sends the alert and clears alert code
+			break;
 			default:
 				Log.infoln("Undefined Error State");
 				sysStatus.alertCodeNode = 0;
@@ -436,6 +570,7 @@ void loop()
 	LED.loop();         														// Update the Status LED
 	sysData.loop();
 	currentData.loop();
+	aggregator.loop();
 	LoRA.loop();
 }
 
@@ -461,11 +596,35 @@ void publishStateTransition(void)
 	if (publish) Log.infoln(stateTransitionString);
 }
 
+void sampleOccupancy() {
+	int16_t occupancyBeforeMeasure = current.occupancyNet;
+	
+	measure.loop();	
+
+	int16_t occupancyAfterMeasure = current.occupancyNet;
+
+	if(occupancyBeforeMeasure != occupancyAfterMeasure) {
+		pendingReport = true;
+		Log.infoln("Occupancy changed from %d to %d - setting pending report - state %d", occupancyBeforeMeasure, occupancyAfterMeasure, current.occupancyState);
+	}
+}
+
+void sampleWhileSending() {									// Called while a message is on its way - as Active Ping would while someone is there
+	if (!sensorDetect && !digitalRead(gpio.I2C_INT) && current.occupancyState != 3) return;
+	sensorDetect = false;
+	sampleOccupancy();
+}
+
 void userSwitchISR() {
 	userSwitchDetected = true;
   	IRQ_Reason = IRQ_UserSwitch;
 }
 
+void wakeUp_RFM95_DIO0() {
+	rfm95Interrupt = true;
+	IRQ_Reason = IRQ_RF95_DIO0;
+}
+
 void sensorISR() {	
 	sensorDetect = true;	      // flag that the sensor has detected something
 	IRQ_Reason = IRQ_Sensor;      // and write to IRQ_Reason in order to wake the device up
@@ -0,0 +1,91 @@
+/**
+ * @file LoRA_Airtime.h
+ * @author Chip McClelland (chip@seeinisghts.com)
+ * @brief Time on air for a LoRa packet with the modem settings read back from the radio
+ * @details Follows the Semtech SX1276 datasheet (section 4.1.1.7) / AN1200.13 time on air formula. The modem settings
+ * are decoded from the RFM95 modem configuration registers so the result matches whatever configuration is active.
+ *
+ * This file only depends on the C standard headers so it can also be compiled natively (see tools/).
+ *
+ * @version 0.1
+ * @date 2024-03-04
+ *
+ */
+
+#ifndef __LORA_AIRTIME_H
+#define __LORA_AIRTIME_H
+
+#include <stdint.h>
+
+/**
+ * @brief The modem settings that determine the time on air
+ */
+struct LoRaModem {
+    uint8_t spreadingFactor;                            // 6 to 12
+    uint32_t bandwidthHz;                               // 7800 to 500000
+    uint8_t codingRate;                                 // 5 to 8 for 4/5 to 4/8
+    uint16_t preambleLength;                            // Programmed preamble symbols (the radio adds 4.25)
+    bool lowDataRateOptimize;
+    bool crc;
+    bool implicitHeader;
+};
+
+/**
+ * @brief Decodes the modem settings from RH_RF95_REG_1D_MODEM_CONFIG1, RH_RF95_REG_1E_MODEM_CONFIG2 and RH_RF95_REG_26_MODEM_CONFIG3
+ */
+inline LoRaModem loraModemFromRegisters(uint8_t reg1d, uint8_t reg1e, uint8_t reg26, uint16_t preambleLength) {
+    static const uint32_t bandwidths[10] = {7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000};
+    LoRaModem modem;
+    uint8_t bandwidthIndex = reg1d >> 4;
+    modem.bandwidthHz = bandwidths[(bandwidthIndex < 10) ? bandwidthIndex : 9];
+    modem.codingRate = ((reg1d >> 1) & 0x07) + 4;
+    modem.implicitHeader = reg1d & 0x01;
+    modem.spreadingFactor = reg1e >> 4;
+    modem.crc = reg1e & 0x04;
+    modem.lowDataRateOptimize = reg26 & 0x08;
+    modem.preambleLength = preambleLength;
+    return modem;
+}
+
+/**
+ * @brief Time on air in microseconds for a LoRa payload of payloadLength bytes (everything handed to the radio's FIFO)
+ */
+inline uint32_t loraAirtimeMicros(const LoRaModem &modem, uint8_t payloadLength) {
+    int32_t sf = modem.spreadingFactor;
+    int32_t numerator = 8 * (int32_t)payloadLength - 4 * sf + 28 + (modem.crc ? 16 : 0) - (modem.implicitHeader ? 20 : 0);
+    int32_t denominator = 4 * (sf - (modem.lowDataRateOptimize ? 2 : 0));
+    int32_t payloadSymbols = 8;
+    if (numerator > 0) payloadSymbols += ((numerator + denominator - 1) / denominator) * modem.codingRate;
+
+    // Count quarter symbols so the 4.25 symbols added to the preamble stay exact
+    uint32_t quarterSymbols = 4 * (uint32_t)modem.preambleLength + 17 + 4 * (uint32_t)payloadSymbols;
+    return (uint32_t)(((uint64_t)quarterSymbols << sf) * 1000000ULL / (4ULL * modem.bandwidthHz));
+}
+
+/**
+ * @brief True when the symbol time is over 16ms - RH_RF95::setLowDatarate() turns on low data rate optimisation for these
+ */
+inline bool loraNeedsLowDataRateOptimize(uint8_t spreadingFactor, uint32_t bandwidthHz) {
+    return ((1000000ULL << spreadingFactor) / bandwidthHz) > 16000;
+}
+
+/**
+ * @brief Time on air in microseconds for any RH_RF95::ModemConfig (reg_1d, reg_1e, reg_26) - as applied by setLowDatarate()
+ *
+ * @details Use RH_RF95::getModemConfig() to get the ModemConfig for one of the canned choices.
+ */
+template <class ModemConfig>
+inline uint32_t loraConfigAirtimeMicros(const ModemConfig &config, uint8_t payloadLength, uint16_t preambleLength = 8) {
+    LoRaModem modem = loraModemFromRegisters(config.reg_1d, config.reg_1e, config.reg_26, preambleLength);
+    if (loraNeedsLowDataRateOptimize(modem.spreadingFactor, modem.bandwidthHz)) modem.lowDataRateOptimize = true;
+    return loraAirtimeMicros(modem, payloadLength);
+}
+
+/**
+ * @brief Lowest SNR (in tenths of a dB) at which a packet can be demodulated - -7.5dB at SF7 and 2.5dB lower for each step in SF
+ */
+inline int16_t loraDemodulationFloorTenths(uint8_t spreadingFactor) {
+    return -75 - 25 * ((int16_t)spreadingFactor - 7);
+}
+
+#endif  /* __LORA_AIRTIME_H */
@@ -0,0 +1,403 @@
+/**
+ * @file LoRA_Frames.h
+ * @author Chip McClelland (chip@seeinisghts.com)
+ * @brief Field layouts for the messages exchanged between the node and the gateway
+ * @details Each message type is described once as a list of (name, type) fields. The list generates
+ * a packed layout (offsets are computed by the compiler), an in-place view with big-endian accessors that
+ * reads and writes the radio buffer directly, and a table of offsets for the gateway side.
+ * Adding a field means adding one line to the list - no byte indices to edit.
+ * Values that need less than a byte (status, configuration) are described the same way as bit fields and are
+ * carried as a block inside a message.
+ *
+ * This file only depends on the C standard headers so it can also be compiled natively (see tools/).
+ *
+ * @version 0.1
+ * @date 2024-03-04
+ *
+ */
+
+#ifndef __LORA_FRAMES_H
+#define __LORA_FRAMES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * @brief Reads a big-endian value of type T from the buffer
+ */
+template <typename T>
+inline T frameGet(const uint8_t* p) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < sizeof(T); i++) value = (value << 8) | p[i];
+    return (T)value;
+}
+
+/**
+ * @brief Writes a value of type T to the buffer in big-endian order
+ */
+template <typename T>
+inline void framePut(uint8_t* p, T value) {
+    uint32_t bits = (uint32_t)value;
+    for (uint8_t i = sizeof(T); i > 0; i--) {
+        p[i - 1] = (uint8_t)bits;
+        bits >>= 8;
+    }
+}
+
+/**
+ * @brief Reads an unsigned field of width bits starting at bit position (most significant bit of buf[0] is position 0)
+ */
+inline uint32_t frameGetBits(const uint8_t* p, uint16_t position, uint8_t width) {
+    uint32_t value = 0;
+    for (uint16_t bit = position; bit < position + width; bit++) {
+        value = (value << 1) | ((p[bit >> 3] >> (7 - (bit & 7))) & 1);
+    }
+    return value;
+}
+
+/**
+ * @brief Writes an unsigned field of width bits starting at bit position - values that do not fit are clamped
+ */
+inline void framePutBits(uint8_t* p, uint16_t position, uint8_t width, int32_t value) {
+    int32_t maximum = (int32_t)((1UL << width) - 1);
+    if (value < 0) value = 0;
+    if (value > maximum) value = maximum;
+    for (uint16_t bit = position + width; bit > position; bit--) {
+        uint8_t mask = 1 << (7 - ((bit - 1) & 7));
+        if (value & 1) p[(bit - 1) >> 3] |= mask;
+        else p[(bit - 1) >> 3] &= ~mask;
+        value >>= 1;
+    }
+}
+
+/**
+ * @brief Maps a signed value to an unsigned one so small changes in either direction encode in few bytes
+ */
+inline uint32_t zigzagEncode(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t zigzagDecode(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * @brief Writes an unsigned varint (7 bits per byte, high bit set when more bytes follow)
+ *
+ * @return The number of bytes written (1 to 5)
+ */
+inline uint8_t framePutVarint(uint8_t* p, uint32_t value) {
+    uint8_t count = 0;
+    while (value > 0x7F) {
+        p[count++] = (uint8_t)(value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    p[count++] = (uint8_t)value;
+    return count;
+}
+
+/**
+ * @brief Reads an unsigned varint without reading past end
+ *
+ * @return The number of bytes read or 0 if the varint is truncated or too long
+ */
+inline uint8_t frameGetVarint(const uint8_t* p, const uint8_t* end, uint32_t &value) {
+    value = 0;
+    for (uint8_t count = 0; count < 5 && p + count < end; count++) {
+        value |= (uint32_t)(p[count] & 0x7F) << (7 * count);
+        if (!(p[count] & 0x80)) return count + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief One row of the layout table - used to print / generate the gateway side of the protocol
+ */
+struct FrameFieldInfo {
+    const char* name;
+    const char* type;
+    uint8_t offset;                                     // Bytes for a message field, bits for a bit field
+    uint8_t size;                                       // Bytes for a message field, bits for a bit field
+    int16_t minimum;                                    // Bit fields carry (value - minimum)
+};
+
+/**
+ * @brief How a field type is stored in a message - scalars are big-endian, bit blocks (LORA_BITS) are views
+ */
+template <typename T>
+struct FrameCodec {
+    typedef T value_type;
+    enum { size = sizeof(T) };
+    static T get(const uint8_t* p) { return frameGet<T>(p); }
+    static void put(uint8_t* p, T value) { framePut<T>(p, value); }
+};
+
+// Generators used by LORA_FRAME - each field list is expanded once with each of these
+#define LORA_FRAME_BYTES(name, type)        uint8_t name[FrameCodec<type>::size];
+#define LORA_FRAME_ACCESSORS(name, type)    typename FrameCodec<type>::value_type name() const { return FrameCodec<type>::get(_buf + offsetof(Layout, name)); } \
+                                            void name(typename FrameCodec<type>::value_type value) { FrameCodec<type>::put(_buf + offsetof(Layout, name), value); }
+#define LORA_FRAME_TABLE(name, type)        { #name, #type, (uint8_t)offsetof(Layout, name), (uint8_t)FrameCodec<type>::size, 0 },
+
+/**
+ * @brief Declares an in-place view of a message in the radio buffer
+ *
+ * @details className(buf).field() reads a field and className(buf).field(value) writes it.
+ * className::length is the length of the message on the wire and className::fields() the layout table.
+ */
+#define LORA_FRAME(className, FIELDS)                                                               \
+class className {                                                                                   \
+public:                                                                                             \
+    struct Layout { FIELDS(LORA_FRAME_BYTES) };                                                     \
+    enum { length = sizeof(Layout) };                                                               \
+    explicit className(uint8_t* buf) : _buf(buf) {}                                                 \
+    FIELDS(LORA_FRAME_ACCESSORS)                                                                    \
+    static const FrameFieldInfo* fields() {                                                         \
+        static const FrameFieldInfo table[] = { FIELDS(LORA_FRAME_TABLE) };                         \
+        return table;                                                                               \
+    }                                                                                               \
+    static uint8_t fieldCount() {                                                                   \
+        static const FrameFieldInfo table[] = { FIELDS(LORA_FRAME_TABLE) };                         \
+        return sizeof(table) / sizeof(table[0]);                                                    \
+    }                                                                                               \
+private:                                                                                            \
+    uint8_t* _buf;                                                                                  \
+};
+
+// Generators used by LORA_BITS - positions come from an enum so each field starts where the previous one ended
+#define LORA_BITS_POSITION(name, bits, minimum)     name##_position, name##_last = name##_position + (bits) - 1,
+#define LORA_BITS_ACCESSORS(name, bits, minimum)    int32_t name() const { return (int32_t)frameGetBits(_buf, name##_position, bits) + (minimum); } \
+                                                    void name(int32_t value) { framePutBits(_buf, name##_position, bits, value - (minimum)); }
+#define LORA_BITS_TABLE(name, bits, minimum)        { #name, "bits", (uint8_t)name##_position, (uint8_t)(bits), (int16_t)(minimum) },
+
+/**
+ * @brief Declares an in-place view of a block of bit fields - each field is (name, bits, minimum)
+ *
+ * @details A field carries (value - minimum) in bits bits, so it holds minimum to minimum + 2^bits - 1. Values
+ * outside that range are clamped when written. The block is used as the type of a LORA_FRAME field.
+ */
+#define LORA_BITS(className, FIELDS)                                                                \
+class className {                                                                                   \
+public:                                                                                             \
+    enum { FIELDS(LORA_BITS_POSITION) totalBits };                                                  \
+    enum { length = (totalBits + 7) / 8 };                                                          \
+    explicit className(uint8_t* buf) : _buf(buf) {}                                                 \
+    uint8_t* data() const { return _buf; }                                                          \
+    FIELDS(LORA_BITS_ACCESSORS)                                                                     \
+    static const FrameFieldInfo* fields() {                                                         \
+        static const FrameFieldInfo table[] = { FIELDS(LORA_BITS_TABLE) };                          \
+        return table;                                                                               \
+    }                                                                                               \
+    static uint8_t fieldCount() {                                                                   \
+        static const FrameFieldInfo table[] = { FIELDS(LORA_BITS_TABLE) };                          \
+        return sizeof(table) / sizeof(table[0]);                                                    \
+    }                                                                                               \
+private:                                                                                            \
+    uint8_t* _buf;                                                                                  \
+};                                                                                                  \
+template <>                                                                                         \
+struct FrameCodec<className> {                                                                      \
+    typedef className value_type;                                                                   \
+    enum { size = className::length };                                                              \
+    static className get(uint8_t* p) { return className(p); }                                       \
+    static void put(uint8_t* p, const className &value) { memmove(p, value.data(), size); }         \
+};
+
+// Node configuration set by the gateway - sent back in every data report so the gateway can check it - and the report's
+// sequence number. A report that could not be delivered is queued and sent again later with the same sequence number.
+#define LORA_NODE_CONFIG_BITS(BITS)                                                                 \
+    BITS(space,                    6,  0)       /* Space the node is associated with (0-63)     */  \
+    BITS(placement,                1,  0)       /* 0 for outside, 1 for inside                  */  \
+    BITS(multi,                    1,  0)       /* 1 for a room with more than one entrance     */  \
+    BITS(zoneMode,                 3,  0)       /* TOF zone mode                                */  \
+    BITS(sequence,                 5,  0)       /* Report sequence number (wraps at 32)         */
+
+// Status data - Common to all Nodes - sent with every report
+#define LORA_STATUS_BITS(BITS)                                                                      \
+    BITS(internalTempC,            7,  -40)     /* Enclosure temp (-40 to 87 degrees C)         */  \
+    BITS(stateOfCharge,            7,  -1)      /* State of charge (-1 unknown to 100%)         */  \
+    BITS(batteryState,             3,  0)       /* Battery State (0 to 6)                       */  \
+    BITS(resetCount,               8,  0)                                                           \
+    BITS(RSSI,                     7,  -157)    /* From the Node's perspective (-157 to -30 dBm)*/  \
+    BITS(SNR,                      6,  -32)     /* From the Node's perspective (-32 to 31 dB)   */  \
+    BITS(dataRate,                 3,  0)       /* Data rate in use (step in the ADR ladder)    */  \
+    BITS(proposedDataRate,         3,  0)       /* Data rate the node's SNR margin allows       */  \
+    BITS(txPower,                  5,  0)       /* Transmit power in use (dBm)                  */  \
+    BITS(clockError,               5,  -16)     /* Clock error at last sync (10mS steps)        */  \
+    BITS(queuedReports,            2,  0)       /* Reports waiting to be sent again (0 to 3+)   */
+
+LORA_BITS(NodeConfigBits, LORA_NODE_CONFIG_BITS)
+LORA_BITS(StatusBits, LORA_STATUS_BITS)
+
+// The last two bytes of every message are reserved for RHReliableDatagram.cpp / RHMesh.cpp. They update the number
+// of re-transmissions and the accumulated re-transmission delay (hundredths of a second) as the message is delivered.
+#define LORA_RETRANSMISSION_FIELDS(FIELD)                                                           \
+    FIELD(retries,                 uint8_t)     /* Number of re-transmissions                   */  \
+    FIELD(retransmissionDelay,     uint8_t)     /* Accumulated re-transmission delay            */
+
+// Header common to every message from the Node to the Gateway
+#define LORA_NODE_HEADER_FIELDS(FIELD)                                                              \
+    FIELD(magicNumber,             uint16_t)    /* Identifies the Gateway's network             */  \
+    FIELD(nodeNumber,              uint8_t)     /* Unique to each node on the gateway's network */  \
+    FIELD(token,                   uint16_t)    /* Token given to the node, good for 24 hours   */  \
+    FIELD(sensorType,              uint8_t)     /* What sensor type is it                       */  \
+    FIELD(uniqueID,                uint32_t)    /* Unique to each node and only set once        */
+
+// Status data - Common to all Nodes - packed (see LORA_STATUS_BITS)
+#define LORA_STATUS_FIELDS(FIELD)                                                                   \
+    FIELD(status,                  StatusBits)
+
+// Format of a data report - From the Node to the Gateway so includes a token - most common message from node to gateway
+#define LORA_DATA_REPORT_FIELDS(FIELD)                                                              \
+    LORA_NODE_HEADER_FIELDS(FIELD)                                                                  \
+    /*** Payload Section - 6 bytes, sensor type determines interpretation                       */  \
+    FIELD(occupancyGross,          uint16_t)                                                        \
+    FIELD(occupancyNet,            int16_t)                                                         \
+    FIELD(config,                  NodeConfigBits)                                                  \
+    LORA_STATUS_FIELDS(FIELD)                                                                       \
+    LORA_RETRANSMISSION_FIELDS(FIELD)
+
+// Format of an aggregated report - From the Node to the Gateway - several reporting intervals (buckets) in one message
+// The fixed fields are followed by bucketCount pairs of zigzag varints - the change in occupancyGross and in occupancyNet
+// over each bucket, oldest first - and then the two retransmission bytes (which must always be the last two bytes).
+// The sequence number is shared with the other reports and only moves on when a report is delivered or queued. A report
+// sent again after a lost acknowledgement repeats buckets the gateway has - it drops those that start before the end of
+// the last report it has with the same sequence number.
+#define LORA_AGGREGATE_REPORT_FIELDS(FIELD)                                                         \
+    LORA_NODE_HEADER_FIELDS(FIELD)                                                                  \
+    FIELD(sequence,                uint8_t)     /* Report sequence number (wraps at 32)         */  \
+    LORA_STATUS_FIELDS(FIELD)                                                                       \
+    FIELD(bucketMinutes,           uint8_t)     /* Length of each bucket - set by the gateway   */  \
+    FIELD(bucketCount,             uint8_t)     /* Number of buckets that follow                */  \
+    FIELD(firstBucketStart,        uint32_t)    /* Start time of the oldest bucket              */  \
+    FIELD(occupancyGrossBase,      uint16_t)    /* occupancyGross at the start of the 1st bucket*/  \
+    FIELD(occupancyNetBase,        int16_t)     /* occupancyNet at the start of the 1st bucket  */
+
+// Format of a queued report - From the Node to the Gateway - a data report that could not be delivered (or an aggregation
+// bucket that did not fit) sent again once the gateway is heard from. The gateway drops a sequence number it has already seen.
+#define LORA_QUEUED_REPORT_FIELDS(FIELD)                                                            \
+    LORA_NODE_HEADER_FIELDS(FIELD)                                                                  \
+    FIELD(sequence,                uint8_t)     /* Sequence number of the original report       */  \
+    FIELD(queueDepth,              uint8_t)     /* Reports queued - including this one          */  \
+    FIELD(oldestQueuedMinutes,     uint16_t)    /* Age of the oldest report in the queue        */  \
+    FIELD(reportTime,              uint32_t)    /* When the counts were taken                   */  \
+    FIELD(occupancyGross,          uint16_t)                                                        \
+    FIELD(occupancyNet,            int16_t)                                                         \
+    LORA_RETRANSMISSION_FIELDS(FIELD)
+
+// Format of a configuration report - From the Node to the Gateway - confirms the configuration block in a data ack
+// The fixed fields are followed by each item of the block (ConfigBlock.h) with the value now in effect - none if the block
+// was rejected - and then the two retransmission bytes (which must always be the last two bytes).
+#define LORA_CONFIG_REPORT_FIELDS(FIELD)                                                            \
+    LORA_NODE_HEADER_FIELDS(FIELD)                                                                  \
+    FIELD(configId,                uint8_t)     /* Id of the block being confirmed              */  \
+    FIELD(result,                  uint8_t)     /* ConfigBlock::Result - 0 when it was applied  */  \
+    FIELD(failedTag,               uint8_t)     /* Tag of the item that was rejected - or 0     */
+
+// Format of a join request - From the Node to the Gateway
+// nodeNumber is typically 255 and the token may not be valid - if it is valid the response only sets the clock
+#define LORA_JOIN_REQUEST_FIELDS(FIELD)                                                             \
+    LORA_NODE_HEADER_FIELDS(FIELD)                                                                  \
+    FIELD(space,                   uint8_t)     /* Payload - may be updated in the join process */  \
+    FIELD(placement,               uint8_t)                                                         \
+    FIELD(multi,                   uint8_t)                                                         \
+    FIELD(reserved,                uint8_t)                                                         \
+    LORA_RETRANSMISSION_FIELDS(FIELD)
+
+// Header common to both acknowledgements - From the Gateway to the Node
+#define LORA_ACK_HEADER_FIELDS(FIELD)                                                               \
+    FIELD(magicNumber,             uint16_t)                                                        \
+    FIELD(nodeNumber,              uint8_t)                                                         \
+    FIELD(token,                   uint16_t)    /* Token for validation - good for the day      */  \
+    FIELD(time,                    uint32_t)    /* Time.now() on the gateway                    */  \
+    FIELD(secondsTillNextReport,   uint16_t)    /* Up to 18 hours                               */  \
+    FIELD(alertCodeNode,           uint8_t)     /* Lets the Gateway trigger an alert on the node*/
+
+// Format of a data acknowledgement - From the Gateway to the Node - Most common message from gateway to node
+// A longer data ack carries a configuration block (ConfigBlock.h) between slotOffset and the two retransmission bytes
+#define LORA_DATA_ACK_FIELDS(FIELD)                                                                 \
+    LORA_ACK_HEADER_FIELDS(FIELD)                                                                   \
+    FIELD(alertContextNode,        uint16_t)    /* Context for the alert code if needed         */  \
+    FIELD(sensorType,              uint8_t)     /* Lets the Gateway reset the sensor if needed  */  \
+    FIELD(replyDelayMillis,        uint16_t)    /* Gateway reply delay in ms - 0 if unknown     */  \
+    FIELD(timeHundredths,          uint8_t)     /* Hundredths of a second to go with time       */  \
+    FIELD(slotFrameSeconds,        uint8_t)     /* Reporting frame length - 0 for no slots      */  \
+    FIELD(slotOffset,              uint16_t)    /* Node's slot in the frame (hundredths)        */  \
+    LORA_RETRANSMISSION_FIELDS(FIELD)
+
+// Format for a join acknowledgement -  From the Gateway to the Node
+#define LORA_JOIN_ACK_FIELDS(FIELD)                                                                 \
+    LORA_ACK_HEADER_FIELDS(FIELD)                                                                   \
+    FIELD(alertContextNode,        uint8_t)     /* Context for the alert code if needed         */  \
+    FIELD(sensorType,              uint8_t)     /* Gateway confirms sensor type                 */  \
+    FIELD(uniqueID,                uint32_t)    /* Only set by the gateway on 1st joining       */  \
+    FIELD(assignedNodeNumber,      uint8_t)     /* Gateway assigns a node number                */  \
+    FIELD(space,                   uint8_t)     /* Payload - sensor type determines use         */  \
+    FIELD(placement,               uint8_t)                                                         \
+    FIELD(multi,                   uint8_t)                                                         \
+    FIELD(timeHundredths,          uint8_t)     /* Hundredths of a second to go with time       */  \
+    LORA_RETRANSMISSION_FIELDS(FIELD)
+
+LORA_FRAME(DataReportFrame, LORA_DATA_REPORT_FIELDS)
+LORA_FRAME(AggregateReportFrame, LORA_AGGREGATE_REPORT_FIELDS)
+LORA_FRAME(QueuedReportFrame, LORA_QUEUED_REPORT_FIELDS)
+LORA_FRAME(ConfigReportFrame, LORA_CONFIG_REPORT_FIELDS)
+LORA_FRAME(JoinRequestFrame, LORA_JOIN_REQUEST_FIELDS)
+LORA_FRAME(AckHeaderFrame, LORA_ACK_HEADER_FIELDS)
+LORA_FRAME(DataAckFrame, LORA_DATA_ACK_FIELDS)
+LORA_FRAME(JoinAckFrame, LORA_JOIN_ACK_FIELDS)
+
+// Message flags - carried in the RadioHead header, not in the message - say which of the layouts above a message has
+typedef enum { NULL_STATE, JOIN_REQ, JOIN_ACK, DATA_RPT, DATA_ACK, ALERT_RPT, ALERT_ACK, AGGREGATE_RPT, QUEUED_RPT, CONFIG_RPT, LORA_STATE_COUNT } LoRA_State;
+
+/**
+ * @brief Checks a reply from the gateway before any of it is read - it must be one of the two acknowledgements and at
+ * least as long as its layout (a data ack may carry a configuration block as well)
+ */
+inline bool frameReplyValid(uint8_t messageFlag, uint8_t length) {
+    if (messageFlag == JOIN_ACK) return length >= JoinAckFrame::length;
+    if (messageFlag == DATA_ACK) return length >= DataAckFrame::length;
+    return false;
+}
+
+// Frame size planner - RHMesh adds its own header (1 byte) and RHRouter's (5 bytes) before RHEncryptedDriver pads the
+// message to whole Speck blocks. With STRICT_CONTENT_LEN a length byte is added first, so a message of n bytes is sent
+// as (n + 6) / 16 + 1 blocks. RH_RF95 then adds its own 4 byte header in the clear.
+#define LORA_ROUTED_HEADER_LEN 6                        // RHRouter::RoutedMessageHeader + RHMesh::MeshMessageHeader
+#define LORA_CIPHER_BLOCK_LEN 16                        // Speck block size
+#define LORA_RADIO_HEADER_LEN 4                         // RH_RF95_HEADER_LEN
+#define LORA_SEQUENCE_MODULUS 32                        // Report sequence numbers wrap - the configuration block carries 5 bits
+
+/**
+ * @brief Number of encrypted bytes sent for an application message of length bytes - over 255 if it is too long to send
+ */
+constexpr uint16_t frameEncryptedLength(uint8_t length) {
+    return ((length + LORA_ROUTED_HEADER_LEN) / LORA_CIPHER_BLOCK_LEN + 1) * LORA_CIPHER_BLOCK_LEN;
+}
+
+/**
+ * @brief Number of bytes that could be added to an application message of length bytes without sending another block
+ */
+inline uint8_t frameBlockSlack(uint8_t length) {
+    return frameEncryptedLength(length) - LORA_ROUTED_HEADER_LEN - 1 - length;
+}
+
+/**
+ * @brief Number of bytes sent over the air (the LoRa payload) for an application message of length bytes
+ */
+inline uint8_t frameRadioPayloadLength(uint8_t length) {
+    return frameEncryptedLength(length) + LORA_RADIO_HEADER_LEN;
+}
+
+// These lengths are the wire format agreed with the gateway - a change here is a breaking change
+static_assert(NodeConfigBits::length == 2, "Node configuration block must be 2 bytes");
+static_assert(StatusBits::length == 7, "Status block must be 7 bytes");
+static_assert(DataReportFrame::length == 25, "Data report must be 25 bytes");
+static_assert(QueuedReportFrame::length == 24, "Queued report must be 24 bytes");
+static_assert(JoinRequestFrame::length == 16, "Join request must be 16 bytes");
+static_assert(DataAckFrame::length == 23, "Data acknowledgement must be 23 bytes");
+static_assert(JoinAckFrame::length == 25, "Join acknowledgement must be 25 bytes");
+static_assert(DataReportFrame::length + LORA_ROUTED_HEADER_LEN + 1 <= 2 * LORA_CIPHER_BLOCK_LEN, "Data report must encrypt to two blocks");
+static_assert(QueuedReportFrame::length + LORA_ROUTED_HEADER_LEN + 1 <= 2 * LORA_CIPHER_BLOCK_LEN, "Queued report must encrypt to two blocks");
+
+#endif  /* __LORA_FRAMES_H */
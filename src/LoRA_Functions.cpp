@@ -1,4 +1,6 @@
 #include "LoRA_Functions.h"
+#include "LinkAdaptation.h"
+#include "take_measurements.h"
 
 RH_RF95 rf95(gpio.RFM95_CS, gpio.RFM95_INT);  	// Class instance for the RFM95 radio driver
 Speck myCipher;                             	// Class instance for Speck block ciphering
@@ -27,28 +29,24 @@ LoRA_Functions::~LoRA_Functions() {
 // ************************************************************************
 
 
-// Define the message flags
-typedef enum { NULL_STATE, JOIN_REQ, JOIN_ACK, DATA_RPT, DATA_ACK, ALERT_RPT, ALERT_ACK} LoRA_State;
-char loraStateNames[7][16] = {"Null", "Join Req", "Join Ack", "Data Report", "Data Ack", "Alert Rpt", "Alert Ack"};
+// Names of the message flags (LoRA_State in LoRA_Frames.h)
+char loraStateNames[LORA_STATE_COUNT][16] = {"Null", "Join Req", "Join Ack", "Data Report", "Data Ack", "Alert Rpt", "Alert Ack", "Aggregate Rpt", "Queued Rpt", "Config Rpt"};
 static LoRA_State lora_state = NULL_STATE;
 
-// Mesh has much greater memory requirements, and you may need to limit the
-// max message length to prevent wierd crashes
-#ifndef RH_MAX_MESSAGE_LEN
-#define RH_MAX_MESSAGE_LEN 255
-#endif
+// The radio stack's buffers are no longer than the longest frame needs - RH_MAX_MESSAGE_LEN and RH_RF95_MAX_MESSAGE_LEN
+// are set in platformio.ini (see RHMessagePool.h and tools/radio_ram_report.cpp)
+static_assert(LORA_MAX_FRAME_LEN <= RH_MESH_MAX_MESSAGE_LEN, "RH_MAX_MESSAGE_LEN is too short for the longest frame");
+static_assert(frameEncryptedLength(LORA_MAX_FRAME_LEN) <= RH_POOL_BUFFER_LEN, "RH_MAX_MESSAGE_LEN is too short for the longest frame encrypted");
+static_assert(frameEncryptedLength(LORA_MAX_FRAME_LEN) <= RH_RF95_MAX_MESSAGE_LEN, "RH_RF95_MAX_MESSAGE_LEN is too short for the longest frame encrypted");
 
-// Mesh has much greater memory requirements, and you may need to limit the
-// max message length to prevent wierd crashes
-// #define RH_MESH_MAX_MESSAGE_LEN 50
 uint8_t buf[RH_MESH_MAX_MESSAGE_LEN];               // Related to max message size - RadioHead example note: dont put this on the stack:
 
 bool LoRA_Functions::setup(bool gatewayID) {
     // Set up the Radio Module
 	LoRA_Functions::initializeRadio();
 
-	manager.setTimeout(120); // Set to 120
 	manager.setRetries(2); // Set to 2	
+	routeStore.setup(manager);						// Routes saved before a reset or power cycle - discovered again only when a delivery fails
 
 	Log.infoln("In LoRA setup - node number %d and uniqueID of %u",sysStatus.nodeNumber, sysStatus.uniqueID);
 
@@ -80,16 +78,26 @@ void LoRA_Functions::loop() {
 
 
 void LoRA_Functions::clearBuffer() {
-	uint8_t bufT[RH_RF95_MAX_MESSAGE_LEN];
-	uint8_t lenT;
-
-	while(driver.recv(bufT, &lenT)) {};
+	while(driver.recv(NULL, NULL)) {};						// Discarded without being copied or decrypted
 }
 
 void LoRA_Functions::sleepLoRaRadio() {
+	manager.flushRebroadcast();						// A request held back would be dropped
 	driver.sleep();                             	// Here is where we will power down the LoRA radio module
 }
 
+uint32_t LoRA_Functions::rebroadcastDueIn(uint32_t timeLeft) {
+	return manager.rebroadcastDueIn(timeLeft);
+}
+
+void LoRA_Functions::flushRebroadcast() {
+	manager.flushRebroadcast();
+}
+
+void LoRA_Functions::saveRoutes() {
+	routeStore.save(manager);
+}
+
 bool  LoRA_Functions::initializeRadio() {  			// Set up the Radio Module
 	digitalWrite(gpio.RFM95_RST,LOW);				// Reset the radio module before setup
 	delay(10);
@@ -101,20 +109,96 @@ bool  LoRA_Functions::initializeRadio() {  			// Set up the Radio Module
 		return false;
 	}
 	rf95.setFrequency(RF95_FREQ);					// Frequency is typically 868.0 or 915.0 in the Americas, or 433.0 in the EU - Are there more settings possible here?
-	rf95.setTxPower(23, false);                   // If you are using RFM95/96/97/98 modules which uses the PA_BOOST transmitter pin, then you can set transmitter powers from 5 to 23 dBm (13dBm default).  PA_BOOST?
+	rf95.setTxPower(linkControl.txPower(), false);	// If you are using RFM95/96/97/98 modules which uses the PA_BOOST transmitter pin, then you can set transmitter powers from 5 to 23 dBm (13dBm default).  PA_BOOST?
 
-	rf95.setModemConfig(RH_RF95::Bw500Cr45Sf128);	 // Optimized for fast transmission and short range - MAFC
+	rf95.setModemConfig(RH_RF95::Bw500Cr45Sf128);	 // Optimized for fast transmission and short range - MAFC - this is ADR_DEFAULT_DATA_RATE
 	// driver.setModemConfig(RH_RF95::Bw125Cr45Sf2048); // This is the value used in the park 
 	//driver.setModemConfig(RH_RF95::Bw125Cr48Sf4096);	// This optimized the radio for long range - https://www.airspayce.com/mikem/arduino/RadioHead/classRH__RF95.html
 	rf95.setLowDatarate();						// https://www.airspayce.com/mikem/arduino/RadioHead/classRH__RF95.html#a8e2df6a6d2cb192b13bd572a7005da67
-	manager.setTimeout(1000);						// 200mSec is the default - may need to extend once we play with other settings on the modem - https://www.airspayce.com/mikem/arduino/RadioHead/classRHReliableDatagram.html
+	if (sysStatus.dataRate != ADR_DEFAULT_DATA_RATE) LoRA_Functions::applyModemConfig(linkControl.modemConfig(sysStatus.dataRate));	// The gateway confirmed a different data rate
+	else {
+		LoRA_Functions::applyAckTimeout();
+		LoRA_Functions::applyChannelAccess();
+		LoRA_Functions::logFramePlan();
+	}
 return true;
 }
 
+void LoRA_Functions::applyTxPower(uint8_t power) {
+	rf95.setTxPower(power, false);
+}
+
+void LoRA_Functions::applyModemConfig(const RH_RF95::ModemConfig &config) {
+	rf95.setModemRegisters(&config);
+	rf95.setLowDatarate();
+	LoRA_Functions::applyAckTimeout();
+	LoRA_Functions::applyChannelAccess();
+	LoRA_Functions::logFramePlan();
+}
+
+void LoRA_Functions::applyAckTimeout() {
+	// The manager times each next hop's acknowledgements and waits a little longer than they take - these bound it at this data rate
+	LoRaModem modem = activeModem();
+	uint32_t ackMicros = loraAirtimeMicros(modem, LORA_CIPHER_BLOCK_LEN + LORA_RADIO_HEADER_LEN);
+	uint32_t roundTripMicros = loraAirtimeMicros(modem, frameRadioPayloadLength(DataReportFrame::length)) + ackMicros;
+	manager.clearRoundTripTimes();											// Round trips timed at another data rate no longer apply
+	manager.setTimeout(2 * roundTripMicros / 1000UL + 100);					// Until a next hop's round trip is timed - twice the round trip on air
+	manager.setMinTimeout(ackMicros / 1000UL + ACK_TIMEOUT_MARGIN_MS);		// Timing starts once our message is sent - an acknowledgement cannot come back sooner
+}
+
+void LoRA_Functions::applyChannelAccess() {
+	uint32_t backoff = loraAirtimeMicros(activeModem(), frameRadioPayloadLength(DataReportFrame::length)) / 1000UL;
+	if (backoff < LBT_MIN_BACKOFF_MS) backoff = LBT_MIN_BACKOFF_MS;
+	uint32_t timeout = backoff << RH_CAD_MAX_BACKOFF_EXPONENT;				// Time for the backoff to grow to its longest - at slow rates one slot is most of a second
+	if (timeout < LBT_CAD_TIMEOUT_MS) timeout = LBT_CAD_TIMEOUT_MS;
+	rf95.setCADTimeout(LBT_CAD_TIMEOUT_MS ? timeout : 0);					// The driver checks the channel before every transmission except acknowledgements and replies
+	rf95.setCADBackoff(backoff);											// A busy channel is most likely another node's report
+}
+
+LoRaModem LoRA_Functions::activeModem() {
+	uint16_t preambleLength = (rf95.spiRead(RH_RF95_REG_20_PREAMBLE_MSB) << 8) | rf95.spiRead(RH_RF95_REG_21_PREAMBLE_LSB);
+	return loraModemFromRegisters(rf95.spiRead(RH_RF95_REG_1D_MODEM_CONFIG1), rf95.spiRead(RH_RF95_REG_1E_MODEM_CONFIG2), rf95.spiRead(RH_RF95_REG_26_MODEM_CONFIG3), preambleLength);
+}
+
+void LoRA_Functions::logFramePlan() {
+	const uint8_t unpackedReportLength = 28;						// Data report before the status and configuration were packed
+	LoRaModem modem = activeModem();
+	uint32_t packedAirtime = loraAirtimeMicros(modem, frameRadioPayloadLength(DataReportFrame::length));
+	uint32_t unpackedAirtime = loraAirtimeMicros(modem, frameRadioPayloadLength(unpackedReportLength));
+
+	Log.infoln("Modem SF%d BW%lHz CR4/%d - data report %d bytes sent as %d encrypted bytes (was %d) - %lus on air, saves %lus per report", modem.spreadingFactor, modem.bandwidthHz, modem.codingRate, DataReportFrame::length, frameEncryptedLength(DataReportFrame::length), frameEncryptedLength(unpackedReportLength), packedAirtime, unpackedAirtime - packedAirtime);
+}
+
 
 // ************************************************************************
 // *****                         Node Functions                       *****
 // ************************************************************************
+// Header and status fields are common to the data and aggregated reports
+template <class Frame>
+static void writeNodeHeader(Frame &frame) {
+	frame.magicNumber(sysStatus.magicNumber);
+	frame.nodeNumber(sysStatus.nodeNumber);
+	frame.token(sysStatus.token);
+	frame.sensorType(sysStatus.sensorType);
+	frame.uniqueID(sysStatus.uniqueID);
+}
+
+template <class Frame>
+static void writeStatus(Frame &frame) {
+	StatusBits status = frame.status();						// Packed - values outside a field's range are clamped
+	status.internalTempC(current.internalTempC);
+	status.stateOfCharge(current.stateOfCharge);
+	status.batteryState(current.batteryState);
+	status.resetCount(sysStatus.resetCount);
+	status.RSSI(current.RSSI);
+	status.SNR(current.SNR);
+	status.dataRate(sysStatus.dataRate);
+	status.proposedDataRate(linkControl.proposedDataRate());	// The gateway confirms a change with alert code 15
+	status.txPower(linkControl.txPower());
+	status.clockError(timeFunctions.clockError_ms / 10);		// Clamped to -160 to 150mS
+	status.queuedReports(reportQueue.depth());				// Clamped to 3 - the queued reports carry the full depth
+}
+
 bool LoRA_Functions::listenForLoRAMessageNode() {
 	uint8_t len = sizeof(buf);
 	uint8_t from;  
@@ -123,99 +207,206 @@ bool LoRA_Functions::listenForLoRAMessageNode() {
 	uint8_t messageFlag;
 	uint8_t hops;
 	if (manager.recvfromAck(buf, &len, &from, &dest, &id, &messageFlag, &hops))	{					// We have received a message
-		buf[len] = 0;
-		if ((buf[0] << 8 | buf[1]) != sysStatus.magicNumber) {
-			Log.infoln("Magic Number mismatch - ignoring message");
-			return false;
-		} 
-		lora_state = (LoRA_State)messageFlag;
-		Log.infoln("Received from node %d with RSSI / SNR of %d / %d - a %s message with %d hops", from, driver.lastRssi(), rf95.lastSNR(), loraStateNames[lora_state], hops);
-
-		sysStatus.token = (buf[3] << 8 | buf[4]);						// Set the token for validation - good for the day
-		sysStatus.lastConnection = ((buf[5] << 24) | (buf[6] << 16) | (buf[7] << 8) | buf[8]);	// Correct time from gateway
-		timeFunctions.setTime(sysStatus.lastConnection,0);  // Set time based on response from gateway
-		uint16_t secondsTillNextReport = (buf[9] << 8 | buf[10]);			// Frequency of reporting set by Gateway
-		if (secondsTillNextReport < 60) secondsTillNextReport = 60;		// Minimum of 60 seconds
-		sysStatus.nextConnection = timeFunctions.getTime() + secondsTillNextReport;
-
-		Log.infoln("Next report is in %u seconds", secondsTillNextReport);
-
-		// Process Alert Codes
-		sysStatus.alertCodeNode = buf[11];			// The gateway may set an alert code for the node
-		sysStatus.alertContextNode = (buf[12] << 8 | buf[13]);		// The gateway may send alert context with an alert code
-
-		if (sysStatus.alertCodeNode) {
-			Log.infoln("The gateway set an alert %d with context %d", sysStatus.alertCodeNode, sysStatus.alertContextNode);
-		}
+		return handleReplyNode(len, from, messageFlag, hops);
+	}
+	return false;															// Nothing for us - anything else in the radio was relayed or dropped by the manager
+}
 
-		if (lora_state == DATA_ACK) { if(LoRA_Functions::instance().receiveAcknowledmentDataReportNode()) return true;}
-		else if (lora_state == JOIN_ACK) { if(LoRA_Functions::instance().receiveAcknowledmentJoinRequestNode()) return true;}
-		else {Log.infoln("Invalid LoRA message flag"); return false;}
+bool LoRA_Functions::handleReplyNode(uint8_t len, uint8_t from, uint8_t messageFlag, uint8_t hops, bool timeUncertain) {
+	if (!frameReplyValid(messageFlag, len)) {							// Checked before any of it is read - only an acknowledgement at least as long as its layout
+		Log.infoln("Unexpected message flag %d or truncated message (%d bytes) - ignoring message", messageFlag, len);
+		return false;
+	}
+	AckHeaderFrame ack(buf);											// Fields common to both acknowledgements - read in place
+	if (ack.magicNumber() != sysStatus.magicNumber) {
+		Log.infoln("Magic Number mismatch - ignoring message");
+		return false;
+	} 
+	contentionAttempts = 0;												// The gateway heard us - no more backing off
+	_linkUp = true;														// ... and queued reports can be sent
+	lora_state = (LoRA_State)messageFlag;
+	Log.infoln("Received from node %d with RSSI / SNR of %d / %d - a %s message with %d hops", from, driver.lastRssi(), rf95.lastSNR(), loraStateNames[lora_state], hops);
+
+	sysStatus.token = ack.token();										// Set the token for validation - good for the day
+	sysStatus.lastConnection = ack.time();								// Correct time from gateway
+	uint8_t hundredths = (lora_state == JOIN_ACK) ? JoinAckFrame(buf).timeHundredths() : DataAckFrame(buf).timeHundredths();
+	if (buf[len-1] == 255) timeUncertain = true;						// Delay byte is saturated - more than 2.55 seconds in retries
+	timeFunctions.setTimeCompensated(sysStatus.lastConnection, hundredths, deliveryMillis(len, hops), timeUncertain ? TIME_SYNC_MAX_ERROR_MS : 0);
+	uint16_t secondsTillNextReport = ack.secondsTillNextReport();		// Frequency of reporting set by Gateway
+	if (secondsTillNextReport < 60) secondsTillNextReport = 60;		// Minimum of 60 seconds
+	sysStatus.nextConnection = timeFunctions.getTime() + secondsTillNextReport;
+
+	Log.infoln("Next report is in %u seconds", secondsTillNextReport);
+
+	// Process Alert Codes
+	sysStatus.alertCodeNode = ack.alertCodeNode();			// The gateway may set an alert code for the node
+	if (lora_state == JOIN_ACK) sysStatus.alertContextNode = JoinAckFrame(buf).alertContextNode();	// The gateway may send alert context with an alert code
+	else {
+		DataAckFrame dataAck(buf);
+		sysStatus.alertContextNode = dataAck.alertContextNode();					// Two bytes of context in a data ack, one in a join ack
+		replyDelayMillis = dataAck.replyDelayMillis();							// Sizes the next listen window
+		if (dataAck.slotFrameSeconds() != sysStatus.slotFrameSeconds || dataAck.slotOffset() != sysStatus.slotOffset) {
+			sysStatus.slotFrameSeconds = dataAck.slotFrameSeconds();				// The gateway assigns each node its own reporting slot
+			sysStatus.slotOffset = dataAck.slotOffset();
+			Log.infoln("Reporting slot now %d hundredths into a %d second frame", sysStatus.slotOffset, sysStatus.slotFrameSeconds);
+		}
+		if (lora_state == DATA_ACK && len > DataAckFrame::length) receiveConfigBlock(buf + DataAckFrame::length - 2, buf + len - 2);	// Between the fixed fields and the retransmission bytes
+		reportAcknowledged();												// Only the gateway's data ack confirms a report - not a relay's acknowledgement
+	}
 
+	if (sysStatus.alertCodeNode) {
+		Log.infoln("The gateway set an alert %d with context %d", sysStatus.alertCodeNode, sysStatus.alertContextNode);
 	}
-	else LoRA_Functions::clearBuffer();
+
+	if (lora_state == DATA_ACK) { if(LoRA_Functions::instance().receiveAcknowledmentDataReportNode()) return true;}
+	else { if(LoRA_Functions::instance().receiveAcknowledmentJoinRequestNode()) return true;}	// A join ack - nothing else gets this far
 	return false;
 }
 
+// The gateway stamps the time as it sends its first try. Each try that was not acknowledged added its timeout (and any route
+// discovery) to the delay byte, as did the time listen before talk held each try back at the gateway and at each relay, and
+// each try and each relay hop put the message on the air again.
+uint16_t LoRA_Functions::deliveryMillis(uint8_t len, uint8_t hops) {
+	uint8_t retries = buf[len-2];										// The last two bytes are always the retransmission bytes
+	uint8_t delayHundredths = buf[len-1];
+	LoRaModem modem = activeModem();									// Relays are assumed to use the same data rate
+	uint32_t messageMicros = loraAirtimeMicros(modem, frameRadioPayloadLength(len));
+	uint32_t linkAckMicros = loraAirtimeMicros(modem, LORA_CIPHER_BLOCK_LEN + LORA_RADIO_HEADER_LEN);
+	uint32_t airMillis = ((retries + 1UL + hops) * messageMicros + hops * linkAckMicros) / 1000UL;
+	uint32_t waitingMillis = millis() - rf95.getLastRxTime();			// Received but not yet read
+	if (rf95.getLastRxTime() == rxAsleepTime) waitingMillis += rxAsleepMillis;	// ... and slept through while millis() stood still
+	uint32_t total = delayHundredths * 10UL + airMillis + waitingMillis + TIME_SYNC_GATEWAY_LATENCY_MS;
+	return (total < 65535UL) ? total : 65535;
+}
+
+uint8_t LoRA_Functions::sendRequestNode(uint8_t len, uint8_t messageFlag) {
+	uint8_t replyLen = sizeof(buf);
+	uint8_t replyFlag = NULL_STATE;
+	unsigned long started = millis();
+
+	_replyReceived = false;
+	awaitingReport = messageFlag;											// Until the gateway acknowledges it - in the reply or in the listen window
+	uint32_t retransmissions = manager.retransmissions();
+	// The gateway answers in the acknowledgement - its reply delay is how much longer than a plain acknowledgement that takes
+	uint8_t result = manager.sendtoStartReply(buf, len, GATEWAY_ADDRESS, messageFlag, buf, &replyLen, &replyFlag, replyDelayMillis);
+	while (result == RH_ROUTER_SEND_PENDING) {								// The node goes on sampling until the message is delivered or given up
+		if (sendingHandler) sendingHandler();
+		result = manager.sendPoll();
+	}
+	logChannelAccess();
+	if (result != RH_ROUTER_ERROR_NONE) {
+		_linkUp = false;													// Hold the queued reports until the gateway is heard from again
+		awaitingReport = NULL_STATE;
+	}
+	if (result == RH_ROUTER_ERROR_NONE && replyLen > 0) {
+		Log.infoln("Gateway replied in the acknowledgement - one exchange in %lmSec", millis() - started);
+		_replyReceived = handleReplyNode(replyLen, GATEWAY_ADDRESS, replyFlag, 0, manager.retransmissions() != retransmissions);
+	}
+	return result;
+}
+
+void LoRA_Functions::whileSending(void (*handler)()) {
+	sendingHandler = handler;
+}
+
+uint32_t LoRA_Functions::replyWindowMillis() {
+	if (!LISTEN_SLEEP_WINDOW || replyDelayMillis == 0) return LISTEN_TIMEOUT_MS;
+	uint32_t window = replyDelayMillis + loraAirtimeMicros(activeModem(), frameRadioPayloadLength(DataAckFrame::length)) / 1000 + LISTEN_MARGIN_MS;
+	return (window < LISTEN_TIMEOUT_MS) ? window : LISTEN_TIMEOUT_MS;
+}
+
+bool LoRA_Functions::reportSlotDue() {
+	if (sysStatus.slotFrameSeconds == 0) return true;										// The gateway does not assign slots
+	if (timeFunctions.nxtDvcRpt_time == 0) slotOffset = reportSlotOffset();				// A new report - work out where it goes
+	return timeFunctions.deviceReportDue(sysStatus.slotFrameSeconds, slotOffset);
+}
+
+uint32_t LoRA_Functions::reportSlotOffset() {
+	bool joining = sysStatus.nodeNumber == 255 || sysStatus.alertCodeNode == 1 || sysStatus.alertCodeNode == 2;
+	return ::reportSlotOffset(sysStatus.slotFrameSeconds, sysStatus.slotOffset, joining, contentionAttempts, SLOT_CONTENTION_HUNDREDTHS,
+		SLOT_CONTENTION_EXCHANGE_HUNDREDTHS, SLOT_CONTENTION_MAX_BACKOFF, random);
+}
+
+void LoRA_Functions::startListening() {
+	rf95.setModeRx();														// DIO0 goes high on RxDone
+}
+
+void LoRA_Functions::sleptWhileListening(uint32_t asleepMillis, bool woken) {
+	if (woken) return;													// A frame woke us - the radio stamped it as we woke
+	if (rf95.getLastRxTime() != rxAsleepTime) {							// The first sleep since the radio last received
+		rxAsleepTime = rf95.getLastRxTime();
+		rxAsleepMillis = 0;
+	}
+	rxAsleepMillis += asleepMillis;
+}
+
+void LoRA_Functions::logListenWindow(bool replied, uint32_t elapsedMillis, uint32_t asleepMillis) {
+	if (asleepMillis > elapsedMillis) asleepMillis = elapsedMillis;		// The RTC only resolves 10mS
+	uint32_t awakeMillis = elapsedMillis - asleepMillis;
+	// uA x mS is nC - the radio is in receive for the whole window, the processor is either awake or asleep
+	uint32_t chargeMicroCoulombs = (awakeMillis * LISTEN_MCU_ACTIVE_UA + asleepMillis * LISTEN_MCU_SLEEP_UA + elapsedMillis * LISTEN_RADIO_RX_UA) / 1000;
+
+	listenWindows++;
+	listenChargeMicroCoulombs += chargeMicroCoulombs;
+	if (replied) {
+		listenReplies++;
+		replyMillisTotal += elapsedMillis;
+	}
+
+	Log.infoln("Listened %lmS (%lmS awake, %lmS asleep) %s - about %luC", elapsedMillis, awakeMillis, asleepMillis, (replied) ? "for the reply" : "without a reply", chargeMicroCoulombs);
+	Log.infoln("%d listen windows average %luC, %d replies average %lmS to the reply", listenWindows, listenChargeMicroCoulombs / listenWindows, listenReplies, (listenReplies) ? replyMillisTotal / listenReplies : 0UL);
+}
+
+void LoRA_Functions::logChannelAccess() {
+	if (rf95.cadBusy() == cadBusyLogged) return;							// Only when the channel has been busy since the last time
+	cadBusyLogged = rf95.cadBusy();
+	Log.infoln("Channel found busy %d times - messages held back %lmS in total, %d given up", rf95.cadBusy(), rf95.cadDeferMillis(), rf95.cadTimeouts());
+}
+
+
+bool LoRA_Functions::reportResult(uint8_t result, const char* message) {
+	if (result == RH_ROUTER_ERROR_NONE) {
+		current.RSSI = rf95.lastRssi();						// Set these here - will send on next report
+		current.SNR = rf95.lastSNR();
+		linkControl.deliverySucceeded(current.SNR);
+		Log.infoln("Node %d - %s delivered with RSSI/SNR of %d / %d", sysStatus.nodeNumber, message, current.RSSI, current.SNR);
+		return true;
+	}
+	const char* reason = (result == RH_ROUTER_ERROR_NO_ROUTE) ? "No Route" : (result == RH_ROUTER_ERROR_UNABLE_TO_DELIVER) ? "Unable to Deliver" : "Unknown";
+	Log.infoln("Node %d - %s send to gateway %d failed - %s", sysStatus.nodeNumber, message, GATEWAY_ADDRESS, reason);
+	linkControl.deliveryFailed();
+	return false;
+}
 
 bool LoRA_Functions::composeDataReportNode() {
 
 	LED.on();
 
-	buf[0] = highByte(sysStatus.magicNumber);
-	buf[1] = lowByte(sysStatus.magicNumber);
-	buf[2] = sysStatus.nodeNumber;
-	buf[3] = highByte(sysStatus.token);
-	buf[4] = lowByte(sysStatus.token);
-	buf[5] = sysStatus.sensorType;
-	buf[6] = sysStatus.uniqueID >> 24;
-	buf[7] = sysStatus.uniqueID >> 16;
-	buf[8] = sysStatus.uniqueID >> 8;
-	buf[9] = sysStatus.uniqueID;	
-	buf[10] = highByte(current.occupancyGross);
-	buf[11] = lowByte(current.occupancyGross);
-	buf[12] = highByte(current.occupancyNet);
-	buf[13] = lowByte(current.occupancyNet);
-	buf[14] = sysStatus.space;								// The data payload size is constant - not all sensor types will use all 8 bytes
-	buf[15] = sysStatus.placement;
-	buf[16] = sysStatus.multi;
-	buf[17] = sysStatus.zoneMode;
-	buf[18] = current.internalTempC;
-	buf[19] = current.stateOfCharge;
-	buf[20] = current.batteryState;	
-	buf[21] = sysStatus.resetCount;
-	buf[22] = highByte(current.RSSI);
-	buf[23] = lowByte(current.RSSI);
-	buf[24] = highByte(current.SNR);
-	buf[25] = lowByte(current.SNR);
-	buf[26] = 0;		// These last two bytes are used by the radiohead library to track re-transmissions and re-transmission delays
-	buf[27] = 0;
+	DataReportFrame report(buf);							// Fields are written in place in the radio buffer
+	writeNodeHeader(report);
+	report.occupancyGross(current.occupancyGross);
+	report.occupancyNet(current.occupancyNet);
+	NodeConfigBits config = report.config();				// The data payload size is constant - not all sensor types will use all 6 bytes
+	config.space(sysStatus.space);
+	config.placement(sysStatus.placement);
+	config.multi(sysStatus.multi);
+	config.zoneMode(sysStatus.zoneMode);
+	config.sequence(reportQueue.sequence());				// The same until the report is delivered or queued - retries are repeats
+	writeStatus(report);
+	reportTime = timeFunctions.getTime();					// Kept in case the report has to be queued
+	reportGross = current.occupancyGross;
+	reportNet = current.occupancyNet;
+	reportUnsent = true;
+	report.retries(0);										// These last two bytes are used by the radiohead library to track re-transmissions and re-transmission delays
+	report.retransmissionDelay(0);
 
 
 	// Send a message to manager_server
   	// A route to the destination will be automatically discovered.
-	unsigned char result = manager.sendtoWait(buf, 28, GATEWAY_ADDRESS, DATA_RPT);
-	
-	if ( result == RH_ROUTER_ERROR_NONE) {
-		// It has been reliably delivered to the next node.
-		// Now wait for a reply from the ultimate server 
-		current.RSSI = rf95.lastRssi();				// Set these here - will send on next data report
-		current.SNR = rf95.lastSNR();
-		Log.infoln("Node %d data report delivered with RSSI/SNR of %d / %d ",sysStatus.nodeNumber,current.RSSI, current.SNR);
-		LED.off();
-		return true;
-	}
-	else if (result == RH_ROUTER_ERROR_NO_ROUTE) {
-        Log.infoln("Node %d - Data report send to gateway %d failed - No Route", sysStatus.nodeNumber, GATEWAY_ADDRESS);
-    }
-    else if (result == RH_ROUTER_ERROR_UNABLE_TO_DELIVER) {
-        Log.infoln("Node %d - Data report send to gateway %d failed - Unable to Deliver", sysStatus.nodeNumber, GATEWAY_ADDRESS);
-	}
-	else  {
-		Log.infoln("Node %d - Data report send to gateway %d failed - Unknown", sysStatus.nodeNumber, GATEWAY_ADDRESS);
-	}
+	unsigned char result = sendRequestNode(DataReportFrame::length, DATA_RPT);
 	LED.off();
-	return false;
+
+	return reportResult(result, "Data report");				// Not yet confirmed - see reportAcknowledged()
 }
 
 bool LoRA_Functions::receiveAcknowledmentDataReportNode() {
@@ -228,67 +419,214 @@ bool LoRA_Functions::receiveAcknowledmentDataReportNode() {
 		Log.infoln("Park is closed - will reset current occupancy");
 	}
 
-	Log.infoln("Data report acknowledged %s alert for message %d park is %s and alert code is %d with alert context %d", (sysStatus.alertCodeNode) ? "with":"without", buf[11], (sysStatus.alertCodeNode != 6) ? "open":"closed", sysStatus.alertCodeNode, sysStatus.alertContextNode);
+	Log.infoln("Data report acknowledged %s alert for message %d park is %s and alert code is %d with alert context %d", (sysStatus.alertCodeNode) ? "with":"without", DataAckFrame(buf).alertCodeNode(), (sysStatus.alertCodeNode != 6) ? "open":"closed", sysStatus.alertCodeNode, sysStatus.alertContextNode);
 
 	return true;
 }
 
-bool LoRA_Functions::composeJoinRequesttNode() {
+bool LoRA_Functions::composeAggregateReportNode() {
 
-	manager.setThisAddress(sysStatus.nodeNumber);				// Join with the right node number
+	LED.on();
 
-	buf[0] = highByte(sysStatus.magicNumber);					// Needs to equal 128
-	buf[1] = lowByte(sysStatus.magicNumber);					// Needs to equal 128
-	buf[2] = sysStatus.nodeNumber;								// Node number - typically 255 for a join request
-	buf[3] = highByte(sysStatus.token);							// Token for validation - may not be valid - if it is valid - response is to set the clock only
-	buf[4] = lowByte(sysStatus.token);							// Token for validation - may not be valid - if it is valid - response is to set the clock only
-	buf[5] = sysStatus.sensorType;								// Identifies sensor type to Gateway
-	buf[6] = sysStatus.uniqueID >> 24;							// This is a 4-byte identifier that is unique to each node and is only set once
-	buf[7] = sysStatus.uniqueID >> 16;							// This is a 4-byte identifier that is unique to each node and is only set once
-	buf[8] = sysStatus.uniqueID >> 8;							// This is a 4-byte identifier that is unique to each node and is only set once
-	buf[9] = sysStatus.uniqueID;								// This is a 4-byte identifier that is unique to each node and is only set once
-	buf[10] = sysStatus.space;									// These next four bytes are sent to the gateway and may be updated in join process
-	buf[11] = sysStatus.placement;
-	buf[12] = sysStatus.multi;
-	buf[13] = 0;												// Reserved for future use
-	buf[14] = 0;												// These last two bytes are used by the radiohead library to track re-transmissions and re-transmission delays
-	buf[15] = 0;
-	
-	Log.infoln("Node %d Sending join request with magicNumer = %d, uniqueID = %u and sensorType = %d, and payload %d / %d/ %d",sysStatus.nodeNumber, sysStatus.magicNumber, sysStatus.uniqueID, sysStatus.sensorType, sysStatus.space,sysStatus.placement, sysStatus.multi);
+	AggregateReportFrame report(buf);
+	writeNodeHeader(report);
+	report.sequence(reportQueue.sequence());				// The same until the report is delivered - a repeat carries the buckets it had
+	writeStatus(report);
+	uint8_t len = AggregateReportFrame::length;
+	len += aggregator.writeBuckets(report, buf + len, sizeof(buf) - len - 2);
+	buf[len++] = 0;											// These last two bytes are used by the radiohead library to track re-transmissions and re-transmission delays
+	buf[len++] = 0;
+
+	Log.infoln("Node %d sending %d buckets of %d minutes in a %d byte aggregated report (%d bytes encrypted, %d spare)", sysStatus.nodeNumber, report.bucketCount(), report.bucketMinutes(), len, frameEncryptedLength(len), frameBlockSlack(len));
+
+	unsigned char result = sendRequestNode(len, AGGREGATE_RPT);
+	LED.off();
+
+	return reportResult(result, "Aggregated report");		// The buckets are kept until the gateway confirms them
+}
+
+bool LoRA_Functions::composeQueuedReportNode() {
+	const ReportQueue::Entry *entry = reportQueue.next();
+	if (!entry) return false;
+	uint8_t sequence = entry->sequence;
 
 	LED.on();
-	unsigned char result = manager.sendtoWait(buf, 16, GATEWAY_ADDRESS, JOIN_REQ);
+
+	QueuedReportFrame report(buf);
+	writeNodeHeader(report);
+	report.sequence(sequence);
+	report.queueDepth(reportQueue.depth());
+	uint32_t oldestMinutes = reportQueue.oldestAgeSeconds() / 60;
+	report.oldestQueuedMinutes((oldestMinutes < 65535) ? oldestMinutes : 65535);
+	report.reportTime(entry->reportTime);
+	report.occupancyGross(entry->occupancyGross);
+	report.occupancyNet(entry->occupancyNet);
+	report.retries(0);										// These last two bytes are used by the radiohead library to track re-transmissions and re-transmission delays
+	report.retransmissionDelay(0);
+
+	Log.infoln("Node %d sending queued report %d of %d from %l seconds ago", sysStatus.nodeNumber, sequence, report.queueDepth(), timeFunctions.getTime() - report.reportTime());
+
+	awaitingSequence = sequence;							// Stays queued until the gateway confirms it
+	unsigned char result = sendRequestNode(QueuedReportFrame::length, QUEUED_RPT);
 	LED.off();
 
-	if (result == RH_ROUTER_ERROR_NONE) {						// It has been reliably delivered to the next node.
-		current.RSSI = rf95.lastRssi();						// Set these here - will send on next data report
-		current.SNR = rf95.lastSNR();
-		Log.infoln("Join request sent to gateway successfully RSSI/SNR of %d / %d ",current.RSSI, current.SNR);
-		return true;
+	return reportResult(result, "Queued report");
+}
+
+void LoRA_Functions::queueFailedReport() {
+	awaitingReport = NULL_STATE;
+	if (!reportUnsent) return;								// Only data reports are queued - the aggregator keeps its own buckets
+	reportQueue.push(ReportQueue::PRIORITY_DATA_REPORT, reportTime, reportGross, reportNet);
+	reportUnsent = false;
+}
+
+void LoRA_Functions::replyMissed() {
+	if (awaitingReport == DATA_RPT) queueFailedReport();	// A relay took it but the gateway never confirmed it - it may have been dropped
+	awaitingReport = NULL_STATE;							// Queued reports and the aggregator's buckets are still held - sent again next time
+}
+
+void LoRA_Functions::reportAcknowledged() {
+	switch (awaitingReport) {
+	case DATA_RPT:
+		reportQueue.reportSent();
+		reportUnsent = false;
+	break;
+	case AGGREGATE_RPT:
+		aggregator.reportSent();							// These buckets do not need to be sent again
+		reportQueue.reportSent();
+	break;
+	case QUEUED_RPT:
+		reportQueue.remove(awaitingSequence);				// A repeat would be dropped by the gateway
+		Log.infoln("Node %d queued report %d confirmed - %d left", sysStatus.nodeNumber, awaitingSequence, reportQueue.depth());
+	break;
 	}
-	else if (result == RH_ROUTER_ERROR_NO_ROUTE) {
-        Log.infoln("Node %d - Join request to Gateway %d failed - No Route", sysStatus.nodeNumber, GATEWAY_ADDRESS);
-    }
-    else if (result == RH_ROUTER_ERROR_UNABLE_TO_DELIVER) {
-        Log.infoln("Node %d -  Join request to Gateway %d failed - Unable to Deliver", sysStatus.nodeNumber, GATEWAY_ADDRESS);
+	awaitingReport = NULL_STATE;
+}
+
+void LoRA_Functions::receiveConfigBlock(const uint8_t* p, const uint8_t* end) {
+	configResult = configBlock.parse(p, end);
+	_configReportDue = true;												// Confirmed whether it was applied or not
+	if (configResult != ConfigBlock::APPLIED) {
+		Log.infoln("Configuration block %d rejected - result %d at tag %d - nothing changed", configBlock.id(), configResult, configBlock.failedTag());
+		return;
+	}
+	if (configBlock.repeatOf(sysStatus.configId)) {
+		configResult = ConfigBlock::REPEATED;								// Our confirmation was lost - the settings are already in effect
+		Log.infoln("Configuration block %d already applied - confirming it again", configBlock.id());
+		return;
+	}
+
+	bool recalibrate = false;
+	bool countSet = false;
+	for (uint8_t i = 0; i < configBlock.count(); i++) {					// Every item has been checked - none can fail now
+		int32_t value = configBlock.item(i).value;
+		switch (configBlock.item(i).tag) {
+		case CONFIG_zoneMode: sysStatus.zoneMode = value; break;
+		case CONFIG_distanceMode: sysStatus.distanceMode = value; break;
+		case CONFIG_interferenceBuffer: sysStatus.interferenceBuffer = value; break;
+		case CONFIG_occupancyCalibrationLoops: sysStatus.occupancyCalibrationLoops = value; break;
+		case CONFIG_recalibrate: recalibrate = true; break;
+		case CONFIG_occupancyNet:
+			current.occupancyNet = value;
+			countSet = true;
+		break;
+		case CONFIG_tofDetectionsPerSecond: sysStatus.tofDetectionsPerSecond = value; break;
+		case CONFIG_reportBucketMinutes:
+			sysStatus.reportBucketMinutes = value;
+			aggregator.restart();
+		break;
+		case CONFIG_reportDelta: sysStatus.reportDelta = value; break;
+		}
+	}
+	if (countSet) currentData.storeCurrentData();							// Stored before the id - a reset in between applies the block again, not half of it
+	sysStatus.configId = configBlock.id();
+	sysData.storeSysData();													// One write for the settings and the id
+	Log.infoln("Configuration block %d applied - %d settings", configBlock.id(), configBlock.count());
+
+	if (recalibrate) measure.recalibrate();									// After the settings - it uses the new zone and distance modes
+}
+
+int32_t LoRA_Functions::configValue(uint8_t tag) {
+	switch (tag) {
+	case CONFIG_zoneMode: return sysStatus.zoneMode;
+	case CONFIG_distanceMode: return sysStatus.distanceMode;
+	case CONFIG_interferenceBuffer: return sysStatus.interferenceBuffer;
+	case CONFIG_occupancyCalibrationLoops: return sysStatus.occupancyCalibrationLoops;
+	case CONFIG_occupancyNet: return current.occupancyNet;
+	case CONFIG_tofDetectionsPerSecond: return sysStatus.tofDetectionsPerSecond;
+	case CONFIG_reportBucketMinutes: return sysStatus.reportBucketMinutes;
+	case CONFIG_reportDelta: return sysStatus.reportDelta;
+	default: return 0;														// Actions have no value
 	}
-	else  {
-		Log.infoln("Node %d -  Join request to Gateway %d failed  - Unknown", sysStatus.nodeNumber, GATEWAY_ADDRESS);
+}
+
+bool LoRA_Functions::composeConfigReportNode() {
+
+	LED.on();
+
+	ConfigReportFrame report(buf);
+	writeNodeHeader(report);
+	report.configId(configBlock.id());
+	report.result(configResult);
+	report.failedTag(configBlock.failedTag());
+	uint8_t len = ConfigReportFrame::length;
+	if (configResult == ConfigBlock::APPLIED || configResult == ConfigBlock::REPEATED) {
+		for (uint8_t i = 0; i < configBlock.count(); i++) {
+			len += ConfigBlock::writeItem(buf + len, configBlock.item(i).tag, configValue(configBlock.item(i).tag));
+		}
 	}
+	buf[len++] = 0;											// These last two bytes are used by the radiohead library to track re-transmissions and re-transmission delays
+	buf[len++] = 0;
+
+	Log.infoln("Node %d confirming configuration block %d with result %d in a %d byte report", sysStatus.nodeNumber, report.configId(), report.result(), len);
+
+	_configReportDue = false;								// A new block in the gateway's reply sets it again
+	unsigned char result = sendRequestNode(len, CONFIG_RPT);
+	LED.off();
+
+	if (reportResult(result, "Configuration report")) return true;
+	_configReportDue = true;								// Sent again once the gateway replies
 	return false;
 }
 
+bool LoRA_Functions::composeJoinRequesttNode() {
+
+	manager.setThisAddress(sysStatus.nodeNumber);				// Join with the right node number
+
+	JoinRequestFrame request(buf);
+	request.magicNumber(sysStatus.magicNumber);					// Needs to equal 128
+	request.nodeNumber(sysStatus.nodeNumber);					// Node number - typically 255 for a join request
+	request.token(sysStatus.token);								// Token for validation - may not be valid - if it is valid - response is to set the clock only
+	request.sensorType(sysStatus.sensorType);					// Identifies sensor type to Gateway
+	request.uniqueID(sysStatus.uniqueID);						// This is a 4-byte identifier that is unique to each node and is only set once
+	request.space(sysStatus.space);								// These next four bytes are sent to the gateway and may be updated in join process
+	request.placement(sysStatus.placement);
+	request.multi(sysStatus.multi);
+	request.reserved(0);										// Reserved for future use
+	request.retries(0);											// These last two bytes are used by the radiohead library to track re-transmissions and re-transmission delays
+	request.retransmissionDelay(0);
+	
+	Log.infoln("Node %d Sending join request with magicNumer = %d, uniqueID = %u and sensorType = %d, and payload %d / %d/ %d",sysStatus.nodeNumber, sysStatus.magicNumber, sysStatus.uniqueID, sysStatus.sensorType, sysStatus.space,sysStatus.placement, sysStatus.multi);
+
+	LED.on();
+	unsigned char result = sendRequestNode(JoinRequestFrame::length, JOIN_REQ);
+	LED.off();
+
+	return reportResult(result, "Join request");
+}
+
 bool LoRA_Functions::receiveAcknowledmentJoinRequestNode() {
 	// LEDStatus blinkOrange(RGB_COLOR_ORANGE, LED_PATTERN_BLINK, LED_SPEED_NORMAL, LED_PRIORITY_IMPORTANT);
 	// Activate LED
 
 	// contents of response for 1-12 handled in common function above
 	// In a join request, the gateway will need to confirm the node number, set the uniqueID if this is a virgin device and set the sensor type and send a valid token
+	JoinAckFrame joinAck(buf);
 
-	if (sysStatus.nodeNumber == 255 || sysStatus.nodeNumber == 0) sysStatus.nodeNumber = buf[18];		// Set the node number future use
+	if (sysStatus.nodeNumber == 255 || sysStatus.nodeNumber == 0) sysStatus.nodeNumber = joinAck.assignedNodeNumber();		// Set the node number future use
 
-	if(sysStatus.sensorType != buf[13]) {
-		sysStatus.sensorType = buf[13];
+	if(sysStatus.sensorType != joinAck.sensorType()) {
+		sysStatus.sensorType = joinAck.sensorType();
 		Log.infoln("Node %d Join request acknowledged and sensorType updated to %d", sysStatus.nodeNumber, sysStatus.sensorType);
 	} else {
 		Log.infoln("Node %d Join request acknowledged - sensorType up to date.", sysStatus.nodeNumber);
@@ -296,26 +634,26 @@ bool LoRA_Functions::receiveAcknowledmentJoinRequestNode() {
 
 	Log.infoln("Testing to see if we have a valid uniqueID of %u with %d and %d", sysStatus.uniqueID, sysStatus.uniqueID >> 24 , sysStatus.uniqueID >> 16);
 	if (sysStatus.uniqueID >> 24 == 255 && (0XFF & sysStatus.uniqueID >> 16) == 255) {			// If the uniqueID is not set, set it here
-		sysStatus.uniqueID = (buf[14] << 24 | buf[15] << 16 | buf[16] << 8 | buf[17]);
+		sysStatus.uniqueID = joinAck.uniqueID();
 		sysData.updateUniqueID();														// Update the memory with the new uniqueID	
 		Log.infoln("Node %d Join request acknowledged and sensor set to %d - received uniqueID %u",sysStatus.nodeNumber, sysStatus.sensorType, sysStatus.uniqueID);
 	}
 	
-	if(sysStatus.space != buf[19]) {
-		if(buf[19] > 63){
+	if(sysStatus.space != joinAck.space()) {
+		if(joinAck.space() > 63){
 			sysStatus.space = 0;
 		} else {
-			sysStatus.space = buf[19];
+			sysStatus.space = joinAck.space();
 		}
 		Log.infoln("Node %d Join request acknowledged - space set to %d", sysStatus.nodeNumber, sysStatus.space);
 	}
 	if (sysStatus.sensorType == 10) {
-		if(sysStatus.placement != buf[20]) {
-			sysStatus.placement = buf[20];
+		if(sysStatus.placement != joinAck.placement()) {
+			sysStatus.placement = joinAck.placement();
 			Log.infoln("Node %d Join request acknowledged - placement set to %d", sysStatus.nodeNumber, sysStatus.placement);
 		}
-		if(sysStatus.multi != buf[21]) {
-			sysStatus.multi = buf[21];
+		if(sysStatus.multi != joinAck.multi()) {
+			sysStatus.multi = joinAck.multi();
 		 	Log.infoln("Node %d Join request acknowledged - multiEntrance set to %d", sysStatus.nodeNumber, sysStatus.multi);
 		}
 	}
@@ -8,72 +8,8 @@
  */
 
 // Data exchange formats
-// Format of a data report - From the Node to the Gateway so includes a token - most common message from node to gateway
-/*
-*** Header Section - Common to all Nodes
-buf[0 - 1] magicNumber                      // Magic number that identifies the Gateway's network
-buf[2] nodeNumber                           // nodeNumber - unique to each node on the gateway's network
-buf[3 - 4] Token                            // Token given to the node and good for 24 hours
-buf[5] sensorType                           // What sensor type is it
-buf[6 - 9] uniqueID          // This is a 4-byte identifier that is unique to each node and is only set once
-*** Payload Section - 12 Bytes but interpretion is different for each sensor type
-buf[10 - 17] payload                        // Payload - 8 bytes sensor type determines interpretation
-*** Status Data - Common to all Nodes
-buf[18] temp;                               // Enclosure temp (single byte signed integer -127 to 127 degrees C)
-buf[19] battChg;                            // State of charge (single byte signed integer -1 to 100%)
-buf[20] battState;                          // Battery State (single byte signed integer 0 to 6)
-buf[21] resets                              // Reset count
-buf[22-23] RSSI                             // From the Node's perspective
-buf[24-25] SNR                              // From the Node's perspective
-*** Re-Transmission Data - Common to all Nodes
-buf[26] Re-Tries                            // This byte is dedicated to RHReliableDatagram.cpp to update the number of re-transmissions
-buf[27] Re-Transmission Delay               // This byte is dedicated to RHReliableDatagram.cpp to update the accumulated delay with each re-transmission
-*/
-
-// Format of a data acknowledgement - From the Gateway to the Node - Most common message from gatewat to node
-/*    
-    buf[0 - 1] magicNumber                  // Magic Number
-    buf[2] nodeNumber                       // Node number (unique for the network)
-    buf[3 - 4] Token                        // Parrot the token back to the node
-    buf[5 - 8] Time.now()                   // Set the time 
-    buf[9 - 10] Seconds to next Report      // The gateway tells the node how many seconds until next transmission window - up to 18 hours
-    buf[11] alertCodeNode                   // This lets the Gateway trigger an alert on the node - typically a join request
-    buf[12-13] alertContextNode                // This lets the Gateway send context with an alert code if needed
-    buf[14] sensorType                      // Let's the Gateway reset the sensor if needed 
-    buf[15] Re-Tries                        // This byte is dedicated to RHReliableDatagram.cpp to update the number of re-transmissions
-    buf[16] Re-Transmission Delay           // This byte is dedicated to RHReliableDatagram.cpp to update the accumulated delay with each re-transmission
-*/
-
-// Format of a join request - From the Node to the Gateway
-// SensorType - 0/pressure, 1/PIR, 2/Magnetometer, 4/Soil
-
-/*
-buf[0-1] magicNumber;                       // Magic Number
-buf[2] nodeNumber;                          // nodeNumber - typically 255 for a join request
-buf[3 - 4] token                            // token for validation - may not be valid - if it is valid - response is to set the clock only
-buf[5] sensorType				            // Identifies sensor type to Gateway
-buf[6 - 9] Unique Node Identifier           // This is a 4-byte identifier that is unique to each node and is only set once
-buf[10-13] Payload                          // Payload - 4 bytes sensor type determines interpretation
-buf[14]  Re-Tries                           // This byte is dedicated to RHReliableDatagram.cpp to update the number of re-transmissions
-buf[15]  Re-Transmission Delay              // This byte is dedicated to RHReliableDatagram.cpp to update the accumulated delay with each re-transmission
-*/
-
-// Format for a join acknowledgement -  From the Gateway to the Node
-/*
-    buf[0 - 1]  magicNumber                 // Magic Number
-    buf[2] nodeNumber;                      // nodeNumber - assigned by the Gateway
-    buf[3 - 4] token                        // token for validation - good for the day
-    buf[5 - 8] Time.now()                   // Set the time 
-    buf[9 - 10] Seconds till next report    // For the Gateway minutes on the hour  
-    buf[11] alertCodeNode                   // Gateway can set an alert code here
-    buf[12] alertContextNode                // This lets the Gateway send context with an alert code if needed
-    buf[13]  sensorType				        // Gateway confirms sensor type
-    buf[14 - 17] uniqueID                   // This is a 4-byte identifier that is unique to each node and is only set once by the gateway on 1st joining
-    buf[18]  nodeNumber                     // Gateway assigns a node number
-    buf[19-22] Payload                      // Payload - 4 bytes sensor type determines interpretation                         
-    buf[23]  Re-Tries                       // This byte is dedicated to RHReliableDatagram.cpp to update the number of re-transmissions
-    buf[24] Re-Transmission Delay           // This byte is dedicated to RHReliableDatagram.cpp to update the accumulated delay with each re-transmission
-*/
+// The layout of each message exchanged with the gateway (data report, data ack, join request, join ack) is defined
+// once in LoRA_Frames.h - see the field lists there for the byte order and meaning of each field.
 
 #ifndef __LORA_FUNCTIONS_H
 #define __LORA_FUNCTIONS_H
@@ -88,9 +24,16 @@ buf[15]  Re-Transmission Delay              // This byte is dedicated to RHRelia
 #include <RHEncryptedDriver.h>
 #include <Speck.h>
 #include "pinout.h"
+#include "LoRA_Frames.h"
+#include "LoRA_Airtime.h"
+#include "LoRA_Slots.h"
 #include "MyData.h"
 #include "timing.h"
 #include "stsLED.h"
+#include "ReportAggregator.h"
+#include "ReportQueue.h"
+#include "RouteStore.h"
+#include "ConfigBlock.h"
 
 #define LoRA LoRA_Functions::instance()
 
@@ -144,6 +87,26 @@ public:
     */
     void sleepLoRaRadio();
 
+    /**
+     * @brief How long the node can sleep before a route discovery request it is relaying is due to be passed on
+     *
+     * @details The manager holds a request from another node back for a random wait (see RHMesh::setRebroadcast()) and passes
+     * it on from recvfromAck() - which only runs while we are awake, and millis() stops while we sleep.
+     * @param timeLeft the longest sleep wanted, in milliseconds
+     * @return timeLeft, or less if a request is due sooner - 0 if it is due now
+     */
+    uint32_t rebroadcastDueIn(uint32_t timeLeft);
+
+    /**
+     * @brief Passes on a route discovery request held back now - before the node sleeps past it or stops listening
+     */
+    void flushRebroadcast();
+
+    /**
+     * @brief Saves the mesh routes to the RTC's RAM if they have changed - so a reset or power cycle keeps them (see RouteStore.h)
+     */
+    void saveRoutes();
+
     /**
      * @brief Initialize the LoRA radio
      * 
@@ -159,6 +122,57 @@ public:
      * @return false 
      */
     bool listenForLoRAMessageNode();                // Node - sent a message - awiting reply
+    /**
+     * @brief How long to listen for the gateway's reply after a message is delivered
+     * 
+     * @details The gateway's reply delay (sent in each data ack) plus the time on air of its reply and LISTEN_MARGIN_MS.
+     * LISTEN_TIMEOUT_MS until the gateway has told us its reply delay.
+     */
+    uint32_t replyWindowMillis();
+    /**
+     * @brief True if the gateway's reply came back as the acknowledgement of the last message - there is nothing to listen for
+     */
+    bool replyReceived() const { return _replyReceived; }
+    /**
+     * @brief True once this node's next report may go - at once unless the gateway assigns reporting slots
+     * 
+     * @details The report goes in the slot the gateway assigned. Joins and nodes without a slot contend at a random start in
+     * the contention slot of a random frame - the number of frames doubles each time a contention gets no reply.
+     */
+    bool reportSlotDue();
+    /**
+     * @brief Puts the radio in receive so DIO0 wakes the processor when the reply arrives
+     */
+    void startListening();
+    /**
+     * @brief Logs the length and estimated charge of a listen window and the running averages
+     * 
+     * @param replied true if the gateway replied - elapsedMillis is then the time to the reply
+     * @param elapsedMillis time from the end of the transmission to the reply or the end of the window
+     * @param asleepMillis part of elapsedMillis the processor spent asleep
+     */
+    void logListenWindow(bool replied, uint32_t elapsedMillis, uint32_t asleepMillis);
+    /**
+     * @brief Notes a sleep in the listen window, timed with the RTC - millis() stops while we sleep
+     * 
+     * @details A frame the radio received before the sleep waited through it unread, and deliveryMillis() adds the sleep to
+     * the time since its reception. A frame that arrived during the sleep woke us, so the radio's millis() stamp is good.
+     * @param asleepMillis time asleep from the RTC
+     * @param woken true if DIO0 woke us - a frame arrived
+     */
+    void sleptWhileListening(uint32_t asleepMillis, bool woken);
+
+    /**
+     * @brief Logs how often listen before talk has found the channel busy and how long it has held messages back
+     */
+    void logChannelAccess();
+    /**
+     * @brief Sets a function called over and over while a message is on its way to the gateway - so the node keeps sampling
+     * 
+     * @details Messages are sent with the manager's non-blocking send, and the handler runs between polls - while the message is
+     * on air, while its acknowledgement (or a route discovery) is awaited and between retries. It must not use the radio or buf.
+     */
+    void whileSending(void (*handler)());
     /**
      * @brief Composes a Data Report and sends to the Gateway
      * 
@@ -173,6 +187,51 @@ public:
      * @return false 
      */
     bool receiveAcknowledmentDataReportNode();     // Node - receives acknolwedgement
+    /**
+     * @brief Composes an aggregated report - the closed count buckets - and sends to the Gateway
+     * 
+     * @details Used in place of the data report when the gateway has set a bucket length. The gateway acknowledges with a data ack.
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool composeAggregateReportNode();             // Node - Composes aggregated report
+    /**
+     * @brief Sends the next queued report to the Gateway - removed from the queue once the gateway acknowledges it
+     * 
+     * @details The gateway acknowledges with a data ack and drops a sequence number it has already seen.
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool composeQueuedReportNode();                // Node - Sends a queued report
+    /**
+     * @brief Queues the last data report - call when it could not be delivered after its retries
+     */
+    void queueFailedReport();
+    /**
+     * @brief The listen window ended without the gateway's data ack - a report a relay took is treated as not delivered
+     * 
+     * @details A data report is queued. Queued reports and aggregated buckets stay where they are and are sent again.
+     */
+    void replyMissed();
+    /**
+     * @brief True once the gateway has replied since the last failed delivery - queued reports are only sent then
+     */
+    bool linkUp() const { return _linkUp; }
+    /**
+     * @brief Confirms the last configuration block from the gateway - echoes each item with the value now in effect
+     * 
+     * @details The gateway acknowledges with a data ack. The report is sent again until it is delivered.
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool composeConfigReportNode();                // Node - Confirms a configuration block
+    /**
+     * @brief True while a configuration block from the gateway has not been confirmed
+     */
+    bool configReportDue() const { return _configReportDue; }
     /**
      * @brief Composes a Join Request and sends to the Gateway
      * 
@@ -187,6 +246,26 @@ public:
      * @return false 
      */
     bool receiveAcknowledmentJoinRequestNode();    // Node - received join request asknowledgement
+    /**
+     * @brief Reads the active modem settings back from the radio - used for time on air
+     */
+    LoRaModem activeModem();
+    /**
+     * @brief Applies modem settings to the radio - used by link adaptation to change the data rate
+     * 
+     * @details The acknowledgement timeout and listen before talk backoff are lengthened to suit slower data rates
+     */
+    void applyModemConfig(const RH_RF95::ModemConfig &config);
+    /**
+     * @brief Sets the transmit power (dBm) on the PA_BOOST pin - used by the power control loop
+     */
+    void applyTxPower(uint8_t power);
+    /**
+     * @brief Logs the encrypted size and time on air of a data report for the active modem settings
+     * 
+     * @details Shows the airtime saved by packing the status and configuration so the report fits in two cipher blocks
+     */
+    void logFramePlan();
 
 
 protected:
@@ -219,6 +298,102 @@ protected:
      */
     static LoRA_Functions *_instance;
 
+    /**
+     * @brief Sends the message in buf to the gateway as a request so the gateway's reply is the acknowledgement
+     * 
+     * @details A reply is handled as listenForLoRAMessageNode() would and replyReceived() is set. When the gateway is more
+     * than one hop away, or does not reply to requests, the message is acknowledged as before and the reply is sent separately.
+     * 
+     * @return the RHRouter result code
+     */
+    uint8_t sendRequestNode(uint8_t len, uint8_t messageFlag);
+
+    /**
+     * @brief Logs the result of sending a message to the gateway and tells link adaptation how it went
+     * 
+     * @details Common to every message the node sends - on delivery the link's RSSI / SNR are kept for the next report.
+     * 
+     * @param message - what was sent, for the log ("Data report" ...)
+     * @return true if it was delivered
+     */
+    bool reportResult(uint8_t result, const char* message);
+
+    /**
+     * @brief Checks and acts on a message from the gateway in buf - an acknowledgement of a join request or report
+     * 
+     * @param timeUncertain - the delivery time is not known (a reply to a retried request may be one the gateway kept)
+     */
+    bool handleReplyNode(uint8_t len, uint8_t from, uint8_t messageFlag, uint8_t hops, bool timeUncertain = false);
+
+    /**
+     * @brief The gateway's data ack confirms the report last sent - its sequence number moves on, or it leaves the queue
+     * 
+     * @details The next hop's acknowledgement only says a relay has it, so nothing is dropped until the gateway replies
+     */
+    void reportAcknowledged();
+
+    /**
+     * @brief Checks the configuration block in a data ack (p to end) and applies it - whole or not at all
+     * 
+     * @details The settings and the block's id are stored with one write to EEPROM. A recalibration, if asked for, follows.
+     */
+    void receiveConfigBlock(const uint8_t* p, const uint8_t* end);
+
+    /**
+     * @brief Value now in effect for a configuration block tag - echoed in the configuration report
+     */
+    int32_t configValue(uint8_t tag);
+
+    /**
+     * @brief Bounds the manager's retransmit timeout for the active data rate - it adapts to each next hop's round trips between them
+     */
+    void applyAckTimeout();
+
+    /**
+     * @brief Turns on listen before talk (CAD) with a backoff slot of one data report's time on air at the active data rate
+     */
+    void applyChannelAccess();
+
+    /**
+     * @brief Where the next report goes from the start of the current reporting frame (hundredths of a second)
+     */
+    uint32_t reportSlotOffset();
+
+    /**
+     * @brief Time in mS since the gateway stamped the message in buf - from its retransmission bytes, hops and time on air
+     * 
+     * @details The delay byte carries the retransmission timeouts and the time listen before talk held each try back, on the
+     * way here. The time since the radio received the message is from millis() plus any sleep since (see sleptWhileListening()).
+     */
+    uint16_t deliveryMillis(uint8_t len, uint8_t hops);
+
+    bool _replyReceived = false;                        // The gateway's reply came back as the acknowledgement
+
+    uint16_t replyDelayMillis = 0;                      // Gateway's reply delay from the last data ack - 0 until it tells us
+    uint16_t listenWindows = 0;                         // Listen windows since reset - for comparing listening energy
+    uint16_t listenReplies = 0;                         // ... windows that ended with a reply
+    uint32_t listenChargeMicroCoulombs = 0;             // ... estimated charge used in them
+    uint32_t replyMillisTotal = 0;                      // ... and the total time to the reply
+    uint32_t rxAsleepMillis = 0;                        // Time asleep since the radio received the frame stamped rxAsleepTime
+    uint32_t rxAsleepTime = 0;
+
+    uint32_t slotOffset = 0;                            // Where the scheduled report goes from the start of the current frame
+    uint8_t contentionAttempts = 0;                     // Contentions since the last reply from the gateway - sets the backoff
+    uint16_t cadBusyLogged = 0;                         // Busy channel detections at the last log
+    void (*sendingHandler)() = NULL;                    // Called while a message is on its way - see whileSending()
+
+    uint8_t awaitingReport = 0;                         // Message flag of the report the gateway has not acknowledged yet
+    uint8_t awaitingSequence = 0;                       // ... and the queued report's sequence number
+    bool _linkUp = false;                               // The gateway has replied since the last failed delivery
+    bool reportUnsent = false;                          // The last data report has not been delivered - queued if it is given up
+    time_t reportTime = 0;                              // ... when its counts were taken
+    uint16_t reportGross = 0;                           // ... and the counts
+    int16_t reportNet = 0;
+
+    ConfigBlock configBlock;                            // Last configuration block from the gateway
+    ConfigBlock::Result configResult = ConfigBlock::APPLIED;    // ... what was done with it
+    bool _configReportDue = false;                      // ... and it has not been confirmed yet
+
 public:
     // In this implementation - we have one gateway numde number 0 and up to 10 nodes with node numbers 1-10
     // Node numbers greater than 10 initiate a join request
@@ -0,0 +1,83 @@
+/**
+ * @file LoRA_Slots.h
+ * @author Chip McClelland (chip@seeinisghts.com)
+ * @brief Reporting slots - when a node may transmit within the gateway's reporting frame
+ * @details The gateway divides time into reporting frames of frameSeconds that start on whole multiples of frameSeconds, so
+ * every node with a synchronised clock agrees where a frame starts. The first SLOT_CONTENTION_HUNDREDTHS of each frame is the
+ * contention slot - joins and nodes without a slot transmit there at a random offset. The rest of the frame is divided into
+ * slots and the gateway gives each node the offset of its own slot in the data acknowledgement.
+ *
+ * Times are in hundredths of a second (the AB1805's resolution). This file only depends on the C standard headers so it can
+ * also be compiled natively (see tools/).
+ *
+ * @version 0.1
+ * @date 2024-03-04
+ *
+ */
+
+#ifndef __LORA_SLOTS_H
+#define __LORA_SLOTS_H
+
+#include <stdint.h>
+
+/**
+ * @brief Start of the next slot at offsetHundredths into a reporting frame - now if the slot has just started
+ *
+ * @details An offset of more than a frame is a slot in a later frame - used to spread out contention.
+ */
+inline uint64_t slotNextStart(uint64_t nowHundredths, uint8_t frameSeconds, uint32_t offsetHundredths) {
+    uint64_t frameHundredths = frameSeconds * 100ULL;
+    uint64_t start = nowHundredths - nowHundredths % frameHundredths + offsetHundredths;
+    if (start < nowHundredths) start += frameHundredths;
+    return start;
+}
+
+/**
+ * @brief True if the gateway's offset is a slot of its own - past the contention slot and inside the frame
+ */
+inline bool slotOffsetValid(uint8_t frameSeconds, uint16_t offsetHundredths, uint16_t contentionHundredths) {
+    return frameSeconds != 0 && offsetHundredths >= contentionHundredths && offsetHundredths < frameSeconds * 100UL;
+}
+
+/**
+ * @brief Length of a slot - one report, the gateway's reply and a guard either side for the clock error
+ */
+inline uint16_t slotLengthHundredths(uint32_t exchangeMicros, uint16_t guardHundredths) {
+    return (exchangeMicros + 9999UL) / 10000UL + 2 * guardHundredths;
+}
+
+/**
+ * @brief Number of slots in a frame after the contention slot - the most nodes a gateway can give slots to
+ */
+inline uint16_t slotCount(uint8_t frameSeconds, uint16_t slotHundredths, uint16_t contentionHundredths) {
+    uint32_t frameHundredths = frameSeconds * 100UL;
+    if (slotHundredths == 0 || frameHundredths <= contentionHundredths) return 0;
+    return (frameHundredths - contentionHundredths) / slotHundredths;
+}
+
+/**
+ * @brief Offset the gateway gives the node in slot index (0 to slotCount() - 1) - the guard comes first
+ */
+inline uint16_t slotOffsetForIndex(uint16_t index, uint16_t slotHundredths, uint16_t guardHundredths, uint16_t contentionHundredths) {
+    return contentionHundredths + index * slotHundredths + guardHundredths;
+}
+
+/**
+ * @brief Offset to send a report at - the node's own slot, or while it is joining or has none a random start in the
+ * contention slot of one of the next few frames
+ *
+ * @details Each report sent in contention doubles the frames it may go in, up to 2^maxBackoff - spreads out a crowd of
+ * nodes joining at once. contentionAttempts is counted here - the caller clears it when the gateway replies.
+ *
+ * @param exchangeHundredths - time left at the end of the contention slot for the exchange to finish
+ * @param randomBelow - a random number from 0 to n - 1 (Arduino's random(n))
+ */
+inline uint32_t reportSlotOffset(uint8_t frameSeconds, uint16_t offsetHundredths, bool joining, uint8_t &contentionAttempts,
+        uint16_t contentionHundredths, uint16_t exchangeHundredths, uint8_t maxBackoff, long (*randomBelow)(long)) {
+    if (!joining && slotOffsetValid(frameSeconds, offsetHundredths, contentionHundredths)) return offsetHundredths;
+    uint32_t frames = 1UL << ((contentionAttempts < maxBackoff) ? contentionAttempts : maxBackoff);
+    if (contentionAttempts < 255) contentionAttempts++;
+    return randomBelow(frames) * frameSeconds * 100UL + randomBelow(contentionHundredths - exchangeHundredths);
+}
+
+#endif  /* __LORA_SLOTS_H */
@@ -120,6 +120,12 @@ void sysStatusData::initialize() {
     sysStatus.distanceMode = TOF_DEFAULT_DISTANCE_MODE;                       
     sysStatus.tofDetectionsPerSecond = TOF_DEFAULT_DETECTIONS_PER_SECOND;   
     sysStatus.transmitLatencySeconds = TRANSMIT_LATENCY;   
+    sysStatus.reportBucketMinutes = AGGREGATE_DEFAULT_BUCKET_MINUTES;
+    sysStatus.dataRate = ADR_DEFAULT_DATA_RATE;
+    sysStatus.slotFrameSeconds = 0;
+    sysStatus.slotOffset = 0;
+    sysStatus.reportDelta = REPORT_DEFAULT_DELTA;
+    sysStatus.configId = 0;                                  // No configuration block applied - ConfigBlock::noId
 
     Log.infoln("Saving new system values, node number %i, uniqueID %u and magic number %i", sysStatus.nodeNumber, sysStatus.uniqueID, sysStatus.magicNumber);
     myMem.put(0,sysStatus.structuresVersion);
@@ -151,6 +157,17 @@ void sysStatusData::updateUniqueID() {
     Log.infoln("UniqueID updated to %u and stored in protected space", sysStatus.uniqueID);
 }
 
+bool sysStatusData::getTofBaselines(TofBaselineStructure &baselines) {
+    myMem.get(120, baselines);
+    return (baselines.structuresVersion == STRUCTURES_VERSION);
+}
+
+void sysStatusData::storeTofBaselines(TofBaselineStructure &baselines) {
+    baselines.structuresVersion = STRUCTURES_VERSION;
+    myMem.put(120, baselines);
+    Log.infoln("TOF baselines stored to EEPROM for zone mode %d and distance mode %d", baselines.zoneMode, baselines.distanceMode);
+}
+
 // *****************  Current Status Storage Object *******************
 // Offset of 100 bytes - make room for SysStatus
 // ********************************************************************
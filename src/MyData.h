@@ -38,7 +38,15 @@ System Data
     36              uint8_t        interferenceBuffer           The floor interference buffer of a ToF Sensor.
     37              uint8_t        occupancyCalibrationLoops    The number of calibration loops to execute for a ToF Sensor during calibration.
     38              uint8_t        distanceMode                 The distance mode for the TOF sensor. 0 = short (up to 1.3m), 1 = medium (up to 3m), 2 = long (up to 4m)
-    39-49           Reserved
+    39              uint8_t        tofDetectionsPerSecond       The number of detections to make per second when in detection mode on the TOF sensor
+    40              uint8_t        transmitLatencySeconds       The number of seconds to wait (after a count) before sending a message to the gateway
+    41              uint8_t        reportBucketMinutes          Length of the aggregated report buckets set by the gateway - 0 for a single snapshot per report
+    42              uint8_t        dataRate                     Data rate (step in the ADR ladder) confirmed by the gateway
+    43              uint8_t        slotFrameSeconds             Length of the gateway's reporting frame - 0 when the gateway does not assign slots
+    44              uint16_t       slotOffset                   Start of this node's reporting slot in the frame (hundredths of a second)
+    46              uint8_t        reportDelta                  Change in the net count worth a report of its own - smaller changes wait for the heartbeat
+    47              uint8_t        configId                     Id of the last configuration block applied - a block sent again is not applied twice (0 for none)
+    48-49           Reserved
 Current Data
     90              int8_t         internalTempC;       Enclosure temperature in degrees C
     94              int8_t         internalHumidity     Enclosure humidity in percent
@@ -49,6 +57,13 @@ Current Data
 	110             uint16_t       occupancyGross       Change in occupancy since last report
 	113             uint16_t       occupancyNet         Current occupancy count
     115             uint8_t        occupancyState       Allows us to monitor occupancy state across functions
+TOF Calibration Baselines
+    120             uint8_t        structuresVersion    Must match STRUCTURES_VERSION for the stored baselines to be used
+    121             uint8_t        zoneMode             Zone mode the baselines were captured with
+    122             uint8_t        distanceMode         Distance mode the baselines were captured with
+    124             uint32_t       timingBudget         Timing budget (us) the baselines were captured with
+    128             uint16_t       detectionFloor       Floor distance for the detection zone (before the interferenceBuffer is applied)
+    130             uint16_t       measurementFloor[2]  Floor distances for zone 1 and zone 2 (before the interferenceBuffer is applied)
 */
 
 #ifndef __MYDATA_H
@@ -59,7 +74,7 @@ Current Data
 #include <ArduinoLog.h>
 #include "SparkFun_External_EEPROM.h" // Click here to get the library: http://librarymanager/All#SparkFun_External_EEPROM
 
-#define STRUCTURES_VERSION 22                           // Version of the data structures (system and data)
+#define STRUCTURES_VERSION 27                           // Version of the data structures (system and data)
 
 //Macros(#define) to swap out during pre-processing (use sparingly). This is typically used outside of this .H and .CPP file within the main .CPP file or other .CPP files that reference this header file. 
 // This way you can do "data.setup()" instead of "MyPersistentData::instance().setup()" as an example
@@ -140,6 +155,33 @@ public:
      */
     void updateUniqueID();
 
+    /**
+     * @brief Stored TOF calibration baselines - keyed by the sensor configuration they were captured with
+     * 
+     * Floors are the closest distances seen during calibration, the interferenceBuffer is applied when they are loaded
+     */
+    struct TofBaselineStructure
+    {
+        uint8_t structuresVersion;                        // Must match STRUCTURES_VERSION for the baselines to be used
+        uint8_t zoneMode;                                 // Zone mode the baselines were captured with
+        uint8_t distanceMode;                             // Distance mode the baselines were captured with
+        uint32_t timingBudget;                            // Timing budget (us) the baselines were captured with
+        uint16_t detectionFloor;                          // Floor distance for the detection zone in mm
+        uint16_t measurementFloor[2];                     // Floor distances for zone 1 and zone 2 in mm
+    };
+
+    /**
+     * @brief Retrieves the stored TOF calibration baselines from EEPROM
+     * 
+     * @return true if the stored baselines were written by this structure version
+     */
+    bool getTofBaselines(TofBaselineStructure &baselines);
+
+    /**
+     * @brief Stores the TOF calibration baselines to EEPROM so a reset does not require a full calibration
+     */
+    void storeTofBaselines(TofBaselineStructure &baselines);
+
 
 	struct SystemDataStructure
 	{
@@ -164,6 +206,12 @@ public:
         uint8_t distanceMode;                             // The distance mode for a TOF sensor asset. 0 = short (up to 1.3m), 1 = medium (up to 3m), 2 = long (up to 4m)
         uint8_t tofDetectionsPerSecond;                   // The number of detections to make per second when in detection mode on the TOF sensor
         uint8_t transmitLatencySeconds;                   // The number of seconds to wait (after a count) before sending a message to the gateway
+        uint8_t reportBucketMinutes;                      // Length of the aggregated report buckets - 0 sends a single snapshot with each report - this value is changed by the Gateway
+        uint8_t dataRate;                                 // Data rate (step in the ADR ladder) - proposed by the node and confirmed by the Gateway
+        uint8_t slotFrameSeconds;                         // Length of the reporting frame - 0 if the Gateway does not assign slots - this value is changed by the Gateway
+        uint16_t slotOffset;                              // Start of this node's reporting slot in the frame (hundredths of a second) - this value is changed by the Gateway
+        uint8_t reportDelta;                              // Change in the net count worth a report of its own - smaller changes wait for the heartbeat - this value is changed by the Gateway
+        uint8_t configId;                                 // Id of the last configuration block applied - stored with its settings, after a count it sets
 
     };
 	SystemDataStructure sysStatusStruct;
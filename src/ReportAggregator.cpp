@@ -0,0 +1,115 @@
+#include "ReportAggregator.h"
+
+ReportAggregator *ReportAggregator::_instance;
+
+// [static]
+ReportAggregator &ReportAggregator::instance() {
+    if (!_instance) {
+        _instance = new ReportAggregator();
+    }
+    return *_instance;
+}
+
+ReportAggregator::ReportAggregator() {
+}
+
+ReportAggregator::~ReportAggregator() {
+}
+
+void ReportAggregator::setup() {
+    if (enabled()) Log.infoln("Aggregating counts into %d minute buckets - reporting every %d buckets", sysStatus.reportBucketMinutes, AGGREGATE_MAX_BUCKETS);
+    openBucketEnd = 0;                                                  // The first bucket starts once the clock is valid
+}
+
+void ReportAggregator::loop() {
+    if (!enabled() || !timeFunctions.isRTCSet()) return;
+
+    time_t now = timeFunctions.getTime();
+    time_t bucketSeconds = sysStatus.reportBucketMinutes * 60UL;
+
+    // Start over if this is the first bucket, the clock was moved back or we have been away for longer than all the buckets
+    if (openBucketEnd == 0 || openBucketEnd > now + bucketSeconds || now - openBucketEnd > bucketSeconds * AGGREGATE_MAX_BUCKETS) {
+        restart();
+        return;
+    }
+
+    while (now >= openBucketEnd) {                                      // Counts seen while we were busy go in the first bucket closed
+        closeBucket();
+        openBucketEnd += bucketSeconds;
+    }
+}
+
+void ReportAggregator::restart() {
+    bucketCount = 0;
+    bucketsWritten = 0;
+    grossBase = current.occupancyGross;
+    netBase = current.occupancyNet;
+    if (!enabled() || !timeFunctions.isRTCSet()) {
+        openBucketEnd = 0;
+        return;
+    }
+    time_t bucketSeconds = sysStatus.reportBucketMinutes * 60UL;
+    time_t now = timeFunctions.getTime();
+    firstBucketStart = now - (now % bucketSeconds);                     // Buckets are aligned so the gateway can line up nodes
+    openBucketEnd = firstBucketStart + bucketSeconds;
+    Log.infoln("Aggregation restarted - first bucket closes in %d seconds", (int)(openBucketEnd - now));
+}
+
+void ReportAggregator::closeBucket() {
+    if (bucketCount >= AGGREGATE_MAX_BUCKETS) {                         // Not able to report - the oldest bucket is queued to be sent on its own
+        firstBucketStart += sysStatus.reportBucketMinutes * 60UL;
+        reportQueue.push(ReportQueue::PRIORITY_BUCKET, firstBucketStart, buckets[0].occupancyGross, buckets[0].occupancyNet);
+        grossBase = buckets[0].occupancyGross;
+        netBase = buckets[0].occupancyNet;
+        memmove(&buckets[0], &buckets[1], (AGGREGATE_MAX_BUCKETS - 1) * sizeof(Bucket));
+        bucketCount--;
+        if (bucketsWritten) bucketsWritten--;
+        Log.infoln("Aggregation buckets full - queued the oldest bucket");
+    }
+    buckets[bucketCount].occupancyGross = current.occupancyGross;
+    buckets[bucketCount].occupancyNet = current.occupancyNet;
+    bucketCount++;
+}
+
+void ReportAggregator::queueBuckets() {
+    if (!enabled()) return;
+    time_t bucketEnd = firstBucketStart;
+    for (uint8_t i = 0; i < bucketCount; i++) {                         // Each bucket is the counts at its end
+        bucketEnd += sysStatus.reportBucketMinutes * 60UL;
+        reportQueue.push(ReportQueue::PRIORITY_BUCKET, bucketEnd, buckets[i].occupancyGross, buckets[i].occupancyNet);
+    }
+    restart();
+}
+
+uint8_t ReportAggregator::writeBuckets(AggregateReportFrame &frame, uint8_t *data, uint8_t space) {
+    uint8_t used = 0;
+    uint8_t count = 0;
+    uint16_t gross = grossBase;
+    int16_t net = netBase;
+
+    while (count < bucketCount && used + 6 <= space) {                  // Each count change is at most three bytes as a zigzag varint
+        used += framePutVarint(data + used, zigzagEncode((int32_t)buckets[count].occupancyGross - gross));
+        used += framePutVarint(data + used, zigzagEncode((int32_t)buckets[count].occupancyNet - net));
+        gross = buckets[count].occupancyGross;
+        net = buckets[count].occupancyNet;
+        count++;
+    }
+
+    frame.bucketMinutes(sysStatus.reportBucketMinutes);
+    frame.bucketCount(count);
+    frame.firstBucketStart(firstBucketStart);
+    frame.occupancyGrossBase(grossBase);
+    frame.occupancyNetBase(netBase);
+    bucketsWritten = count;
+    return used;
+}
+
+void ReportAggregator::reportSent() {
+    if (!bucketsWritten) return;
+    grossBase = buckets[bucketsWritten - 1].occupancyGross;
+    netBase = buckets[bucketsWritten - 1].occupancyNet;
+    memmove(&buckets[0], &buckets[bucketsWritten], (bucketCount - bucketsWritten) * sizeof(Bucket));
+    firstBucketStart += bucketsWritten * sysStatus.reportBucketMinutes * 60UL;
+    bucketCount -= bucketsWritten;
+    bucketsWritten = 0;
+}
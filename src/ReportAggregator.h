@@ -0,0 +1,150 @@
+/**
+ * @file ReportAggregator.h
+ * @author Chip McClelland (chip@seeinisghts.com)
+ * @brief Accumulates the occupancy counts into fixed length intervals (buckets) so several intervals can be sent in one report
+ * @details The bucket length is set by the gateway (alert code 14). A length of zero turns aggregation off and the node sends
+ * a single snapshot with each data report as before. Buckets are aligned to multiples of the bucket length so the gateway
+ * can line up reports from different nodes.
+ * @version 0.1
+ * @date 2024-03-04
+ *
+ */
+
+#ifndef __REPORTAGGREGATOR_H
+#define __REPORTAGGREGATOR_H
+
+#include <arduino.h>
+#include <ArduinoLog.h>
+#include "Config.h"
+#include "MyData.h"
+#include "timing.h"
+#include "LoRA_Frames.h"
+#include "ReportQueue.h"
+
+#define aggregator ReportAggregator::instance()
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From global application setup you must call:
+ * ReportAggregator::instance().setup();
+ *
+ * From global application loop you must call:
+ * ReportAggregator::instance().loop();
+ */
+class ReportAggregator {
+public:
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use ReportAggregator::instance() to instantiate the singleton.
+     */
+    static ReportAggregator &instance();
+
+    /**
+     * @brief Perform setup operations; call this from global application setup()
+     *
+     * You typically use aggregator.setup();
+     */
+    void setup();
+
+    /**
+     * @brief Perform application loop operations; call this from global application loop()
+     *
+     * @details Closes the open bucket once its interval has passed
+     */
+    void loop();
+
+    /**
+     * @brief Discards the buckets and starts a new one - used when the bucket length changes or the counts are reset
+     */
+    void restart();
+
+    /**
+     * @brief Moves the closed buckets to the report queue and starts again - used before a power cycle, which loses them
+     */
+    void queueBuckets();
+
+    /**
+     * @brief True if the gateway has set a bucket length - reports are then sent as aggregated reports
+     */
+    bool enabled() const { return sysStatus.reportBucketMinutes != 0; }
+
+    /**
+     * @brief True when all the buckets are full and should be sent
+     */
+    bool reportDue() const { return enabled() && bucketCount >= AGGREGATE_MAX_BUCKETS; }
+
+    /**
+     * @brief Number of closed buckets waiting to be sent
+     */
+    uint8_t pendingBuckets() const { return bucketCount; }
+
+    /**
+     * @brief Writes the closed buckets into an aggregated report
+     *
+     * @details Fills the aggregate fields of the frame and appends the zigzag varint bucket deltas after the fixed fields.
+     * The report header and status fields are left to the caller.
+     *
+     * @param frame The report being composed in the radio buffer
+     * @param data Where the bucket deltas are written (right after the fixed fields)
+     * @param space Number of bytes available at data
+     * @return The number of bytes written at data
+     */
+    uint8_t writeBuckets(AggregateReportFrame &frame, uint8_t *data, uint8_t space);
+
+    /**
+     * @brief The buckets written by the last writeBuckets() were delivered - they can be dropped
+     */
+    void reportSent();
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use ReportAggregator::instance() to instantiate the singleton.
+     */
+    ReportAggregator();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~ReportAggregator();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    ReportAggregator(const ReportAggregator&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    ReportAggregator& operator=(const ReportAggregator&) = delete;
+
+    /**
+     * @brief Closes the open bucket with the current counts - queues the oldest bucket if there is no more room
+     */
+    void closeBucket();
+
+    struct Bucket {
+        uint16_t occupancyGross;                        // occupancyGross at the end of the bucket
+        int16_t occupancyNet;                           // occupancyNet at the end of the bucket
+    };
+
+    Bucket buckets[AGGREGATE_MAX_BUCKETS];              // Closed buckets - oldest first
+    uint8_t bucketCount = 0;                            // Number of closed buckets
+    uint8_t bucketsWritten = 0;                         // Number of buckets in the last report composed
+    time_t firstBucketStart = 0;                        // Start of the oldest closed bucket
+    time_t openBucketEnd = 0;                           // When the open bucket will close
+    uint16_t grossBase = 0;                             // Counts at the start of the oldest bucket
+    int16_t netBase = 0;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static ReportAggregator *_instance;
+};
+
+#endif  /* __REPORTAGGREGATOR_H */
@@ -0,0 +1,80 @@
+/**
+ * @file ReportPolicy.h
+ * @author Chip McClelland (chip@seeinisghts.com)
+ * @brief Decides when a change in the count is worth a report of its own
+ * @details Each report the gateway acknowledges sets the next heartbeat (secondsTillNextReport). In between, a change in
+ * occupancyNet is only reported when the count has moved delta or more from the last report - transmit latency seconds
+ * after the first change that did, so a run of changes goes in one report and a steady stream of them cannot put it off -
+ * or at once when it has moved swing or more or has crossed the occupancy limit. A count that comes back within delta (4 -> 5 -> 4) before then cancels the report.
+ *
+ * This file only depends on the C standard headers so it can also be compiled natively (see tools/).
+ *
+ * @version 0.1
+ * @date 2024-03-04
+ *
+ */
+
+#ifndef __REPORTPOLICY_H
+#define __REPORTPOLICY_H
+
+#include <stdint.h>
+
+class ReportPolicy {
+public:
+    enum Urgency {
+        NOT_NEEDED,                                     // The heartbeat will carry it
+        AFTER_LATENCY,                                  // Report once the count has settled
+        NOW                                             // Report at once
+    };
+
+    /**
+     * @brief How soon a net count of net needs reporting when the last report carried reportedNet
+     *
+     * @param delta - smallest change worth a report of its own (0 is taken as 1 - every change)
+     * @param swing - change reported at once
+     * @param limit - occupancy limit - a count above it generates an alert at the gateway
+     */
+    static Urgency urgency(int16_t reportedNet, int16_t net, uint8_t delta, uint16_t swing, int16_t limit) {
+        int32_t change = (net > reportedNet) ? net - reportedNet : reportedNet - net;
+        if (delta == 0) delta = 1;
+        if ((net > limit) != (reportedNet > limit)) return NOW;
+        if (change >= swing && change >= delta) return NOW;
+        if (change >= delta) return AFTER_LATENCY;
+        return NOT_NEEDED;
+    }
+
+    /**
+     * @brief The net count has changed - works out when (if at all) it will be reported ahead of the heartbeat
+     */
+    Urgency countChanged(uint32_t now, int16_t net, uint8_t delta, uint16_t swing, int16_t limit, uint8_t latencySeconds) {
+        Urgency result = urgency(reportedNet, net, delta, swing, limit);
+        if (result == NOW) changeTime = now;
+        else if (result == AFTER_LATENCY) { if (!changeTime) changeTime = now + latencySeconds; }    // Already pending - not put back
+        else changeTime = 0;                            // Back within delta - nothing to report
+        return result;
+    }
+
+    /**
+     * @brief True once a change is due to be reported
+     */
+    bool changeDue(uint32_t now) const { return changeTime != 0 && now >= changeTime; }
+
+    /**
+     * @brief A report carrying net is being sent - later changes are measured from it
+     */
+    void reportSent(int16_t net) {
+        reportedNet = net;
+        changeTime = 0;
+    }
+
+    /**
+     * @brief The net count in the last report
+     */
+    int16_t lastReported() const { return reportedNet; }
+
+protected:
+    int16_t reportedNet = 0;                            // Net count in the last report
+    uint32_t changeTime = 0;                            // When the change will be reported - 0 if it does not need a report of its own
+};
+
+#endif  /* __REPORTPOLICY_H */
@@ -0,0 +1,117 @@
+#include "ReportQueue.h"
+#include "MyData.h"
+#include "RtcRam.h"
+
+ReportQueue *ReportQueue::_instance;
+
+// [static]
+ReportQueue &ReportQueue::instance() {
+    if (!_instance) {
+        _instance = new ReportQueue();
+    }
+    return *_instance;
+}
+
+ReportQueue::ReportQueue() {
+}
+
+ReportQueue::~ReportQueue() {
+}
+
+void ReportQueue::setup() {
+    static_assert(QUEUE_RAM_ADDRESS + sizeof(Store) <= ROUTE_STORE_RAM_ADDRESS, "Report queue must end before the saved routes in the AB1805's RAM");
+    static_assert(QUEUE_MAX_REPORTS < LORA_SEQUENCE_MODULUS, "A full queue must leave a sequence number free for new reports");
+
+    timeFunctions.readRam(QUEUE_RAM_ADDRESS, (uint8_t *)&store, sizeof(store));
+    if (store.structuresVersion != STRUCTURES_VERSION || store.count > QUEUE_MAX_REPORTS || store.sequence >= LORA_SEQUENCE_MODULUS || store.checksum != checksum()) {
+        Log.infoln("No report queue in the RTC's RAM - starting an empty queue");
+        store.structuresVersion = STRUCTURES_VERSION;
+        store.count = 0;
+        store.sequence = 0;
+        save();
+        return;
+    }
+    if (store.count) Log.infoln("%d reports queued - oldest from %l seconds ago", store.count, oldestAgeSeconds());
+}
+
+void ReportQueue::reportSent() {
+    nextSequence();
+    save();
+}
+
+void ReportQueue::push(Priority priority, time_t reportTime, uint16_t occupancyGross, int16_t occupancyNet) {
+    uint8_t sequence = store.sequence;
+
+    if (store.count >= QUEUE_MAX_REPORTS) {
+        uint8_t drop = 0;                                                   // Oldest report of the lowest priority
+        for (uint8_t i = 1; i < store.count; i++) {
+            if (store.entries[i].priority > store.entries[drop].priority) drop = i;
+        }
+        if (priority > store.entries[drop].priority) {
+            Log.infoln("Report queue full - not queueing report %d", sequence);
+            nextSequence();
+            save();
+            return;
+        }
+        Log.infoln("Report queue full - dropped report %d", store.entries[drop].sequence);
+        memmove(&store.entries[drop], &store.entries[drop + 1], (store.count - drop - 1) * sizeof(Entry));
+        store.count--;
+    }
+
+    Entry &entry = store.entries[store.count++];
+    entry.reportTime = reportTime;
+    entry.occupancyGross = occupancyGross;
+    entry.occupancyNet = occupancyNet;
+    entry.sequence = sequence;
+    entry.priority = priority;
+    nextSequence();
+    save();
+    Log.infoln("Queued report %d - %d reports waiting to be sent again", sequence, store.count);
+}
+
+const ReportQueue::Entry *ReportQueue::next() const {
+    if (!store.count) return NULL;
+    uint8_t first = 0;                                                      // Oldest report of the highest priority
+    for (uint8_t i = 1; i < store.count; i++) {
+        if (store.entries[i].priority < store.entries[first].priority) first = i;
+    }
+    return &store.entries[first];
+}
+
+void ReportQueue::remove(uint8_t sequence) {
+    for (uint8_t i = 0; i < store.count; i++) {
+        if (store.entries[i].sequence != sequence) continue;
+        memmove(&store.entries[i], &store.entries[i + 1], (store.count - i - 1) * sizeof(Entry));
+        store.count--;
+        save();
+        return;
+    }
+}
+
+void ReportQueue::nextSequence() {
+    bool queued;
+    do {                                                                    // Skip those still queued - the gateway would take a new report for a repeat
+        store.sequence = (store.sequence + 1) % LORA_SEQUENCE_MODULUS;
+        queued = false;
+        for (uint8_t i = 0; i < store.count; i++) queued |= store.entries[i].sequence == store.sequence;
+    } while (queued);
+}
+
+uint32_t ReportQueue::oldestAgeSeconds() {
+    if (!store.count) return 0;
+    uint32_t oldest = store.entries[0].reportTime;                          // Buckets may be older than reports queued before them
+    for (uint8_t i = 1; i < store.count; i++) {
+        if (store.entries[i].reportTime < oldest) oldest = store.entries[i].reportTime;
+    }
+    uint32_t now = timeFunctions.getTime();
+    return (now > oldest) ? now - oldest : 0;
+}
+
+void ReportQueue::save() {
+    store.checksum = checksum();
+    timeFunctions.writeRam(QUEUE_RAM_ADDRESS, (const uint8_t *)&store, offsetof(Store, entries) + store.count * sizeof(Entry));
+}
+
+uint8_t ReportQueue::checksum() const {
+    return rtcRamChecksum(store.structuresVersion ^ store.count ^ store.sequence, store.entries, store.count * sizeof(Entry));
+}
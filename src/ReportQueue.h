@@ -0,0 +1,159 @@
+/**
+ * @file ReportQueue.h
+ * @author Chip McClelland (chip@seeinisghts.com)
+ * @brief Keeps the counts from reports that could not be delivered so they can be sent again once the gateway is heard from
+ * @details A data report that fails after its retries or that the gateway never acknowledges (a relay may have dropped
+ * it), and an aggregation bucket that would otherwise be merged away, are queued with their sequence number and the
+ * time their counts were taken. The queue is kept in the AB1805's RAM so it survives resets and the power cycle of
+ * alert code 3 without wearing the EEPROM. Queued reports are sent as queued reports (see LoRA_Frames.h) - buckets
+ * first, then data reports, oldest first - and the gateway drops a sequence number it has already seen, so a report
+ * that did arrive but whose acknowledgement was lost is not counted twice. Sequence numbers wrap at
+ * LORA_SEQUENCE_MODULUS, so new reports skip those still queued - no two reports waiting for the gateway share one.
+ * @version 0.1
+ * @date 2024-03-04
+ *
+ */
+
+#ifndef __REPORTQUEUE_H
+#define __REPORTQUEUE_H
+
+#include <arduino.h>
+#include <ArduinoLog.h>
+#include "Config.h"
+#include "timing.h"
+#include "LoRA_Frames.h"
+
+#define reportQueue ReportQueue::instance()
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From global application setup you must call (after timing setup):
+ * ReportQueue::instance().setup();
+ */
+class ReportQueue {
+public:
+    /**
+     * @brief Which queued reports are sent first - and which are dropped when the queue is full (the last)
+     */
+    enum Priority : uint8_t {
+        PRIORITY_BUCKET = 0,                            // Aggregation bucket - its detail is not carried by any later report
+        PRIORITY_DATA_REPORT = 1                        // Data report - later reports still carry its totals
+    };
+
+    struct Entry {
+        uint32_t reportTime;                            // When the counts were taken
+        uint16_t occupancyGross;
+        int16_t occupancyNet;
+        uint8_t sequence;                               // Sequence number the report was (or would have been) sent with
+        uint8_t priority;
+    };
+
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use ReportQueue::instance() to instantiate the singleton.
+     */
+    static ReportQueue &instance();
+
+    /**
+     * @brief Perform setup operations; call this from global application setup()
+     *
+     * @details Loads the queue from the AB1805's RAM - it is emptied if the RAM does not hold a valid queue (first power up)
+     */
+    void setup();
+
+    /**
+     * @brief Sequence number for the next new report
+     */
+    uint8_t sequence() const { return store.sequence; }
+
+    /**
+     * @brief The gateway acknowledged the report sent with sequence() - the next report takes the next sequence number not queued
+     */
+    void reportSent();
+
+    /**
+     * @brief Queues counts that could not be delivered with sequence() - the next report takes the next sequence number not queued
+     *
+     * @details When the queue is full the oldest report of the lowest priority is dropped - the new one if that is lower still.
+     */
+    void push(Priority priority, time_t reportTime, uint16_t occupancyGross, int16_t occupancyNet);
+
+    /**
+     * @brief The queued report to send next - the oldest of the highest priority - or NULL if the queue is empty
+     */
+    const Entry *next() const;
+
+    /**
+     * @brief The gateway acknowledged the queued report with this sequence number - it can be dropped
+     */
+    void remove(uint8_t sequence);
+
+    /**
+     * @brief Number of queued reports
+     */
+    uint8_t depth() const { return store.count; }
+
+    /**
+     * @brief Seconds since the counts in the oldest queued report were taken - 0 if the queue is empty
+     */
+    uint32_t oldestAgeSeconds();
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use ReportQueue::instance() to instantiate the singleton.
+     */
+    ReportQueue();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~ReportQueue();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    ReportQueue(const ReportQueue&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    ReportQueue& operator=(const ReportQueue&) = delete;
+
+    /**
+     * @brief Moves sequence() on to the next sequence number that no queued report holds
+     */
+    void nextSequence();
+
+    /**
+     * @brief Writes the queue to the AB1805's RAM
+     */
+    void save();
+
+    /**
+     * @brief Check byte over the queue - so the contents of the RAM at first power up are not taken for a queue
+     */
+    uint8_t checksum() const;
+
+    struct Store {
+        uint8_t structuresVersion;                      // STRUCTURES_VERSION when the queue was written
+        uint8_t count;                                  // Number of queued reports - oldest queued first
+        uint8_t sequence;                               // Sequence number for the next new report
+        uint8_t checksum;
+        Entry entries[QUEUE_MAX_REPORTS];
+    };
+
+    Store store;
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static ReportQueue *_instance;
+};
+
+#endif  /* __REPORTQUEUE_H */
@@ -0,0 +1,87 @@
+#include "RouteStore.h"
+#include "MyData.h"
+#include "RtcRam.h"
+
+RouteStore *RouteStore::_instance;
+
+// [static]
+RouteStore &RouteStore::instance() {
+    if (!_instance) {
+        _instance = new RouteStore();
+    }
+    return *_instance;
+}
+
+RouteStore::RouteStore() {
+}
+
+RouteStore::~RouteStore() {
+}
+
+void RouteStore::setup(RHRouter &router) {
+    static_assert(ROUTE_STORE_RAM_ADDRESS + sizeof(Store) <= 256, "Saved routes must fit in the AB1805's RAM");
+
+    timeFunctions.readRam(ROUTE_STORE_RAM_ADDRESS, (uint8_t *)&store, sizeof(store));
+    if (store.structuresVersion != STRUCTURES_VERSION || store.count > ROUTE_STORE_MAX_ROUTES || store.checksum != checksum()) {
+        Log.infoln("No saved routes in the RTC's RAM");
+        return;
+    }
+    uint32_t now = timeFunctions.getTime();
+    if (!timeFunctions.isRTCSet() || now < store.savedTime || now - store.savedTime > ROUTE_STORE_MAX_AGE_SECONDS) {
+        Log.infoln("Saved routes are too old to trust - they will be discovered again");
+        return;
+    }
+    for (uint8_t i = 0; i < store.count; i++) {
+        const Entry &entry = store.entries[i];
+        router.restoreRoute(entry.dest, entry.nextHop, entry.hops, entry.quality, entry.used);
+    }
+    savedChanges = router.routesChanged();
+    saved = true;
+    Log.infoln("Restored %d routes saved %l seconds ago", store.count, now - store.savedTime);
+}
+
+void RouteStore::save(RHRouter &router) {
+    uint32_t time = timeFunctions.getTime();
+    if (saved && router.routesChanged() == savedChanges && time - store.savedTime < ROUTE_STORE_REFRESH_SECONDS) return;  // The RAM is up to date
+
+    // The routes used first, most recently used first - overheard routes fill what room is left
+    uint8_t count = router.routeCount();
+    bool taken[RH_ROUTING_TABLE_SIZE] = { false };
+    uint32_t now = millis();
+    store.count = 0;
+    while (store.count < ROUTE_STORE_MAX_ROUTES && store.count < count) {
+        int best = -1;
+        for (uint8_t i = 0; i < count; i++) {
+            if (taken[i]) continue;
+            const RHRouter::RoutingTableEntry *route = router.routeAt(i);
+            if (route->state != RHRouter::Valid) continue;
+            if (best < 0) { best = i; continue; }
+            const RHRouter::RoutingTableEntry *kept = router.routeAt(best);
+            if ((route->uses > 0) != (kept->uses > 0)) {
+                if (route->uses) best = i;
+            }
+            else if (now - route->lastUsed < now - kept->lastUsed) best = i;
+        }
+        if (best < 0) break;
+        taken[best] = true;
+        const RHRouter::RoutingTableEntry *route = router.routeAt(best);
+        Entry &entry = store.entries[store.count++];
+        entry.dest = route->dest;
+        entry.nextHop = route->next_hop;
+        entry.hops = route->hops;
+        entry.quality = router.nextHopQuality(route->next_hop);
+        entry.used = route->uses ? 1 : 0;
+    }
+    store.structuresVersion = STRUCTURES_VERSION;
+    store.reserved = 0;
+    store.savedTime = time;
+    store.checksum = checksum();
+    timeFunctions.writeRam(ROUTE_STORE_RAM_ADDRESS, (const uint8_t *)&store, offsetof(Store, entries) + store.count * sizeof(Entry));
+    savedChanges = router.routesChanged();
+    saved = true;
+}
+
+uint8_t RouteStore::checksum() const {
+    uint8_t sum = rtcRamChecksum(store.structuresVersion ^ store.count, &store.savedTime, sizeof(store.savedTime));
+    return rtcRamChecksum(sum, store.entries, store.count * sizeof(Entry));
+}
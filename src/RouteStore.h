@@ -0,0 +1,110 @@
+/**
+ * @file RouteStore.h
+ * @author Chip McClelland (chip@seeinisghts.com)
+ * @brief Keeps a copy of the mesh routing table in the AB1805's RAM so a reset or power cycle does not set off route discoveries
+ * @details RHRouter's table is only in the SAMD's RAM - after a reset or the power cycle of alert code 3 the first report would
+ * broadcast a route discovery that every node on the site relays, and wait up to RH_MESH_ARP_TIMEOUT for it. The routes most
+ * worth keeping (those used, then the most recently used) are copied after the report queue in the RTC's RAM whenever the table
+ * has changed - and every ROUTE_STORE_REFRESH_SECONDS while they still work - with the time they were saved. At startup they are
+ * put back if they were saved less than ROUTE_STORE_MAX_AGE_SECONDS ago, so the node only discovers a route again once a delivery
+ * over a saved one fails.
+ * @version 0.1
+ * @date 2024-03-11
+ *
+ */
+
+#ifndef __ROUTESTORE_H
+#define __ROUTESTORE_H
+
+#include <arduino.h>
+#include <ArduinoLog.h>
+#include <RHRouter.h>
+#include "Config.h"
+#include "timing.h"
+
+#define routeStore RouteStore::instance()
+
+/**
+ * This class is a singleton; you do not create one as a global, on the stack, or with new.
+ *
+ * From LoRA setup you must call (after timing setup and once the manager has its address):
+ * RouteStore::instance().setup(manager);
+ */
+class RouteStore {
+public:
+    /**
+     * @brief Gets the singleton instance of this class, allocating it if necessary
+     *
+     * Use RouteStore::instance() to instantiate the singleton.
+     */
+    static RouteStore &instance();
+
+    /**
+     * @brief Puts the saved routes back in the router's table - unless the RAM holds none, or they are too old to trust
+     */
+    void setup(RHRouter &router);
+
+    /**
+     * @brief Saves the routes most worth keeping if the table has changed since they were last saved - or they were saved
+     * ROUTE_STORE_REFRESH_SECONDS ago, so routes that still work stay young enough to restore
+     */
+    void save(RHRouter &router);
+
+protected:
+    /**
+     * @brief The constructor is protected because the class is a singleton
+     *
+     * Use RouteStore::instance() to instantiate the singleton.
+     */
+    RouteStore();
+
+    /**
+     * @brief The destructor is protected because the class is a singleton and cannot be deleted
+     */
+    virtual ~RouteStore();
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    RouteStore(const RouteStore&) = delete;
+
+    /**
+     * This class is a singleton and cannot be copied
+     */
+    RouteStore& operator=(const RouteStore&) = delete;
+
+    /**
+     * @brief Check byte over the saved routes - so the contents of the RAM at first power up are not taken for routes
+     */
+    uint8_t checksum() const;
+
+    struct Entry {
+        uint8_t dest;
+        uint8_t nextHop;
+        uint8_t hops;
+        uint8_t quality;                                // Of the link to nextHop (see RHRouter::routeCost())
+        uint8_t used;                                   // 1 if the route had been looked up - 0 if only overheard
+    };
+
+    struct Store {
+        uint8_t structuresVersion;                      // STRUCTURES_VERSION when the routes were saved
+        uint8_t count;                                  // Number of saved routes
+        uint8_t checksum;
+        uint8_t reserved;
+        uint32_t savedTime;                             // RTC time the routes were saved - the epoch they are valid from
+        Entry entries[ROUTE_STORE_MAX_ROUTES];
+    };
+
+    Store store;
+    uint32_t savedChanges = 0;                          // RHRouter::routesChanged() when the routes were saved
+    bool saved = false;                                 // The RAM holds the routes of this run
+
+    /**
+     * @brief Singleton instance of this class
+     *
+     * The object pointer to this class is stored here. It's NULL at system boot.
+     */
+    static RouteStore *_instance;
+};
+
+#endif  /* __ROUTESTORE_H */
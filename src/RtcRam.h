@@ -0,0 +1,31 @@
+/**
+ * @file RtcRam.h
+ * @author Chip McClelland (chip@seeinisghts.com)
+ * @brief Checks what is kept in the AB1805's RAM
+ * @details The report queue (ReportQueue.h) and the saved mesh routes (RouteStore.h) are kept in the AB1805's RAM, which
+ * survives resets and power cycles while the RTC has power and holds garbage once it has lost it. Each store carries a
+ * checksum over its contents so garbage is read as an empty store.
+ *
+ * This file only depends on the C standard headers so it can also be compiled natively (see tools/).
+ *
+ * @version 0.1
+ * @date 2024-03-04
+ *
+ */
+
+#ifndef __RTCRAM_H
+#define __RTCRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Adds length bytes to a checksum started with sum - the sum rotates so reordered bytes do not match
+ */
+inline uint8_t rtcRamChecksum(uint8_t sum, const void *data, size_t length) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < length; i++) sum = (sum << 1 | sum >> 7) ^ bytes[i];
+    return sum;
+}
+
+#endif  /* __RTCRAM_H */
@@ -65,7 +65,8 @@ bool TofSensor::setup(){
 
   while (TofSensor::instance().measure() == SENSOR_BUFFRER_NOT_FULL) {delay(10);}; // Wait for the buffer to fill up
   
-  if (TofSensor::instance().performOccupancyCalibration()) Log.infoln("Calibration Complete");
+  if (TofSensor::instance().restoreBaselines()) Log.infoln("Stored baselines confirmed - skipping calibration");
+  else if (TofSensor::instance().performOccupancyCalibration()) Log.infoln("Calibration Complete");
   else {
     Log.infoln("Initial calibration failed - waiting 10 seconds and resetting");
     delay(10000);
@@ -115,9 +116,65 @@ bool TofSensor::performOccupancyCalibration() {
   } 
 
   Log.infoln("Target zone is clear with baselines: detection %imm / zone1 %imm / zone2 %imm", detectionBaselineDistance, measurementBaselineDistances[0],measurementBaselineDistances[1]);
+  TofSensor::instance().storeBaselines();                          // Persist the baselines so a reset only needs a quick probe
   return true;
 }
 
+bool TofSensor::restoreBaselines() {
+  sysStatusData::TofBaselineStructure stored;
+
+  if (!sysData.getTofBaselines(stored)) {
+    Log.infoln("No stored baselines - full calibration required");
+    return false;
+  }
+  if (stored.zoneMode != sysStatus.zoneMode || stored.distanceMode != sysStatus.distanceMode || stored.timingBudget != timingBudgetFor(sysStatus.distanceMode)) {
+    Log.infoln("Stored baselines are for zone mode %d / distance mode %d - full calibration required", stored.zoneMode, stored.distanceMode);
+    return false;
+  }
+
+  uint16_t probeMeasurement[2] = {65535, 65535};                 // Closest distances seen during the probe
+  uint16_t probeDetection = 65535;
+  for (int i = 0; i < TOF_BASELINE_PROBE_SAMPLES; i++) {
+    if(TofSensor::instance().measure() == SENSOR_TIMEOUT_ERROR || TofSensor::instance().detect() == SENSOR_TIMEOUT_ERROR){
+      return false;
+    }
+    if(measurementDistances[0] < probeMeasurement[0]) probeMeasurement[0] = measurementDistances[0];
+    if(measurementDistances[1] < probeMeasurement[1]) probeMeasurement[1] = measurementDistances[1];
+    if(detectionDistance < probeDetection) probeDetection = detectionDistance;
+  }
+
+  if (abs((int)probeMeasurement[0] - (int)stored.measurementFloor[0]) > TOF_BASELINE_PROBE_TOLERANCE
+      || abs((int)probeMeasurement[1] - (int)stored.measurementFloor[1]) > TOF_BASELINE_PROBE_TOLERANCE
+      || abs((int)probeDetection - (int)stored.detectionFloor) > TOF_BASELINE_PROBE_TOLERANCE) {
+    Log.infoln("Probe (detection %imm / zone1 %imm / zone2 %imm) disagrees with stored floors (detection %imm / zone1 %imm / zone2 %imm)", probeDetection, probeMeasurement[0], probeMeasurement[1], stored.detectionFloor, stored.measurementFloor[0], stored.measurementFloor[1]);
+    return false;
+  }
+
+  measurementBaselineDistances[0] = stored.measurementFloor[0] - sysStatus.interferenceBuffer;    // Apply the current interferenceBuffer to the stored floors
+  measurementBaselineDistances[1] = stored.measurementFloor[1] - sysStatus.interferenceBuffer;
+  detectionBaselineDistance = stored.detectionFloor - sysStatus.interferenceBuffer;
+
+  if(measurementBaselineDistances[0] > 4000 || measurementBaselineDistances[1] > 4000 || detectionBaselineDistance > 4000) {   // Same test as calibration - the buffer may have changed since the floors were stored
+    Log.infoln("Stored floors are closer than the interference buffer - full calibration required");
+    return false;
+  }
+
+  Log.infoln("Restored baselines: detection %imm / zone1 %imm / zone2 %imm", detectionBaselineDistance, measurementBaselineDistances[0],measurementBaselineDistances[1]);
+  return true;
+}
+
+void TofSensor::storeBaselines() {
+  sysStatusData::TofBaselineStructure baselines;
+
+  baselines.zoneMode = sysStatus.zoneMode;
+  baselines.distanceMode = sysStatus.distanceMode;
+  baselines.timingBudget = timingBudgetFor(sysStatus.distanceMode);
+  baselines.detectionFloor = detectionBaselineDistance + sysStatus.interferenceBuffer;             // Undo the interferenceBuffer so it can be changed without recalibrating
+  baselines.measurementFloor[0] = measurementBaselineDistances[0] + sysStatus.interferenceBuffer;
+  baselines.measurementFloor[1] = measurementBaselineDistances[1] + sysStatus.interferenceBuffer;
+  sysData.storeTofBaselines(baselines);
+}
+
 int TofSensor::loop(){    // This function will update the current detection state and occupancy state. Returns error codes.
   int result = 0;
   
@@ -277,27 +334,33 @@ bool TofSensor::recalibrate() {
   }
 }
 
+uint32_t TofSensor::timingBudgetFor(uint8_t distanceMode){
+  switch (distanceMode) {  // The minimum timing budget allowable for the distanceMode, according to the datasheet https://www.pololu.com/file/0J1506/vl53l1x.pdf
+    case 0:
+      return 22000;                                   // minimum ranging duration for distanceMode short (20000us)
+    case 1:
+      return 33000;                                   // minimum ranging duration for distanceMode medium (33000us)
+    default:
+      return 33000;                                   // minimum ranging duration for distanceMode long (33000us)
+  }
+}
+
 void TofSensor::configureSensor(uint8_t distanceMode, uint8_t zoneDepth, uint8_t zoneWidth, uint8_t zoneOpticalCenter){
-  uint32_t timingBudget;
-  switch (sysStatus.distanceMode) {  // Set the timing budget to the minimum value allowable for the distanceMode, according to the datasheet https://www.pololu.com/file/0J1506/vl53l1x.pdf
+  switch (sysStatus.distanceMode) {  // Set the distance mode - the timing budget for each mode is set below
     case 0:
-      timingBudget = 22000;                           // minimum ranging duration for distanceMode short (20000us)
       myTofSensor.setDistanceMode(VL53L1X::Short);
     break;
     case 1:
-      timingBudget = 33000;                           // minimum ranging duration for distanceMode medium (33000us)
       myTofSensor.setDistanceMode(VL53L1X::Medium);
     break;
     case 2:
-      timingBudget = 33000;                           // minimum ranging duration for distanceMode long (33000us)
       myTofSensor.setDistanceMode(VL53L1X::Long);          
     break;
     default: // default to long if something is up
-      timingBudget = 33000;                           // minimum ranging duration for distanceMode long (33000us)
       myTofSensor.setDistanceMode(VL53L1X::Long);
   }
   
   myTofSensor.setROISize(zoneDepth, zoneWidth);
   myTofSensor.setROICenter(zoneOpticalCenter);
-  myTofSensor.setMeasurementTimingBudget(timingBudget);    // 20000us minimum in short distance mode, 33000us minimum in medium/long distance mode
+  myTofSensor.setMeasurementTimingBudget(timingBudgetFor(sysStatus.distanceMode));    // 20000us minimum in short distance mode, 33000us minimum in medium/long distance mode
 }
\ No newline at end of file
@@ -101,6 +101,16 @@ public:
     */
     bool recalibrate();
 
+    /**
+     * @brief Loads the baselines stored by the last calibration and checks them with a short probe
+     * 
+     * @details The stored baselines are only used if they were captured with the current zoneMode, distanceMode
+     * and timing budget and a probe of TOF_BASELINE_PROBE_SAMPLES agrees with them. Otherwise we need a full calibration.
+     * 
+     * @return true if the stored baselines are now in use
+    */
+    bool restoreBaselines();
+
 private:
 
     /**
@@ -113,6 +123,16 @@ private:
     */
     void configureSensor(uint8_t distanceMode, uint8_t zoneDepth, uint8_t zoneWidth, uint8_t zoneOpticalCenter);
 
+    /**
+     * @brief Returns the timing budget (in us) used for the given distanceMode
+    */
+    uint32_t timingBudgetFor(uint8_t distanceMode);
+
+    /**
+     * @brief Stores the current baselines along with the sensor configuration they were captured with
+    */
+    void storeBaselines();
+
 protected:
     /**
      * @brief The constructor is protected because the class is a singleton
@@ -1,4 +1,6 @@
 #include "timing.h"
+#include "Config.h"
+#include "LoRA_Slots.h"
 
 AB1805 ab1805(Wire); // Class instance for the the AB1805 RTC
 
@@ -58,6 +60,31 @@ bool timing::setTime(time_t UnixTime, uint8_t hundredths){
   }
 }
 
+/*******************************************************************************
+ * Method Name: setTimeCompensated()
+ *******************************************************************************/
+int32_t timing::setTimeCompensated(time_t UnixTime, uint8_t hundredths, uint16_t compensationMillis, uint16_t maxErrorMillis){
+  if (hundredths > 99) hundredths = 0;                  // Gateway did not send hundredths
+  RxTimeComp_ms = compensationMillis;
+  uint32_t compHundredths = hundredths + (compensationMillis + 5) / 10;
+  Rx_Time_Comp = (uint32_t)UnixTime + compHundredths / 100;
+  Rx_Hundrths_Comp = compHundredths % 100;
+
+  ab1805.getRtcAsTime(time_cv, hundrths_cv);
+  int64_t error = ((int64_t)time_cv * 100 + hundrths_cv) - ((int64_t)Rx_Time_Comp * 100 + Rx_Hundrths_Comp);
+  error *= 10;
+  if (error > INT32_MAX) error = INT32_MAX;
+  if (error < -INT32_MAX) error = -INT32_MAX;
+  clockError_ms = (int32_t)error;
+
+  if (maxErrorMillis == 0) maxErrorMillis = RTC_Deadband_ms;
+  if (!ab1805.isRTCSet() || clockError_ms > maxErrorMillis || clockError_ms < -(int32_t)maxErrorMillis) {
+    setTime(Rx_Time_Comp, Rx_Hundrths_Comp);
+  }
+  Log.infoln("Gateway time is %l and %d hundredths after %dmS in delivery - clock error was %lmS", Rx_Time_Comp, Rx_Hundrths_Comp, RxTimeComp_ms, clockError_ms);
+  return clockError_ms;
+}
+
 time_t timing::getTime() {
 
   time_t time_seconds;
@@ -67,6 +94,15 @@ time_t timing::getTime() {
   return time_seconds;
 }
 
+uint32_t timing::rtcMillis() {
+
+  time_t time_seconds;
+  uint8_t hundredths;
+  ab1805.getRtcAsTime(time_seconds, hundredths);
+
+  return (uint32_t)time_seconds * 1000UL + hundredths * 10UL;
+}
+
 
 
 /*******************************************************************************
@@ -87,6 +123,29 @@ void timing::interruptAtEvent(uint8_t eventType){
 
 }
 
+/*******************************************************************************
+ * Method Name: deviceReportDue()
+ *******************************************************************************/
+bool timing::deviceReportDue(uint8_t frameSeconds, uint32_t offsetHundredths){
+  if (frameSeconds == 0) return true;                   // The gateway does not assign slots - report now
+
+  ab1805.getRtcAsTime(time_cv, hundrths_cv);
+  uint64_t now = (uint64_t)time_cv * 100 + hundrths_cv;
+  uint64_t slot = (uint64_t)nxtDvcRpt_time * 100 + nxtDvcRpt_hund;
+  if (nxtDvcRpt_time == 0 || now > slot + SLOT_LATE_HUNDREDTHS || slot > now + frameSeconds * 100ULL + offsetHundredths) {
+    slot = slotNextStart(now, frameSeconds, offsetHundredths);
+    nxtDvcRpt_time = slot / 100;
+    nxtDvcRpt_hund = slot % 100;
+    Log.infoln("Report waits %lmS for its slot at %l hundredths into the frame", (uint32_t)(slot - now) * 10, offsetHundredths);
+  }
+  if (now < slot) return false;
+
+  curDvcRpt_time = nxtDvcRpt_time;
+  curDvcRpt_hund = nxtDvcRpt_hund;
+  nxtDvcRpt_time = 0;
+  return true;
+}
+
 void timing::interruptAtTime(time_t UnixTime, uint8_t hundredths){
   ab1805.interruptAtTime(UnixTime,hundredths);
 }
@@ -113,4 +172,12 @@ bool timing::isRTCSet(){
 
 void timing::deepPowerDown(uint16_t seconds){
   ab1805.deepPowerDown(seconds);
+}
+
+bool timing::readRam(size_t address, uint8_t *data, size_t length){
+  return ab1805.readRam(address, data, length);
+}
+
+bool timing::writeRam(size_t address, const uint8_t *data, size_t length){
+  return ab1805.writeRam(address, data, length);
 }
\ No newline at end of file
@@ -73,11 +73,31 @@ public:
      */
     bool setTime(time_t UnixTime, uint8_t hundredths);
 
+    /**
+     * @brief Set the time from a gateway time stamp and how long its message took to get here
+     *
+     * @details Fills in RxTimeComp_ms, Rx_Time_Comp and Rx_Hundrths_Comp and measures the clock error. The AB1805 is only
+     * written when the error is more than RTC_Deadband_ms (or maxErrorMillis when the delivery time is uncertain) as setting
+     * it restarts the hundredths counter.
+     *
+     * @param UnixTime, hundredths - the gateway's time when it sent the message
+     * @param compensationMillis - time on air, retransmissions, hops and processing since then
+     * @param maxErrorMillis - error left uncorrected - RTC_Deadband_ms if 0
+     * @return the node's clock less the compensated gateway time in mS, before it was corrected
+     */
+    int32_t setTimeCompensated(time_t UnixTime, uint8_t hundredths, uint16_t compensationMillis, uint16_t maxErrorMillis = 0);
+
     /**
      * @brief - Get the time in UNITX Time format - GMT
     */
    time_t getTime();
 
+    /**
+     * @brief - Milliseconds from the RTC (10mS resolution) - unlike millis() this keeps counting while the processor sleeps
+     * @details Only differences are meaningful - the value wraps. Setting the time moves it.
+    */
+   uint32_t rtcMillis();
+
     /**
      * @brief set an interrupt for a future time based on an event type
      * 
@@ -91,6 +111,18 @@ public:
      */
     void interruptAtEvent(uint8_t eventType);
 
+    /**
+     * @brief True once this device's reporting slot has come - eventFlag_nxtDvcRpt
+     * 
+     * @details The first call schedules the report in the next slot offsetHundredths into a reporting frame of frameSeconds
+     * (see LoRA_Slots.h) and keeps it in nxtDvcRpt - an offset of more than a frame is a slot in a later frame. When the slot
+     * comes it moves to curDvcRpt. A slot missed by more than SLOT_LATE_HUNDREDTHS, or moved by a change to the clock, is
+     * scheduled again.
+     * 
+     * @param frameSeconds - length of the gateway's reporting frame - 0 if the gateway does not assign slots (always due)
+     */
+    bool deviceReportDue(uint8_t frameSeconds, uint32_t offsetHundredths);
+
     /**
      * @brief Clear any repeating interrupt
      * 
@@ -128,6 +160,16 @@ public:
      */
     void deepPowerDown(uint16_t seconds=30);
 
+    /**
+     * @brief Read from the AB1805's RAM - 256 bytes that keep their contents through resets and deepPowerDown while the RTC has power
+     */
+    bool readRam(size_t address, uint8_t *data, size_t length);
+
+    /**
+     * @brief Write to the AB1805's RAM - unlike the EEPROM it does not wear out
+     */
+    bool writeRam(size_t address, const uint8_t *data, size_t length);
+
 
 
     uint16_t    nxtRptStrt_sec      = 60;   // Number of seconds to the next reporting start period
@@ -135,16 +177,17 @@ public:
     uint16_t    RxTimeComp_ms;              // Total time compensation due to transmission delays (retransmissions, hops, transmit time, timeouts, etc.)
     uint8_t     Rx_Hundrths_Comp;           // Hundreths value after compensation
     uint32_t    Rx_Time_Comp;               // UNIX time value after compensation 
+    int32_t     clockError_ms = 0;          // Node clock less gateway time at the last sync - the residual error
     uint32_t    dvcRpt_Millis;              // Millis when the device should report it's own readings
     uint32_t    rptEnd_Millis;              //  Millis when reporting finished for all nodes
     uint32_t    nxtRptStrt_time; 
     uint8_t     nxtRptStrt_hund;
-    uint32_t    nxtDvcRpt_time;
-    uint8_t     nxtDvcRpt_hund;
+    uint32_t    nxtDvcRpt_time      = 0;    // Start of this device's next reporting slot - 0 if none is scheduled
+    uint8_t     nxtDvcRpt_hund      = 0;
     uint32_t    rptEnd_time;
     uint8_t     rptEnd_hund;
-    uint32_t    curDvcRpt_time;
-    uint8_t     curDvcRpt_hund;
+    uint32_t    curDvcRpt_time      = 0;    // Start of the slot this device last reported in
+    uint8_t     curDvcRpt_hund      = 0;
     uint32_t    nxtRptStart_Millis = nxtRptStrt_sec * 1000;
     time_t      time_cv;
     uint8_t     hundrths_cv;
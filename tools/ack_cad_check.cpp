@@ -0,0 +1,157 @@
+// ack_cad_check.cpp
+//
+// Checks which of RHReliableDatagram's transmissions (lib/Radiohead/RHReliableDatagram.cpp) listen before they talk. A
+// data message waits for a clear channel - sent by sendtoStart() it backs off in sendPoll() (RHGenericDriver::pollCAD()),
+// by sendtoWait() in the driver's send() (RHGenericDriver::waitCAD(), as RH_RF95::send() calls it) - while an
+// acknowledgement and a reply to a request - sent again when the request is retried - go straight away: they answer a
+// message just received, and a backoff slot is longer than the sender waits for them, so a deferred one would only bring
+// a needless retry. Each case is sent with the channel busy for busyMillis. CAD checks counts the driver's
+// isChannelActive() calls before the transmission and Deferred the time it waited. Exits with 1 if any case is not sent as
+// expected.
+//
+// Build and run natively from the repository root:
+//   R=lib/Radiohead
+//   g++ -O2 -std=gnu++11 -I $R -o ack_cad_check tools/ack_cad_check.cpp $R/RHGenericDriver.cpp
+//       $R/RHReliableDatagram.cpp $R/RHDatagram.cpp
+//   ./ack_cad_check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <RHReliableDatagram.h>
+
+static const unsigned long busyMillis = 400;                // Another node's report on air
+static const unsigned long cadTimeoutMillis = 4000;         // rf95.setCADTimeout()
+static const unsigned long backoffMillis = 100;             // rf95.setCADBackoff() - about one report's time on air
+static const uint8_t thisAddress = 1;
+static const uint8_t senderAddress = 2;
+
+static unsigned long simMillis = 0;
+unsigned long millis() { return simMillis; }
+void delay(unsigned long ms) { simMillis += ms; }
+long random(long to) { return ::random() % to; }
+long random(long from, long to) { return from + ::random() % (to - from); }
+
+struct Sent {
+    uint8_t flags;
+    uint16_t checks;                                        // isChannelActive() calls before it went on air
+    unsigned long deferMillis;
+};
+
+// A radio whose channel is busy until busyUntil. It hands the manager one queued message and, as RH_RF95::send() does,
+// checks the channel with waitCAD() before each transmission. Nothing acknowledges a data message
+class ChannelDriver : public RHGenericDriver {
+public:
+    bool init() { return true; }
+    uint8_t maxMessageLength() { return 64; }
+    bool isChannelActive() { _checks++; return simMillis < busyUntil; }
+    bool send(const uint8_t*, uint8_t) {
+        if (!waitCAD()) return false;
+        sent = { _txHeaderFlags, _checks, simMillis - _start };
+        transmissions++;
+        return true;
+    }
+    bool waitAvailableTimeout(uint16_t timeout, uint16_t = 0) { simMillis += timeout; return available(); }
+    // The channel is busy from now for busyMillis
+    void busy() { busyUntil = simMillis + busyMillis; _start = simMillis; _checks = 0; }
+    bool available() { return _pending; }
+    bool recv(uint8_t* buf, uint8_t* len) {
+        if (!_pending) return false;
+        _rxHeaderTo = _thisAddress;
+        _rxHeaderFrom = senderAddress;
+        _rxHeaderId = _id;
+        _rxHeaderFlags = _flags;
+        if (buf && len && *len) { buf[0] = _id; *len = 1; }
+        _pending = false;
+        return true;
+    }
+    void put(uint8_t id, uint8_t flags) { _id = id; _flags = flags; _pending = true; }
+
+    unsigned long busyUntil = 0;
+    Sent sent;
+    int transmissions = 0;
+
+private:
+    unsigned long _start = 0;
+    uint16_t _checks = 0;
+    uint8_t _id = 0, _flags = 0;
+    bool _pending = false;
+};
+
+static const char* flagNames(uint8_t flags) {
+    static char names[32];
+    snprintf(names, sizeof(names), "%s%s%s", (flags & RH_FLAGS_ACK) ? "ACK " : "", (flags & RH_FLAGS_REQUEST) ? "REQUEST " : "",
+        (flags & RH_FLAGS_RETRY) ? "RETRY " : "");
+    return names[0] ? names : "-";
+}
+
+int main() {
+    ChannelDriver driver;
+    driver.setCADTimeout(cadTimeoutMillis);
+    driver.setCADBackoff(backoffMillis);
+    RHReliableDatagram manager(driver, thisAddress);
+    manager.init();
+    manager.setRetries(0);                                  // A data message fails at its timeout
+    uint8_t message[8];
+    memset(message, 1, sizeof(message));                    // message[5] is not 0, so sendTry() leaves the delay bytes alone
+    uint8_t buf[8];
+    uint8_t len;
+
+    printf("Channel busy for %lu ms before each transmission, backoff slot %lu ms\n\n", busyMillis, backoffMillis);
+    printf("%-36s %-20s %10s %10s  %-10s %s\n", "Case", "Flags", "CAD checks", "Deferred", "Expected", "");
+    int failures = 0;
+    for (int c = 0; c < 6; c++) {
+        driver.busy();
+        int before = driver.transmissions;
+        const char* name = "";
+        bool listens = false;
+        switch (c) {
+        case 0:
+            name = "Data message, sendtoStart()";
+            manager.sendtoStart(message, sizeof(message), senderAddress);
+            while (driver.transmissions == before && manager.sendPoll() == RH_RELIABLE_SEND_PENDING) simMillis++;
+            listens = true;
+            break;
+        case 1:
+            name = "Data message, sendtoWait()";
+            manager.sendtoWait(message, sizeof(message), senderAddress);
+            listens = true;
+            break;
+        case 2:
+            name = "Acknowledgement";
+            driver.put(10, RH_FLAGS_NONE);
+            len = sizeof(buf);
+            manager.recvfromAck(buf, &len);
+            break;
+        case 3:
+            name = "Reply to a request";
+            driver.put(11, RH_FLAGS_REQUEST);
+            len = sizeof(buf);
+            if (manager.recvfromAck(buf, &len)) manager.sendReply(message, sizeof(message));
+            break;
+        case 4:
+            name = "Reply again for a retried request";
+            driver.put(11, RH_FLAGS_REQUEST | RH_FLAGS_RETRY);
+            len = sizeof(buf);
+            manager.recvfromAck(buf, &len);
+            break;
+        case 5:
+            name = "Data message after the replies";
+            manager.sendtoStart(message, sizeof(message), senderAddress);
+            while (driver.transmissions == before && manager.sendPoll() == RH_RELIABLE_SEND_PENDING) simMillis++;
+            listens = true;
+            break;
+        }
+        bool sent = driver.transmissions == before + 1;
+        bool ok = sent && (listens ? driver.sent.checks > 0 && driver.sent.deferMillis >= busyMillis : driver.sent.checks == 0 && driver.sent.deferMillis == 0);
+        failures += !ok;
+        if (sent) printf("%-36s %-20s %10u %7lu ms  %-10s %s\n", name, flagNames(driver.sent.flags), driver.sent.checks, driver.sent.deferMillis,
+            listens ? "listens" : "straight", ok ? "ok" : "FAILED");
+        else printf("%-36s %-20s %10s %10s  %-10s %s\n", name, "not sent", "", "", listens ? "listens" : "straight", "FAILED");
+        manager.sendPoll();
+        simMillis += 1000;
+        manager.sendPoll();
+    }
+    printf("\n%s\n", failures ? "FAILED" : "Acknowledgements and replies go without listen before talk");
+    return failures ? 1 : 0;
+}
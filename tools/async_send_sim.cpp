@@ -0,0 +1,343 @@
+// async_send_sim.cpp
+//
+// Walkers missed while a report is on its way to the gateway, with the report sent by RHMesh::sendtoWaitReply() as it
+// was before v15.19 (the node does nothing else until the gateway has acknowledged or the retries are exhausted) and by
+// sendtoStartReply() and sendPoll() as it is now (LoRA_Functions::sendRequestNode() - the sensor is looked at between
+// polls while the report is on air, while its acknowledgement is awaited and between retries).
+//
+// The node runs the real RHMesh over a radio simulated in-process - millis() is the simulation's clock, so its timeouts,
+// retries, route discovery and round trip times run as on the node. The gateway is scripted at the radio: it replies to
+// each report in the acknowledgement after up to replyDelayMillis, and to a route discovery request with a route
+// discovery response. A report, an acknowledgement or a response is lost now and then. Walkers pass the sensor at
+// random, each in view for passMillis. Between polls the node checks the sensor's interrupt pin and, while someone is in
+// view, takes a measurement (measureMillis, as measure.loop() does for the TOF sensor). A walker is missed if they came
+// and went during a send without a measurement being taken - before and after a send the node samples as it always did.
+// Longest gap is the longest the sensor went unchecked during a send: the whole send when it blocks. Each data rate is
+// run with the route to the gateway known, with the route discovered first (a reset with no saved routes), and with the
+// route known but the channel busy with other nodes' reports (channelLoadPercent of the time, as after a lecture). Listen
+// before talk is set up as LoRA_Functions::applyChannelAccess() does: the blocking send backs off in the driver's send()
+// (RHGenericDriver::waitCAD()), the polled send in sendPoll() (RHGenericDriver::pollCAD()). Each CAD takes the radio two
+// symbols.
+//
+// Build and run natively from the repository root:
+//   R=lib/Radiohead
+//   g++ -O2 -std=gnu++11 -I $R -I src -o async_send_sim tools/async_send_sim.cpp $R/RHGenericDriver.cpp $R/RHMesh.cpp
+//       $R/RHRouter.cpp $R/RHReliableDatagram.cpp $R/RHDatagram.cpp $R/RHMessagePool.cpp
+//   ./async_send_sim
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <RHMesh.h>
+#include "Config.h"
+#include "LoRA_Frames.h"
+#include "LoRA_Airtime.h"
+
+static const int reports = 500;                             // A minute apart
+static const int retries = 2;                               // manager.setRetries(2)
+static const int lostPercent = 10;                          // Of each frame, either way
+static const uint16_t replyDelayMillis = 40;                // The gateway preparing its reply - sent to the node in each data ack
+static const unsigned long walkerMeanMillis = 2000;         // Mean time between walkers - a busy doorway
+static const unsigned long passMillis = 600;                // A walker in view of the sensor
+static const unsigned long measureMillis = 20;              // measure.loop() with someone in view
+static const unsigned long pinCheckMillis = 1;              // Checking the interrupt pin, and a pass of the main loop
+static const int channelLoadPercent = 30;                   // Other nodes' reports on air, in the busy channel runs
+static const uint8_t nodeAddress = 2;
+static const uint8_t gatewayAddress = 0;
+
+static unsigned long simMillis = 0;
+unsigned long millis() { return simMillis; }
+void delay(unsigned long ms) { simMillis += ms; }
+long random(long to) { return ::random() % to; }
+long random(long from, long to) { return from + ::random() % (to - from); }
+
+// Losses and walkers come from their own generator, so both ways of sending meet the same ones
+struct SimRandom {
+    uint32_t state;
+    explicit SimRandom(uint32_t seed) : state(seed * 2654435761u + 1) {}
+    uint32_t next() { state ^= state << 13; state ^= state >> 17; state ^= state << 5; return state; }
+    double uniform() { return (next() + 0.5) / 4294967296.0; }
+};
+
+struct ModemConfig { uint8_t reg_1d, reg_1e, reg_26; };
+struct DataRate { const char* name; ModemConfig config; };
+static const DataRate dataRates[] = {                       // Steps 0, 5 and 7 of the ladder in LinkAdaptation.cpp
+    { "Bw500Sf7",  { 0x92, 0x74, 0x04 } },
+    { "Bw125Sf10", { 0x72, 0xa4, 0x04 } },
+    { "Bw125Sf12", { 0x72, 0xc4, 0x0c } }
+};
+
+struct Frame {
+    uint8_t from, to, id, flags, len;
+    uint8_t data[RH_MAX_MESSAGE_LEN];
+    unsigned long arrival;
+};
+
+// The node's radio, with the gateway at the other end. A transmission is on air (mode() is RHModeTx) until its time on
+// air has passed, as RH_RF95's is until TxDone, and the gateway answers it once it has ended
+class GatewayLink : public RHGenericDriver {
+public:
+    GatewayLink(const ModemConfig &config, SimRandom &losses) : _config(config), _losses(losses), _txEnd(0), _gatewayId(0) {}
+    bool init() { return true; }
+    uint8_t maxMessageLength() { return RH_MAX_MESSAGE_LEN; }
+    RHMode mode() { return simMillis < _txEnd ? RHModeTx : RHModeRx; }
+    bool waitPacketSent() {
+        if (_txEnd > simMillis) simMillis = _txEnd;
+        return true;
+    }
+
+    bool send(const uint8_t* data, uint8_t len) {
+        waitPacketSent();                                   // As RH_RF95::send()
+        if (!waitCAD()) return false;
+        transmissions++;
+        _txEnd = simMillis + airtimeMillis(len);
+        if (_txHeaderFlags & RH_FLAGS_ACK) return true;     // The node acknowledging a route discovery response
+        if (_losses.next() % 100 < lostPercent) return true;
+        uint8_t msgType = data[sizeof(RHRouter::RoutedMessageHeader)];
+        if (_txHeaderTo == RH_BROADCAST_ADDRESS && msgType == RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST) respond();
+        else if (_txHeaderTo == gatewayAddress) reply();
+        return true;
+    }
+
+    // The headers are known once a frame is available, as RH_RF95's are
+    bool available() {
+        if (mode() == RHModeTx) return false;
+        for (const Frame &frame : _frames) {
+            if (frame.arrival > simMillis) continue;
+            _rxHeaderTo = frame.to;
+            _rxHeaderFrom = frame.from;
+            _rxHeaderId = frame.id;
+            _rxHeaderFlags = frame.flags;
+            return true;
+        }
+        return false;
+    }
+
+    // Jumps the clock to the next frame, or the end of the wait
+    bool waitAvailableTimeout(uint16_t timeout, uint16_t = 0) {
+        waitPacketSent();
+        unsigned long next = simMillis + timeout;
+        for (const Frame &frame : _frames) if (frame.arrival < next) next = frame.arrival;
+        bool arrived = next < simMillis + timeout;
+        simMillis = arrived ? (next > simMillis ? next : simMillis) : simMillis + timeout;
+        return arrived && available();
+    }
+
+    bool recv(uint8_t* buf, uint8_t* len) {
+        if (!available()) return false;
+        for (size_t i = 0; i < _frames.size(); i++) {
+            const Frame &frame = _frames[i];
+            if (frame.arrival > simMillis) continue;
+            if (buf && len) {
+                if (*len > frame.len) *len = frame.len;
+                memcpy(buf, frame.data, *len);
+            }
+            _frames.erase(_frames.begin() + i);
+            return true;
+        }
+        return false;
+    }
+
+    // A message of len bytes (with RHRouter's and RHMesh's headers) padded to whole cipher blocks by RHEncryptedDriver
+    unsigned long airtimeMillis(uint8_t len) {
+        uint8_t payload = (len / LORA_CIPHER_BLOCK_LEN + 1) * LORA_CIPHER_BLOCK_LEN + LORA_RADIO_HEADER_LEN;
+        return (loraConfigAirtimeMicros(_config, payload) + 999) / 1000;
+    }
+
+    // Other nodes' reports, one report's time on air each, for the next minute - the same ones for each way of sending
+    void traffic(int report, int loadPercent) {
+        _busy.clear();
+        if (!loadPercent) return;
+        SimRandom others(report + 1000);
+        unsigned long reportMillis = airtimeMillis(LORA_ROUTED_HEADER_LEN + DataReportFrame::length);
+        double meanGap = reportMillis * (100.0 - loadPercent) / loadPercent;
+        for (double t = meanGap * -log(others.uniform()); t < 60000; t += reportMillis + meanGap * -log(others.uniform()))
+            _busy.push_back(simMillis + (unsigned long)t);
+    }
+
+    // A CAD takes two symbols, then says whether another node's report is on air
+    bool isChannelActive() {
+        LoRaModem modem = loraModemFromRegisters(_config.reg_1d, _config.reg_1e, _config.reg_26, 8);
+        simMillis += ((2000000ULL << modem.spreadingFactor) / modem.bandwidthHz + 999) / 1000;
+        unsigned long reportMillis = airtimeMillis(LORA_ROUTED_HEADER_LEN + DataReportFrame::length);
+        for (unsigned long start : _busy) if (start <= simMillis && simMillis < start + reportMillis) return true;
+        return false;
+    }
+
+    void clear() { _frames.clear(); }
+
+    long transmissions = 0;
+
+private:
+    // The gateway's reply to a report, as the acknowledgement - a plain ACK if the report was not a request
+    void reply() {
+        Frame frame = { gatewayAddress, _txHeaderFrom, _txHeaderId, RH_FLAGS_ACK, 0, {}, 0 };
+        if (_txHeaderFlags & RH_FLAGS_REQUEST) {
+            frame.flags |= RH_FLAGS_REQUEST;
+            RHRouter::RoutedMessageHeader header = { _txHeaderFrom, gatewayAddress, 0, ++_gatewayId, 0 };
+            memcpy(frame.data, &header, sizeof(header));
+            frame.data[sizeof(header)] = RH_MESH_MESSAGE_TYPE_APPLICATION;
+            memset(frame.data + sizeof(header) + 1, 1, DataAckFrame::length);
+            frame.len = sizeof(header) + 1 + DataAckFrame::length;
+        }
+        else {
+            frame.data[0] = '!';
+            frame.len = 1;
+        }
+        unsigned long wait = (frame.flags & RH_FLAGS_REQUEST) ? replyDelayMillis / 2 + _losses.next() % (replyDelayMillis / 2) : 5;
+        deliver(frame, wait);
+    }
+
+    // The gateway's route discovery response - unicast straight back, the route is the gateway itself
+    void respond() {
+        Frame frame = { gatewayAddress, _txHeaderFrom, ++_gatewayId, RH_FLAGS_NONE, 0, {}, 0 };
+        RHRouter::RoutedMessageHeader header = { _txHeaderFrom, gatewayAddress, 0, _gatewayId, 0 };
+        memcpy(frame.data, &header, sizeof(header));
+        RHMesh::MeshRouteDiscoveryMessage* response = (RHMesh::MeshRouteDiscoveryMessage*)(frame.data + sizeof(header));
+        response->header.msgType = RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_RESPONSE;
+        response->destlen = 1;
+        response->dest = gatewayAddress;
+        frame.len = sizeof(header) + sizeof(RHMesh::MeshMessageHeader) + 2;
+        deliver(frame, 5 + _losses.next() % 20);
+    }
+
+    // Sent after wait milliseconds from the end of the node's transmission, unless it is lost
+    void deliver(Frame &frame, unsigned long wait) {
+        if (_losses.next() % 100 < lostPercent) return;
+        frame.arrival = _txEnd + wait + airtimeMillis(frame.len);
+        _frames.push_back(frame);
+    }
+
+    ModemConfig _config;
+    SimRandom &_losses;
+    unsigned long _txEnd;
+    uint8_t _gatewayId;
+    std::vector<Frame> _frames;
+    std::vector<unsigned long> _busy;                       // When other nodes' reports start
+};
+
+// Walkers passing during a send, and the measurements taken while they were in view
+class Sensor {
+public:
+    // Walkers from passMillis before the send starts - the same ones for each way of sending
+    void start(int report) {
+        SimRandom walkers(report + 1);
+        _start = simMillis;
+        _lastCheck = simMillis;
+        _walkers.clear();
+        _seen.clear();
+        for (double t = -(double)passMillis; t < 60000; t += walkerMeanMillis * -log(walkers.uniform())) {
+            _walkers.push_back(_start + (long)t);
+            _seen.push_back(false);
+        }
+    }
+
+    // Between polls - a measurement if someone is in view, otherwise a look at the interrupt pin
+    void check() {
+        unsigned long gap = simMillis - _lastCheck;
+        if (gap > longestGap) longestGap = gap;
+        bool inView = false;
+        for (unsigned long walker : _walkers) inView |= walker <= simMillis && simMillis < walker + passMillis;
+        if (inView) {
+            for (size_t i = 0; i < _walkers.size(); i++)
+                _seen[i] = _seen[i] || (_walkers[i] <= simMillis + measureMillis && simMillis < _walkers[i] + passMillis);
+            simMillis += measureMillis;
+            measurements++;
+        }
+        else simMillis += pinCheckMillis;
+        _lastCheck = simMillis;
+    }
+
+    // Walkers who came and went during the send - those seen before or after it are counted as always
+    void finish() {
+        unsigned long gap = simMillis - _lastCheck;
+        if (gap > longestGap) longestGap = gap;
+        for (size_t i = 0; i < _walkers.size(); i++) {
+            if (_walkers[i] <= _start || _walkers[i] + passMillis >= simMillis) continue;
+            walkers++;
+            missed += !_seen[i];
+        }
+    }
+
+    long walkers = 0, missed = 0, measurements = 0;
+    unsigned long longestGap = 0;
+
+private:
+    unsigned long _start, _lastCheck;
+    std::vector<unsigned long> _walkers;
+    std::vector<bool> _seen;
+};
+
+// Reports sent blocking or polled, over a known route, after a route discovery or on a busy channel
+enum Scenario { KNOWN, DISCOVERED, BUSY };
+static const char* scenarioNames[] = { "Known", "Discovered", "Busy" };
+
+static void run(const DataRate &rate, bool polled, Scenario scenario) {
+    srandom(7);
+    SimRandom losses(7);
+    GatewayLink link(rate.config, losses);
+    RHMesh manager(link, nodeAddress);
+    manager.init();
+    manager.setRetries(retries);
+    uint32_t ackMillis = link.airtimeMillis(LORA_ROUTED_HEADER_LEN + DataAckFrame::length);
+    uint32_t roundTripMillis = link.airtimeMillis(LORA_ROUTED_HEADER_LEN + DataReportFrame::length) + ackMillis;
+    manager.setTimeout(2 * roundTripMillis + 100);          // As LoRA_Functions::applyAckTimeout()
+    manager.setMinTimeout(link.airtimeMillis(5) + ACK_TIMEOUT_MARGIN_MS);
+    unsigned long backoff = link.airtimeMillis(LORA_ROUTED_HEADER_LEN + DataReportFrame::length);
+    if (backoff < LBT_MIN_BACKOFF_MS) backoff = LBT_MIN_BACKOFF_MS;
+    unsigned long cadTimeout = backoff << RH_CAD_MAX_BACKOFF_EXPONENT;
+    link.setCADTimeout(cadTimeout > LBT_CAD_TIMEOUT_MS ? cadTimeout : LBT_CAD_TIMEOUT_MS);    // As LoRA_Functions::applyChannelAccess()
+    link.setCADBackoff(backoff);
+
+    Sensor sensor;
+    long delivered = 0, replies = 0, sendMillis = 0;
+    for (int r = 0; r < reports; r++) {
+        simMillis += 60000;
+        link.clear();
+        link.traffic(r, scenario == BUSY ? channelLoadPercent : 0);
+        if (scenario == DISCOVERED) manager.clearRoutingTable();
+        else if (!manager.getRouteTo(gatewayAddress)) manager.addRouteTo(gatewayAddress, gatewayAddress);
+        uint8_t buf[RH_MESH_MAX_MESSAGE_LEN];
+        memset(buf, 1, DataReportFrame::length);
+        buf[DataReportFrame::length - 2] = buf[DataReportFrame::length - 1] = 0;    // The retransmission bytes
+        uint8_t replyLen = sizeof(buf);
+        uint8_t replyFlag = 0;
+
+        sensor.start(r);
+        unsigned long start = simMillis;
+        uint8_t result;
+        if (polled) {
+            result = manager.sendtoStartReply(buf, DataReportFrame::length, gatewayAddress, 0, buf, &replyLen, &replyFlag, replyDelayMillis);
+            while (result == RH_ROUTER_SEND_PENDING) {
+                sensor.check();
+                result = manager.sendPoll();
+            }
+        }
+        else result = manager.sendtoWaitReply(buf, DataReportFrame::length, gatewayAddress, 0, buf, &replyLen, &replyFlag, replyDelayMillis);
+        sensor.finish();
+        sendMillis += simMillis - start;
+        delivered += result == RH_ROUTER_ERROR_NONE;
+        replies += result == RH_ROUTER_ERROR_NONE && replyLen == DataAckFrame::length;
+    }
+    printf("%-10s %-10s %-8s %10.2f%% %10.2f%% %10.0f %12lu %10.2f %10.2f%% %10.0f\n", rate.name, scenarioNames[scenario],
+        polled ? "Polled" : "Blocking", 100.0 * delivered / reports, delivered ? 100.0 * replies / delivered : 0.0,
+        (double)sendMillis / reports, sensor.longestGap, (double)sensor.walkers / reports,
+        sensor.walkers ? 100.0 * sensor.missed / sensor.walkers : 0.0, (double)link.cadDeferMillis() / reports);
+}
+
+int main() {
+    printf("%d reports a minute apart, %d retries, %d%% of frames lost, a walker every %lums on average in view for %lums,\n",
+        reports, retries, lostPercent, walkerMeanMillis, passMillis);
+    printf("the busy channel carrying other nodes' reports %d%% of the time\n\n", channelLoadPercent);
+    printf("%-10s %-10s %-8s %11s %11s %10s %12s %10s %11s %10s\n", "Data rate", "Route", "Send", "Delivered", "Replied", "Send", "Longest", "Walkers", "Walkers", "Deferred");
+    printf("%-10s %-10s %-8s %11s %11s %10s %12s %10s %11s %10s\n", "", "", "", "", "", "(ms)", "gap (ms)", "per send", "missed", "(ms)");
+    for (const DataRate &rate : dataRates) {
+        for (int scenario = KNOWN; scenario <= BUSY; scenario++) {
+            run(rate, false, (Scenario)scenario);
+            run(rate, true, (Scenario)scenario);
+        }
+    }
+    return 0;
+}
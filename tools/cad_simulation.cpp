@@ -0,0 +1,207 @@
+// cad_simulation.cpp
+//
+// Simulates nodes sending their reports through RHReliableDatagram at the same time (the end of a lecture, no reporting
+// slots) with and without listen before talk, and counts the transmissions lost to collisions, the retries and the reports
+// that fail. With listen before talk each try waits for a clear channel as RHGenericDriver::waitCAD() does - a random
+// backoff of 1 to 2^n slots of one report's time on air, until the CAD timeout - 2^RH_CAD_MAX_BACKOFF_EXPONENT slots, and
+// never less than LBT_CAD_TIMEOUT_MS, as LoRA_Functions::applyChannelAccess() sets it.
+//
+// CAD is built to find a preamble - it finds a transmission in its preamble every time and one in its payload with the
+// probability given in the table, as that depends on the radio and the signal.
+//
+// Build and run natively from the repository root:
+//   g++ -std=c++11 -I src -o cad_simulation tools/cad_simulation.cpp
+//   ./cad_simulation
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <queue>
+#include <vector>
+#include "Config.h"
+#include "LoRA_Frames.h"
+#include "LoRA_Airtime.h"
+
+static const uint32_t gatewayReplyMicros = 50000;           // Gateway's reply delay
+static const uint32_t lectureEndSeconds = 10;               // Reports start over this long as the room empties
+static const uint8_t retries = 2;                           // manager.setRetries(2)
+static const uint8_t maxBackoffExponent = 4;                // RH_CAD_MAX_BACKOFF_EXPONENT
+static const int trials = 200;
+
+struct DataRate { const char* name; uint8_t reg1d, reg1e, reg26; };
+static const DataRate dataRates[] = {                       // Steps 0, 2, 5 and 7 of the ladder in LinkAdaptation.cpp
+    { "Bw500Sf7",  0x92, 0x74, 0x04 },
+    { "Bw125Sf7",  0x72, 0x74, 0x04 },
+    { "Bw125Sf10", 0x72, 0xa4, 0x04 },
+    { "Bw125Sf12", 0x72, 0xc4, 0x0c }
+};
+
+static uint32_t rngState = 2463534242UL;
+static uint32_t rng(uint32_t range) {                       // xorshift - the same run every time
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState % range;
+}
+
+struct Transmission { int64_t start; int64_t end; };
+
+enum EventType { ATTEMPT, REQUEST_END, ACK_END, RETRY };
+struct Event {
+    int64_t time; EventType type; int node;
+    bool operator>(const Event &other) const { return time > other.time; }
+};
+
+struct NodeState {
+    int tries;                                              // Tries so far for this report
+    uint8_t backoffExponent;
+    int64_t cadStarted;                                     // When this try started waiting for a clear channel
+    size_t request;                                         // Index of the request in the transmissions
+};
+
+struct Results {
+    long transmissions = 0, lost = 0, tries = 0, failed = 0, busy = 0, cadTimeouts = 0;
+    int64_t deferMicros = 0;
+};
+
+class Simulation {
+public:
+    Simulation(const LoRaModem &modem, int nodes, bool listenBeforeTalk, uint32_t payloadDetectPercent) :
+        nodes(nodes), lbt(listenBeforeTalk), payloadDetectPercent(payloadDetectPercent), state(nodes) {
+        requestMicros = loraAirtimeMicros(modem, frameRadioPayloadLength(DataReportFrame::length));
+        uint32_t linkAckMicros = loraAirtimeMicros(modem, LORA_CIPHER_BLOCK_LEN + LORA_RADIO_HEADER_LEN);
+        ackMicros = loraAirtimeMicros(modem, frameRadioPayloadLength(DataAckFrame::length));
+        preambleMicros = (uint32_t)(((uint64_t)(4 * modem.preambleLength + 17) << modem.spreadingFactor) * 1000000ULL / (4ULL * modem.bandwidthHz));
+        uint32_t timeout = 2 * (requestMicros + linkAckMicros) / 1000UL + 100;   // As LoRA_Functions::applyModemConfig()
+        timeoutMicros = ((timeout > 1000) ? timeout : 1000) * 1000LL + gatewayReplyMicros;
+        backoffMicros = requestMicros > LBT_MIN_BACKOFF_MS * 1000 ? requestMicros : LBT_MIN_BACKOFF_MS * 1000;
+        cadTimeoutMicros = (int64_t)backoffMicros << maxBackoffExponent;
+        if (cadTimeoutMicros < (int64_t)LBT_CAD_TIMEOUT_MS * 1000) cadTimeoutMicros = LBT_CAD_TIMEOUT_MS * 1000;
+    }
+
+    void run(Results &results) {
+        for (int node = 0; node < nodes; node++) {
+            state[node].tries = 0;
+            startTry(node, rng(lectureEndSeconds * 1000) * 1000LL);
+        }
+        while (!events.empty()) {
+            Event event = events.top();
+            events.pop();
+            handle(event, results);
+        }
+    }
+
+private:
+    void startTry(int node, int64_t time) {
+        state[node].backoffExponent = 0;
+        state[node].cadStarted = time;
+        events.push({ time, ATTEMPT, node });
+    }
+
+    bool overlapped(size_t index) const {
+        for (size_t i = 0; i < transmissions.size(); i++) {
+            if (i != index && transmissions[i].start < transmissions[index].end && transmissions[i].end > transmissions[index].start) return true;
+        }
+        return false;
+    }
+
+    bool channelBusy(int64_t time) {
+        for (const Transmission &tx : transmissions) {
+            if (tx.start > time || tx.end <= time) continue;
+            if (time - tx.start < preambleMicros || rng(100) < payloadDetectPercent) return true;
+        }
+        return false;
+    }
+
+    // A try that was not acknowledged is sent again after the acknowledgement timeout - as RHReliableDatagram::sendtoWait()
+    void retryAfterTimeout(int node, int64_t sent) {
+        events.push({ sent + timeoutMicros + (int64_t)timeoutMicros * rng(256) / 256, RETRY, node });
+    }
+
+    void handle(const Event &event, Results &results) {
+        NodeState &node = state[event.node];
+        switch (event.type) {
+        case ATTEMPT:
+            if (lbt && channelBusy(event.time)) {
+                results.busy++;
+                if (event.time - node.cadStarted > cadTimeoutMicros) {
+                    results.cadTimeouts++;
+                    results.deferMicros += event.time - node.cadStarted;
+                    results.tries++;
+                    retryAfterTimeout(event.node, event.time);   // send() fails and the ack never comes
+                    break;
+                }
+                if (node.backoffExponent < maxBackoffExponent) node.backoffExponent++;
+                events.push({ event.time + (int64_t)(1 + rng(1UL << node.backoffExponent)) * backoffMicros, ATTEMPT, event.node });
+                break;
+            }
+            results.deferMicros += event.time - node.cadStarted;
+            results.tries++;
+            results.transmissions++;
+            node.request = transmissions.size();
+            transmissions.push_back({ event.time, event.time + requestMicros });
+            events.push({ event.time + requestMicros, REQUEST_END, event.node });
+            break;
+        case REQUEST_END:
+            if (overlapped(node.request)) {
+                results.lost++;
+                retryAfterTimeout(event.node, event.time);
+                break;
+            }
+            results.transmissions++;                                    // The gateway replies - its reply can collide too
+            transmissions.push_back({ event.time + gatewayReplyMicros, event.time + gatewayReplyMicros + ackMicros });
+            node.request = transmissions.size() - 1;
+            events.push({ event.time + gatewayReplyMicros + ackMicros, ACK_END, event.node });
+            break;
+        case ACK_END:
+            if (overlapped(node.request)) {
+                results.lost++;
+                retryAfterTimeout(event.node, event.time - gatewayReplyMicros - ackMicros);
+            }
+            break;
+        case RETRY:
+            if (++node.tries > retries) results.failed++;
+            else startTry(event.node, event.time);
+            break;
+        }
+    }
+
+    int nodes;
+    bool lbt;
+    uint32_t payloadDetectPercent;
+    uint32_t requestMicros, ackMicros, preambleMicros, backoffMicros;
+    int64_t timeoutMicros, cadTimeoutMicros;
+    std::vector<NodeState> state;
+    std::vector<Transmission> transmissions;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events;
+};
+
+int main() {
+    const int nodeCounts[] = { 12, 25, 50, 100 };
+    const int payloadDetect[] = { 0, 50, 90 };
+
+    printf("Reports from every node starting within %lu seconds - no reporting slots, %d retries, %d trials\n", (unsigned long)lectureEndSeconds, retries, trials);
+    printf("Lost - transmissions lost to collisions, Tries - per report, Failed - reports not delivered after the retries\n");
+    printf("Busy - busy channel detections per report, Deferred - time per report spent waiting for a clear channel\n\n");
+    printf("%-10s %6s %-12s %8s %8s %8s %10s %10s\n", "Data rate", "Nodes", "Access", "Lost", "Tries", "Failed", "Busy/rpt", "Deferred");
+
+    for (const DataRate &rate : dataRates) {
+        LoRaModem modem = loraModemFromRegisters(rate.reg1d, rate.reg1e, rate.reg26, 8);
+        for (int nodes : nodeCounts) {
+            for (int access = -1; access < (int)(sizeof(payloadDetect) / sizeof(payloadDetect[0])); access++) {
+                Results results;
+                for (int trial = 0; trial < trials; trial++) {
+                    Simulation simulation(modem, nodes, access >= 0, (access >= 0) ? payloadDetect[access] : 0);
+                    simulation.run(results);
+                }
+                char name[16];
+                if (access < 0) snprintf(name, sizeof(name), "Blind");
+                else snprintf(name, sizeof(name), "CAD %d%%", payloadDetect[access]);
+                long reports = (long)trials * nodes;
+                printf("%-10s %6d %-12s %7.1f%% %8.2f %7.1f%% %10.2f %8ldmS\n", rate.name, nodes, name,
+                    100.0 * results.lost / results.transmissions, (double)results.tries / reports, 100.0 * results.failed / reports,
+                    (double)results.busy / reports, (long)(results.deferMicros / reports / 1000));
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+// dedup_window_check.cpp
+//
+// Checks RHReliableDatagram's duplicate detection (lib/Radiohead/RHReliableDatagram.cpp - a sliding window of the
+// sequence numbers received from each sender) against patterns of first tries and retries that relays and lost
+// acknowledgements produce, and shows what the detection it had before v15.17 (the last id from each sender) made of
+// them. Each message is handed to recvfromAck() as the radio would - "r" marks a retry (RH_FLAGS_RETRY) - and is either
+// delivered (D) or taken as a duplicate and only acknowledged again (-). Exits with 1 if any pattern is not handled as
+// expected.
+//
+// Build and run natively from the repository root:
+//   R=lib/Radiohead
+//   g++ -O2 -std=gnu++11 -I $R -o dedup_window_check tools/dedup_window_check.cpp $R/RHGenericDriver.cpp
+//       $R/RHReliableDatagram.cpp $R/RHDatagram.cpp
+//   ./dedup_window_check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <RHReliableDatagram.h>
+
+static unsigned long simMillis = 0;
+unsigned long millis() { return simMillis; }
+void delay(unsigned long) {}
+long random(long to) { return ::random() % to; }
+long random(long from, long to) { return from + ::random() % (to - from); }
+
+struct Message {
+    uint8_t from, id;
+    bool retry;
+};
+
+// Hands the next message to the manager - acknowledgements go nowhere
+class QueueDriver : public RHGenericDriver {
+public:
+    bool init() { return true; }
+    uint8_t maxMessageLength() { return 64; }
+    bool send(const uint8_t*, uint8_t) { return true; }
+    bool available() { return _pending; }
+    bool recv(uint8_t* buf, uint8_t* len) {
+        if (!_pending) return false;
+        _rxHeaderTo = _thisAddress;
+        _rxHeaderFrom = _message.from;
+        _rxHeaderId = _message.id;
+        _rxHeaderFlags = _message.retry ? RH_FLAGS_RETRY : 0;
+        if (buf && len && *len) { buf[0] = _message.id; *len = 1; }
+        _pending = false;
+        return true;
+    }
+    void put(const Message &message) { _message = message; _pending = true; }
+
+private:
+    Message _message;
+    bool _pending = false;
+};
+
+// The detection before v15.17 - a retry is a duplicate if its id is the last one received from its sender
+class LastIdOnly {
+public:
+    LastIdOnly() { memset(_seenIds, 0, sizeof(_seenIds)); }
+    bool deliver(const Message &m) {
+        if (RH_ENABLE_EXPLICIT_RETRY_DEDUP && !m.retry) { _seenIds[m.from] = m.id; return true; }
+        if (m.id == _seenIds[m.from]) return false;
+        _seenIds[m.from] = m.id;
+        return true;
+    }
+private:
+    uint8_t _seenIds[256];
+};
+
+struct Pattern {
+    const char *name;
+    std::vector<Message> messages;
+    std::string expected;                                   // D delivered, - duplicate
+};
+
+static std::vector<Message> sequence(uint8_t from, int first, int last) {
+    std::vector<Message> messages;
+    for (int id = first; id <= last; id++) messages.push_back({ from, (uint8_t)id, false });
+    return messages;
+}
+
+static std::vector<Message> operator+(std::vector<Message> a, const std::vector<Message> &b) {
+    a.insert(a.end(), b.begin(), b.end());
+    return a;
+}
+
+static std::string pattern(const std::vector<Message> &messages) {
+    std::string text;
+    uint8_t firstFrom = messages[0].from;
+    bool senders = false;                                   // Senders are lettered when there is more than one
+    for (const Message &m : messages) senders |= m.from != firstFrom;
+    for (const Message &m : messages) {
+        char item[16];
+        if (senders) snprintf(item, sizeof(item), "%c%d%s ", 'A' + m.from - firstFrom, m.id, m.retry ? "r" : "");
+        else snprintf(item, sizeof(item), "%d%s ", m.id, m.retry ? "r" : "");
+        text += item;
+    }
+    return text.size() > 34 ? text.substr(0, 31) + "..." : text;
+}
+
+int main() {
+    const uint8_t a = 10, b = 11;
+    std::vector<Message> others;                            // One message from each of more senders than the table keeps
+    for (int i = 0; i < RH_RELIABLE_DEDUP_SOURCES; i++) others.push_back({ (uint8_t)(a + 2 + i), 1, false });
+
+    const std::vector<Pattern> patterns = {
+        { "In order", sequence(a, 1, 3), "DDD" },
+        { "Lost acknowledgement", { { a, 1, false }, { a, 1, true } }, "D-" },
+        { "Retry after a newer message", { { a, 1, false }, { a, 2, false }, { a, 1, true } }, "DD-" },
+        { "Reordered by relays", { { a, 1, false }, { a, 3, false }, { a, 2, false } }, "DDD" },
+        { "Reordered, then both retried", { { a, 1, false }, { a, 3, false }, { a, 2, false }, { a, 3, true }, { a, 2, true } }, "DDD--" },
+        { "Retry of a lost first try", { { a, 1, false }, { a, 2, true } }, "DD" },
+        { "Lost first try, retried late", { { a, 1, false }, { a, 3, false }, { a, 2, true }, { a, 2, true } }, "DDD-" },
+        { "Two senders, the same ids", { { a, 1, false }, { b, 1, false }, { a, 1, true }, { b, 1, true } }, "DD--" },
+        { "Ids wrapping past 255", { { a, 254, false }, { a, 255, false }, { a, 0, false }, { a, 1, false }, { a, 255, true }, { a, 0, true } }, "DDDD--" },
+        { "Sender restarted", sequence(a, 1, 5) + std::vector<Message>{ { a, 1, false }, { a, 2, true } }, "DDDDDDD" },
+        { "Retry from before the window", sequence(a, 1, RH_RELIABLE_DEDUP_WINDOW + 1) + std::vector<Message>{ { a, 1, true } },
+            std::string(RH_RELIABLE_DEDUP_WINDOW + 2, 'D') },
+        { "Retry from the window's edge", sequence(a, 1, RH_RELIABLE_DEDUP_WINDOW) + std::vector<Message>{ { a, 1, true } },
+            std::string(RH_RELIABLE_DEDUP_WINDOW, 'D') + "-" },
+        { "Sender pushed out of the table", std::vector<Message>{ { a, 1, false } } + others + std::vector<Message>{ { a, 1, true } },
+            std::string(RH_RELIABLE_DEDUP_SOURCES + 2, 'D') },
+    };
+
+    printf("Window of %d ids for each of %d senders - D delivered, - taken as a duplicate\n\n", RH_RELIABLE_DEDUP_WINDOW, RH_RELIABLE_DEDUP_SOURCES);
+    printf("%-32s %-34s %-10s %-10s %-10s %s\n", "Pattern", "Messages", "Expected", "Window", "Last id", "");
+    int failures = 0;
+    for (const Pattern &p : patterns) {
+        QueueDriver driver;
+        RHReliableDatagram manager(driver, 1);
+        manager.init();
+        LastIdOnly before;
+        std::string window, lastId;
+        for (const Message &m : p.messages) {
+            driver.put(m);
+            uint8_t buf[4];
+            uint8_t len = sizeof(buf);
+            window += manager.recvfromAck(buf, &len) ? 'D' : '-';
+            lastId += before.deliver(m) ? 'D' : '-';
+        }
+        bool ok = window == p.expected;
+        failures += !ok;
+        const size_t shown = 10;
+        auto tail = [shown](const std::string &s) { return s.size() > shown ? "..." + s.substr(s.size() - (shown - 3)) : s; };
+        printf("%-32s %-34s %-10s %-10s %-10s %s\n", p.name, pattern(p.messages).c_str(), tail(p.expected).c_str(), tail(window).c_str(),
+            tail(lastId).c_str(), ok ? "ok" : "FAILED");
+    }
+    printf("\n%s\n", failures ? "FAILED" : "All patterns handled as expected");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,339 @@
+// discovery_flood_sim.cpp
+//
+// Broadcasts per route discovery, with RHMesh passing requests on as it did before v15.15 (every copy not yet through
+// the node is rebroadcast at once) and as it does now (lib/Radiohead/RHMesh.cpp - each request is passed on once, after a
+// random wait, and not at all if enough neighbours have been heard passing it on - see RHMesh::setRebroadcast()).
+//
+// Every node runs the real RHMesh over an in-process radio. Nodes are spread over three floors of a 120 x 40m building,
+// with the gateway (address 0) in one corner, as in route_selection_sim.cpp. A transmission takes its time on air at
+// SF7/500kHz and a receiver gets it with the link's probability - unless the receiver was transmitting, or another
+// transmission it hears within 6dB overlapped it. Before transmitting a node waits for a clear channel as the driver's
+// CAD does, which cannot keep apart neighbours that start in the same millisecond. A node is polled every millisecond
+// unless it is transmitting, as the main loop does while listening. In each discovery a random node looks for the
+// gateway, which here only notes when the request reaches it (its response is unicast and does not change the flood).
+// Broadcasts are all the transmissions in the RH_MESH_ARP_TIMEOUT the originator waits and the time after it until the
+// mesh is quiet. Reached is the share of requests that got to the gateway within RH_MESH_ARP_TIMEOUT.
+//
+// RH_MESH_SEEN_REQUESTS is set when RadioHead is compiled - build once as it is and once with -DRH_MESH_SEEN_REQUESTS=0
+// for the behaviour before v15.15. From the repository root:
+//   R=lib/Radiohead
+//   g++ -O2 -std=gnu++11 -I $R -o discovery_flood_sim tools/discovery_flood_sim.cpp $R/RHGenericDriver.cpp $R/RHMesh.cpp
+//       $R/RHRouter.cpp $R/RHReliableDatagram.cpp $R/RHDatagram.cpp $R/RHMessagePool.cpp
+//   ./discovery_flood_sim
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <RHMesh.h>
+
+static const int discoveries = 200;
+static const unsigned long discoveryMillis = RH_MESH_ARP_TIMEOUT + 2000;   // Until the mesh is quiet again
+static const unsigned long cadBackoffMillis = 20;           // applyChannelAccess() - a data report's time on air
+static const double captureDb = 6;
+static const double wallLossDbPerMetre = 0.6;
+static const double floorLossDb = 20;
+static const double shadowingDb = 6;
+static const double sensitivityDbm = -118;
+
+static unsigned long simMillis = 0;
+unsigned long millis() { return simMillis; }
+void delay(unsigned long) {}
+long random(long to) { return ::random() % to; }
+long random(long from, long to) { return from + ::random() % (to - from); }
+
+static double uniform() { return (::random() + 0.5) / 2147483648.0; }
+
+static double gaussian() {
+    return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+struct Building {
+    int nodes;                                              // Including the gateway, node 0
+    std::vector<std::vector<double>> rssi;                  // Symmetric
+    std::vector<std::vector<double>> success;               // Of one transmission with nothing overlapping it
+    std::vector<std::vector<int>> neighbours;               // Nodes a transmission reaches at least 1% of the time
+};
+
+static Building makeBuilding(int nodes) {
+    Building b;
+    b.nodes = nodes;
+    std::vector<double> x(nodes), y(nodes), floor(nodes);
+    for (int i = 0; i < nodes; i++) {
+        x[i] = i ? uniform() * 120 : 0;
+        y[i] = i ? uniform() * 40 : 0;
+        floor[i] = i ? ::random() % 3 : 0;
+    }
+    b.rssi.assign(nodes, std::vector<double>(nodes, -200));
+    for (int i = 0; i < nodes; i++) {
+        for (int j = i + 1; j < nodes; j++) {
+            double d = sqrt((x[i] - x[j]) * (x[i] - x[j]) + (y[i] - y[j]) * (y[i] - y[j]) + 9 * (floor[i] - floor[j]) * (floor[i] - floor[j]));
+            double loss = 40 + 30 * log10(d < 1 ? 1 : d) + wallLossDbPerMetre * d + floorLossDb * fabs(floor[i] - floor[j]) + shadowingDb * gaussian();
+            b.rssi[i][j] = b.rssi[j][i] = 14 - loss;        // 14dBm transmit power
+        }
+    }
+    b.success.assign(nodes, std::vector<double>(nodes, 0));
+    b.neighbours.resize(nodes);
+    for (int i = 0; i < nodes; i++) {
+        for (int j = 0; j < nodes; j++) {
+            if (i == j) continue;
+            b.success[i][j] = 1 / (1 + exp(-(b.rssi[i][j] - sensitivityDbm) / 1.5));
+            if (b.success[i][j] >= 0.01) b.neighbours[i].push_back(j);
+        }
+    }
+    return b;
+}
+
+// Time on air at SF7/500kHz CR4/5 with an explicit header and CRC - RHEncryptedDriver pads the message to 16 bytes
+static unsigned long airtimeMillis(uint8_t len) {
+    double symbol = 128 / 500000.0;
+    int payload = 4 + 16 * ((len + 1 + 15) / 16);
+    int symbols = 8 + std::max((int)ceil((8.0 * payload - 28 + 28 + 16) / 28) * 5, 0);
+    return (unsigned long)ceil((12.25 + symbols) * symbol * 1000);
+}
+
+struct Transmission {
+    int from;
+    unsigned long start, end;
+    uint8_t to, source, id, flags;                          // RadioHead's headers - source is headerFrom()
+    std::vector<uint8_t> payload;
+};
+
+class Ether;
+
+// The radio of one node - sends go out on the ether, receptions wait in one buffer as in RH_RF95
+class SimDriver : public RHGenericDriver {
+public:
+    SimDriver(Ether &ether, int node) : _ether(ether), _node(node), _busyUntil(0) {}
+    bool init() { return true; }
+    bool available() { return !_rx.empty(); }
+    bool recv(uint8_t* buf, uint8_t* len);
+    bool send(const uint8_t* data, uint8_t len);
+    uint8_t maxMessageLength() { return 64; }
+
+    void received(const Transmission &t, double rssi);
+    bool transmitting() const { return simMillis < _busyUntil; }
+    unsigned long busyUntil() const { return _busyUntil; }
+
+private:
+    Ether &_ether;
+    int _node;
+    unsigned long _busyUntil;                               // The send blocks the node until its transmission ends
+    std::deque<Transmission> _rx;
+};
+
+class Ether {
+public:
+    Ether(const Building &b) : _b(b), _drivers(b.nodes, NULL) {}
+
+    void attach(int node, SimDriver *driver) { _drivers[node] = driver; }
+
+    // When a node that waits for a clear channel starts transmitting - the deferral as RHGenericDriver::waitCAD()
+    unsigned long clearChannel(int node, unsigned long t) {
+        uint8_t backoffExponent = 0;
+        while (busyAt(node, t)) {
+            if (backoffExponent < RH_CAD_MAX_BACKOFF_EXPONENT) backoffExponent++;
+            t += random(1, (1UL << backoffExponent) + 1) * cadBackoffMillis;
+        }
+        return t;
+    }
+
+    void transmit(const Transmission &t) {
+        _air.push_back(t);
+        transmissions++;
+    }
+
+    // Delivers the transmissions that end now
+    void tick() {
+        for (size_t k = 0; k < _air.size(); k++) {
+            const Transmission &t = _air[k];
+            if (t.end != simMillis) continue;
+            for (int to : _b.neighbours[t.from]) {
+                if (uniform() >= _b.success[t.from][to] || heardOver(k, to)) continue;
+                if (to == 0) gatewayHeard(t);
+                else _drivers[to]->received(t, _b.rssi[t.from][to]);
+            }
+        }
+        _air.erase(std::remove_if(_air.begin(), _air.end(), [](const Transmission &t) { return t.end + 1000 < simMillis; }), _air.end());
+    }
+
+    long transmissions = 0;
+    long reachedAt = -1;                                    // When the request being followed first reached the gateway
+    uint8_t followSource = 0, followId = 0;
+
+private:
+    // CAD takes a few symbols - a transmission that starts the same millisecond is not detected
+    bool busyAt(int node, unsigned long t) {
+        for (const Transmission &other : _air) {
+            if (other.start < t && t < other.end && (other.from == node || _b.rssi[other.from][node] >= sensitivityDbm - 3)) return true;
+        }
+        return false;
+    }
+
+    // The receiver was transmitting, or heard another transmission that overlapped this one and was not 6dB weaker
+    bool heardOver(size_t k, int to) {
+        const Transmission &t = _air[k];
+        if (to != 0 && _drivers[to]->busyUntil() > t.start) {
+            for (const Transmission &other : _air) if (other.from == to && other.start < t.end && t.start < other.end) return true;
+        }
+        for (size_t o = 0; o < _air.size(); o++) {
+            const Transmission &other = _air[o];
+            if (o == k || other.from == to || other.end <= t.start || t.end <= other.start) continue;
+            if (_b.rssi[other.from][to] > _b.rssi[t.from][to] - captureDb && _b.success[other.from][to] >= 0.01) return true;
+        }
+        return false;
+    }
+
+    // The gateway only notes the request - RoutedMessageHeader, then the mesh message type, destlen and dest
+    void gatewayHeard(const Transmission &t) {
+        const std::vector<uint8_t> &p = t.payload;
+        if (t.to != RH_BROADCAST_ADDRESS || p.size() < 8 || p[5] != RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST || p[7] != 0) return;
+        if (p[1] == followSource && p[3] == followId && reachedAt < 0) reachedAt = simMillis;
+    }
+
+    const Building &_b;
+    std::vector<SimDriver *> _drivers;
+    std::vector<Transmission> _air;
+};
+
+bool SimDriver::recv(uint8_t* buf, uint8_t* len) {
+    if (_rx.empty()) return false;
+    const Transmission &t = _rx.front();
+    _rxHeaderTo = t.to;
+    _rxHeaderFrom = t.source;
+    _rxHeaderId = t.id;
+    _rxHeaderFlags = t.flags;
+    if (*len > t.payload.size()) *len = t.payload.size();
+    memcpy(buf, t.payload.data(), *len);
+    _rx.pop_front();
+    _rxGood++;
+    return true;
+}
+
+bool SimDriver::send(const uint8_t* data, uint8_t len) {
+    Transmission t;
+    t.from = _node;
+    t.start = _ether.clearChannel(_node, simMillis);
+    t.end = t.start + airtimeMillis(len);
+    t.to = _txHeaderTo;
+    t.source = _txHeaderFrom;
+    t.id = _txHeaderId;
+    t.flags = _txHeaderFlags;
+    t.payload.assign(data, data + len);
+    _ether.transmit(t);
+    _busyUntil = t.end;
+    _txGood++;
+    return true;
+}
+
+void SimDriver::received(const Transmission &t, double rssi) {
+    if (t.to != _thisAddress && t.to != RH_BROADCAST_ADDRESS) return;
+    if (!_rx.empty()) _rx.pop_front();                      // One receive buffer - an unread message is overwritten
+    _rx.push_back(t);
+    _lastRssi = (int16_t)rssi;
+}
+
+class SimMesh final : public RHMesh {                     // final - deleted as a SimMesh, and RHMesh has no virtual destructor
+public:
+    SimMesh(SimDriver &driver, uint8_t address) : RHMesh(driver, address) {}
+
+    // Broadcasts a request for the gateway as doArp() does - the wait for the response is the simulation's
+    uint8_t discoverGateway() {
+        MeshRouteDiscoveryMessage* p = (MeshRouteDiscoveryMessage*)_request;
+        p->header.msgType = RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST;
+        p->destlen = 1;
+        p->dest = 0;
+        uint8_t id = _lastE2ESequenceNumber;                // The id RHRouter::sendtoWait() gives it
+        RHRouter::sendtoWait(_request, sizeof(MeshMessageHeader) + 2, RH_BROADCAST_ADDRESS);
+        return id;
+    }
+
+private:
+    uint8_t _request[4];
+};
+
+struct Totals {
+    long discoveries = 0, broadcasts = 0, reached = 0, latency = 0;
+};
+
+static Totals run(const Building &b, uint16_t maxDelay, uint8_t threshold) {
+    Ether ether(b);
+    std::vector<SimDriver *> drivers(b.nodes, NULL);
+    std::vector<SimMesh *> meshes(b.nodes, NULL);
+    for (int node = 1; node < b.nodes; node++) {
+        drivers[node] = new SimDriver(ether, node);
+        meshes[node] = new SimMesh(*drivers[node], node);
+        meshes[node]->init();
+        meshes[node]->setRetries(2);
+#if RH_MESH_SEEN_REQUESTS
+        meshes[node]->setRebroadcast(maxDelay, threshold);
+#endif
+        ether.attach(node, drivers[node]);
+    }
+
+    Totals totals;
+    simMillis = 1;
+    for (int d = 0; d < discoveries; d++) {
+        int originator = 1 + ::random() % (b.nodes - 1);
+        unsigned long start = simMillis;
+        long before = ether.transmissions;
+        ether.reachedAt = -1;
+        ether.followSource = originator;
+        ether.followId = meshes[originator]->discoverGateway();
+        while (simMillis < start + discoveryMillis) {
+            simMillis++;
+            ether.tick();
+            for (int node = 1; node < b.nodes; node++) {
+                if (drivers[node]->transmitting()) continue;
+                uint8_t buf[RH_MESH_MAX_MESSAGE_LEN];
+                uint8_t len = sizeof(buf);
+                meshes[node]->recvfromAck(buf, &len);
+            }
+        }
+        totals.discoveries++;
+        totals.broadcasts += ether.transmissions - before;
+        if (ether.reachedAt >= 0 && (unsigned long)ether.reachedAt - start <= RH_MESH_ARP_TIMEOUT) {
+            totals.reached++;
+            totals.latency += ether.reachedAt - start;
+        }
+    }
+    for (int node = 1; node < b.nodes; node++) {
+        delete meshes[node];
+        delete drivers[node];
+    }
+    return totals;
+}
+
+int main() {
+    printf("%d discoveries of the gateway, each followed for %lums, %lums CAD backoff slots\n\n", discoveries, discoveryMillis, cadBackoffMillis);
+    printf("%6s %-34s %12s %12s %12s\n", "Nodes", "Rebroadcast", "Broadcasts", "Reached", "Latency");
+    printf("%6s %-34s %12s %12s %12s\n", "", "", "per discovery", "gateway", "(ms)");
+
+    struct Variant { const char *name; uint16_t maxDelay; uint8_t threshold; };
+#if RH_MESH_SEEN_REQUESTS
+    const Variant variants[] = {
+        { "Once, at once", 0, 0 },
+        { "Once, random wait up to 250ms", 250, 0 },
+        { "As above, unless 3 copies heard", 250, 3 },
+        { "As above, unless 2 copies heard", 250, 2 },
+    };
+#else
+    const Variant variants[] = { { "Every copy, at once (before v15.15)", 0, 0 } };
+#endif
+    const int sizes[] = { 15, 30, 60 };
+    for (int nodes : sizes) {
+        srandom(nodes);
+        Building building = makeBuilding(nodes);
+        for (const Variant &variant : variants) {
+            srandom(nodes * 7);                             // The same originators for each
+            Totals totals = run(building, variant.maxDelay, variant.threshold);
+            printf("%6d %-34s %12.1f %11.1f%% %12.0f\n", nodes, variant.name, (double)totals.broadcasts / totals.discoveries,
+                100.0 * totals.reached / totals.discoveries, totals.reached ? (double)totals.latency / totals.reached : 0.0);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
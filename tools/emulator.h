@@ -0,0 +1,75 @@
+// emulator.h
+//
+// Shared by the gateway and node emulators (tools/gateway_emulator.cpp, tools/node_emulator.cpp). They are RadioHead
+// simulator sketches - RHMesh over RH_TCP, connected through lib/Radiohead/tools/etherSimulator.pl or tools/ether_emulator.cpp - that exchange the
+// messages laid out in src/LoRA_Frames.h. See tools/scenario_bench.sh for building and running them.
+
+#ifndef __EMULATOR_H
+#define __EMULATOR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <RHMesh.h>
+#include <RH_TCP.h>
+#include "Config.h"
+#include "LoRA_Frames.h"
+#include "LoRA_Airtime.h"
+#include "LoRA_Slots.h"
+
+#define EMULATOR_GATEWAY_ADDRESS 0
+#define EMULATOR_MAGIC_NUMBER 27617                     // sysStatus.magicNumber after sysData.initialize()
+#define EMULATOR_REGISTERS 0x92, 0x74, 0x04             // Bw500Cr45Sf128 - ADR_DEFAULT_DATA_RATE in src/LinkAdaptation.cpp
+
+// The ether's address - RH_ETHER is host:port, localhost:4000 if it is not set
+inline const char* emulatorEther() {
+    const char* ether = getenv("RH_ETHER");
+    return ether ? ether : "localhost:4000";
+}
+
+// Wall clock in hundredths of a second - the nodes and the gateway share it, as if every node's clock had been set to the hundredth
+inline uint64_t emulatorHundredths() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 100ULL + now.tv_usec / 10000;
+}
+
+// RH_TCP that adds up the time on air each message would take on the radio - encrypted to whole Speck blocks with a length
+// byte (RHEncryptedDriver with STRICT_CONTENT_LEN) and sent with RH_RF95's 4 byte header
+class CountingDriver : public RH_TCP {
+public:
+    CountingDriver(const char* server) : RH_TCP(server) {
+        modem = loraModemFromRegisters(EMULATOR_REGISTERS, 8);
+    }
+
+    virtual bool send(const uint8_t* data, uint8_t len) {
+        transmissions++;
+        airtimeMicros += loraAirtimeMicros(modem, (len / LORA_CIPHER_BLOCK_LEN + 1) * LORA_CIPHER_BLOCK_LEN + LORA_RADIO_HEADER_LEN);
+        return RH_TCP::send(data, len);
+    }
+
+    LoRaModem modem;
+    uint32_t transmissions = 0;
+    uint64_t airtimeMicros = 0;
+};
+
+// Reads "name=value" from the command line - the sketch only sees argc and argv through simMain.cpp
+inline long emulatorOption(int argc, char** argv, const char* name, long defaultValue) {
+    size_t length = strlen(name);
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], name, length) == 0 && argv[i][length] == '=') return atol(argv[i] + length + 1);
+    }
+    return defaultValue;
+}
+
+inline const char* emulatorText(int argc, char** argv, const char* name, const char* defaultValue) {
+    size_t length = strlen(name);
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], name, length) == 0 && argv[i][length] == '=') return argv[i] + length + 1;
+    }
+    return defaultValue;
+}
+
+#endif  /* __EMULATOR_H */
@@ -0,0 +1,167 @@
+// ether_emulator.cpp
+//
+// The ether for the gateway and node emulators (tools/gateway_emulator.cpp, tools/node_emulator.cpp) when Perl's POE
+// module - which lib/Radiohead/tools/etherSimulator.pl needs - is not installed. It follows etherSimulator.pl's rules:
+// a packet from one sketch goes to every other sketch once its time on air (8 bits a byte at the ether's bit rate) has
+// passed, and a packet reaching a sketch that is still waiting for another one destroys both - a collision. There is no
+// configuration file - every packet is delivered unless it collides.
+//
+// Messages to and from the sketches are as lib/Radiohead/RHTcpProtocol.h - a length (uint32_t, network byte order),
+// then the message type and its payload.
+//
+// Build from the repository root (tools/scenario_bench.sh does, and uses it when POE is missing):
+//   g++ -O2 -std=gnu++11 -o ether_emulator tools/ether_emulator.cpp
+//   ./ether_emulator -p 4000 -b 21875
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+
+#define ETHER_MESSAGE_TYPE_PACKET 2                     // RH_TCP_MESSAGE_TYPE_PACKET
+#define ETHER_MAX_MESSAGE_LEN 1024                      // Longer than any RH_TCP message - anything longer drops the sketch
+
+struct Sketch {
+    int socket;
+    std::string input;                                  // Bytes read and not yet a whole message
+    std::string output;                                 // Bytes to write
+    std::string packet;                                 // Waiting for its time on air to pass
+    bool waiting;
+    double received;                                    // When the packet was sent, in seconds
+};
+
+static double seconds() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec / 1e6;
+}
+
+static void queueMessage(Sketch &sketch, uint8_t type, const std::string &payload) {
+    uint32_t length = htonl(payload.size() + 1);
+    sketch.output.append((const char*)&length, 4);
+    sketch.output.push_back((char)type);
+    sketch.output.append(payload);
+}
+
+// A packet from one sketch reaches every other one - and collides with any packet still waiting there
+static void transmit(std::vector<Sketch> &sketches, size_t from, const std::string &packet) {
+    for (size_t i = 0; i < sketches.size(); i++) {
+        if (i == from) continue;
+        if (sketches[i].waiting) {
+            sketches[i].waiting = false;
+            sketches[i].packet.clear();
+        }
+        else {
+            sketches[i].waiting = true;
+            sketches[i].packet = packet;
+            sketches[i].received = seconds();
+        }
+    }
+}
+
+// Whole messages in a sketch's input - false if it sent one no sketch would
+static bool readMessages(std::vector<Sketch> &sketches, size_t index) {
+    std::string &input = sketches[index].input;
+    while (input.size() >= 4) {
+        uint32_t length;
+        memcpy(&length, input.data(), 4);
+        length = ntohl(length);
+        if (length == 0 || length > ETHER_MAX_MESSAGE_LEN) return false;
+        if (input.size() < 4 + length) break;
+        if ((uint8_t)input[4] == ETHER_MESSAGE_TYPE_PACKET) transmit(sketches, index, input.substr(5, length - 1));
+        input.erase(0, 4 + length);                     // RH_TCP_MESSAGE_TYPE_THISADDRESS is not needed - nothing is filtered by address
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int port = 4000;
+    double bps = 10000;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:b:")) != -1) {
+        if (opt == 'p') port = atoi(optarg);
+        else if (opt == 'b') bps = atof(optarg);
+        else {
+            fprintf(stderr, "usage: %s [-p portnumber] [-b bitspersec]\n", argv[0]);
+            return 1;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 256) < 0) {
+        perror("ether_emulator");
+        return 1;
+    }
+    printf("Ether on port %d at %.0f bits per second\n", port, bps);
+    fflush(stdout);
+
+    std::vector<Sketch> sketches;
+    std::vector<struct pollfd> fds;
+    for (;;) {
+        fds.assign(1, { listener, POLLIN, 0 });
+        for (const Sketch &sketch : sketches) fds.push_back({ sketch.socket, (short)(POLLIN | (sketch.output.empty() ? 0 : POLLOUT)), 0 });
+        poll(fds.data(), fds.size(), 1);                // etherSimulator.pl delivers on a 1ms tick
+
+        std::vector<bool> closed(sketches.size(), false);
+        for (size_t i = 0; i < sketches.size(); i++) {
+            short events = fds[i + 1].revents;
+            Sketch &sketch = sketches[i];
+            if (events & POLLIN) {
+                char buf[512];
+                ssize_t got = read(sketch.socket, buf, sizeof(buf));
+                if (got <= 0) closed[i] = true;
+                else {
+                    sketch.input.append(buf, got);
+                    if (!readMessages(sketches, i)) closed[i] = true;
+                }
+            }
+            else if (events & (POLLERR | POLLHUP)) closed[i] = true;
+            if ((events & POLLOUT) && !closed[i]) {
+                ssize_t sent = write(sketch.socket, sketch.output.data(), sketch.output.size());
+                if (sent < 0 && errno != EAGAIN) closed[i] = true;
+                else if (sent > 0) sketch.output.erase(0, sent);
+            }
+        }
+        for (size_t i = sketches.size(); i-- > 0; ) {
+            if (!closed[i]) continue;
+            close(sketches[i].socket);
+            sketches.erase(sketches.begin() + i);
+        }
+
+        double now = seconds();                         // Packets whose time on air has passed
+        for (Sketch &sketch : sketches) {
+            if (!sketch.waiting || now - sketch.received <= sketch.packet.size() * 8 / bps) continue;
+            queueMessage(sketch, ETHER_MESSAGE_TYPE_PACKET, sketch.packet);
+            sketch.waiting = false;
+            sketch.packet.clear();
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int client = accept(listener, NULL, NULL);
+            if (client >= 0) {
+                fcntl(client, F_SETFL, O_NONBLOCK);
+                setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                sketches.push_back({ client, "", "", "", false, 0 });
+            }
+        }
+    }
+}
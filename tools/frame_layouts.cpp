@@ -0,0 +1,79 @@
+// frame_layouts.cpp
+//
+// Prints the node <-> gateway message layouts defined in src/LoRA_Frames.h as a C header of
+// offsets and lengths so the gateway code can use the same layout rather than hand-copied byte indices.
+// Run it whenever a field list in LoRA_Frames.h changes.
+//
+// Build and run natively from the repository root:
+//   g++ -std=c++11 -I src -o frame_layouts tools/frame_layouts.cpp
+//   ./frame_layouts > LoRA_Frame_Layouts.h
+
+#include <stdio.h>
+#include <ctype.h>
+#include "LoRA_Frames.h"
+#include "ConfigBlock.h"
+
+static void printFrame(const char* prefix, uint8_t length, const FrameFieldInfo* fields, uint8_t count) {
+    printf("\n// %s - %d bytes\n", prefix, length);
+    printf("#define %s_LENGTH %d\n", prefix, length);
+    for (uint8_t i = 0; i < count; i++) {
+        char name[40];
+        uint8_t j = 0;
+        for (const char* c = fields[i].name; *c && j < sizeof(name) - 1; c++) name[j++] = toupper(*c);
+        name[j] = 0;
+        printf("#define %s_%s_OFFSET %d\t\t// %s\n", prefix, name, fields[i].offset, fields[i].type);
+    }
+}
+
+static void printBits(const char* prefix, uint8_t length, const FrameFieldInfo* fields, uint8_t count) {
+    printf("\n// %s - %d bytes of bit fields, most significant bit first - value = field + minimum\n", prefix, length);
+    printf("#define %s_LENGTH %d\n", prefix, length);
+    for (uint8_t i = 0; i < count; i++) {
+        char name[40];
+        uint8_t j = 0;
+        for (const char* c = fields[i].name; *c && j < sizeof(name) - 1; c++) name[j++] = toupper(*c);
+        name[j] = 0;
+        printf("#define %s_%s_BIT %d\n", prefix, name, fields[i].offset);
+        printf("#define %s_%s_BITS %d\n", prefix, name, fields[i].size);
+        printf("#define %s_%s_MIN %d\n", prefix, name, fields[i].minimum);
+    }
+}
+
+static void printConfigItems() {
+    printf("\n// Configuration block items - tag, value bytes and range - values are big-endian, signed when the minimum is negative\n");
+    for (uint8_t i = 0; i < ConfigBlock::maxItems; i++) {
+        const ConfigItemInfo &item = ConfigBlock::items()[i];
+        char name[40];
+        uint8_t j = 0;
+        for (const char* c = item.name; *c && j < sizeof(name) - 1; c++) name[j++] = toupper(*c);
+        name[j] = 0;
+        printf("#define CONFIG_%s_TAG %d\n", name, item.tag);
+        printf("#define CONFIG_%s_LENGTH %d\n", name, item.length);
+        printf("#define CONFIG_%s_MIN %ld\n", name, (long)item.minimum);
+        printf("#define CONFIG_%s_MAX %ld\n", name, (long)item.maximum);
+    }
+}
+
+#define PRINT_FRAME(prefix, frame) printFrame(prefix, frame::length, frame::fields(), frame::fieldCount())
+#define PRINT_BITS(prefix, block) printBits(prefix, block::length, block::fields(), block::fieldCount())
+
+int main() {
+    printf("// Generated by tools/frame_layouts.cpp from LoRA_Frames.h - do not edit\n");
+    printf("// All multi-byte fields are big-endian\n");
+    printf("#ifndef __LORA_FRAME_LAYOUTS_H\n#define __LORA_FRAME_LAYOUTS_H\n");
+    PRINT_BITS("NODE_CONFIG", NodeConfigBits);
+    PRINT_BITS("STATUS", StatusBits);
+    PRINT_FRAME("DATA_RPT", DataReportFrame);
+    PRINT_FRAME("AGGREGATE_RPT", AggregateReportFrame);
+    printf("// Followed by AGGREGATE_RPT bucketCount pairs of zigzag varints (gross change, net change) and the two retransmission bytes\n");
+    PRINT_FRAME("QUEUED_RPT", QueuedReportFrame);
+    PRINT_FRAME("CONFIG_RPT", ConfigReportFrame);
+    printf("// Followed by CONFIG_RPT an item (tag, length, value) for each item of the block with the value now in effect and the two retransmission bytes\n");
+    PRINT_FRAME("DATA_ACK", DataAckFrame);
+    printf("// A longer DATA_ACK carries a configuration block - an id byte and items (tag, length, value) - before the two retransmission bytes\n");
+    printConfigItems();
+    PRINT_FRAME("JOIN_REQ", JoinRequestFrame);
+    PRINT_FRAME("JOIN_ACK", JoinAckFrame);
+    printf("\n#endif\n");
+    return 0;
+}
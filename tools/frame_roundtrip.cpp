@@ -0,0 +1,306 @@
+// frame_roundtrip.cpp
+//
+// Encodes and decodes every message in src/LoRA_Frames.h and checks what goes on the wire. Each field of each frame is
+// written through its accessor with the edge values of its type (0, the minimum - negative counts for the signed ones -
+// and the maximum), then read back and compared byte for byte with the big-endian value at the field's offset - and
+// nothing else in the buffer may change. The bit fields of the configuration and status blocks (NodeConfigBits,
+// StatusBits) are written at their minimum and maximum, and one beyond each, which must clamp.
+//
+// The variable parts are checked too: an aggregated report with every bucket (AGGREGATE_MAX_BUCKETS) at the largest
+// count changes, and a configuration block (src/ConfigBlock.h) with every item at its limits, echoed as a configuration
+// report. Both are decoded again from every truncated length - a decoder must stop short, never read past the end. The
+// first block a new node gets must be applied, whatever its id.
+// Replies with every message flag and length are checked too - only a whole acknowledgement may be read.
+//
+// Prints a line for each frame and exits with 1 if any check fails.
+//
+// Build and run natively from the repository root:
+//   g++ -std=c++11 -I src -o frame_roundtrip tools/frame_roundtrip.cpp
+//   ./frame_roundtrip
+
+#include <stdio.h>
+#include <string.h>
+#include <limits>
+#include "LoRA_Frames.h"
+#include "ConfigBlock.h"
+
+static const uint8_t background = 0xA5;                     // What the buffer holds before each write
+static int failures = 0;
+static int checks = 0;
+
+static void check(bool passed, const char* frame, const char* field, const char* what, long value) {
+    checks++;
+    if (passed) return;
+    failures++;
+    printf("  FAILED %s.%s - %s (value %ld)\n", frame, field, what, value);
+}
+
+// The bytes outside [offset, offset + size) must still hold the background
+static bool untouched(const uint8_t* buf, size_t length, size_t offset, size_t size) {
+    for (size_t i = 0; i < length; i++) {
+        if ((i < offset || i >= offset + size) && buf[i] != background) return false;
+    }
+    return true;
+}
+
+template <typename T, typename Set, typename Get>
+static void checkField(T*, const char* frame, const char* field, uint8_t* buf, size_t length, size_t offset, Set set, Get get) {
+    const T values[] = { 0, std::numeric_limits<T>::min(), std::numeric_limits<T>::max(), (T)0x5A3C1E0F };
+    for (T value : values) {
+        memset(buf, background, length);
+        set(value);
+        check(get() == value, frame, field, "read back a different value", (long)value);
+        uint32_t bits = (uint32_t)value;
+        bool bigEndian = true;
+        for (size_t i = sizeof(T); i > 0; i--, bits >>= 8) bigEndian &= buf[offset + i - 1] == (uint8_t)bits;
+        check(bigEndian, frame, field, "not big-endian at its offset", (long)value);
+        check(untouched(buf, length, offset, sizeof(T)), frame, field, "wrote outside its bytes", (long)value);
+    }
+}
+
+// A bit field - clamped to minimum .. minimum + 2^bits - 1 and no other bit of the block changes
+template <typename Set, typename Get>
+static void checkBits(const char* block, const char* field, uint8_t* buf, size_t length, uint16_t position, uint8_t width,
+        int32_t minimum, Set set, Get get) {
+    int32_t maximum = minimum + (int32_t)((1UL << width) - 1);
+    const int32_t values[][2] = { { minimum, minimum }, { maximum, maximum }, { minimum - 1, minimum }, { maximum + 1, maximum } };
+    for (const int32_t *value : values) {
+        for (int fill = 0; fill <= 0xFF; fill += 0xFF) {
+            uint8_t before[8];
+            memset(buf, fill, length);
+            memcpy(before, buf, length);
+            set(value[0]);
+            check(get() == value[1], block, field, (value[0] == value[1]) ? "read back a different value" : "did not clamp", (long)value[0]);
+            bool others = true;
+            for (uint16_t bit = 0; bit < length * 8; bit++) {
+                if (bit >= position && bit < position + width) continue;
+                others &= frameGetBits(buf, bit, 1) == frameGetBits(before, bit, 1);
+            }
+            check(others, block, field, "changed another field's bits", (long)value[0]);
+        }
+    }
+}
+
+#define ROUNDTRIP_BITS(name, bits, minimum) \
+    checkBits(blockName, #name, buf, Block::length, Block::name##_position, bits, minimum, \
+        [&](int32_t value) { block.name(value); }, [&]() { return block.name(); });
+
+#define ROUNDTRIP_BLOCK(className, BITS) {                                                          \
+    typedef className Block;                                                                        \
+    const char* blockName = #className;                                                             \
+    uint8_t buf[Block::length];                                                                     \
+    Block block(buf);                                                                               \
+    BITS(ROUNDTRIP_BITS)                                                                            \
+    check(Block::totalBits <= Block::length * 8, blockName, "", "bits do not fit its length", Block::totalBits); \
+    printf("%-22s %3d bytes %3d fields\n", blockName, Block::length, Block::fieldCount());          \
+}
+
+// A bit block inside a frame - the view must start at the field's offset
+template <typename Block, typename Get>
+static void checkBlockField(const char* frame, const char* field, uint8_t* buf, size_t offset, Get get) {
+    check(get().data() == buf + offset, frame, field, "block is not at its offset", offset);
+    check((int)FrameCodec<Block>::size == (int)Block::length, frame, field, "block size is not its length", FrameCodec<Block>::size);
+}
+
+template <typename Set, typename Get>
+static void checkField(NodeConfigBits*, const char* frame, const char* field, uint8_t* buf, size_t, size_t offset, Set, Get get) {
+    checkBlockField<NodeConfigBits>(frame, field, buf, offset, get);
+}
+
+template <typename Set, typename Get>
+static void checkField(StatusBits*, const char* frame, const char* field, uint8_t* buf, size_t, size_t offset, Set, Get get) {
+    checkBlockField<StatusBits>(frame, field, buf, offset, get);
+}
+
+// The layout table - fields follow each other with no gaps and the retransmission bytes, where a frame has them, are last
+static void checkLayout(const char* frame, uint8_t length, const FrameFieldInfo* fields, uint8_t count) {
+    uint8_t next = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        check(fields[i].offset == next, frame, fields[i].name, "does not follow the field before it", fields[i].offset);
+        next = fields[i].offset + fields[i].size;
+        if (!strcmp(fields[i].name, "retries")) check(fields[i].offset == length - 2, frame, fields[i].name, "is not the second last byte", fields[i].offset);
+    }
+    check(next == length, frame, "", "fields do not add up to its length", next);
+}
+
+#define ROUNDTRIP_FIELD(name, type) \
+    checkField((type*)0, frameName, #name, buf, Frame::length, offsetof(Frame::Layout, name), \
+        [&](FrameCodec<type>::value_type value) { frame.name(value); }, [&]() { return frame.name(); });
+
+#define ROUNDTRIP_FRAME(className, FIELDS) {                                                        \
+    typedef className Frame;                                                                        \
+    const char* frameName = #className;                                                             \
+    uint8_t buf[Frame::length];                                                                     \
+    Frame frame(buf);                                                                               \
+    FIELDS(ROUNDTRIP_FIELD)                                                                         \
+    checkLayout(frameName, Frame::length, Frame::fields(), Frame::fieldCount());                    \
+    printf("%-22s %3d bytes %3d fields\n", frameName, Frame::length, Frame::fieldCount());          \
+}
+
+// Decodes bucketCount pairs of zigzag varints from data to end as the gateway does - false if they stop short
+static bool decodeBuckets(const uint8_t* data, const uint8_t* end, uint8_t bucketCount, uint16_t gross, int16_t net,
+        uint16_t* grossOut, int16_t* netOut) {
+    for (uint8_t i = 0; i < bucketCount; i++) {
+        uint32_t grossChange, netChange;
+        uint8_t used = frameGetVarint(data, end, grossChange);
+        if (!used) return false;
+        data += used;
+        used = frameGetVarint(data, end, netChange);
+        if (!used) return false;
+        data += used;
+        gross = grossOut[i] = gross + zigzagDecode(grossChange);
+        net = netOut[i] = net + zigzagDecode(netChange);
+    }
+    return true;
+}
+
+// Every bucket at the largest change in each direction - as ReportAggregator::writeBuckets() lays them out
+static void checkAggregateReport() {
+    const char* name = "AggregateReportFrame";
+    uint8_t buf[LORA_MAX_AGGREGATE_REPORT_LEN];
+    AggregateReportFrame report(buf);
+    uint16_t gross[AGGREGATE_MAX_BUCKETS], grossRead[AGGREGATE_MAX_BUCKETS];
+    int16_t net[AGGREGATE_MAX_BUCKETS], netRead[AGGREGATE_MAX_BUCKETS];
+    uint16_t grossBase = 0;
+    int16_t netBase = -32768;
+
+    uint8_t len = AggregateReportFrame::length;
+    uint16_t lastGross = grossBase;
+    int16_t lastNet = netBase;
+    for (uint8_t i = 0; i < AGGREGATE_MAX_BUCKETS; i++) {
+        gross[i] = (i & 1) ? 0 : 65535;
+        net[i] = (i & 1) ? -32768 : 32767;
+        len += framePutVarint(buf + len, zigzagEncode((int32_t)gross[i] - lastGross));
+        len += framePutVarint(buf + len, zigzagEncode((int32_t)net[i] - lastNet));
+        lastGross = gross[i];
+        lastNet = net[i];
+    }
+    report.bucketCount(AGGREGATE_MAX_BUCKETS);
+    report.occupancyGrossBase(grossBase);
+    report.occupancyNetBase(netBase);
+    buf[len++] = 0;                                         // The two retransmission bytes
+    buf[len++] = 0;
+    check(len == LORA_MAX_AGGREGATE_REPORT_LEN, name, "buckets", "longest report is not LORA_MAX_AGGREGATE_REPORT_LEN", len);
+
+    const uint8_t* data = buf + AggregateReportFrame::length;
+    const uint8_t* end = buf + len - 2;
+    bool decoded = decodeBuckets(data, end, report.bucketCount(), report.occupancyGrossBase(), report.occupancyNetBase(), grossRead, netRead);
+    check(decoded, name, "buckets", "did not decode", report.bucketCount());
+    for (uint8_t i = 0; decoded && i < AGGREGATE_MAX_BUCKETS; i++) {
+        check(grossRead[i] == gross[i] && netRead[i] == net[i], name, "buckets", "bucket decoded to different counts", i);
+    }
+    for (const uint8_t* cut = data; cut < end; cut++) {
+        check(!decodeBuckets(data, cut, report.bucketCount(), grossBase, netBase, grossRead, netRead), name, "buckets",
+            "decoded from a truncated report", cut - data);
+    }
+    printf("%-22s %3d bytes %3d buckets, truncated %d ways\n", name, len, AGGREGATE_MAX_BUCKETS, (int)(end - data));
+}
+
+// Every item at its minimum, then at its maximum - carried in a data ack and echoed in a configuration report
+static void checkConfigBlock() {
+    const char* name = "ConfigBlock";
+    for (int limit = 0; limit < 2; limit++) {
+        uint8_t ack[LORA_MAX_DATA_ACK_LEN];
+        uint8_t* block = ack + DataAckFrame::length - 2;    // Between slotOffset and the retransmission bytes
+        uint8_t len = 0;
+        block[len++] = 200 + limit;                         // The block's id
+        for (uint8_t i = 0; i < ConfigBlock::maxItems; i++) {
+            const ConfigItemInfo &item = ConfigBlock::items()[i];
+            len += ConfigBlock::writeItem(block + len, item.tag, limit ? item.maximum : item.minimum);
+        }
+        check(len == ConfigBlock::maxLength, name, "items", "block with every item is not maxLength", len);
+        check(DataAckFrame::length + len == LORA_MAX_DATA_ACK_LEN, name, "items", "data ack is not LORA_MAX_DATA_ACK_LEN", DataAckFrame::length + len);
+
+        ConfigBlock parsed;
+        check(parsed.parse(block, block + len) == ConfigBlock::APPLIED, name, "items", "block at its limits was not applied", parsed.failedTag());
+        check(parsed.id() == 200 + limit && parsed.count() == ConfigBlock::maxItems, name, "items", "id or item count differs", parsed.count());
+        for (uint8_t i = 0; i < parsed.count(); i++) {
+            const ConfigItemInfo &item = ConfigBlock::items()[i];
+            int32_t expected = item.length ? (limit ? item.maximum : item.minimum) : 0;
+            check(parsed.item(i).tag == item.tag && parsed.item(i).value == expected, name, item.name, "read back a different value", expected);
+        }
+
+        uint8_t report[LORA_MAX_CONFIG_REPORT_LEN];         // The echo - each item with the value now in effect
+        uint8_t reportLen = ConfigReportFrame::length;
+        for (uint8_t i = 0; i < parsed.count(); i++) reportLen += ConfigBlock::writeItem(report + reportLen, parsed.item(i).tag, parsed.item(i).value);
+        reportLen += 2;
+        check(reportLen == LORA_MAX_CONFIG_REPORT_LEN, name, "items", "echo is not LORA_MAX_CONFIG_REPORT_LEN", reportLen);
+        check(memcmp(report + ConfigReportFrame::length, block + 1, len - 1) == 0, name, "items", "echo differs from the block", limit);
+
+        // Cut short - at an item boundary it is a shorter valid block, anywhere else it is truncated
+        uint8_t boundary = 1;
+        for (uint8_t cut = 0; cut < len; cut++) {
+            ConfigBlock::Result result = parsed.parse(block, block + cut);
+            if (cut == boundary) {
+                check(result == ConfigBlock::APPLIED, name, "items", "block cut between items was not applied", cut);
+                boundary += 2 + block[boundary + 1];
+            }
+            else check(result == ConfigBlock::TRUNCATED, name, "items", "block cut inside an item was not truncated", cut);
+        }
+    }
+
+    for (uint8_t i = 0; i < ConfigBlock::maxItems; i++) {   // One past either limit is refused
+        const ConfigItemInfo &item = ConfigBlock::items()[i];
+        int32_t outside[] = { item.minimum - 1, item.maximum + 1 };
+        for (int32_t value : outside) {
+            uint32_t span = item.length ? 1UL << (8 * item.length) : 0;
+            bool isSigned = item.minimum < 0;
+            if (!item.length || (isSigned ? value < -(int32_t)(span / 2) || value >= (int32_t)(span / 2) : value < 0 || value >= (int32_t)span)) continue;
+            uint8_t block[8] = { 1 };
+            uint8_t len = 1 + ConfigBlock::writeItem(block + 1, item.tag, value);
+            ConfigBlock parsed;
+            check(parsed.parse(block, block + len) == ConfigBlock::OUT_OF_RANGE && parsed.failedTag() == item.tag, name, item.name,
+                "value outside its range was not refused", value);
+        }
+    }
+
+    // A new node has applied no block (sysStatus.configId is noId) - its first block is applied whatever its id, and
+    // only the block it applied last is a repeat
+    uint8_t applied = ConfigBlock::noId;
+    for (int id = 0; id <= 255; id++) {
+        uint8_t block[4] = { (uint8_t)id };
+        uint8_t len = 1 + ConfigBlock::writeItem(block + 1, CONFIG_reportDelta, 5);
+        ConfigBlock parsed;
+        check(parsed.parse(block, block + len) == ConfigBlock::APPLIED && !parsed.repeatOf(applied), name, "id",
+            "first block on a new node taken for a repeat", id);
+        if (id == ConfigBlock::noId) continue;
+        check(parsed.repeatOf(id), name, "id", "block sent again not taken for a repeat", id);
+        check(!parsed.repeatOf((id % 255) + 1), name, "id", "another block taken for a repeat", id);
+    }
+    printf("%-22s %3d bytes %3d items, truncated, out of range and repeated\n", name, ConfigBlock::maxLength, ConfigBlock::maxItems);
+}
+
+// A reply is checked before it is read - any flag but the two acknowledgements (and any past the names the node has for
+// them) is refused, and so is an acknowledgement shorter than its layout
+static void checkReplies() {
+    const char* name = "frameReplyValid";
+    for (int flag = 0; flag <= 255; flag++) {
+        uint8_t shortest = (flag == JOIN_ACK) ? JoinAckFrame::length : (flag == DATA_ACK) ? DataAckFrame::length : 0;
+        for (int len = 0; len <= LORA_MAX_DATA_ACK_LEN; len++) {
+            bool valid = frameReplyValid(flag, len);
+            if (!shortest) check(!valid, name, "flag", "accepted a flag that is not an acknowledgement", flag);
+            else if (len < shortest) check(!valid, name, "length", "accepted a truncated acknowledgement", flag * 1000 + len);
+            else check(valid, name, "length", "refused a whole acknowledgement", flag * 1000 + len);
+        }
+    }
+    printf("%-22s 256 flags, %d lengths\n", name, LORA_MAX_DATA_ACK_LEN + 1);
+}
+
+int main() {
+    ROUNDTRIP_BLOCK(NodeConfigBits, LORA_NODE_CONFIG_BITS)
+    ROUNDTRIP_BLOCK(StatusBits, LORA_STATUS_BITS)
+    ROUNDTRIP_FRAME(DataReportFrame, LORA_DATA_REPORT_FIELDS)
+    ROUNDTRIP_FRAME(AggregateReportFrame, LORA_AGGREGATE_REPORT_FIELDS)
+    ROUNDTRIP_FRAME(QueuedReportFrame, LORA_QUEUED_REPORT_FIELDS)
+    ROUNDTRIP_FRAME(ConfigReportFrame, LORA_CONFIG_REPORT_FIELDS)
+    ROUNDTRIP_FRAME(JoinRequestFrame, LORA_JOIN_REQUEST_FIELDS)
+    ROUNDTRIP_FRAME(AckHeaderFrame, LORA_ACK_HEADER_FIELDS)
+    ROUNDTRIP_FRAME(DataAckFrame, LORA_DATA_ACK_FIELDS)
+    ROUNDTRIP_FRAME(JoinAckFrame, LORA_JOIN_ACK_FIELDS)
+    checkAggregateReport();
+    checkConfigBlock();
+    checkReplies();
+
+    printf("\n%d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
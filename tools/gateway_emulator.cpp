@@ -0,0 +1,172 @@
+// gateway_emulator.cpp
+//
+// A gateway for tools/node_emulator.cpp - answers join requests with a join ack and every report (data, aggregated, queued,
+// configuration) with a data ack, as the request's reply when the node sent it as a request. Each ack carries the time to the
+// hundredth, secondsTillNextReport and, if asked for, reporting slots and an alert code for each node's first data ack.
+// Prints what it received when the run ends.
+//
+// Options (name=value):
+//   duration=180       seconds to run
+//   heartbeat=60       secondsTillNextReport sent in every ack
+//   slots=0            reporting frame in seconds - 0 for no slots - nodes get slots in the order they join
+//   alert=0            alert code for each node's first data ack (16 sets the report delta)
+//   context=0          ... and its context
+//   replydelay=0       replyDelayMillis sent in the data ack
+//
+// Build from the repository root with the RadioHead simulator (see tools/scenario_bench.sh):
+//   R=lib/Radiohead
+//   g++ -O2 -std=gnu++11 -I $R -I src -o gateway_emulator tools/gateway_emulator.cpp $R/tools/simMain.cpp $R/RHGenericDriver.cpp
+//       $R/RHMesh.cpp $R/RHRouter.cpp $R/RHReliableDatagram.cpp $R/RHDatagram.cpp $R/RHMessagePool.cpp $R/RH_TCP.cpp
+//   RH_ETHER=localhost:4000 ./gateway_emulator duration=180
+
+#include "emulator.h"
+
+extern int _simulator_argc;
+extern char** _simulator_argv;
+
+static const uint16_t guardHundredths = 5;                  // As tools/slot_simulation.cpp
+
+CountingDriver driver(emulatorEther());
+RHMesh manager(driver, EMULATOR_GATEWAY_ADDRESS);
+
+struct NodeRecord {
+    bool joined = false;
+    bool alertSent = false;
+    uint16_t slotOffset = 0;                                // 0 - no slot of its own
+    long joins = 0;
+    long reports = 0;
+    long repeats = 0;                                       // Reports with the sequence number of the last one
+    int lastSequence = -1;
+};
+
+static NodeRecord nodes[256];
+static long durationSeconds, heartbeatSeconds, slotFrameSeconds, alertCode, alertContext, replyDelayMillis;
+static unsigned long startMillis;
+static uint16_t slotHundredths = 0, slotsGiven = 0;
+static long unknownMessages = 0;
+
+uint8_t buf[RH_MESH_MAX_MESSAGE_LEN];
+uint8_t reply[RH_MESH_MAX_MESSAGE_LEN];
+
+static void writeAckHeader(AckHeaderFrame ack, uint8_t node) {
+    uint64_t now = emulatorHundredths();
+    ack.magicNumber(EMULATOR_MAGIC_NUMBER);
+    ack.nodeNumber(node);
+    ack.token(1234);
+    ack.time((uint32_t)(now / 100));
+    ack.secondsTillNextReport(heartbeatSeconds);
+    ack.alertCodeNode(0);
+}
+
+static void sendAck(uint8_t to, uint8_t len, uint8_t flag) {
+    if (manager.replyAddress() == to) manager.sendReply(reply, len, flag);     // The ack of the node's request
+    else if (manager.sendtoWait(reply, len, to, flag) != RH_ROUTER_ERROR_NONE) printf("Ack to node %d not delivered\n", to);
+}
+
+static void joinRequest(uint8_t from) {
+    JoinRequestFrame request(buf);
+    NodeRecord &node = nodes[from];
+    node.joins++;
+    if (!node.joined && slotFrameSeconds) {
+        uint16_t count = slotCount(slotFrameSeconds, slotHundredths, SLOT_CONTENTION_HUNDREDTHS);
+        if (slotsGiven < count) node.slotOffset = slotOffsetForIndex(slotsGiven++, slotHundredths, guardHundredths, SLOT_CONTENTION_HUNDREDTHS);
+    }
+    node.joined = true;
+
+    JoinAckFrame ack(reply);
+    writeAckHeader(AckHeaderFrame(reply), from);
+    ack.alertContextNode(0);
+    ack.sensorType(request.sensorType());
+    ack.uniqueID(request.uniqueID());
+    ack.assignedNodeNumber(from);
+    ack.space(request.space());
+    ack.placement(request.placement());
+    ack.multi(request.multi());
+    ack.timeHundredths(emulatorHundredths() % 100);
+    ack.retries(0);
+    ack.retransmissionDelay(0);
+    sendAck(from, JoinAckFrame::length, JOIN_ACK);
+}
+
+static void report(uint8_t from, uint8_t flag) {
+    NodeRecord &node = nodes[from];
+    node.reports++;
+    if (flag == DATA_RPT || flag == AGGREGATE_RPT) {
+        int sequence = (flag == DATA_RPT) ? DataReportFrame(buf).config().sequence() : AggregateReportFrame(buf).sequence();
+        if (sequence == node.lastSequence) node.repeats++;             // The ack was lost and the node sent the report again
+        node.lastSequence = sequence;
+    }
+
+    DataAckFrame ack(reply);
+    writeAckHeader(AckHeaderFrame(reply), from);
+    if (!node.alertSent && alertCode && flag == DATA_RPT) {
+        ack.alertCodeNode(alertCode);
+        ack.alertContextNode(alertContext);
+        node.alertSent = true;
+    }
+    else ack.alertContextNode(0);
+    ack.sensorType(10);
+    ack.replyDelayMillis(replyDelayMillis);
+    ack.timeHundredths(emulatorHundredths() % 100);
+    ack.slotFrameSeconds(node.slotOffset ? slotFrameSeconds : 0);
+    ack.slotOffset(node.slotOffset);
+    ack.retries(0);
+    ack.retransmissionDelay(0);
+    sendAck(from, DataAckFrame::length, DATA_ACK);
+}
+
+static void summary() {
+    long joined = 0, joins = 0, reports = 0, repeats = 0;
+    for (int i = 1; i < 255; i++) {
+        if (nodes[i].joined) joined++;
+        joins += nodes[i].joins;
+        reports += nodes[i].reports;
+        repeats += nodes[i].repeats;
+    }
+    printf("GATEWAY nodes=%ld joins=%ld reports=%ld repeats=%ld unknown=%ld transmissions=%lu airtimeUs=%llu slots=%d\n", joined, joins,
+        reports, repeats, unknownMessages, (unsigned long)driver.transmissions, (unsigned long long)driver.airtimeMicros, slotsGiven);
+    fflush(stdout);
+}
+
+void setup() {
+    durationSeconds = emulatorOption(_simulator_argc, _simulator_argv, "duration", 180);
+    heartbeatSeconds = emulatorOption(_simulator_argc, _simulator_argv, "heartbeat", 60);
+    slotFrameSeconds = emulatorOption(_simulator_argc, _simulator_argv, "slots", 0);
+    alertCode = emulatorOption(_simulator_argc, _simulator_argv, "alert", 0);
+    alertContext = emulatorOption(_simulator_argc, _simulator_argv, "context", 0);
+    replyDelayMillis = emulatorOption(_simulator_argc, _simulator_argv, "replydelay", 0);
+    if (!manager.init()) {
+        fprintf(stderr, "Gateway emulator - could not connect to the ether at %s\n", emulatorEther());
+        exit(1);
+    }
+    uint32_t ackMicros = loraAirtimeMicros(driver.modem, LORA_CIPHER_BLOCK_LEN + LORA_RADIO_HEADER_LEN);    // As LoRA_Functions::applyAckTimeout()
+    manager.setTimeout(2 * (loraAirtimeMicros(driver.modem, frameRadioPayloadLength(DataReportFrame::length)) + ackMicros) / 1000UL + 100);
+    manager.setMinTimeout(ackMicros / 1000UL + ACK_TIMEOUT_MARGIN_MS);
+    manager.setRetries(2);
+    uint32_t exchangeMicros = loraAirtimeMicros(driver.modem, frameRadioPayloadLength(DataReportFrame::length)) + replyDelayMillis * 1000UL
+        + loraAirtimeMicros(driver.modem, frameRadioPayloadLength(DataAckFrame::length));
+    slotHundredths = slotLengthHundredths(exchangeMicros, guardHundredths);
+    startMillis = millis();
+    printf("Gateway emulator on %s - %ld second heartbeat, %ld second slot frame (%d hundredth slots)\n", emulatorEther(), heartbeatSeconds, slotFrameSeconds, slotHundredths);
+    fflush(stdout);
+}
+
+void loop() {
+    if (millis() - startMillis >= (unsigned long)durationSeconds * 1000UL) {
+        summary();
+        exit(0);
+    }
+    uint8_t len = sizeof(buf);
+    uint8_t from, dest, id, flag, hops;
+    if (!manager.recvfromAck(buf, &len, &from, &dest, &id, &flag, &hops)) {
+        driver.waitAvailableTimeout(10);
+        return;
+    }
+    if (from == 0 || from == 255) {
+        unknownMessages++;
+        return;
+    }
+    if (flag == JOIN_REQ && len >= JoinRequestFrame::length) joinRequest(from);
+    else if ((flag == DATA_RPT && len >= DataReportFrame::length) || flag == AGGREGATE_RPT || flag == QUEUED_RPT || flag == CONFIG_RPT) report(from, flag);
+    else unknownMessages++;
+}
@@ -0,0 +1,287 @@
+// node_emulator.cpp
+//
+// One node for tools/gateway_emulator.cpp - joins, then reports its count the way the firmware does: the report policy
+// (src/ReportPolicy.h) decides which count changes are worth a report, the gateway's secondsTillNextReport sets the
+// heartbeat and, once the gateway gives it one, the node reports in its slot (src/LoRA_Slots.h). Reports go as requests so
+// the gateway's ack comes back as the reply. Alert codes 1 and 2 (join again), 6 (park closed - count reset) and 16 (report
+// delta) are acted on. The counts come from a scripted scenario instead of the sensor.
+//
+// This is the firmware's protocol, not the firmware - there is no sensor, sleep or storage, and the radio is RH_TCP.
+//
+// Prints a REPORT line for each delivered report and a RESULT line when the run ends (see tools/scenario_bench.sh).
+//
+// Options (name=value):
+//   node=1             address and node number (1 to 254) - the node joins with it, as after alert code 2
+//   scenario=trickle   egress - the room empties over ten seconds at egress= seconds, trickle - people come and go all run
+//   duration=180       seconds to run
+//   start=10           the node starts at a random time in the first start= seconds
+//   people=40          count at the start
+//   egress=60          seconds into the run the lecture ends
+//   rate=2             trickle - count changes per minute
+//   latency=60         transmit latency in seconds (TRANSMIT_LATENCY)
+//
+// Build from the repository root as tools/gateway_emulator.cpp (with the ether and gateway running), then run:
+//   RH_ETHER=localhost:4000 ./node_emulator node=1 scenario=egress
+
+#include <math.h>
+#include "emulator.h"
+#include "ReportPolicy.h"
+
+extern int _simulator_argc;
+extern char** _simulator_argv;
+
+static const uint8_t applicationRetries = 3;                // Sends after the first before a report is given up
+static const uint16_t minimumHeartbeatSeconds = 10;
+
+static long nodeNumber, durationSeconds, egressSeconds, latencySeconds;
+static double changesPerSecond;
+static bool egress;
+
+CountingDriver* driver;
+RHMesh* manager;
+
+uint8_t buf[RH_MESH_MAX_MESSAGE_LEN];
+
+static uint64_t startHundredths, endHundredths;           // The node's start (after start=) and the end of the run
+static bool joined = false;
+static int16_t net = 0;
+static uint16_t gross = 0;
+static uint8_t sequence = 0;
+static uint8_t delta = REPORT_DEFAULT_DELTA;
+static uint16_t heartbeatSeconds = 60;
+static uint64_t heartbeatHundredths = 0;                   // When the next heartbeat report is due
+static uint8_t slotFrameSeconds = 0;
+static uint16_t slotOffset = 0;
+static uint8_t contentionAttempts = 0;
+static ReportPolicy policy;
+
+static uint64_t dueHundredths = 0;                          // When the report waiting to go became due - 0 if none
+static uint64_t sendHundredths = 0;                         // When it will be sent
+static uint8_t attempts = 0;                                // Sends of the report waiting to go
+static uint32_t retriesThisReport = 0;
+
+static uint64_t nextChangeHundredths = 0;                   // Next count change in the scenario
+static int egressLeft = 0;
+static uint32_t egressStepHundredths = 0;
+
+// Totals for the RESULT line
+static long joinMillis = -1, reports = 0, delivered = 0, failed = 0, retries = 0;
+
+static double uniform() { return (random() + 1.0) / (RAND_MAX + 2.0); }
+
+// Where in the frame to send - the node's slot, or a random start in the contention slot of one of the next few frames
+static uint32_t slotOffsetHundredths() {
+    return reportSlotOffset(slotFrameSeconds, slotOffset, !joined, contentionAttempts, SLOT_CONTENTION_HUNDREDTHS,
+        SLOT_CONTENTION_EXCHANGE_HUNDREDTHS, SLOT_CONTENTION_MAX_BACKOFF, random);
+}
+
+static void reportDue(uint64_t now) {
+    dueHundredths = now;
+    attempts = 0;
+    retriesThisReport = 0;
+    sendHundredths = (slotFrameSeconds) ? slotNextStart(now, slotFrameSeconds, slotOffsetHundredths()) : now;
+}
+
+// The scenario's count changes up to now - each goes through the report policy as it would on the node
+static void countChanges(uint64_t now) {
+    while (nextChangeHundredths && now >= nextChangeHundredths) {
+        if (egress) {
+            if (net > 0) net--;
+            nextChangeHundredths = (--egressLeft > 0) ? nextChangeHundredths + egressStepHundredths : 0;
+        }
+        else {
+            if (net > 0 && random() % 2) net--;
+            else {
+                net++;
+                gross++;
+            }
+            nextChangeHundredths += (uint64_t)(-log(uniform()) / changesPerSecond * 100);
+        }
+        if (joined) policy.countChanged(now / 100, net, delta, delta * REPORT_SWING_FACTOR, DEFAULT_PEOPLE_LIMIT, latencySeconds);
+    }
+}
+
+static uint8_t composeJoinRequest() {
+    JoinRequestFrame request(buf);
+    request.magicNumber(EMULATOR_MAGIC_NUMBER);
+    request.nodeNumber(nodeNumber);
+    request.token(0);
+    request.sensorType(10);
+    request.uniqueID(0x10000 + nodeNumber);
+    request.space(0);
+    request.placement(0);
+    request.multi(0);
+    request.reserved(0);
+    request.retries(0);
+    request.retransmissionDelay(0);
+    return JoinRequestFrame::length;
+}
+
+static uint8_t composeDataReport() {
+    DataReportFrame report(buf);
+    report.magicNumber(EMULATOR_MAGIC_NUMBER);
+    report.nodeNumber(nodeNumber);
+    report.token(0);
+    report.sensorType(10);
+    report.uniqueID(0x10000 + nodeNumber);
+    report.occupancyGross(gross);
+    report.occupancyNet(net);
+    NodeConfigBits config = report.config();
+    config.space(0);
+    config.placement(0);
+    config.multi(0);
+    config.zoneMode(0);
+    config.sequence(sequence);
+    StatusBits status = report.status();
+    status.internalTempC(20);
+    status.stateOfCharge(100);
+    status.batteryState(1);
+    status.resetCount(0);
+    status.RSSI(-70);
+    status.SNR(10);
+    status.dataRate(ADR_DEFAULT_DATA_RATE);
+    status.proposedDataRate(ADR_DEFAULT_DATA_RATE);
+    status.txPower(TX_POWER_MAX);
+    status.clockError(0);
+    status.queuedReports(0);
+    report.retries(0);
+    report.retransmissionDelay(0);
+    return DataReportFrame::length;
+}
+
+static void handleAck(uint8_t flag, uint64_t now) {
+    AckHeaderFrame ack(buf);
+    if (ack.secondsTillNextReport()) heartbeatSeconds = (ack.secondsTillNextReport() > minimumHeartbeatSeconds) ? ack.secondsTillNextReport() : minimumHeartbeatSeconds;
+    heartbeatHundredths = now + heartbeatSeconds * 100ULL;
+    if (flag == JOIN_ACK) {
+        joined = true;
+        if (joinMillis < 0) joinMillis = (now - startHundredths) * 10;
+        heartbeatHundredths = now;                          // The first report follows the join - it gives the count and gets the slot
+        return;
+    }
+    DataAckFrame dataAck(buf);
+    slotFrameSeconds = dataAck.slotFrameSeconds();
+    slotOffset = dataAck.slotOffset();
+    contentionAttempts = 0;
+    switch (dataAck.alertCodeNode()) {
+    case 1:
+    case 2: joined = false; break;                          // Join again with the same node number
+    case 6:                                                 // Park closed
+        net = 0;
+        policy.reportSent(net);
+    break;
+    case 16: delta = dataAck.alertContextNode(); break;
+    }
+}
+
+static void send(uint64_t now) {
+    uint8_t len = joined ? composeDataReport() : composeJoinRequest();
+    uint8_t flag = joined ? DATA_RPT : JOIN_REQ;
+    uint8_t replyLen = sizeof(buf);
+    uint8_t replyFlag = NULL_STATE;
+    uint32_t retransmissions = manager->retransmissions();
+
+    if (attempts++) retriesThisReport++;
+    uint8_t result = manager->sendtoWaitReply(buf, len, EMULATOR_GATEWAY_ADDRESS, flag, buf, &replyLen, &replyFlag, 1000);
+    retriesThisReport += manager->retransmissions() - retransmissions;
+    now = emulatorHundredths();
+
+    if (result == RH_ROUTER_ERROR_NONE && replyFlag == (joined ? DATA_ACK : JOIN_ACK) && frameReplyValid(replyFlag, replyLen)) {
+        if (joined) {
+            reports++;
+            delivered++;
+            retries += retriesThisReport;
+            sequence = (sequence + 1) & 0x1F;
+            policy.reportSent(net);
+            printf("REPORT node=%ld latencyMs=%lu retries=%u\n", nodeNumber, (unsigned long)((now - dueHundredths) * 10), (unsigned)retriesThisReport);
+        }
+        handleAck(replyFlag, now);
+        dueHundredths = 0;
+        return;
+    }
+    if (attempts <= applicationRetries) {                   // Back off for a random few seconds and send it again
+        sendHundredths = now + 100 + random() % (200UL << attempts);
+        if (slotFrameSeconds) sendHundredths = slotNextStart(sendHundredths, slotFrameSeconds, slotOffsetHundredths());
+        return;
+    }
+    if (!joined) {                                          // Keep trying to join - the join time runs on
+        attempts = 0;
+        sendHundredths = now + 500 + random() % 1000;
+        if (slotFrameSeconds) sendHundredths = slotNextStart(sendHundredths, slotFrameSeconds, slotOffsetHundredths());
+        return;
+    }
+    reports++;                                              // Given up - the next heartbeat carries the count
+    failed++;
+    retries += retriesThisReport;
+    policy.reportSent(net);
+    heartbeatHundredths = now + heartbeatSeconds * 100ULL;
+    dueHundredths = 0;
+}
+
+static void result() {
+    printf("RESULT node=%ld joinMs=%ld reports=%ld delivered=%ld failed=%ld retries=%ld transmissions=%lu airtimeUs=%llu\n", nodeNumber, joinMillis,
+        reports, delivered, failed, retries, (unsigned long)driver->transmissions, (unsigned long long)driver->airtimeMicros);
+    fflush(stdout);
+}
+
+void setup() {
+    nodeNumber = emulatorOption(_simulator_argc, _simulator_argv, "node", 1);
+    durationSeconds = emulatorOption(_simulator_argc, _simulator_argv, "duration", 180);
+    egress = strcmp(emulatorText(_simulator_argc, _simulator_argv, "scenario", "trickle"), "egress") == 0;
+    egressSeconds = emulatorOption(_simulator_argc, _simulator_argv, "egress", 60);
+    changesPerSecond = emulatorOption(_simulator_argc, _simulator_argv, "rate", 2) / 60.0;
+    latencySeconds = emulatorOption(_simulator_argc, _simulator_argv, "latency", TRANSMIT_LATENCY);
+    long startSeconds = emulatorOption(_simulator_argc, _simulator_argv, "start", 10);
+    net = gross = emulatorOption(_simulator_argc, _simulator_argv, "people", 40);
+    if (nodeNumber < 1 || nodeNumber > 254) {
+        fprintf(stderr, "Node emulator - node must be 1 to 254\n");
+        exit(1);
+    }
+
+    driver = new CountingDriver(emulatorEther());
+    manager = new RHMesh(*driver, nodeNumber);
+    if (!manager->init()) {
+        fprintf(stderr, "Node emulator - could not connect to the ether at %s\n", emulatorEther());
+        exit(1);
+    }
+    uint32_t ackMicros = loraAirtimeMicros(driver->modem, LORA_CIPHER_BLOCK_LEN + LORA_RADIO_HEADER_LEN);   // As LoRA_Functions::applyAckTimeout()
+    manager->setTimeout(2 * (loraAirtimeMicros(driver->modem, frameRadioPayloadLength(DataReportFrame::length)) + ackMicros) / 1000UL + 100);
+    manager->setMinTimeout(ackMicros / 1000UL + ACK_TIMEOUT_MARGIN_MS);
+    manager->setRetries(2);
+
+    uint64_t now = emulatorHundredths();
+    endHundredths = now + durationSeconds * 100ULL;
+    startHundredths = now + (startSeconds ? random() % (startSeconds * 100UL) : 0);
+    sendHundredths = dueHundredths = startHundredths;       // The join time runs from here
+    if (egress) {
+        egressLeft = net;
+        egressStepHundredths = net ? 1000 / net : 0;        // Out over ten seconds
+        nextChangeHundredths = now + egressSeconds * 100ULL + random() % 500;      // Not everyone's lecture ends on the second
+    }
+    else nextChangeHundredths = now + (uint64_t)(-log(uniform()) / changesPerSecond * 100);
+}
+
+void loop() {
+    uint64_t now = emulatorHundredths();
+    if (now >= endHundredths) {
+        result();
+        exit(0);
+    }
+    countChanges(now);
+
+    if (joined && !dueHundredths && (policy.changeDue(now / 100) || now >= heartbeatHundredths)) reportDue(now);
+    if (!joined && !dueHundredths) {                        // Told to join again
+        dueHundredths = now;
+        attempts = 0;
+        sendHundredths = now + random() % 200;
+    }
+    if (dueHundredths && sendHundredths && now >= sendHundredths) {
+        send(now);
+        return;
+    }
+
+    // Asleep between reports - whatever the radio would have heard is dropped
+    uint8_t len = sizeof(buf);
+    while (driver->available()) driver->recv(buf, &len);
+    usleep(10000);
+}
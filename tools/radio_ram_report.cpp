@@ -0,0 +1,66 @@
+// radio_ram_report.cpp
+//
+// The SRAM taken by the radio stack's message buffers and routing table before v15.20 and in this build. Before, each
+// buffer was sized for RadioHead's longest message (255 bytes): RHRouter and RHMesh had one each, RHEncryptedDriver
+// allocated one on the heap for its ciphertext and LoRA_Functions::clearBuffer() put one on the stack. Now RHRouter's and
+// RHEncryptedDriver's come from RHMessagePool (lib/Radiohead/RHMessagePool.h), RHMesh builds its messages in RHRouter's,
+// clearBuffer() has none, and all are sized for the longest frame the node sends or receives (LORA_MAX_FRAME_LEN in
+// src/ConfigBlock.h). RHRouter's routes were 3 bytes each, and now also hold their age, uses, hops, link quality and
+// place in the eviction lists, found through an index by destination (lib/Radiohead/RHRouter.h).
+//
+// The sizes are those RadioHead is compiled with - build with the build_flags in platformio.ini. From the repository root:
+//   R=lib/Radiohead
+//   g++ -O2 -std=gnu++11 -I $R -I src -DRH_MAX_MESSAGE_LEN=96 -DRH_RF95_MAX_MESSAGE_LEN=96 -o radio_ram_report
+//       tools/radio_ram_report.cpp
+//   ./radio_ram_report
+
+#include <stdio.h>
+#include <RH_RF95.h>
+#include <RHMesh.h>
+#include <RHMessagePool.h>
+#include "Config.h"
+#include "LoRA_Frames.h"
+#include "ConfigBlock.h"
+
+// As LoRA_Functions.cpp checks - a build whose buffers are too short for the longest frame stops here
+static_assert(LORA_MAX_FRAME_LEN <= RH_MESH_MAX_MESSAGE_LEN, "RH_MAX_MESSAGE_LEN is too short for the longest frame");
+static_assert(frameEncryptedLength(LORA_MAX_FRAME_LEN) <= RH_POOL_BUFFER_LEN, "RH_MAX_MESSAGE_LEN is too short for the longest frame encrypted");
+static_assert(frameEncryptedLength(LORA_MAX_FRAME_LEN) <= RH_RF95_MAX_MESSAGE_LEN, "RH_RF95_MAX_MESSAGE_LEN is too short for the longest frame encrypted");
+
+struct Buffer {
+    const char *name;
+    int before;                                             // v15.19 - RadioHead's defaults
+    int now;
+};
+
+int main() {
+    const Buffer buffers[] = {
+        { "RH_RF95 receive buffer",                 255, RH_RF95_MAX_MESSAGE_LEN + RH_RF95_HEADER_LEN },
+        { "RHRouter message",                       255, 0 },
+        { "RHMesh message",                         250, 0 },
+        { "RHEncryptedDriver ciphertext (heap)",    251, 0 },
+        { "RHMessagePool",                          0,   RH_POOL_BUFFERS * RH_POOL_BUFFER_LEN },
+        { "LoRA_Functions buf",                     249, (int)RH_MESH_MAX_MESSAGE_LEN },
+        { "clearBuffer() (stack)",                  251, 0 },
+        { "RHRouter routing table",                 RH_ROUTING_TABLE_SIZE * 3, (int)(RH_ROUTING_TABLE_SIZE * sizeof(RHRouter::RoutingTableEntry)) },
+        { "RHRouter route index",                   0,   RH_ROUTE_INDEX_SIZE },
+    };
+
+    printf("Longest frame %d bytes - %d encrypted, %d on air\n", LORA_MAX_FRAME_LEN, frameEncryptedLength(LORA_MAX_FRAME_LEN),
+        frameRadioPayloadLength(LORA_MAX_FRAME_LEN));
+    printf("  aggregated report %d, configuration report %d, data acknowledgement %d\n", LORA_MAX_AGGREGATE_REPORT_LEN,
+        LORA_MAX_CONFIG_REPORT_LEN, LORA_MAX_DATA_ACK_LEN);
+    printf("RadioHead built for %d byte messages (RH_MAX_MESSAGE_LEN), %d from the radio (RH_RF95_MAX_MESSAGE_LEN), %d pool buffers\n\n",
+        RH_MAX_MESSAGE_LEN, RH_RF95_MAX_MESSAGE_LEN, RH_POOL_BUFFERS);
+
+    printf("%-38s %10s %10s\n", "Buffer or table", "v15.19", "Now");
+    int before = 0, now = 0;
+    for (const Buffer &b : buffers) {
+        printf("%-38s %10d %10d\n", b.name, b.before, b.now);
+        before += b.before;
+        now += b.now;
+    }
+    printf("%-38s %10d %10d\n", "Total", before, now);
+    printf("%-38s %10s %10d\n", "Saved", "", before - now);
+    return 0;
+}
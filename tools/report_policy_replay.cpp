@@ -0,0 +1,141 @@
+// report_policy_replay.cpp
+//
+// Replays a day of count changes through the reporting policy (src/ReportPolicy.h) and through the policy it replaced
+// (every change reported TRANSMIT_LATENCY seconds after it) and counts the transmissions. Also shows what the gateway gives
+// up - how far the last reported net count is from the real one, averaged over the day and at worst.
+//
+// The trace is read from a file of "seconds net" lines (seconds since midnight, net count after the change) - the counts
+// a node logs - or, with no file, a classroom day is generated: hourly lectures with late arrivals and early leavers,
+// and people in the corridor tripping the sensor (4 -> 5 -> 4) all day.
+//
+// Build and run natively from the repository root:
+//   g++ -std=c++11 -I src -o report_policy_replay tools/report_policy_replay.cpp
+//   ./report_policy_replay [trace.txt]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "Config.h"
+#include "ReportPolicy.h"
+
+static const uint32_t daySeconds = 86400;
+static const uint32_t heartbeatSeconds = 3600;              // secondsTillNextReport from the gateway
+static const int16_t limit = 40;                            // Occupancy limit of the room
+static const int days = 30;                                 // Generated days
+
+static uint32_t rngState = 2463534242UL;
+static uint32_t rng(uint32_t range) {                       // xorshift - the same run every time
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState % range;
+}
+
+struct Change { uint32_t time; int16_t net; };
+
+// A classroom - lectures on the hour from 8 to 17 that fill over the ten minutes before and empty after 50 minutes
+static std::vector<Change> generateDay() {
+    struct Step { uint32_t time; int16_t delta; };
+    std::vector<Step> steps;
+    for (uint32_t hour = 8; hour < 17; hour++) {
+        if (rng(10) < 2) continue;                          // No lecture this hour
+        uint32_t start = hour * 3600;
+        int students = 10 + rng(31);
+        for (int i = 0; i < students; i++) {
+            uint32_t in = start - 600 + rng(660);           // Up to a minute late
+            uint32_t out = start + 3000 + rng(300);
+            if (rng(20) == 0) out = in + 600 + rng(2000);   // Leaves early
+            steps.push_back({ in, 1 });
+            steps.push_back({ out, -1 });
+        }
+    }
+    for (uint32_t t = 7 * 3600; t < 19 * 3600; t += 60 + rng(300)) {       // Someone looks in from the corridor and leaves
+        uint32_t back = t + 5 + rng(30);
+        steps.push_back({ t, 1 });
+        steps.push_back({ back, -1 });
+    }
+    std::sort(steps.begin(), steps.end(), [](const Step &a, const Step &b) { return a.time < b.time; });
+
+    std::vector<Change> changes;
+    int16_t net = 0;
+    for (const Step &step : steps) {
+        net += step.delta;
+        if (net < 0) net = 0;
+        if (!changes.empty() && changes.back().time == step.time) changes.back().net = net;
+        else changes.push_back({ step.time, net });
+    }
+    return changes;
+}
+
+static std::vector<Change> readTrace(const char* name) {
+    std::vector<Change> changes;
+    FILE* file = fopen(name, "r");
+    if (!file) {
+        perror(name);
+        exit(1);
+    }
+    unsigned long time;
+    int net;
+    while (fscanf(file, "%lu %d", &time, &net) == 2) changes.push_back({ (uint32_t)(time % daySeconds), (int16_t)net });
+    fclose(file);
+    std::sort(changes.begin(), changes.end(), [](const Change &a, const Change &b) { return a.time < b.time; });
+    return changes;
+}
+
+struct Results {
+    long transmissions = 0;
+    double errorSeconds = 0;                                // Sum of |real - reported| over each second
+    int worstError = 0;
+};
+
+// delta of 0 replays the policy before v15.9 - every change is reported TRANSMIT_LATENCY seconds after it
+static void replay(const std::vector<Change> &changes, uint8_t delta, Results &results) {
+    ReportPolicy policy;
+    size_t next = 0;
+    int16_t net = 0, reported = 0;
+    uint32_t heartbeat = heartbeatSeconds;
+    uint32_t everyChange = 0;                               // The old policy's next connection after a change
+
+    for (uint32_t now = 0; now < daySeconds; now++) {
+        while (next < changes.size() && changes[next].time == now) {
+            net = changes[next++].net;
+            if (delta == 0) everyChange = now + TRANSMIT_LATENCY;
+            else policy.countChanged(now, net, delta, delta * REPORT_SWING_FACTOR, limit, TRANSMIT_LATENCY);
+        }
+        bool due = (delta == 0) ? (everyChange && now >= everyChange) || now >= heartbeat : policy.changeDue(now) || now >= heartbeat;
+        if (due) {
+            results.transmissions++;
+            reported = net;
+            policy.reportSent(net);
+            everyChange = 0;
+            heartbeat = now + heartbeatSeconds;
+        }
+        int error = abs(net - reported);
+        results.errorSeconds += error;
+        if (error > results.worstError) results.worstError = error;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::vector<Change> > traces;
+    if (argc > 1) traces.push_back(readTrace(argv[1]));
+    else for (int day = 0; day < days; day++) traces.push_back(generateDay());
+
+    long changeCount = 0;
+    for (const std::vector<Change> &trace : traces) changeCount += trace.size();
+    printf("%lu day(s), %.0f count changes per day, %lu second heartbeat, %lu second transmit latency, swing of %d deltas\n\n", (unsigned long)traces.size(), (double)changeCount / traces.size(), (unsigned long)heartbeatSeconds, (unsigned long)TRANSMIT_LATENCY, REPORT_SWING_FACTOR);
+    printf("%-14s %14s %18s %14s\n", "Policy", "Transmissions", "Mean error", "Worst error");
+    printf("%-14s %14s %18s %14s\n", "", "per day", "(people)", "(people)");
+
+    const uint8_t deltas[] = { 0, 1, 2, 3, 5 };
+    for (uint8_t delta : deltas) {
+        Results results;
+        for (const std::vector<Change> &trace : traces) replay(trace, delta, results);
+        char name[24];
+        if (delta == 0) snprintf(name, sizeof(name), "Every change");
+        else snprintf(name, sizeof(name), "Delta %d", delta);
+        printf("%-14s %14.1f %18.2f %14d\n", name, (double)results.transmissions / traces.size(), results.errorSeconds / ((double)daySeconds * traces.size()), results.worstError);
+    }
+    return 0;
+}
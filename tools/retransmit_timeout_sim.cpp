@@ -0,0 +1,171 @@
+// retransmit_timeout_sim.cpp
+//
+// Messages acknowledged by one next hop through RHReliableDatagram::sendtoWait(), with the fixed retransmit timeout it
+// had before v15.16 and with the current one (lib/Radiohead/RHReliableDatagram.cpp - timed from each next hop's round
+// trips, as TCP does, between the bounds LoRA_Functions::applyAckTimeout() sets for the data rate).
+//
+// The radio is simulated in-process and millis() is the simulation's clock, so the real sendtoWait() runs - its timeouts,
+// random variation and retries. A message or its acknowledgement is lost now and then. The round trip is the time the
+// next hop takes to acknowledge (decrypting - the acknowledgement goes without listen before talk, see
+// RHReliableDatagram::acknowledge()) and the acknowledgement's time on air. A retry sent while the acknowledgement of
+// the last try was still on its way is spurious. The wait after a loss is how long the sender waited
+// for an acknowledgement that was never coming before it retried.
+//
+// Before v15.16 the timeout was 120ms after a reset (LoRA_Functions::setup() set it after the radio's data rate) and
+// the larger of 1s and twice the round trip on air after a data rate change. RH_RELIABLE_RTT_PEERS is set when RadioHead
+// is compiled - build once as it is and once with -DRH_RELIABLE_RTT_PEERS=0 for the fixed timeouts. From the
+// repository root:
+//   R=lib/Radiohead
+//   g++ -O2 -std=gnu++11 -I $R -I src -o retransmit_timeout_sim tools/retransmit_timeout_sim.cpp $R/RHGenericDriver.cpp
+//       $R/RHReliableDatagram.cpp $R/RHDatagram.cpp
+//   ./retransmit_timeout_sim
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <RHReliableDatagram.h>
+#include "Config.h"
+#include "LoRA_Frames.h"
+#include "LoRA_Airtime.h"
+
+static const int messages = 5000;
+static const int retries = 2;                               // manager.setRetries(2)
+static const int lostMessagePercent = 10;
+static const int lostAckPercent = 5;
+static const unsigned long processingMillis = 6;            // The next hop decrypting
+
+static unsigned long simMillis = 0;
+unsigned long millis() { return simMillis; }
+void delay(unsigned long ms) { simMillis += ms; }
+long random(long to) { return ::random() % to; }
+long random(long from, long to) { return from + ::random() % (to - from); }
+
+struct ModemConfig { uint8_t reg_1d, reg_1e, reg_26; };
+struct DataRate { const char* name; ModemConfig config; };
+static const DataRate dataRates[] = {                       // Steps 0, 5 and 7 of the ladder in LinkAdaptation.cpp
+    { "Bw500Sf7",  { 0x92, 0x74, 0x04 } },
+    { "Bw125Sf10", { 0x72, 0xa4, 0x04 } },
+    { "Bw125Sf12", { 0x72, 0xc4, 0x0c } }
+};
+
+// The next hop, seen from the sender's radio - acknowledgements are scheduled when a message gets through
+class SimLink : public RHGenericDriver {
+public:
+    SimLink(const ModemConfig &config) : _config(config), _lastId(0), _lastLost(false), _lastEnd(0) {}
+    bool init() { return true; }
+    uint8_t maxMessageLength() { return 64; }
+
+    bool send(const uint8_t*, uint8_t len) {
+        bool retry = _txHeaderId == _lastId && _txHeaderFlags & RH_FLAGS_RETRY;
+        if (retry && !_lastLost) spurious++;                // The last try's acknowledgement was still on its way
+        if (retry && _lastLost) { lossWaits++; lossWaitMillis += simMillis - _lastEnd; }
+        transmissions++;
+        simMillis += airtimeMillis(frameRadioPayloadLength(len));
+        _lastId = _txHeaderId;
+        _lastEnd = simMillis;
+        _lastLost = true;
+        if (::random() % 100 < lostMessagePercent) return true;
+        if (::random() % 100 < lostAckPercent) return true;
+        _lastLost = false;                                  // This try will be acknowledged - perhaps after the timeout
+        unsigned long delay = processingMillis + ::random() % 4;
+        _acks.push_back({ simMillis + delay + airtimeMillis(LORA_CIPHER_BLOCK_LEN + LORA_RADIO_HEADER_LEN), _txHeaderId });
+        return true;
+    }
+
+    bool available() {
+        for (const Ack &ack : _acks) if (ack.arrival <= simMillis) return true;
+        return false;
+    }
+
+    // Jumps the clock to the next acknowledgement, or the end of the wait
+    bool waitAvailableTimeout(uint16_t timeout, uint16_t = 0) {
+        unsigned long next = simMillis + timeout;
+        for (const Ack &ack : _acks) if (ack.arrival < next) next = ack.arrival;
+        bool arrived = next < simMillis + timeout;
+        simMillis = arrived ? (next > simMillis ? next : simMillis) : simMillis + timeout;
+        return arrived;
+    }
+
+    bool recv(uint8_t* buf, uint8_t* len) {
+        for (size_t i = 0; i < _acks.size(); i++) {
+            if (_acks[i].arrival > simMillis) continue;
+            _rxHeaderTo = _thisAddress;
+            _rxHeaderFrom = 1;
+            _rxHeaderId = _acks[i].id;
+            _rxHeaderFlags = RH_FLAGS_ACK;
+            if (buf && len && *len) { buf[0] = '!'; *len = 1; }
+            _acks.erase(_acks.begin() + i);
+            return true;
+        }
+        return false;
+    }
+
+    unsigned long airtimeMillis(uint8_t payloadLength) {
+        return (loraConfigAirtimeMicros(_config, payloadLength) + 999) / 1000;
+    }
+
+    long transmissions = 0, spurious = 0, lossWaits = 0, lossWaitMillis = 0;
+
+private:
+    struct Ack { unsigned long arrival; uint8_t id; };
+    ModemConfig _config;
+    std::vector<Ack> _acks;
+    uint8_t _lastId;
+    bool _lastLost;
+    unsigned long _lastEnd;
+};
+
+struct Totals {
+    long delivered = 0, deliveryMillis = 0;
+};
+
+// Messages a minute apart to the next hop - with the timeout set as applyAckTimeout() does, or fixed if timeout is not 0
+static void run(const DataRate &rate, uint16_t timeout, const char *name) {
+    SimLink link(rate.config);
+    RHReliableDatagram manager(link, 2);
+    manager.init();
+    manager.setRetries(retries);
+    uint32_t ackMillis = link.airtimeMillis(LORA_CIPHER_BLOCK_LEN + LORA_RADIO_HEADER_LEN);
+    uint32_t roundTripMillis = link.airtimeMillis(frameRadioPayloadLength(DataReportFrame::length)) + ackMillis;
+    if (timeout) manager.setTimeout(timeout);
+    else {
+        manager.setTimeout(2 * roundTripMillis + 100);
+        manager.setMinTimeout(ackMillis + ACK_TIMEOUT_MARGIN_MS);
+    }
+
+    Totals totals;
+    srandom(7);                                             // The same losses and delays for each timeout
+    for (int m = 0; m < messages; m++) {
+        simMillis += 60000;
+        uint8_t message[DataReportFrame::length];
+        memset(message, 1, sizeof(message));                // message[5] is not 0, so sendtoWait() leaves the delay bytes alone
+        unsigned long start = simMillis;
+        if (manager.sendtoWait(message, sizeof(message), 1)) {
+            totals.delivered++;
+            totals.deliveryMillis += simMillis - start;
+        }
+    }
+    printf("%-10s %-30s %14.3f %10.1f %12.0f %10.0f %10.2f%%\n", rate.name, name, (double)link.transmissions / messages,
+        100.0 * link.spurious / messages, link.lossWaits ? (double)link.lossWaitMillis / link.lossWaits : 0.0,
+        totals.delivered ? (double)totals.deliveryMillis / totals.delivered : 0.0, 100.0 * totals.delivered / messages);
+}
+
+int main() {
+    printf("%d messages a minute apart, %d retries, %d%% of messages and %d%% of acknowledgements lost\n\n",
+        messages, retries, lostMessagePercent, lostAckPercent);
+    printf("%-10s %-30s %14s %10s %12s %10s %11s\n", "Data rate", "Timeout", "Transmissions", "Spurious", "Wait after", "Delivery", "Delivered");
+    printf("%-10s %-30s %14s %10s %12s %10s %11s\n", "", "", "per message", "per 100", "a loss (ms)", "(ms)", "");
+    for (const DataRate &rate : dataRates) {
+#if RH_RELIABLE_RTT_PEERS
+        run(rate, 0, "Round trips timed");
+#else
+        SimLink link(rate.config);
+        uint32_t roundTripMillis = link.airtimeMillis(frameRadioPayloadLength(DataReportFrame::length)) + link.airtimeMillis(LORA_CIPHER_BLOCK_LEN + LORA_RADIO_HEADER_LEN);
+        uint16_t changed = 2 * roundTripMillis + 100;
+        run(rate, 120, "120ms (after a reset)");
+        run(rate, changed > 1000 ? changed : 1000, "1s or 2 round trips (rate change)");
+#endif
+    }
+    return 0;
+}
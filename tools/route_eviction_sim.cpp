@@ -0,0 +1,159 @@
+// route_eviction_sim.cpp
+//
+// Route discoveries per day for one node's routing table, with the eviction RHRouter had before v15.12 (the first
+// route added goes first, however busy it is) and with the current one (lib/Radiohead/RHRouter.cpp - routes never
+// used go first, then the least recently used with poor quality routes ahead, and stale routes expire).
+//
+// The node reports to the gateway (address 0) every ten minutes or so while the site is open and hourly overnight, and
+// relays the reports of a few nodes behind it. It also overhears the route discoveries of every other node on the site
+// and - as RHMesh does - adds a route to each address in their route lists. The table only holds RH_ROUTING_TABLE_SIZE
+// routes, so on a big site the overheard routes push out the ones the node uses. A report or relayed message with no
+// route to the gateway sets off a discovery. Next hops that do not acknowledge lose their route either way.
+//
+// Build and run natively from the repository root (millis() is the simulation's clock):
+//   R=lib/Radiohead
+//   g++ -O2 -std=gnu++11 -I $R -o route_eviction_sim tools/route_eviction_sim.cpp $R/RHGenericDriver.cpp $R/RHRouter.cpp
+//       $R/RHReliableDatagram.cpp $R/RHDatagram.cpp $R/RHMessagePool.cpp $R/RH_TCP.cpp
+//   ./route_eviction_sim
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include <RHRouter.h>
+#include <RH_TCP.h>
+
+static const int days = 7;
+static const int relayedNodes = 3;                          // Nodes whose reports go through this one
+static const int discoveriesPerNodePerDay = 4;              // Resets, failed deliveries and joins elsewhere on the site
+static const int lostAckPercent = 2;                        // Messages whose next hop does not acknowledge
+
+static unsigned long simMillis = 0;
+unsigned long millis() { return simMillis; }
+void delay(unsigned long) {}
+long random(long to) { return ::random() % to; }
+long random(long from, long to) { return from + ::random() % (to - from); }
+
+// The table before v15.12 - routes are retired in the order they were added
+class FirstAddedRoutes {
+public:
+    FirstAddedRoutes() : _count(0) {}
+
+    void addRouteTo(uint8_t dest, uint8_t next_hop) {
+        for (int i = 0; i < _count; i++) {
+            if (_routes[i].dest == dest) { _routes[i].next_hop = next_hop; return; }
+        }
+        if (_count == RH_ROUTING_TABLE_SIZE) deleteRoute(0);
+        _routes[_count].dest = dest;
+        _routes[_count++].next_hop = next_hop;
+    }
+
+    bool getRouteTo(uint8_t dest) {
+        for (int i = 0; i < _count; i++) if (_routes[i].dest == dest) return true;
+        return false;
+    }
+
+    void deleteRouteTo(uint8_t dest) {
+        for (int i = 0; i < _count; i++) if (_routes[i].dest == dest) { deleteRoute(i); return; }
+    }
+
+    void updateRouteQuality(uint8_t, bool) {}
+
+private:
+    void deleteRoute(int index) {
+        memmove(&_routes[index], &_routes[index + 1], sizeof(_routes[0]) * (_count - index - 1));
+        _count--;
+    }
+
+    struct { uint8_t dest, next_hop; } _routes[RH_ROUTING_TABLE_SIZE];
+    int _count;
+};
+
+// RHRouter's table - useRouteTo() and updateRouteQuality() are what route() calls for each send
+class CurrentRoutes : public RHRouter {
+public:
+    CurrentRoutes(RHGenericDriver &driver) : RHRouter(driver, 1) {}
+    bool getRouteTo(uint8_t dest) { return useRouteTo(dest) != NULL; }
+    void addRouteTo(uint8_t dest, uint8_t next_hop) { RHRouter::addRouteTo(dest, next_hop); }
+    void deleteRouteTo(uint8_t dest) { RHRouter::deleteRouteTo(dest); }
+    using RHRouter::updateRouteQuality;
+};
+
+enum EventType { REPORT, RELAYED, OVERHEARD };
+struct Event {
+    uint32_t time;
+    EventType type;
+    uint8_t source;
+    uint8_t relays[2];
+    uint8_t relayCount;
+};
+
+static std::vector<Event> generateEvents(int siteNodes) {
+    std::vector<Event> events;
+    for (int day = 0; day < days; day++) {
+        uint32_t dayStart = day * 86400000UL;
+        for (int node = 0; node <= relayedNodes; node++) {                  // This node (0) and the nodes it relays for
+            uint32_t t = dayStart + ::random() % 600000;
+            while (t < dayStart + 86400000UL) {
+                uint32_t hour = (t - dayStart) / 3600000UL;
+                events.push_back({ t, node ? RELAYED : REPORT, (uint8_t)(2 + node), {0, 0}, 0 });
+                t += (hour >= 8 && hour < 18) ? 300000 + ::random() % 600000 : 3600000;
+            }
+        }
+        for (int i = 0; i < siteNodes * discoveriesPerNodePerDay; i++) {   // Route lists of overheard discoveries
+            Event event = { dayStart + (uint32_t)(::random() % 86400000UL), OVERHEARD, (uint8_t)(10 + ::random() % siteNodes), {0, 0}, 0 };
+            event.relayCount = ::random() % 3;
+            for (int r = 0; r < event.relayCount; r++) event.relays[r] = 10 + ::random() % siteNodes;
+            events.push_back(event);
+        }
+    }
+    std::sort(events.begin(), events.end(), [](const Event &a, const Event &b) { return a.time < b.time; });
+    return events;
+}
+
+// Discoveries this node sets off
+template <typename Table>
+static long replay(Table &table, const std::vector<Event> &events) {
+    long discoveries = 0;
+    srandom(7);                                                             // The same lost acknowledgements for both tables
+    for (const Event &event : events) {
+        simMillis = event.time;
+        if (event.type == OVERHEARD) {                                      // As RHMesh::peekAtMessage() - a route to each address, via the broadcaster
+            uint8_t via = event.relayCount ? event.relays[event.relayCount - 1] : event.source;
+            table.addRouteTo(event.source, via);
+            for (int r = 0; r < event.relayCount; r++) table.addRouteTo(event.relays[r], via);
+            continue;
+        }
+        if (event.type == RELAYED) table.addRouteTo(event.source, event.source);     // The route back, as RHMesh::route()
+        if (!table.getRouteTo(0)) {
+            discoveries++;
+            table.addRouteTo(0, 0);
+        }
+        bool acknowledged = ::random() % 100 >= lostAckPercent;
+        table.updateRouteQuality(0, acknowledged);
+        if (!acknowledged) table.deleteRouteTo(0);                          // As RHMesh does when the next hop does not acknowledge
+    }
+    return discoveries;
+}
+
+int main() {
+    printf("Routing table of %d routes, %d day(s), %d relayed nodes, %d overheard discoveries per site node per day, %d%% lost acks\n\n", RH_ROUTING_TABLE_SIZE, days, relayedNodes, discoveriesPerNodePerDay, lostAckPercent);
+    printf("%10s %12s %22s %22s\n", "Site nodes", "Sends/day", "Discoveries/day", "Discoveries/day");
+    printf("%10s %12s %22s %22s\n", "", "", "(first added evicted)", "(LRU and quality)");
+
+    const int sites[] = { 25, 50, 100, 250 };
+    for (int siteNodes : sites) {
+        srandom(siteNodes);
+        std::vector<Event> events = generateEvents(siteNodes);
+        long sends = 0;
+        for (const Event &event : events) if (event.type != OVERHEARD) sends++;
+
+        FirstAddedRoutes before;
+        RH_TCP driver;                                                      // Never connected - only the table is used
+        CurrentRoutes after(driver);
+        long discoveriesBefore = replay(before, events);
+        long discoveriesAfter = replay(after, events);
+        printf("%10d %12.0f %22.1f %22.1f\n", siteNodes, (double)sends / days, (double)discoveriesBefore / days, (double)discoveriesAfter / days);
+    }
+    return 0;
+}
@@ -0,0 +1,222 @@
+// route_selection_sim.cpp
+//
+// Transmissions per delivered report over routes to the gateway in a multi-storey building, with the route selection
+// RHMesh had before v15.13 (the first route discovery response wins, and any route heard of replaces the one held) and
+// with the current one (lib/Radiohead/RHRouter.cpp, RHMesh.cpp - responses are collected and each route is offered with
+// the quality of the link it came over and its hop count, and acknowledgements rescore the routes held).
+//
+// Nodes are spread over three floors of a 120 x 40m building with the gateway (address 0) in one corner. A link's RSSI
+// follows a log-distance path loss with a loss per floor and fixed shadowing, and a transmission gets through with a
+// probability that rises from 0 to 1 over a few dB around the sensitivity. A discovery floods as RHMesh's does (every
+// copy rebroadcast, here up to three relays) and the gateway answers every copy that reaches it - the response comes back
+// along the path the request took. Each node then sends reports, each hop retried twice as LoRA_Functions sets up, and
+// now and then overhears another node's discovery, which offers it a route through one of its neighbours. A report lost
+// on any hop deletes the route, as RHMesh's route failure does, and the next report discovers a new one. Relays are
+// assumed to forward along the path the report's route was discovered on. Transmissions are the tries of reports on each
+// hop - route discovery broadcasts are not counted.
+//
+// Build and run natively from the repository root:
+//   R=lib/Radiohead
+//   g++ -O2 -std=gnu++11 -I $R -o route_selection_sim tools/route_selection_sim.cpp $R/RHGenericDriver.cpp $R/RHRouter.cpp
+//       $R/RHReliableDatagram.cpp $R/RHDatagram.cpp $R/RHMessagePool.cpp $R/RH_TCP.cpp
+//   ./route_selection_sim
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include <RHRouter.h>
+#include <RH_TCP.h>
+
+static const int reportsPerNode = 200;
+static const int maxRelays = 3;
+static const int retries = 2;                               // manager.setRetries(2)
+static const int overhearPercent = 10;                      // Reports after which the node has overheard another discovery
+static const double wallLossDbPerMetre = 0.6;
+static const double floorLossDb = 20;
+static const double shadowingDb = 6;
+static const double sensitivityDbm = -118;
+
+static unsigned long simMillis = 0;
+unsigned long millis() { return simMillis; }
+void delay(unsigned long) {}
+long random(long to) { return ::random() % to; }
+long random(long from, long to) { return from + ::random() % (to - from); }
+
+static double uniform() { return (::random() + 0.5) / 2147483648.0; }
+
+static double gaussian() {
+    return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+struct Building {
+    int nodes;                                              // Including the gateway, node 0
+    std::vector<std::vector<double>> rssi;                  // Symmetric
+    std::vector<std::vector<double>> success;               // Of one transmission
+    std::vector<std::vector<int>> neighbours;               // Nodes a transmission reaches at least 1% of the time
+};
+
+static Building makeBuilding(int nodes) {
+    Building b;
+    b.nodes = nodes;
+    std::vector<double> x(nodes), y(nodes), floor(nodes);
+    for (int i = 0; i < nodes; i++) {
+        x[i] = i ? uniform() * 120 : 0;
+        y[i] = i ? uniform() * 40 : 0;
+        floor[i] = i ? ::random() % 3 : 0;
+    }
+    b.rssi.assign(nodes, std::vector<double>(nodes, -200));
+    for (int i = 0; i < nodes; i++) {
+        for (int j = i + 1; j < nodes; j++) {
+            double d = sqrt((x[i] - x[j]) * (x[i] - x[j]) + (y[i] - y[j]) * (y[i] - y[j]) + 9 * (floor[i] - floor[j]) * (floor[i] - floor[j]));
+            double loss = 40 + 30 * log10(d < 1 ? 1 : d) + wallLossDbPerMetre * d + floorLossDb * fabs(floor[i] - floor[j]) + shadowingDb * gaussian();
+            b.rssi[i][j] = b.rssi[j][i] = 14 - loss;        // 14dBm transmit power
+        }
+    }
+    b.success.assign(nodes, std::vector<double>(nodes, 0));
+    b.neighbours.resize(nodes);
+    for (int i = 0; i < nodes; i++) {
+        for (int j = 0; j < nodes; j++) {
+            if (i == j) continue;
+            b.success[i][j] = 1 / (1 + exp(-(b.rssi[i][j] - sensitivityDbm) / 1.5));
+            if (b.success[i][j] >= 0.01) b.neighbours[i].push_back(j);
+        }
+    }
+    return b;
+}
+
+// A route discovery response, with the path the request took (originator first, gateway last) and when it came back
+struct Response {
+    std::vector<int> path;
+    double arrival;
+};
+
+static void flood(const Building &b, std::vector<int> &path, double time, std::vector<Response> &responses) {
+    int from = path.back();
+    for (int to : b.neighbours[from]) {
+        if (uniform() >= b.success[from][to]) continue;
+        bool visited = false;
+        for (int node : path) visited |= node == to;
+        if (visited) continue;
+        double arrival = time + 1 + uniform();              // A time on air and a random wait for the channel
+        path.push_back(to);
+        if (to == 0) responses.push_back({ path, arrival + (path.size() - 1) * (1 + uniform()) });
+        else if ((int)path.size() - 1 <= maxRelays) flood(b, path, arrival, responses);
+        path.pop_back();
+    }
+}
+
+// Tries a hop with its retries - returns whether it was acknowledged and counts the transmissions
+static bool hop(const Building &b, int from, int to, long &transmissions) {
+    for (int attempt = 0; attempt <= retries; attempt++) {
+        transmissions++;
+        if (uniform() < b.success[from][to] && uniform() < b.success[to][from]) return true;
+    }
+    return false;
+}
+
+class SimDriver : public RH_TCP {
+public:
+    void receivedFrom(double rssi) { _lastRssi = (int16_t)rssi; }
+};
+
+class CurrentRoutes : public RHRouter {
+public:
+    CurrentRoutes(SimDriver &driver) : RHRouter(driver, 1), _driver(driver) {}
+    void heard(const Building &b, int node, const std::vector<int> &path) {     // As RHMesh::peekAtMessage()
+        _driver.receivedFrom(b.rssi[node][path[1]]);
+        offerRoute(0, path[1], path.size() - 1, linkQuality());
+    }
+    using RHRouter::getRouteTo;
+    using RHRouter::useRouteTo;
+    using RHRouter::deleteRouteTo;
+    using RHRouter::updateRouteQuality;
+private:
+    SimDriver &_driver;
+};
+
+struct Totals {
+    long delivered = 0, reports = 0, transmissions = 0, discoveries = 0, hops = 0;
+};
+
+// Reports from one node - current selects routes with RHRouter, otherwise as before v15.13
+static void sendReports(const Building &b, int node, bool current, Totals &totals) {
+    SimDriver driver;                                       // Never connected - only the table is used
+    CurrentRoutes table(driver);
+    std::vector<std::vector<int>> paths(b.nodes);           // The path of each next hop's route - what relays follow
+    std::vector<int> held;                                  // Before v15.13 - the path of the one route
+
+    simMillis = 0;
+    for (int report = 0; report < reportsPerNode; report++) {
+        simMillis += 600000;
+        if (uniform() * 100 < overhearPercent) {            // Another node's discovery, heard through a neighbour
+            std::vector<int> path = { node };
+            std::vector<Response> responses;
+            flood(b, path, 0, responses);
+            if (!responses.empty()) {
+                const std::vector<int> &heard = responses[::random() % responses.size()].path;
+                if (current) {
+                    table.heard(b, node, heard);
+                    if (table.getRouteTo(0) && table.getRouteTo(0)->next_hop == heard[1]) paths[heard[1]] = heard;
+                }
+                else held = heard;
+            }
+        }
+
+        bool routed = current ? table.getRouteTo(0) != NULL : !held.empty();
+        if (!routed) {
+            totals.discoveries++;
+            std::vector<int> path = { node };
+            std::vector<Response> responses;
+            flood(b, path, 0, responses);
+            if (responses.empty()) { totals.reports++; continue; }
+            if (current) {                                  // Every response within the window, in the order they come
+                std::sort(responses.begin(), responses.end(), [](const Response &x, const Response &y) { return x.arrival < y.arrival; });
+                for (const Response &response : responses) {
+                    table.heard(b, node, response.path);
+                    if (table.getRouteTo(0)->next_hop == response.path[1]) paths[response.path[1]] = response.path;
+                }
+            }
+            else {
+                held = responses[0].path;
+                for (const Response &response : responses) if (response.arrival < responses[0].arrival) held = response.path;
+            }
+        }
+
+        const std::vector<int> &path = current ? paths[table.useRouteTo(0)->next_hop] : held;      // As route() for each send
+        totals.reports++;
+        totals.hops += path.size() - 1;
+        bool delivered = true;
+        for (size_t i = 0; i + 1 < path.size() && delivered; i++) {
+            delivered = hop(b, path[i], path[i + 1], totals.transmissions);
+            if (i == 0 && current) table.updateRouteQuality(0, delivered);
+        }
+        if (delivered) totals.delivered++;
+        else if (current) table.deleteRouteTo(0);
+        else held.clear();
+    }
+}
+
+int main() {
+    printf("%d reports per node, up to %d relays, %d retries per hop, overheard discoveries after %d%% of reports\n\n", reportsPerNode,
+        maxRelays, retries, overhearPercent);
+    printf("%6s %-16s %10s %14s %12s %16s\n", "Nodes", "Selection", "Hops", "Transmissions", "Delivered", "Discoveries");
+    printf("%6s %-16s %10s %14s %12s %16s\n", "", "", "", "per delivered", "", "per 100 reports");
+
+    const int sizes[] = { 15, 30, 60 };
+    for (int nodes : sizes) {
+        srandom(nodes);
+        Building building = makeBuilding(nodes);
+        for (int current = 0; current <= 1; current++) {
+            Totals totals;
+            srandom(nodes * 7);                             // The same floods and losses for both
+            for (int node = 1; node < nodes; node++) sendReports(building, node, current, totals);
+            printf("%6d %-16s %10.2f %14.2f %11.1f%% %16.1f\n", nodes, current ? "Quality and hops" : "First response",
+                (double)totals.hops / totals.reports, (double)totals.transmissions / totals.delivered,
+                100.0 * totals.delivered / totals.reports, 100.0 * totals.discoveries / totals.reports);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
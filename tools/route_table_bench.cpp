@@ -0,0 +1,115 @@
+// route_table_bench.cpp
+//
+// Times RHRouter's routing table (lib/Radiohead/RHRouter.cpp) against the table it replaced - a linear scan of
+// RH_ROUTING_TABLE_SIZE entries for every lookup and up to three scans for every insert - with 50 and 250 destinations.
+// Lookups are what every send and forward does, inserts what every received route discovery does for each address in
+// its route list.
+//
+// millis() reads a counter, as it does on the SAMD, rather than the host's clock - every insert reads it once.
+//
+// RH_ROUTING_TABLE_SIZE is set when RadioHead is compiled - build once with the default (50) and once with room for
+// every destination. From the repository root:
+//   R=lib/Radiohead
+//   g++ -O2 -std=gnu++11 -I $R -o route_table_bench tools/route_table_bench.cpp $R/RHGenericDriver.cpp
+//       $R/RHRouter.cpp $R/RHReliableDatagram.cpp $R/RHDatagram.cpp $R/RHMessagePool.cpp $R/RH_TCP.cpp
+//   ./route_table_bench
+//   (and again with -DRH_ROUTING_TABLE_SIZE=250)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <RHRouter.h>
+#include <RH_TCP.h>
+
+static const long operations = 2000000;
+
+static volatile unsigned long ticks = 0;                    // The SAMD core's millisecond count
+unsigned long millis() { return ticks; }
+void delay(unsigned long) {}
+long random(long to) { return ::random() % to; }
+long random(long from, long to) { return from + ::random() % (to - from); }
+
+// The table before v15.11 - kept here to compare against
+class LinearRoutes {
+public:
+    LinearRoutes() { for (int i = 0; i < RH_ROUTING_TABLE_SIZE; i++) _routes[i].state = RHRouter::Invalid; }
+
+    void addRouteTo(uint8_t dest, uint8_t next_hop, uint8_t state = RHRouter::Valid) {
+        uint8_t i;
+        for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++) {
+            if (_routes[i].dest == dest) { set(i, dest, next_hop, state); return; }
+        }
+        for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++) {
+            if (_routes[i].state == RHRouter::Invalid) { set(i, dest, next_hop, state); return; }
+        }
+        memmove(&_routes[0], &_routes[1], sizeof(_routes[0]) * (RH_ROUTING_TABLE_SIZE - 1));
+        _routes[RH_ROUTING_TABLE_SIZE - 1].state = RHRouter::Invalid;
+        for (i = 0; i < RH_ROUTING_TABLE_SIZE; i++) {
+            if (_routes[i].state == RHRouter::Invalid) { set(i, dest, next_hop, state); return; }
+        }
+    }
+
+    RHRouter::RoutingTableEntry* getRouteTo(uint8_t dest) {
+        for (uint8_t i = 0; i < RH_ROUTING_TABLE_SIZE; i++)
+            if (_routes[i].dest == dest && _routes[i].state != RHRouter::Invalid) return &_routes[i];
+        return NULL;
+    }
+
+private:
+    void set(uint8_t i, uint8_t dest, uint8_t next_hop, uint8_t state) {
+        _routes[i].dest = dest;
+        _routes[i].next_hop = next_hop;
+        _routes[i].state = state;
+    }
+
+    RHRouter::RoutingTableEntry _routes[RH_ROUTING_TABLE_SIZE];
+};
+
+RH_TCP driver;                                              // Never connected - the table does not use the radio
+RHRouter router(driver, 0);
+LinearRoutes linear;
+
+static uint8_t destinations[operations & 0xFFFF];          // Random destinations 1 to n, drawn once for both tables
+
+static double nanosSince(const struct timespec &start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) * 1e9 + (now.tv_nsec - start.tv_nsec);
+}
+
+template <typename Table>
+static void measure(Table &table, const char* name, int count) {
+    volatile uint8_t sink = 0;
+    struct timespec start;
+    size_t mask = sizeof(destinations) - 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);                 // Inserts and updates - the table is full once count > its size
+    for (long i = 0; i < operations; i++) table.addRouteTo(destinations[i & mask], 1);
+    double insertNanos = nanosSince(start) / operations;
+
+    long found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);                 // Lookups - misses too when count > the table size
+    for (long i = 0; i < operations; i++) {
+        RHRouter::RoutingTableEntry* route = table.getRouteTo(destinations[(i * 7) & mask]);
+        if (route) {
+            found++;
+            sink ^= route->next_hop;
+        }
+    }
+    double lookupNanos = nanosSince(start) / operations;
+
+    printf("%-8s %12d %14.1f %14.1f %10.0f%%\n", name, count, insertNanos, lookupNanos, 100.0 * found / operations);
+}
+
+int main() {
+    printf("Routing table of %d routes - %ld operations per measurement\n\n", RH_ROUTING_TABLE_SIZE, operations);
+    printf("%-8s %12s %14s %14s %11s\n", "Table", "Destinations", "Insert (ns)", "Lookup (ns)", "Found");
+    const int counts[] = { 50, 250 };
+    for (int count : counts) {
+        for (size_t i = 0; i < sizeof(destinations); i++) destinations[i] = 1 + random() % count;
+        router.clearRoutingTable();
+        measure(linear, "Linear", count);
+        measure(router, "Indexed", count);
+    }
+    return 0;
+}
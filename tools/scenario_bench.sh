@@ -0,0 +1,97 @@
+#!/bin/bash
+#
+# scenario_bench.sh
+# Runs the gateway emulator and N node emulators (tools/gateway_emulator.cpp, tools/node_emulator.cpp) through
+# scripted scenarios over RadioHead's ether simulator and prints, for each run, the time to join, the latency of
+# delivered reports (from when the report was due to the gateway's ack), retries per report and time on air per node.
+#
+# usage: tools/scenario_bench.sh [node counts...]          (from the repository root - default 10 50 250)
+#
+# Environment:
+#   SCENARIOS="egress trickle"   scenarios to run (see tools/node_emulator.cpp)
+#   DURATION=240                 seconds per run
+#   EGRESS=90                    seconds into the run the lecture ends
+#   HEARTBEAT=60                 secondsTillNextReport from the gateway
+#   SLOTS=0                      reporting frame in seconds - 0 for no slots
+#   GATEWAY_OPTIONS, NODE_OPTIONS  more name=value options for the emulators (alert=16 context=3, latency=30 ...)
+#   BPS=21875                    ether bit rate - Bw500Cr45Sf128 (the default data rate)
+#   PORT=4100                    first ether port - each run uses the next one
+#   ETHER                        ether command - etherSimulator.pl, or tools/ether_emulator.cpp if Perl's POE is missing
+
+cd "$(dirname "$0")/.." || exit 1
+
+RH=lib/Radiohead
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"; kill $(jobs -p) 2>/dev/null' EXIT
+
+SCENARIOS=${SCENARIOS:-"egress trickle"}
+DURATION=${DURATION:-240}
+EGRESS=${EGRESS:-90}
+HEARTBEAT=${HEARTBEAT:-60}
+SLOTS=${SLOTS:-0}
+BPS=${BPS:-21875}
+PORT=${PORT:-4100}
+COUNTS=${*:-"10 50 250"}
+
+if [ -z "$ETHER" ]; then
+    if perl -MPOE -e 1 2>/dev/null; then
+        ETHER="perl $RH/tools/etherSimulator.pl"
+    else
+        g++ -O2 -std=gnu++11 -o "$BUILD/ether_emulator" tools/ether_emulator.cpp || exit 1
+        ETHER="$BUILD/ether_emulator"
+    fi
+fi
+
+for SKETCH in gateway_emulator node_emulator; do
+    g++ -O2 -std=gnu++11 -I $RH -I src -o "$BUILD/$SKETCH" tools/$SKETCH.cpp $RH/tools/simMain.cpp $RH/RHGenericDriver.cpp \
+        $RH/RHMesh.cpp $RH/RHRouter.cpp $RH/RHReliableDatagram.cpp $RH/RHDatagram.cpp $RH/RHMessagePool.cpp $RH/RH_TCP.cpp || exit 1
+done
+
+printf "%-6s %-8s %7s %9s %9s %9s %9s %9s %9s %8s %10s %12s\n" "Nodes" "Scenario" "Joined" "Join ms" "Join max" \
+    "Latency" "p50 ms" "p95 ms" "Max ms" "Retries" "Delivered" "Air ms/node"
+
+for NODES in $COUNTS; do
+    if [ "$NODES" -lt 1 ] || [ "$NODES" -gt 250 ]; then
+        echo "Node counts are 1 to 250" >&2
+        exit 1
+    fi
+    for SCENARIO in $SCENARIOS; do
+        RUN=$BUILD/$NODES-$SCENARIO
+        mkdir -p "$RUN"
+        $ETHER -p $PORT -b $BPS > "$RUN/ether.txt" 2>&1 &
+        ETHER_PID=$!
+        sleep 1
+        export RH_ETHER=localhost:$PORT
+
+        "$BUILD/gateway_emulator" duration=$((DURATION + 5)) heartbeat=$HEARTBEAT slots=$SLOTS $GATEWAY_OPTIONS > "$RUN/gateway.txt" 2>&1 &
+        GATEWAY_PID=$!
+        sleep 1
+        NODE_PIDS=""
+        for ((NODE = 1; NODE <= NODES; NODE++)); do
+            "$BUILD/node_emulator" node=$NODE scenario=$SCENARIO duration=$DURATION egress=$EGRESS $NODE_OPTIONS > "$RUN/node$NODE.txt" 2>&1 &
+            NODE_PIDS="$NODE_PIDS $!"
+        done
+        wait $NODE_PIDS
+        wait $GATEWAY_PID
+        kill $ETHER_PID 2>/dev/null
+        wait $ETHER_PID 2>/dev/null
+
+        grep -h '^REPORT' "$RUN"/node*.txt | sed 's/.*latencyMs=\([0-9]*\).*/\1/' | sort -n > "$RUN/latency.txt"
+        grep -h '^RESULT' "$RUN"/node*.txt | awk -v nodes=$NODES -v scenario=$SCENARIO -v latencies="$RUN/latency.txt" '
+            {
+                for (i = 2; i <= NF; i++) { split($i, field, "="); value[field[1]] = field[2] }
+                if (value["joinMs"] >= 0) { joined++; joinSum += value["joinMs"]; if (value["joinMs"] > joinMax) joinMax = value["joinMs"] }
+                reports += value["reports"]; delivered += value["delivered"]; retries += value["retries"]; airtime += value["airtimeUs"]
+            }
+            END {
+                while ((getline latency < latencies) > 0) sorted[count++] = latency
+                for (i = 0; i < count; i++) latencySum += sorted[i]
+                printf "%-6d %-8s %7d %9.0f %9d %9.0f %9d %9d %9d %8.2f %9.1f%% %12.0f\n", nodes, scenario, joined,
+                    joined ? joinSum / joined : 0, joinMax, count ? latencySum / count : 0, count ? sorted[int(count * 0.5)] : 0,
+                    count ? sorted[int(count * 0.95)] : 0, count ? sorted[count - 1] : 0, reports ? retries / reports : 0,
+                    reports ? 100 * delivered / reports : 0, airtime / nodes / 1000
+            }'
+        grep -h '^GATEWAY' "$RUN/gateway.txt" | sed 's/^/       /'
+        PORT=$((PORT + 1))
+    done
+done
@@ -0,0 +1,143 @@
+// slot_simulation.cpp
+//
+// Simulates a gateway's nodes reporting at the same moment (the end of a lecture) with and without reporting slots
+// (src/LoRA_Slots.h) and counts the reports lost to collisions. A report is lost if any other exchange (report, gateway
+// reply delay and reply) overlaps it - the gateway cannot hear one node while it is receiving or answering another.
+// Also simulates every node re-joining at once (after a power cut) through the contention slot with its backoff.
+//
+// Build and run natively from the repository root:
+//   g++ -std=c++11 -I src -o slot_simulation tools/slot_simulation.cpp
+//   ./slot_simulation
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "Config.h"
+#include "LoRA_Frames.h"
+#include "LoRA_Airtime.h"
+#include "LoRA_Slots.h"
+
+static const uint8_t frameSeconds = 60;                     // Reporting frame the gateway would use
+static const uint16_t guardHundredths = 5;                  // Clock error either side - RTC_Deadband_ms plus drift between reports
+static const uint32_t gatewayReplyMicros = 50000;           // Gateway's reply delay
+static const uint32_t lectureEndSeconds = 10;               // Counts change over this long as the room empties
+static const int trials = 1000;
+static const int maxJoinFrames = 240;                       // Give up on a join simulation after this many frames
+
+struct DataRate { const char* name; uint8_t reg1d, reg1e, reg26; };
+static const DataRate dataRates[] = {                       // Steps 0, 2 and 5 of the ladder in LinkAdaptation.cpp
+    { "Bw500Sf7",  0x92, 0x74, 0x04 },
+    { "Bw125Sf7",  0x72, 0x74, 0x04 },
+    { "Bw125Sf10", 0x72, 0xa4, 0x04 }
+};
+
+static uint32_t rngState = 2463534242UL;
+static uint32_t rng(uint32_t range) {                       // xorshift - the same run every time
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState % range;
+}
+
+struct Exchange { int64_t start; int64_t end; int node; bool lost; };
+
+// Number of exchanges that overlap another one - each is marked lost
+static int collisions(std::vector<Exchange> &exchanges) {
+    std::sort(exchanges.begin(), exchanges.end(), [](const Exchange &a, const Exchange &b) { return a.start < b.start; });
+    int lost = 0;
+    int64_t latestEnd = INT64_MIN;
+    for (size_t i = 0; i < exchanges.size(); i++) {
+        bool hitsEarlier = exchanges[i].start < latestEnd;
+        bool hitsLater = i + 1 < exchanges.size() && exchanges[i + 1].start < exchanges[i].end;
+        exchanges[i].lost = hitsEarlier || hitsLater;
+        if (exchanges[i].lost) lost++;
+        latestEnd = std::max(latestEnd, exchanges[i].end);
+    }
+    return lost;
+}
+
+// Frames a node spreads its next contention over - as LoRA_Functions::reportSlotOffset()
+static uint32_t contentionFrames(int attempts) {
+    return 1UL << ((attempts < SLOT_CONTENTION_MAX_BACKOFF) ? attempts : SLOT_CONTENTION_MAX_BACKOFF);
+}
+
+static uint32_t exchangeMicros(const LoRaModem &modem, uint8_t requestLength, uint8_t replyLength) {
+    return loraAirtimeMicros(modem, frameRadioPayloadLength(requestLength)) + gatewayReplyMicros + loraAirtimeMicros(modem, frameRadioPayloadLength(replyLength));
+}
+
+int main() {
+    const int nodeCounts[] = { 12, 25, 50, 75, 100 };
+
+    printf("Reports lost to collisions on the first try when every node's count changes within %lu seconds\n", (unsigned long)lectureEndSeconds);
+    printf("%d second reporting frame, %d hundredths contention slot, +/-%d hundredths clock error, %d trials\n\n", frameSeconds, SLOT_CONTENTION_HUNDREDTHS, guardHundredths, trials);
+    printf("%-10s %8s %8s %8s %6s %12s %12s\n", "Data rate", "Exchange", "Slot", "Slots", "Nodes", "Unslotted", "Slotted");
+
+    for (const DataRate &rate : dataRates) {
+        LoRaModem modem = loraModemFromRegisters(rate.reg1d, rate.reg1e, rate.reg26, 8);
+        uint32_t exchange = exchangeMicros(modem, DataReportFrame::length, DataAckFrame::length);
+        uint16_t slot = slotLengthHundredths(exchange, guardHundredths);
+        uint16_t slots = slotCount(frameSeconds, slot, SLOT_CONTENTION_HUNDREDTHS);
+
+        for (int nodes : nodeCounts) {
+            if (nodes > slots) {
+                printf("%-10s %6lumS %6dmS %8d %6d %12s %12s\n", rate.name, (unsigned long)exchange / 1000, slot * 10, slots, nodes, "-", "too many");
+                continue;
+            }
+            long lostUnslotted = 0, lostSlotted = 0;
+            for (int trial = 0; trial < trials; trial++) {
+                std::vector<Exchange> unslotted, slotted;
+                int64_t frameStart = (int64_t)(1700000000ULL + rng(86400)) / frameSeconds * frameSeconds * 1000000LL;
+                for (int node = 0; node < nodes; node++) {
+                    int64_t changed = frameStart + rng(lectureEndSeconds * 1000) * 1000LL;
+                    int64_t due = changed / 1000000LL * 1000000LL + TRANSMIT_LATENCY * 1000000LL;	// The node checks the time in seconds
+                    int64_t start = due + rng(100) * 1000LL;                                     // ... as its loop comes round
+                    unslotted.push_back({ start, start + exchange, node, false });
+
+                    uint16_t offset = slotOffsetForIndex(node, slot, guardHundredths, SLOT_CONTENTION_HUNDREDTHS);
+                    int64_t slotStart = (int64_t)slotNextStart(due / 10000, frameSeconds, offset) * 10000LL;
+                    slotStart += ((int64_t)rng(2 * guardHundredths * 10 + 1) - guardHundredths * 10) * 1000LL;	// This node's clock error
+                    slotted.push_back({ slotStart, slotStart + exchange, node, false });
+                }
+                lostUnslotted += collisions(unslotted);
+                lostSlotted += collisions(slotted);
+            }
+            printf("%-10s %6lumS %6dmS %8d %6d %11.1f%% %11.1f%%\n", rate.name, (unsigned long)exchange / 1000, slot * 10, slots, nodes,
+                100.0 * lostUnslotted / (trials * nodes), 100.0 * lostSlotted / (trials * nodes));
+        }
+    }
+
+    printf("\nEvery node re-joining at once through the contention slot - frames until all have joined\n");
+    printf("%-10s %8s %6s %12s %12s\n", "Data rate", "Exchange", "Nodes", "Mean frames", "Worst");
+    for (const DataRate &rate : dataRates) {
+        LoRaModem modem = loraModemFromRegisters(rate.reg1d, rate.reg1e, rate.reg26, 8);
+        uint32_t exchange = exchangeMicros(modem, JoinRequestFrame::length, JoinAckFrame::length);
+        for (int nodes : nodeCounts) {
+            long totalFrames = 0;
+            int worst = 0;
+            for (int trial = 0; trial < trials && worst < maxJoinFrames; trial++) {
+                std::vector<int> attempts(nodes, 0), nextFrame(nodes, 0);
+                int waiting = nodes, frame = 0;
+                for (int node = 0; node < nodes; node++) nextFrame[node] = rng(contentionFrames(attempts[node]++));
+                for (; waiting > 0 && frame < maxJoinFrames; frame++) {
+                    std::vector<Exchange> joins;
+                    for (int node = 0; node < nodes; node++) {
+                        if (nextFrame[node] != frame) continue;
+                        int64_t start = rng(SLOT_CONTENTION_HUNDREDTHS - SLOT_CONTENTION_EXCHANGE_HUNDREDTHS) * 10000LL;
+                        joins.push_back({ start, start + exchange, node, false });
+                    }
+                    collisions(joins);
+                    for (const Exchange &join : joins) {
+                        if (join.lost) nextFrame[join.node] = frame + 1 + rng(contentionFrames(attempts[join.node]++));
+                        else waiting--;
+                    }
+                }
+                totalFrames += frame;
+                worst = std::max(worst, frame);
+            }
+            if (worst >= maxJoinFrames) printf("%-10s %6lumS %6d %12s %11s%d\n", rate.name, (unsigned long)exchange / 1000, nodes, "-", ">", maxJoinFrames);
+            else printf("%-10s %6lumS %6d %12.1f %12d\n", rate.name, (unsigned long)exchange / 1000, nodes, (double)totalFrames / trials, worst);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,220 @@
+// window_transfer_sim.cpp
+//
+// A backlog of queued reports sent to one next hop, one at a time by RHReliableDatagram::sendtoWait() (stop and wait -
+// a round trip for each report) and in bursts by sendtoWaitWindow() (lib/Radiohead/RHReliableDatagram.cpp - the ACK of
+// the last report of a burst says which of the others arrived, and only those that did not are sent again).
+//
+// Both ends are the real RHReliableDatagram on a radio simulated in-process - millis() is the simulation's clock, so
+// the sender's timeouts, retries and round trip times and the receiver's duplicate detection and ACKs all run as on
+// the node. A report or an ACK is lost now and then. The receiver takes a few milliseconds to read each report and
+// acknowledge. The awake time is how long the sender's radio is on for a backlog - from the first transmission until
+// the last report is acknowledged or given up on - and reports a second is how many were delivered in that time.
+//
+// Build and run natively from the repository root:
+//   R=lib/Radiohead
+//   g++ -O2 -std=gnu++11 -I $R -I src -o window_transfer_sim tools/window_transfer_sim.cpp $R/RHGenericDriver.cpp
+//       $R/RHReliableDatagram.cpp $R/RHDatagram.cpp
+//   ./window_transfer_sim
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <RHReliableDatagram.h>
+#include "Config.h"
+#include "LoRA_Frames.h"
+#include "LoRA_Airtime.h"
+
+static const int backlogs = 200;                            // A minute apart
+static const int backlog = 24;                              // Reports in each
+static const int retries = 2;                               // manager.setRetries(2)
+static const int lostMessagePercent = 10;
+static const int lostAckPercent = 5;
+static const unsigned long processingMillis = 6;            // The receiver reading a report and acknowledging
+
+static unsigned long simMillis = 0;
+unsigned long millis() { return simMillis; }
+void delay(unsigned long ms) { simMillis += ms; }
+long random(long to) { return ::random() % to; }
+long random(long from, long to) { return from + ::random() % (to - from); }
+
+struct ModemConfig { uint8_t reg_1d, reg_1e, reg_26; };
+struct DataRate { const char* name; ModemConfig config; };
+static const DataRate dataRates[] = {                       // Steps 0, 5 and 7 of the ladder in LinkAdaptation.cpp
+    { "Bw500Sf7",  { 0x92, 0x74, 0x04 } },
+    { "Bw125Sf10", { 0x72, 0xa4, 0x04 } },
+    { "Bw125Sf12", { 0x72, 0xc4, 0x0c } }
+};
+
+struct Frame {
+    uint8_t from, to, id, flags, len;
+    uint8_t data[RH_MAX_MESSAGE_LEN];
+    unsigned long arrival;
+};
+
+// One end of the link. What it sends reaches the other end at the end of its time on air, unless it is lost
+class SimRadio : public RHGenericDriver {
+public:
+    SimRadio(const ModemConfig &config, int lostPercent) : _config(config), _lostPercent(lostPercent), _other(NULL) {}
+    void connect(SimRadio *other) { _other = other; }
+    bool init() { return true; }
+    uint8_t maxMessageLength() { return RH_MAX_MESSAGE_LEN; }
+
+    // The sender's transmissions take the clock on, the receiver's ACKs go out after it has read the report
+    bool send(const uint8_t* data, uint8_t len) {
+        transmissions++;
+        unsigned long air = airtimeMillis(frameRadioPayloadLength(len));
+        unsigned long end = (_txHeaderFlags & RH_FLAGS_ACK) ? simMillis + processingMillis + air : (simMillis += air);
+        if (::random() % 100 < _lostPercent) return true;
+        Frame frame = { _thisAddress, _txHeaderTo, _txHeaderId, _txHeaderFlags, len, {}, end };
+        memcpy(frame.data, data, len);
+        _other->_frames.push_back(frame);
+        return true;
+    }
+
+    // The headers are known once a frame is available, as RH_RF95's are
+    bool available() {
+        for (const Frame &frame : _frames) {
+            if (frame.arrival > simMillis) continue;
+            _rxHeaderTo = frame.to;
+            _rxHeaderFrom = frame.from;
+            _rxHeaderId = frame.id;
+            _rxHeaderFlags = frame.flags;
+            return true;
+        }
+        return false;
+    }
+
+    // Jumps the clock to the next frame, or the end of the wait
+    bool waitAvailableTimeout(uint16_t timeout, uint16_t = 0) {
+        unsigned long next = simMillis + timeout;
+        for (const Frame &frame : _frames) if (frame.arrival < next) next = frame.arrival;
+        bool arrived = next < simMillis + timeout;
+        simMillis = arrived ? (next > simMillis ? next : simMillis) : simMillis + timeout;
+        return arrived && available();
+    }
+
+    bool recv(uint8_t* buf, uint8_t* len) {
+        for (size_t i = 0; i < _frames.size(); i++) {
+            const Frame &frame = _frames[i];
+            if (frame.arrival > simMillis) continue;
+            available();
+            if (buf && len) {
+                if (*len > frame.len) *len = frame.len;
+                memcpy(buf, frame.data, *len);
+            }
+            _frames.erase(_frames.begin() + i);
+            return true;
+        }
+        return false;
+    }
+
+    unsigned long airtimeMillis(uint8_t payloadLength) {
+        return (loraConfigAirtimeMicros(_config, payloadLength) + 999) / 1000;
+    }
+
+    long transmissions = 0;
+
+private:
+    ModemConfig _config;
+    int _lostPercent;
+    SimRadio *_other;
+    std::vector<Frame> _frames;
+};
+
+// The next hop - reads each report as it arrives, so its ACKs go out and duplicates are caught as on the node
+class Receiver {
+public:
+    Receiver(SimRadio &radio) : manager(radio, 1) { manager.init(); }
+    void poll() {
+        uint8_t buf[RH_MAX_MESSAGE_LEN];
+        uint8_t len = sizeof(buf);
+        while (manager.available()) {
+            len = sizeof(buf);
+            if (!manager.recvfromAck(buf, &len)) continue;
+            deliveries++;
+            if (delivered[buf[0]]) duplicates++;
+            delivered[buf[0]] = true;
+        }
+    }
+    void clear() { memset(delivered, 0, sizeof(delivered)); }
+
+    RHReliableDatagram manager;
+    bool delivered[backlog];
+    long deliveries = 0, duplicates = 0;
+};
+
+// The sender's radio runs the receiver whenever the sender waits or transmits again
+class SenderRadio : public SimRadio {
+public:
+    SenderRadio(const ModemConfig &config, int lostPercent) : SimRadio(config, lostPercent), receiver(NULL) {}
+    bool send(const uint8_t* data, uint8_t len) {
+        bool sent = SimRadio::send(data, len);
+        receiver->poll();                                   // The report arrived at the end of its time on air
+        return sent;
+    }
+    Receiver *receiver;
+};
+
+struct Totals {
+    long delivered = 0, awakeMillis = 0;
+};
+
+// Backlogs sent stop and wait (window 0) or in bursts of window reports
+static void run(const DataRate &rate, int window, const char *name) {
+    SenderRadio senderRadio(rate.config, lostMessagePercent);
+    SimRadio receiverRadio(rate.config, lostAckPercent);
+    senderRadio.connect(&receiverRadio);
+    receiverRadio.connect(&senderRadio);
+    Receiver receiver(receiverRadio);
+    senderRadio.receiver = &receiver;
+    RHReliableDatagram manager(senderRadio, 2);
+    manager.init();
+    manager.setRetries(retries);
+    uint32_t ackMillis = senderRadio.airtimeMillis(LORA_CIPHER_BLOCK_LEN + LORA_RADIO_HEADER_LEN);
+    uint32_t roundTripMillis = senderRadio.airtimeMillis(frameRadioPayloadLength(QueuedReportFrame::length)) + ackMillis;
+    manager.setTimeout(2 * roundTripMillis + 100);          // As LoRA_Functions::applyAckTimeout()
+    manager.setMinTimeout(ackMillis + ACK_TIMEOUT_MARGIN_MS);
+    if (window) manager.setWindow(window);
+
+    Totals totals;
+    srandom(7);                                             // The same losses for each way of sending
+    static uint8_t reports[backlog][QueuedReportFrame::length];
+    uint8_t *bufs[backlog];
+    uint8_t lens[backlog];
+    for (int b = 0; b < backlogs; b++) {
+        simMillis += 60000;
+        receiver.clear();
+        for (int i = 0; i < backlog; i++) {
+            memset(reports[i], 1, sizeof(reports[i]));      // reports[i][5] is not 0, so sendtoWait() leaves the delay bytes alone
+            reports[i][0] = i;
+            bufs[i] = reports[i];
+            lens[i] = sizeof(reports[i]);
+        }
+        unsigned long start = simMillis;
+        if (window) {
+            uint32_t acked = manager.sendtoWaitWindow(bufs, lens, backlog, 1);
+            for (int i = 0; i < backlog; i++) totals.delivered += (acked >> i) & 1;
+        }
+        else for (int i = 0; i < backlog; i++) totals.delivered += manager.sendtoWait(bufs[i], lens[i], 1);
+        totals.awakeMillis += simMillis - start;
+    }
+    long messages = (long)backlogs * backlog;
+    printf("%-10s %-16s %10.2f %10.0f %14.2f %10.2f%% %10ld\n", rate.name, name, 1000.0 * totals.delivered / totals.awakeMillis,
+        (double)totals.awakeMillis / backlogs, (double)senderRadio.transmissions / messages, 100.0 * totals.delivered / messages,
+        receiver.duplicates);
+}
+
+int main() {
+    printf("%d backlogs of %d queued reports, %d retries, %d%% of reports and %d%% of acknowledgements lost\n\n",
+        backlogs, backlog, retries, lostMessagePercent, lostAckPercent);
+    printf("%-10s %-16s %10s %10s %14s %11s %10s\n", "Data rate", "Sent", "Reports", "Awake (ms)", "Transmissions", "Delivered", "Delivered");
+    printf("%-10s %-16s %10s %10s %14s %11s %10s\n", "", "", "a second", "a backlog", "per report", "", "twice");
+    for (const DataRate &rate : dataRates) {
+        run(rate, 0, "Stop and wait");
+        run(rate, 4, "Window of 4");
+        run(rate, 8, "Window of 8");
+        run(rate, 16, "Window of 16");
+    }
+    return 0;
+}